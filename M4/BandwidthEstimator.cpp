@@ -0,0 +1,180 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// @file BandwidthEstimator.cpp
+///
+/// Copyright (c) 2015, BoxCast, Inc. All rights reserved.
+///
+/// This library is free software; you can redistribute it and/or modify it under the terms of the
+/// GNU Lesser General Public License as published by the Free Software Foundation; either version
+/// 3.0 of the License, or (at your option) any later version.
+///
+/// This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+/// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See
+/// the GNULesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License along with this
+/// library; if not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+/// Boston, MA 02110-1301 USA
+///
+/// @brief This file defines the functions of the BandwidthEstimator class.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>              // for std::min, std::max
+#include "BandwidthEstimator.hpp" // for class declaration
+
+
+const double BandwidthEstimator::HIGH_LOSS = 0.10;
+
+const double BandwidthEstimator::LOW_LOSS = 0.02;
+
+const double BandwidthEstimator::OVERUSE_GRADIENT = 0.01;
+
+const double BandwidthEstimator::GRADIENT_SMOOTHING = 0.5;
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// BandwidthEstimator::BandwidthEstimator()
+///
+/// Constructor.
+///
+/// @param minBitrate  The estimate never goes below this, in bits/sec.
+///
+/// @param startBitrate  The estimate before any reports arrive (and where probing starts).
+///
+/// @param maxBitrate  The estimate never goes above this, in bits/sec.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+BandwidthEstimator::BandwidthEstimator(size_t minBitrate, size_t startBitrate, size_t maxBitrate)
+	: m_MinBitrate(minBitrate)
+	, m_MaxBitrate(std::max(minBitrate, maxBitrate))
+	, m_Bitrate(0)
+	, m_LossBitrate(0.0)
+	, m_DelayBitrate(0.0)
+	, m_Probing(true)
+	, m_FirstReportUs(0)
+	, m_LastReportUs(0)
+	, m_LastDelaySeconds(0.0)
+	, m_DelayGradient(0.0)
+	, m_FractionLost(0.0)
+	, m_RoundTripSeconds(0.0)
+{
+	m_Bitrate = Clamp(static_cast<double>(startBitrate));
+	m_LossBitrate = static_cast<double>(m_Bitrate);
+	m_DelayBitrate = static_cast<double>(m_Bitrate);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// BandwidthEstimator::OnReceiverReport()
+///
+/// Update the estimate from a receiver report.
+///
+/// @param nowUs  The (monotonic) time the report arrived, in microseconds.
+///
+/// @param fractionLost  The fraction of packets lost since the previous report (0.0 - 1.0).
+///
+/// @param roundTripSeconds  The round trip time computed from the report, in seconds.
+///
+/// @param jitterSeconds  The interarrival jitter from the report, in seconds.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void BandwidthEstimator::OnReceiverReport(int64_t nowUs, double fractionLost, double roundTripSeconds, double jitterSeconds)
+{
+	m_FractionLost = fractionLost;
+	m_RoundTripSeconds = roundTripSeconds;
+
+	// Work out the delay gradient from the change in one-way delay since the last report.
+	double delaySeconds = (roundTripSeconds / 2.0) + jitterSeconds;
+	if (m_FirstReportUs == 0)
+	{
+		m_FirstReportUs = nowUs;
+	}
+	else if (nowUs > m_LastReportUs)
+	{
+		double gradient = (delaySeconds - m_LastDelaySeconds) / (static_cast<double>(nowUs - m_LastReportUs) / 1000000.0);
+		m_DelayGradient = (GRADIENT_SMOOTHING * gradient) + ((1.0 - GRADIENT_SMOOTHING) * m_DelayGradient);
+	}
+	m_LastReportUs = nowUs;
+	m_LastDelaySeconds = delaySeconds;
+
+	bool overuse = (m_DelayGradient > OVERUSE_GRADIENT);
+	bool congested = overuse || (fractionLost > LOW_LOSS);
+
+	// While probing, double with every clean report. The first sign of congestion (or running out
+	// of time) ends probing; we then settle just below the last rate that was clean.
+	if (m_Probing)
+	{
+		if (congested || ((nowUs - m_FirstReportUs) >= PROBE_DURATION_US))
+		{
+			m_Probing = false;
+			if (congested)
+			{
+				m_LossBitrate = m_DelayBitrate = 0.85 * (static_cast<double>(m_Bitrate) / 2.0);
+				m_Bitrate = Clamp(m_LossBitrate);
+				return;
+			}
+		}
+		else
+		{
+			m_LossBitrate = m_DelayBitrate = 2.0 * static_cast<double>(m_Bitrate);
+			m_Bitrate = Clamp(m_LossBitrate);
+			return;
+		}
+	}
+
+	// Loss-based estimate: back off in proportion to heavy loss, grow slowly while loss is low,
+	// and hold in between.
+	if (fractionLost > HIGH_LOSS)
+	{
+		m_LossBitrate = static_cast<double>(m_Bitrate) * (1.0 - (0.5 * fractionLost));
+	}
+	else if (fractionLost < LOW_LOSS)
+	{
+		m_LossBitrate = std::max(m_LossBitrate, static_cast<double>(m_Bitrate)) * 1.05;
+	}
+
+	// Delay-based estimate: back off on overuse, hold while queues are draining, and otherwise
+	// grow.
+	if (overuse)
+	{
+		m_DelayBitrate = 0.85 * static_cast<double>(m_Bitrate);
+	}
+	else if (m_DelayGradient > -OVERUSE_GRADIENT)
+	{
+		m_DelayBitrate = std::max(m_DelayBitrate, static_cast<double>(m_Bitrate)) * 1.05;
+	}
+
+	// Keep the individual estimates from running away above the range.
+	m_LossBitrate = std::min(m_LossBitrate, static_cast<double>(m_MaxBitrate));
+	m_DelayBitrate = std::min(m_DelayBitrate, static_cast<double>(m_MaxBitrate));
+
+	m_Bitrate = Clamp(std::min(m_LossBitrate, m_DelayBitrate));
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// BandwidthEstimator::SetMaxBitrate()
+///
+/// Change the maximum bitrate; the current estimate is clamped to it.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void BandwidthEstimator::SetMaxBitrate(size_t maxBitrate)
+{
+	m_MaxBitrate = std::max(m_MinBitrate, maxBitrate);
+	m_Bitrate = Clamp(static_cast<double>(m_Bitrate));
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// BandwidthEstimator::Clamp()
+///
+/// Clamp a bitrate to [m_MinBitrate, m_MaxBitrate].
+///////////////////////////////////////////////////////////////////////////////////////////////////
+size_t BandwidthEstimator::Clamp(double bitrate) const
+{
+	if (bitrate < static_cast<double>(m_MinBitrate))
+	{
+		return m_MinBitrate;
+	}
+	if (bitrate > static_cast<double>(m_MaxBitrate))
+	{
+		return m_MaxBitrate;
+	}
+	return static_cast<size_t>(bitrate);
+}
@@ -0,0 +1,143 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// @file BandwidthEstimator.hpp
+///
+/// Copyright (c) 2015, BoxCast, Inc. All rights reserved.
+///
+/// This library is free software; you can redistribute it and/or modify it under the terms of the
+/// GNU Lesser General Public License as published by the Free Software Foundation; either version
+/// 3.0 of the License, or (at your option) any later version.
+///
+/// This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+/// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See
+/// the GNULesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License along with this
+/// library; if not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+/// Boston, MA 02110-1301 USA
+///
+/// @brief This file declares the BandwidthEstimator class, which estimates the bandwidth available
+/// towards one destination from the RTCP receiver reports that destination sends back.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#ifndef __BANDWIDTH_ESTIMATOR_HPP__
+#define __BANDWIDTH_ESTIMATOR_HPP__
+
+#include <cstddef>  // for size_t
+#include <stdint.h> // for int64_t
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// This class combines two congestion signals taken from RTCP receiver reports:
+///  - A loss-based estimate, which backs off in proportion to the reported fraction lost and
+///	grows slowly while loss stays low, and
+///  - A delay-based estimate, which watches the gradient of the one-way delay (half the round
+///	trip time plus the interarrival jitter) and backs off as soon as queues start to build.
+///
+/// The estimate is the smaller of the two. For the first PROBE_DURATION_US after the first report
+/// the estimator is "probing": it doubles the estimate with every clean report, so that a call
+/// quickly finds its starting bitrate, and leaves probing at the first sign of congestion.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class BandwidthEstimator
+{
+public:
+	/// Constructor.
+	BandwidthEstimator(size_t minBitrate, size_t startBitrate, size_t maxBitrate);
+
+
+	/// Feed a receiver report into the estimator.
+	void OnReceiverReport(int64_t nowUs, double fractionLost, double roundTripSeconds, double jitterSeconds);
+
+
+	/// The current bandwidth estimate, in bits/sec.
+	inline size_t Bitrate() const { return m_Bitrate; }
+
+
+	/// The most recently reported fraction of packets lost (0.0 - 1.0).
+	inline double FractionLost() const { return m_FractionLost; }
+
+
+	/// The most recently reported round trip time, in seconds.
+	inline double RoundTripSeconds() const { return m_RoundTripSeconds; }
+
+
+	/// Whether the estimator is still in the initial probing phase.
+	inline bool IsProbing() const { return m_Probing; }
+
+
+	/// Change the maximum bitrate.
+	void SetMaxBitrate(size_t maxBitrate);
+
+
+private:
+	/// How long the initial probing phase lasts, in microseconds.
+	static const int64_t PROBE_DURATION_US = 3000000;
+
+
+	/// Loss above this fraction makes the loss-based estimate back off.
+	static const double HIGH_LOSS;
+
+
+	/// Loss below this fraction lets the loss-based estimate grow.
+	static const double LOW_LOSS;
+
+
+	/// A delay gradient (seconds of delay per second) above this is considered overuse.
+	static const double OVERUSE_GRADIENT;
+
+
+	/// The smoothing factor for the delay gradient.
+	static const double GRADIENT_SMOOTHING;
+
+
+	/// Clamp a bitrate to the configured range.
+	size_t Clamp(double bitrate) const;
+
+
+	/// The minimum bitrate.
+	const size_t m_MinBitrate;
+
+
+	/// The maximum bitrate.
+	size_t m_MaxBitrate;
+
+
+	/// The current combined estimate.
+	size_t m_Bitrate;
+
+
+	/// The loss-based estimate.
+	double m_LossBitrate;
+
+
+	/// The delay-based estimate.
+	double m_DelayBitrate;
+
+
+	/// Whether we're still probing.
+	bool m_Probing;
+
+
+	/// The time of the first report (0 if none yet).
+	int64_t m_FirstReportUs;
+
+
+	/// The time of the previous report.
+	int64_t m_LastReportUs;
+
+
+	/// The one-way delay computed from the previous report, in seconds.
+	double m_LastDelaySeconds;
+
+
+	/// The smoothed delay gradient.
+	double m_DelayGradient;
+
+
+	/// The last reported fraction lost.
+	double m_FractionLost;
+
+
+	/// The last reported round trip time.
+	double m_RoundTripSeconds;
+};
+
+#endif // __BANDWIDTH_ESTIMATOR_HPP__
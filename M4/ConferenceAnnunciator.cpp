@@ -43,6 +43,7 @@ ConferenceAnnunciator::ConferenceAnnunciator()
 	, m_WorkerThread()
 	, m_pCallPacketListener(NULL)
 	, m_pParameterPacketListener(NULL)
+	, m_pLayerRequestListener(NULL)
 	, m_NextXmitTime()
 	, m_pParticipantListPacket(NULL)
 	, m_ParticipantListPacketLength(0)
@@ -50,6 +51,7 @@ ConferenceAnnunciator::ConferenceAnnunciator()
 	, m_ParameterPacketLength(0)
 	, m_pDestinationAddresses(NULL)
 	, m_NumberOfDestinations(0)
+	, m_pLayerRequests(NULL)
 {
 	// Set "now" as the next xmit time so that, in theory, we would send right away.
 	assert(clock_gettime(CLOCK_MONOTONIC, &m_NextXmitTime) == 0);
@@ -89,6 +91,13 @@ ConferenceAnnunciator::~ConferenceAnnunciator()
 		delete[] pDestinationAddressesSave;
 	}
 	
+	if (m_pLayerRequests != NULL)
+	{
+		unsigned int* pLayerRequestsSave = m_pLayerRequests;
+		m_pLayerRequests = NULL;
+		delete[] pLayerRequestsSave;
+	}
+	
 	close(m_UdpSocket);
 }
 
@@ -100,11 +109,13 @@ ConferenceAnnunciator::~ConferenceAnnunciator()
 ///
 /// @param pPictureParameters  The string of picture parameter data (e.g. sprop-parameter-sets)
 ///
+/// @param pAudioParameters  The string of audio parameter data (the audio RTP caps)
+///
 /// @param videoSsrc  The SSRC of the video stream.
 ///
 /// @param audioSsrc  The SSRC of the audio stream.
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-void ConferenceAnnunciator::SendParameters(const char* pPictureParameters, unsigned int videoSsrc, unsigned int audioSsrc)
+void ConferenceAnnunciator::SendParameters(const char* pPictureParameters, const char* pAudioParameters, unsigned int videoSsrc, unsigned int audioSsrc)
 {
 	// If we already have a parameter packet, free it.
 	if (m_pParameterPacket != NULL)
@@ -121,8 +132,10 @@ void ConferenceAnnunciator::SendParameters(const char* pPictureParameters, unsig
 	//  - Picture parameters string, NULL-terminated
 	//  - Video SSRC in network byte order
 	//  - Audio SSRC in network byte order
+	//  - Audio parameters string, NULL-terminated
 	size_t pictureParametersLength = std::strlen(pPictureParameters);
-	m_ParameterPacketLength = 4 + pictureParametersLength + 1 + sizeof(videoSsrc) + sizeof(audioSsrc);
+	size_t audioParametersLength = std::strlen(pAudioParameters);
+	m_ParameterPacketLength = 4 + pictureParametersLength + 1 + sizeof(videoSsrc) + sizeof(audioSsrc) + audioParametersLength + 1;
 	char* pParameterPacket = new char[m_ParameterPacketLength];
 	std::memcpy(pParameterPacket, "PARM", 4);
 	char* pWorking = &pParameterPacket[4];
@@ -132,6 +145,9 @@ void ConferenceAnnunciator::SendParameters(const char* pPictureParameters, unsig
 	*((unsigned int *)pWorking) = htonl(videoSsrc);
 	pWorking += sizeof(videoSsrc);
 	*((unsigned int *)pWorking) = htonl(audioSsrc);
+	pWorking += sizeof(audioSsrc);
+	std::strcpy(pWorking, pAudioParameters);
+	pWorking[audioParametersLength] = '\0';
 	m_pParameterPacket = pParameterPacket;
 }
 
@@ -194,13 +210,19 @@ void ConferenceAnnunciator::SendParticipantList(const char* participantAddresses
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 void ConferenceAnnunciator::SetParticipantList(const char* participantAddresses[], size_t numberOfParticipants)
 {
-	// If we already have a destination list, free it.
+	// If we already have a destination list (and layer requests to go with it), free it.
 	if (m_pDestinationAddresses != NULL)
 	{
 		const struct sockaddr_in* pDestinationAddressesSave = m_pDestinationAddresses;
 		m_pDestinationAddresses = NULL;
 		delete[] pDestinationAddressesSave;
 	}
+	if (m_pLayerRequests != NULL)
+	{
+		unsigned int* pLayerRequestsSave = m_pLayerRequests;
+		m_pLayerRequests = NULL;
+		delete[] pLayerRequestsSave;
+	}
 	
 	// Convert the participant addresses to sockaddr structs and save for posterity.
 	struct sockaddr_in* destinationAddresses = new struct sockaddr_in[numberOfParticipants];
@@ -211,11 +233,50 @@ void ConferenceAnnunciator::SetParticipantList(const char* participantAddresses[
 		pAddr->sin_port = htons(UDP_PORT);
 		assert(inet_pton(AF_INET, participantAddresses[i], &pAddr->sin_addr) == 1);
 	}
+	
+	// No layers have been requested from anyone yet.
+	unsigned int* layerRequests = new unsigned int[numberOfParticipants];
+	for (size_t i = 0; i < numberOfParticipants; ++i)
+	{
+		layerRequests[i] = NO_LAYER_REQUEST;
+	}
+	m_pLayerRequests = layerRequests;
 	m_NumberOfDestinations = numberOfParticipants;
 	m_pDestinationAddresses = destinationAddresses;
 }
 
 
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ConferenceAnnunciator::SendLayerRequest
+///
+/// Ask a participant to send us a particular simulcast video layer. The request is sent right
+/// away, and then again with every periodic transmission in case it gets lost.
+///
+/// @param participantAddress  The NULL-terminated address of the participant (the video sender).
+///
+/// @param layer  The requested layer; 0 is full resolution.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ConferenceAnnunciator::SendLayerRequest(const char* participantAddress, unsigned int layer)
+{
+	// Early return in case we don't have a destination list
+	if ((m_pDestinationAddresses == NULL) || (m_pLayerRequests == NULL))
+	{
+		return;
+	}
+	
+	struct in_addr addr;
+	assert(inet_pton(AF_INET, participantAddress, &addr) == 1);
+	for (size_t i = 0; i < m_NumberOfDestinations; ++i)
+	{
+		if (m_pDestinationAddresses[i].sin_addr.s_addr == addr.s_addr)
+		{
+			m_pLayerRequests[i] = layer;
+			SendLayerRequest(i);
+		}
+	}
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 /// ConferenceAnnunciator::CreateSocket
 ///
@@ -317,6 +378,16 @@ void ConferenceAnnunciator::HandleParameterPacket(const char* packet, size_t pac
 	unsigned int videoSsrc = ntohl(*((unsigned int *)packet));
 	packet += sizeof(videoSsrc);
 	unsigned int audioSsrc = ntohl(*((unsigned int *)packet));
+	packet += sizeof(audioSsrc);
+	
+	// The audio parameters were added later; a packet without them means the sender's default
+	// audio (an empty string).
+	const char* audioParameters = "";
+	const char* pEnd = pictureParameters + packetSize;
+	if ((packet < pEnd) && (std::memchr(packet, '\0', pEnd - packet) != NULL))
+	{
+		audioParameters = packet;
+	}
 	
 	// Get a string for sender address
 	char ipAddress[INET_ADDRSTRLEN];
@@ -325,7 +396,40 @@ void ConferenceAnnunciator::HandleParameterPacket(const char* packet, size_t pac
 	// Call listener
 	if (m_pParameterPacketListener != NULL)
 	{
-		m_pParameterPacketListener->OnParameterPacket(ipAddress, pictureParameters, videoSsrc, audioSsrc);
+		m_pParameterPacketListener->OnParameterPacket(ipAddress, pictureParameters, audioParameters, videoSsrc, audioSsrc);
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ConferenceAnnunciator::HandleLayerRequestPacket
+///
+/// Called when a new layer request packet is received. If configured, this winds up calling the
+/// layer request listener.
+///
+/// @param packet  The layer request packet AFTER the initial "LAYR" bytes.
+///
+/// @param packetSize  The size of the packet (not including the initial "LAYR" bytes).
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ConferenceAnnunciator::HandleLayerRequestPacket(const char* packet, size_t packetSize, struct sockaddr_in* pSenderAddress)
+{
+	// Early return if no one's listening, or if the packet is too short
+	if ((m_pLayerRequestListener == NULL) || (packetSize < sizeof(unsigned int)))
+	{
+		return;
+	}
+	
+	// Take the layer from the packet
+	unsigned int layer = ntohl(*((unsigned int *)packet));
+	
+	// Get a string for sender address
+	char ipAddress[INET_ADDRSTRLEN];
+	inet_ntop(AF_INET, &(reinterpret_cast<struct sockaddr_in*>(pSenderAddress)->sin_addr), ipAddress, INET_ADDRSTRLEN);
+	
+	// Call listener
+	if (m_pLayerRequestListener != NULL)
+	{
+		m_pLayerRequestListener->OnLayerRequest(ipAddress, layer);
 	}
 }
 
@@ -376,6 +480,33 @@ void ConferenceAnnunciator::SendParameters()
 }
 
 
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ConferenceAnnunciator::SendLayerRequest
+///
+/// Transmit the layer request (if any) for a single destination.
+///
+/// @param destinationIndex  The index of the destination in the destination list.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ConferenceAnnunciator::SendLayerRequest(size_t destinationIndex)
+{
+	const unsigned int* pLayerRequests = m_pLayerRequests;
+	if ((pLayerRequests == NULL) || (pLayerRequests[destinationIndex] == NO_LAYER_REQUEST))
+	{
+		return;
+	}
+	
+	// Layer request packets are of the following form:
+	//  - Four characters "LAYR" (not NULL-terminated)
+	//  - Requested layer in network byte order
+	char packet[4 + sizeof(unsigned int)];
+	std::memcpy(packet, "LAYR", 4);
+	*((unsigned int *)&packet[4]) = htonl(pLayerRequests[destinationIndex]);
+	
+	// Purposefully ignoring return value here, as in SendParameters().
+	sendto(m_UdpSocket, packet, sizeof(packet), 0, reinterpret_cast<const struct sockaddr *>(&m_pDestinationAddresses[destinationIndex]), sizeof(m_pDestinationAddresses[destinationIndex]));
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 /// Returns the difference in struct timespecs IN MICROSECONDS.
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -482,6 +613,10 @@ void* ConferenceAnnunciator::WorkerFn()
 				{
 					HandleParameterPacket(&buffer[4], read - 4, &addr);
 				}
+				else if (std::strncmp(buffer, "LAYR", 4) == 0)
+				{
+					HandleLayerRequestPacket(&buffer[4], read - 4, &addr);
+				}
 			}
 		}
 		
@@ -495,6 +630,10 @@ void* ConferenceAnnunciator::WorkerFn()
 				// It is time to transmit.
 				SendParticipantList();
 				SendParameters();
+				for (size_t i = 0; i < m_NumberOfDestinations; ++i)
+				{
+					SendLayerRequest(i);
+				}
 			}
 		}
 		
@@ -42,6 +42,10 @@
 /// All call partipants (organizers and non-organizers) should implement IParameterPacketListener
 /// and use SetParameterPacketListener and ClearParameterPacketListener to receive notification of
 /// incoming parameter data for call participants.
+///
+/// Participants that send simulcast video should implement ILayerRequestListener and use
+/// SetLayerRequestListener and ClearLayerRequestListener to learn which video layer each other
+/// participant wants to receive. SendLayerRequest tells another participant which layer "I" want.
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 class ConferenceAnnunciator
 {
@@ -70,7 +74,20 @@ public:
 		virtual ~IParameterPacketListener() {}
 		
 		/// Called when a new parameter packet arrives.
-		virtual void OnParameterPacket(const char* address, const char* pictureParameters, unsigned int videoSsrc, unsigned int audioSsrc) = 0;
+		virtual void OnParameterPacket(const char* address, const char* pictureParameters, const char* audioParameters, unsigned int videoSsrc, unsigned int audioSsrc) = 0;
+	};
+	
+	///////////////////////////////////////////////////////////////////////////////////////////////
+	/// This interface allows the annunciator to notify about incoming layer request packets.
+	///////////////////////////////////////////////////////////////////////////////////////////////
+	class ILayerRequestListener
+	{
+	public:
+		/// Destructor.
+		virtual ~ILayerRequestListener() {}
+		
+		/// Called when a participant asks for a particular simulcast video layer.
+		virtual void OnLayerRequest(const char* address, unsigned int layer) = 0;
 	};
 	
 	
@@ -98,8 +115,16 @@ public:
 	inline void ClearParameterPacketListener() { m_pParameterPacketListener = NULL; }
 	
 	
+	/// Set the listener for incoming layer request packets.
+	inline void SetLayerRequestListener(ILayerRequestListener* listener) { m_pLayerRequestListener = listener; }
+	
+	
+	/// Clear the listener for incoming layer request packets.
+	inline void ClearLayerRequestListener() { m_pLayerRequestListener = NULL; }
+	
+	
 	/// Configure the annunciator to send parameters to other participants
-	void SendParameters(const char* pPictureParameters, unsigned int videoSsrc, unsigned int audioSsrc);
+	void SendParameters(const char* pPictureParameters, const char* pAudioParameters, unsigned int videoSsrc, unsigned int audioSsrc);
 
 
 	/// Configure the annunciator to send the participant list periodically.
@@ -108,6 +133,10 @@ public:
 	
 	/// Configure the annunciator with the participant list to use for sent packets
 	void SetParticipantList(const char* participantAddresses[], size_t numberOfParticipants);
+	
+	
+	/// Ask a participant to send us a particular simulcast video layer
+	void SendLayerRequest(const char* participantAddress, unsigned int layer);
 
 	
 protected:
@@ -121,6 +150,10 @@ private:
 	static const long TRANSMIT_INTERVAL_US = 2000000;
 	
 	
+	/// The layer request value meaning "no layer requested (yet)"
+	static const unsigned int NO_LAYER_REQUEST = 0xFFFFFFFF;
+	
+	
 	/// (Static) function to create the UDP socket (for ctor usage)
 	static int CreateSocket();
 	
@@ -140,6 +173,10 @@ private:
 	void HandleParameterPacket(const char* packet, size_t packetSize, struct sockaddr_in* pSenderAddress);
 	
 	
+	/// This function is called when a "layr" packet is received with a layer request
+	void HandleLayerRequestPacket(const char* packet, size_t packetSize, struct sockaddr_in* pSenderAddress);
+	
+	
 	/// This function sends the participant list
 	void SendParticipantList();
 	
@@ -148,6 +185,10 @@ private:
 	void SendParameters();
 	
 	
+	/// This function sends a layer request to one destination (if a layer has been requested)
+	void SendLayerRequest(size_t destinationIndex);
+	
+	
 	/// The (instance) worker function
 	void* WorkerFn();
 	
@@ -173,6 +214,10 @@ private:
 	IParameterPacketListener* m_pParameterPacketListener;
 	
 	
+	/// The ILayerRequestListener
+	ILayerRequestListener* m_pLayerRequestListener;
+	
+	
 	/// The next time we should send packets
 	struct timespec m_NextXmitTime;
 	
@@ -190,6 +235,11 @@ private:
 	/// The destination addresses and number of addresses (if specified)
 	const struct sockaddr_in* m_pDestinationAddresses;
 	size_t m_NumberOfDestinations;
+	
+	
+	/// The layer requested from each destination (NO_LAYER_REQUEST if none), parallel to
+	/// m_pDestinationAddresses
+	unsigned int* m_pLayerRequests;
 };
 
 #endif // __CONFERENCEANNUNCIATOR_HPP__
\ No newline at end of file
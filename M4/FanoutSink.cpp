@@ -0,0 +1,366 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// @file FanoutSink.cpp
+///
+/// Copyright (c) 2015, BoxCast, Inc. All rights reserved.
+///
+/// This library is free software; you can redistribute it and/or modify it under the terms of the
+/// GNU Lesser General Public License as published by the Free Software Foundation; either version
+/// 3.0 of the License, or (at your option) any later version.
+///
+/// This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+/// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See
+/// the GNULesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License along with this
+/// library; if not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+/// Boston, MA 02110-1301 USA
+///
+/// @brief This file defines the functions of the FanoutSink class.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "FanoutSink.hpp" // for class declaration
+
+
+const char FanoutSink::ELEMENT_NAME[] = "m4fanoutsink";
+
+gpointer FanoutSink::s_pParentClass = NULL;
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// FanoutSink::Register()
+///
+/// Register the element with GStreamer so that gst_element_factory_make(ELEMENT_NAME, ...) works.
+///
+/// @return true if the element was registered.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool FanoutSink::Register()
+{
+	return gst_element_register(NULL, ELEMENT_NAME, GST_RANK_NONE, GetType()) == TRUE;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// FanoutSink::GetType()
+///
+/// Get the element's GType, registering it the first time.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+GType FanoutSink::GetType()
+{
+	static gsize type = 0;
+	if (g_once_init_enter(&type))
+	{
+		GType t = g_type_register_static_simple(GST_TYPE_BASE_SINK,
+			"M4FanoutSink",
+			sizeof(Class),
+			ClassInit,
+			sizeof(Instance),
+			InstanceInit,
+			static_cast<GTypeFlags>(0));
+		g_once_init_leave(&type, t);
+	}
+	return type;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// FanoutSink::ClassInit()
+///
+/// Install the virtual functions, properties, pad template, and metadata.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void FanoutSink::ClassInit(gpointer klass, gpointer classData)
+{
+	static GstStaticPadTemplate sinkTemplate = GST_STATIC_PAD_TEMPLATE("sink", GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS_ANY);
+
+	s_pParentClass = g_type_class_peek_parent(klass);
+
+	GObjectClass* pObjectClass = G_OBJECT_CLASS(klass);
+	pObjectClass->set_property = SetProperty;
+	pObjectClass->get_property = GetProperty;
+	pObjectClass->finalize = Finalize;
+
+	g_object_class_install_property(pObjectClass, PROP_CLIENTS,
+		g_param_spec_string("clients", "Clients", "A comma separated list of host:port pairs",
+			NULL, static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+	g_object_class_install_property(pObjectClass, PROP_MODE,
+		g_param_spec_uint("mode", "Mode", "0 = sendto per packet, 1 = sendmmsg, 2 = sendmmsg with UDP GSO",
+			UdpFanout::MODE_SENDTO, UdpFanout::MODE_SENDMMSG_GSO, UdpFanout::MODE_SENDMMSG_GSO,
+			static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+	g_object_class_install_property(pObjectClass, PROP_PACER,
+		g_param_spec_pointer("pacer", "Pacer", "The Pacer to send through (set only while stopped), or NULL",
+			static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+	g_object_class_install_property(pObjectClass, PROP_PRIORITY,
+		g_param_spec_boolean("priority", "Priority", "Never queue packets in the pacer",
+			FALSE, static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+	g_object_class_install_property(pObjectClass, PROP_PACING_RATE,
+		g_param_spec_uint64("pacing-rate", "Pacing rate", "The pacer's rate in bits/sec (0 = not paced)",
+			0, G_MAXUINT64, 0, static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+	g_object_class_install_property(pObjectClass, PROP_BUFFER_SIZE,
+		g_param_spec_int("buffer-size", "Buffer Size", "Size of the kernel send buffer in bytes, 0 = default",
+			0, G_MAXINT, 0, static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+	g_object_class_install_property(pObjectClass, PROP_STATS,
+		g_param_spec_boxed("stats", "Statistics", "Pacing queue and sending statistics",
+			GST_TYPE_STRUCTURE, static_cast<GParamFlags>(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+	GstElementClass* pElementClass = GST_ELEMENT_CLASS(klass);
+	gst_element_class_add_pad_template(pElementClass, gst_static_pad_template_get(&sinkTemplate));
+	gst_element_class_set_static_metadata(pElementClass,
+		"UDP fan-out sink",
+		"Sink/Network",
+		"Sends packets to multiple clients, batching system calls",
+		"BoxCast");
+
+	GstBaseSinkClass* pBaseSinkClass = GST_BASE_SINK_CLASS(klass);
+	pBaseSinkClass->render = Render;
+	pBaseSinkClass->render_list = RenderList;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// FanoutSink::InstanceInit()
+///
+/// Create the instance's UdpFanout and scratch space.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void FanoutSink::InstanceInit(GTypeInstance* pInstance, gpointer klass)
+{
+	Instance* pSelf = reinterpret_cast<Instance*>(pInstance);
+	pSelf->pFanout = new UdpFanout();
+	pSelf->pPacer = NULL;
+	pSelf->pFlow = NULL;
+	pSelf->priority = FALSE;
+	pSelf->pacingRate = 0;
+	pSelf->bufferSize = 0;
+	pSelf->pClients = NULL;
+	pSelf->pMaps = new std::vector<GstMapInfo>();
+	pSelf->pPackets = new std::vector<UdpFanout::Packet>();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// FanoutSink::Finalize()
+///
+/// Release what InstanceInit created, then chain up.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void FanoutSink::Finalize(GObject* pObject)
+{
+	Instance* pSelf = reinterpret_cast<Instance*>(pObject);
+	if (pSelf->pFlow != NULL)
+	{
+		pSelf->pPacer->RemoveFlow(pSelf->pFlow);
+	}
+	delete pSelf->pPackets;
+	delete pSelf->pMaps;
+	delete pSelf->pFanout;
+	g_free(pSelf->pClients);
+
+	G_OBJECT_CLASS(s_pParentClass)->finalize(pObject);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// FanoutSink::SetProperty()
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void FanoutSink::SetProperty(GObject* pObject, guint propId, const GValue* pValue, GParamSpec* pSpec)
+{
+	Instance* pSelf = reinterpret_cast<Instance*>(pObject);
+	switch (propId)
+	{
+	case PROP_CLIENTS:
+		GST_OBJECT_LOCK(pSelf);
+		g_free(pSelf->pClients);
+		pSelf->pClients = g_value_dup_string(pValue);
+		GST_OBJECT_UNLOCK(pSelf);
+		pSelf->pFanout->SetClients(g_value_get_string(pValue));
+		break;
+
+	case PROP_MODE:
+		pSelf->pFanout->SetMode(static_cast<UdpFanout::Mode>(g_value_get_uint(pValue)));
+		break;
+
+	case PROP_PACER:
+		if (pSelf->pFlow != NULL)
+		{
+			pSelf->pPacer->RemoveFlow(pSelf->pFlow);
+			pSelf->pFlow = NULL;
+		}
+		pSelf->pPacer = reinterpret_cast<Pacer*>(g_value_get_pointer(pValue));
+		if (pSelf->pPacer != NULL)
+		{
+			pSelf->pFlow = pSelf->pPacer->AddFlow(pSelf->pFanout);
+			pSelf->pPacer->SetPriority(pSelf->pFlow, pSelf->priority == TRUE);
+			pSelf->pPacer->SetRate(pSelf->pFlow, pSelf->pacingRate);
+		}
+		break;
+
+	case PROP_PRIORITY:
+		pSelf->priority = g_value_get_boolean(pValue);
+		if (pSelf->pFlow != NULL)
+		{
+			pSelf->pPacer->SetPriority(pSelf->pFlow, pSelf->priority == TRUE);
+		}
+		break;
+
+	case PROP_PACING_RATE:
+		pSelf->pacingRate = g_value_get_uint64(pValue);
+		if (pSelf->pFlow != NULL)
+		{
+			pSelf->pPacer->SetRate(pSelf->pFlow, pSelf->pacingRate);
+		}
+		break;
+
+	case PROP_BUFFER_SIZE:
+		pSelf->bufferSize = g_value_get_int(pValue);
+		if (pSelf->bufferSize > 0)
+		{
+			pSelf->pFanout->SetBufferSize(pSelf->bufferSize);
+		}
+		break;
+
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID(pObject, propId, pSpec);
+		break;
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// FanoutSink::GetProperty()
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void FanoutSink::GetProperty(GObject* pObject, guint propId, GValue* pValue, GParamSpec* pSpec)
+{
+	Instance* pSelf = reinterpret_cast<Instance*>(pObject);
+	switch (propId)
+	{
+	case PROP_CLIENTS:
+		GST_OBJECT_LOCK(pSelf);
+		g_value_set_string(pValue, pSelf->pClients);
+		GST_OBJECT_UNLOCK(pSelf);
+		break;
+
+	case PROP_MODE:
+		g_value_set_uint(pValue, pSelf->pFanout->GetMode());
+		break;
+
+	case PROP_PACER:
+		g_value_set_pointer(pValue, pSelf->pPacer);
+		break;
+
+	case PROP_PRIORITY:
+		g_value_set_boolean(pValue, pSelf->priority);
+		break;
+
+	case PROP_PACING_RATE:
+		g_value_set_uint64(pValue, pSelf->pacingRate);
+		break;
+
+	case PROP_BUFFER_SIZE:
+		g_value_set_int(pValue, pSelf->bufferSize);
+		break;
+
+	case PROP_STATS:
+	{
+		Pacer::Stats stats = { 0, 0, 0, 0, 0 };
+		if (pSelf->pFlow != NULL)
+		{
+			stats = pSelf->pPacer->GetStats(pSelf->pFlow);
+		}
+		g_value_take_boxed(pValue, gst_structure_new("m4fanoutsink-stats",
+			"queued-packets",     G_TYPE_UINT,   static_cast<guint>(stats.queuedPackets),
+			"queued-bytes",       G_TYPE_UINT,   static_cast<guint>(stats.queuedBytes),
+			"max-queued-packets", G_TYPE_UINT,   static_cast<guint>(stats.maxQueuedPackets),
+			"queue-delay",        G_TYPE_UINT64, static_cast<guint64>(stats.queueDelayUs),
+			"datagrams",          G_TYPE_UINT64, static_cast<guint64>(pSelf->pFanout->DatagramCount()),
+			"syscalls",           G_TYPE_UINT64, static_cast<guint64>(pSelf->pFanout->SyscallCount()),
+			"buffer-size",        G_TYPE_INT,    pSelf->pFanout->GetBufferSize(),
+			NULL));
+		break;
+	}
+
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID(pObject, propId, pSpec);
+		break;
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// FanoutSink::Render()
+///
+/// Send a single buffer (e.g. an audio packet) to all clients. Even so, that is one batch.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+GstFlowReturn FanoutSink::Render(GstBaseSink* pSink, GstBuffer* pBuffer)
+{
+	Instance* pSelf = reinterpret_cast<Instance*>(pSink);
+
+	GstMapInfo map;
+	if (!gst_buffer_map(pBuffer, &map, GST_MAP_READ))
+	{
+		return GST_FLOW_ERROR;
+	}
+	UdpFanout::Packet packet = { map.data, map.size };
+	Send(pSelf, &packet, 1);
+	gst_buffer_unmap(pBuffer, &map);
+
+	return GST_FLOW_OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// FanoutSink::RenderList()
+///
+/// Send a buffer list (e.g. all of the RTP packets of one video frame) to all clients as one
+/// batch. Buffers made of several memories are merged by the mapping.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+GstFlowReturn FanoutSink::RenderList(GstBaseSink* pSink, GstBufferList* pList)
+{
+	Instance* pSelf = reinterpret_cast<Instance*>(pSink);
+	std::vector<GstMapInfo>& maps = *pSelf->pMaps;
+	std::vector<UdpFanout::Packet>& packets = *pSelf->pPackets;
+
+	guint length = gst_buffer_list_length(pList);
+	maps.resize(length);
+	packets.clear();
+	packets.reserve(length);
+
+	GstFlowReturn ret = GST_FLOW_OK;
+	guint mapped = 0;
+	for (; mapped < length; ++mapped)
+	{
+		if (!gst_buffer_map(gst_buffer_list_get(pList, mapped), &maps[mapped], GST_MAP_READ))
+		{
+			ret = GST_FLOW_ERROR;
+			break;
+		}
+		UdpFanout::Packet packet = { maps[mapped].data, maps[mapped].size };
+		packets.push_back(packet);
+	}
+
+	if ((ret == GST_FLOW_OK) && !packets.empty())
+	{
+		Send(pSelf, &packets[0], packets.size());
+	}
+
+	for (guint i = 0; i < mapped; ++i)
+	{
+		gst_buffer_unmap(gst_buffer_list_get(pList, i), &maps[i]);
+	}
+
+	return ret;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// FanoutSink::Send()
+///
+/// Send packets through the pacer, which copies any it queues, or straight to the clients.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void FanoutSink::Send(Instance* pSelf, const UdpFanout::Packet* pPackets, size_t numPackets)
+{
+	if (pSelf->pFlow != NULL)
+	{
+		pSelf->pPacer->Send(pSelf->pFlow, pPackets, numPackets);
+	}
+	else
+	{
+		pSelf->pFanout->Send(pPackets, numPackets);
+	}
+}
@@ -0,0 +1,122 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// @file FanoutSink.hpp
+///
+/// Copyright (c) 2015, BoxCast, Inc. All rights reserved.
+///
+/// This library is free software; you can redistribute it and/or modify it under the terms of the
+/// GNU Lesser General Public License as published by the Free Software Foundation; either version
+/// 3.0 of the License, or (at your option) any later version.
+///
+/// This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+/// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See
+/// the GNULesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License along with this
+/// library; if not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+/// Boston, MA 02110-1301 USA
+///
+/// @brief This file declares the FanoutSink class, which implements the "m4fanoutsink" GStreamer
+/// element: a batching replacement for multiudpsink.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#ifndef __FANOUT_SINK_HPP__
+#define __FANOUT_SINK_HPP__
+
+#include <gst/gst.h>               // for GStreamer stuff
+#include <gst/base/gstbasesink.h>  // for GstBaseSink
+#include <vector>                  // for std::vector
+#include "Pacer.hpp"               // for Pacer
+#include "UdpFanout.hpp"           // for UdpFanout
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// This class registers and implements the "m4fanoutsink" element. It takes the same "clients"
+/// property as multiudpsink, so it can stand in for one, but hands each buffer list (rtph264pay
+/// pushes one per frame) to a UdpFanout, which sends it to all clients in one batch.
+///
+/// The "mode" property selects the UdpFanout::Mode; it defaults to the most batched mode the
+/// platform supports.
+///
+/// With the "pacer" property set (to a Pacer*, only while the element is stopped), packets go
+/// through that Pacer: at most "pacing-rate" bits/sec, or right away if "priority" is set. The
+/// read-only "stats" property holds the pacing queue's statistics.
+///
+/// "buffer-size" sets the socket's send buffer size (SO_SNDBUF), at any time.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class FanoutSink
+{
+public:
+	/// The element's factory name
+	static const char ELEMENT_NAME[];
+
+
+	/// Register the element with GStreamer; call once after gst_init().
+	static bool Register();
+
+
+private:
+	/// The element's instance structure
+	struct Instance
+	{
+		GstBaseSink parent;
+		UdpFanout* pFanout;
+		Pacer* pPacer;
+		Pacer::Flow* pFlow;
+		gboolean priority;
+		guint64 pacingRate;
+		gint bufferSize;
+		gchar* pClients;
+		std::vector<GstMapInfo>* pMaps;
+		std::vector<UdpFanout::Packet>* pPackets;
+	};
+
+
+	/// The element's class structure
+	struct Class
+	{
+		GstBaseSinkClass parentClass;
+	};
+
+
+	/// Property IDs
+	enum
+	{
+		PROP_0,
+		PROP_CLIENTS,
+		PROP_MODE,
+		PROP_PACER,
+		PROP_PRIORITY,
+		PROP_PACING_RATE,
+		PROP_BUFFER_SIZE,
+		PROP_STATS
+	};
+
+
+	/// Get (registering, the first time) the element's GType.
+	static GType GetType();
+
+
+	/// GObject class and instance initialization, and finalization
+	static void ClassInit(gpointer klass, gpointer classData);
+	static void InstanceInit(GTypeInstance* pInstance, gpointer klass);
+	static void Finalize(GObject* pObject);
+
+
+	/// GObject property accessors
+	static void SetProperty(GObject* pObject, guint propId, const GValue* pValue, GParamSpec* pSpec);
+	static void GetProperty(GObject* pObject, guint propId, GValue* pValue, GParamSpec* pSpec);
+
+
+	/// Send packets through the pacer, if there is one, or straight to the clients
+	static void Send(Instance* pSelf, const UdpFanout::Packet* pPackets, size_t numPackets);
+	
+	
+	/// GstBaseSink rendering of a single buffer and of a buffer list
+	static GstFlowReturn Render(GstBaseSink* pSink, GstBuffer* pBuffer);
+	static GstFlowReturn RenderList(GstBaseSink* pSink, GstBufferList* pList);
+
+
+	/// The parent (GstBaseSink) class
+	static gpointer s_pParentClass;
+}; // END class FanoutSink
+
+#endif // __FANOUT_SINK_HPP__
@@ -0,0 +1,143 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// @file JitterEstimator.cpp
+///
+/// Copyright (c) 2015, BoxCast, Inc. All rights reserved.
+///
+/// This library is free software; you can redistribute it and/or modify it under the terms of the
+/// GNU Lesser General Public License as published by the Free Software Foundation; either version
+/// 3.0 of the License, or (at your option) any later version.
+///
+/// This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+/// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See
+/// the GNULesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License along with this
+/// library; if not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+/// Boston, MA 02110-1301 USA
+///
+///
+/// @brief This file defines the functions of the JitterEstimator class.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>           // for std::nth_element, std::min, std::max
+#include <cstdlib>             // for std::llabs
+#include "JitterEstimator.hpp" // for class declaration
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// JitterEstimator::JitterEstimator()
+///
+/// Constructor.
+///
+/// @param clockRate  The RTP clock rate of the stream.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+JitterEstimator::JitterEstimator(unsigned int clockRate)
+	: m_ClockRate(clockRate)
+	, m_Samples()
+	, m_Scratch()
+	, m_HavePacket(false)
+	, m_LastTimestamp(0)
+	, m_ExtendedTimestamp(0)
+	, m_LastTransitUs(0)
+	, m_JitterUs(0.0)
+	, m_BacklogTransitUs(0)
+	, m_BacklogUntilUs(0)
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// JitterEstimator::OnPacket()
+///
+/// Account for an arriving packet: update the interarrival jitter (RFC 3550 A.8) from the change
+/// in transit time, and add the packet to the window unless it belongs to a stall's backlog.
+///
+/// @param arrivalUs  The (monotonic) arrival time, in microseconds.
+///
+/// @param rtpTimestamp  The packet's RTP timestamp.
+///
+/// @return true if the packet ends a stall.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool JitterEstimator::OnPacket(int64_t arrivalUs, uint32_t rtpTimestamp)
+{
+	if (m_HavePacket)
+	{
+		m_ExtendedTimestamp += static_cast<int32_t>(rtpTimestamp - m_LastTimestamp);
+	}
+	m_LastTimestamp = rtpTimestamp;
+	int64_t transitUs = arrivalUs - ((m_ExtendedTimestamp * 1000000) / m_ClockRate);
+
+	bool stall = false;
+	if (m_HavePacket)
+	{
+		int64_t d = transitUs - m_LastTransitUs;
+		m_JitterUs += (static_cast<double>(std::llabs(d)) - m_JitterUs) / 16.0;
+		if ((d > STALL_US) && (m_BacklogUntilUs == 0))
+		{
+			m_BacklogTransitUs = m_LastTransitUs + STALL_US;
+			m_BacklogUntilUs = arrivalUs + MAX_BACKLOG_US;
+			stall = true;
+		}
+	}
+	m_LastTransitUs = transitUs;
+	m_HavePacket = true;
+
+	if (m_BacklogUntilUs != 0)
+	{
+		if ((transitUs > m_BacklogTransitUs) && (arrivalUs < m_BacklogUntilUs))
+		{
+			return stall;
+		}
+		m_BacklogUntilUs = 0;
+	}
+
+	Sample sample = { arrivalUs, transitUs };
+	m_Samples.push_back(sample);
+	while ((m_Samples.size() > MAX_SAMPLES) || ((arrivalUs - m_Samples.front().arrivalUs) > WINDOW_US))
+	{
+		m_Samples.pop_front();
+	}
+	return stall;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// JitterEstimator::Retarget()
+///
+/// Pick the target latency, the percentile of the packets' delays over the fastest one in the
+/// window (plus MARGIN_MS), and step the current latency toward it.
+///
+/// @param currentMs  The current latency, in milliseconds.
+///
+/// @param percentile  The fraction of packets that should arrive in time (0.0 - 1.0).
+///
+/// @return The new latency, in milliseconds.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+unsigned int JitterEstimator::Retarget(unsigned int currentMs, double percentile)
+{
+	if (m_Samples.empty())
+	{
+		return currentMs;
+	}
+
+	int64_t minTransitUs = m_Samples.front().transitUs;
+	for (std::deque<Sample>::const_iterator it = m_Samples.begin(); it != m_Samples.end(); ++it)
+	{
+		minTransitUs = std::min(minTransitUs, it->transitUs);
+	}
+	m_Scratch.clear();
+	for (std::deque<Sample>::const_iterator it = m_Samples.begin(); it != m_Samples.end(); ++it)
+	{
+		m_Scratch.push_back(it->transitUs - minTransitUs);
+	}
+	size_t n = std::min(m_Scratch.size() - 1, static_cast<size_t>(percentile * m_Scratch.size()));
+	std::nth_element(m_Scratch.begin(), m_Scratch.begin() + n, m_Scratch.end());
+
+	unsigned int targetMs = static_cast<unsigned int>((m_Scratch[n] + 999) / 1000) + MARGIN_MS;
+	targetMs = std::max(static_cast<unsigned int>(MIN_LATENCY_MS), std::min(static_cast<unsigned int>(MAX_LATENCY_MS), targetMs));
+	if (targetMs > currentMs)
+	{
+		return std::min(targetMs, currentMs + MAX_STEP_UP_MS);
+	}
+	return std::max(targetMs, (currentMs > MAX_STEP_DOWN_MS) ? (currentMs - MAX_STEP_DOWN_MS) : 0);
+}
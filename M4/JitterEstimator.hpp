@@ -0,0 +1,148 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// @file JitterEstimator.hpp
+///
+/// Copyright (c) 2015, BoxCast, Inc. All rights reserved.
+///
+/// This library is free software; you can redistribute it and/or modify it under the terms of the
+/// GNU Lesser General Public License as published by the Free Software Foundation; either version
+/// 3.0 of the License, or (at your option) any later version.
+///
+/// This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+/// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See
+/// the GNULesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License along with this
+/// library; if not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+/// Boston, MA 02110-1301 USA
+///
+///
+/// @brief This file declares the JitterEstimator class, which measures how much a stream's packets
+/// are delayed on the way, and from that how long a jitter buffer should hold them.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#ifndef __JITTER_ESTIMATOR_HPP__
+#define __JITTER_ESTIMATOR_HPP__
+
+#include <stdint.h> // for int64_t, uint32_t
+#include <cstddef>  // for size_t
+#include <deque>    // for std::deque
+#include <vector>   // for std::vector
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// This class follows the transit times (arrival time minus RTP timestamp) of one stream's
+/// packets. From them it keeps the RFC 3550 interarrival jitter, and picks a jitter buffer latency:
+/// the delay, over the stream's fastest packet in the last WINDOW_US, that the given percentile of
+/// packets arrive within.
+///
+/// The latency moves toward that target in bounded steps: quickly up, so that late packets stop
+/// being lost, and slowly down, so that a quiet moment doesn't undo it.
+///
+/// A stall (the network holding packets back, then delivering them in a burst) would push the
+/// target to the length of the stall. The packets of such a backlog are too late to play out
+/// anyway, so they are left out of the window until the transit times are back to normal.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class JitterEstimator
+{
+public:
+	/// The lowest latency picked, in milliseconds.
+	static const unsigned int MIN_LATENCY_MS = 5;
+
+
+	/// The highest latency picked, in milliseconds.
+	static const unsigned int MAX_LATENCY_MS = 400;
+
+
+	/// Constructor.
+	explicit JitterEstimator(unsigned int clockRate);
+
+
+	/// Account for an arriving packet; returns true if it ends a stall.
+	bool OnPacket(int64_t arrivalUs, uint32_t rtpTimestamp);
+
+
+	/// The RFC 3550 interarrival jitter, in microseconds.
+	inline double GetJitterUs() const { return m_JitterUs; }
+
+
+	/// Get the next latency, stepping from the current one toward the target.
+	unsigned int Retarget(unsigned int currentMs, double percentile);
+
+
+private:
+	/// How long packets stay in the window, in microseconds.
+	static const int64_t WINDOW_US = 5000000;
+
+
+	/// The most packets kept in the window.
+	static const size_t MAX_SAMPLES = 4096;
+
+
+	/// A transit time this much longer than the previous packet's starts a stall, in microseconds.
+	static const int64_t STALL_US = 250000;
+
+
+	/// The longest a stall's backlog is left out of the window, in microseconds.
+	static const int64_t MAX_BACKLOG_US = 2000000;
+
+
+	/// The most the latency goes up per step, in milliseconds.
+	static const unsigned int MAX_STEP_UP_MS = 20;
+
+
+	/// The most the latency goes down per step, in milliseconds.
+	static const unsigned int MAX_STEP_DOWN_MS = 2;
+
+
+	/// Added to the measured delay for the time it takes to process a packet, in milliseconds.
+	static const unsigned int MARGIN_MS = 2;
+
+
+	/// One packet in the window
+	struct Sample
+	{
+		int64_t arrivalUs;
+		int64_t transitUs;
+	};
+
+
+	/// The RTP clock rate
+	const unsigned int m_ClockRate;
+
+
+	/// The packets in the window, oldest first
+	std::deque<Sample> m_Samples;
+
+
+	/// Scratch space for picking the percentile, kept to avoid allocating per retarget
+	std::vector<int64_t> m_Scratch;
+
+
+	/// Whether a packet has arrived yet
+	bool m_HavePacket;
+
+
+	/// The previous packet's RTP timestamp
+	uint32_t m_LastTimestamp;
+
+
+	/// The previous packet's RTP timestamp, extended past wraparounds, from the first packet's
+	int64_t m_ExtendedTimestamp;
+
+
+	/// The previous packet's transit time, in microseconds
+	int64_t m_LastTransitUs;
+
+
+	/// The RFC 3550 interarrival jitter, in microseconds
+	double m_JitterUs;
+
+
+	/// While catching up after a stall: the transit time that ends the backlog, in microseconds
+	int64_t m_BacklogTransitUs;
+
+
+	/// While catching up after a stall: when to stop waiting for the backlog to end (0 if not)
+	int64_t m_BacklogUntilUs;
+}; // END class JitterEstimator
+
+#endif // __JITTER_ESTIMATOR_HPP__
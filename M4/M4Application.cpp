@@ -18,6 +18,9 @@
 /// @brief This file defines the functions of the M4Application class.
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 #include <gst/gst.h>
+#include "FanoutSink.hpp"
+#include "PlayoutMixer.hpp"
+#include "UdpBatchSrc.hpp"
 #include "M4Application.hpp"
 #include "M4Frame.hpp"
 
@@ -34,6 +37,9 @@ bool M4Application::OnInit()
 	// Initialize GStreamer
 	int argc = 0;
 	gst_init(&argc, NULL);
+	FanoutSink::Register();
+	PlayoutMixer::Register();
+	UdpBatchSrc::Register();
 	
 	M4Frame *frame = new M4Frame();
  	frame->Centre();
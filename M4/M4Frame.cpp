@@ -36,6 +36,18 @@ const char M4Frame::DIRECTORY_FILENAME[] = "directory.json";
 
 const size_t M4Frame::VIDEO_BITRATE = 100000000;
 
+const size_t M4Frame::SIMULCAST_LAYERS = 3;
+
+const unsigned int M4Frame::GRID_VIDEO_LAYER = 1;
+
+const int M4Frame::SELF_VIEW_FRAME_RATE = 15;
+
+const uint16_t M4Frame::RECEIVE_PORT_BASE = 9000;
+
+const bool M4Frame::COMPOSITE_VIDEO = false;
+
+const SenderPipeline::AudioSettings M4Frame::AUDIO_SETTINGS = { SenderPipeline::AUDIO_CODEC_OPUS, 10, true, true };
+
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 /// M4Frame::M4Frame
@@ -47,13 +59,15 @@ M4Frame::M4Frame()
 	: wxFrame(NULL, wxID_ANY, wxT("Video Conferencing System"), wxDefaultPosition, wxSize(400, 600))
 	, m_Directory()
 	, m_MyAddress("")
-	, m_ReceiverPipelinesByVideoSsrc()
+	, m_pReceiverPipeline(NULL)
 	, videoInputName()
 	, audioInputName()
 	, m_ParticipantList()
 	, m_Annunciator()
 	, m_VideoPanels()
 	, m_pSenderPipeline(NULL)
+	, m_pCompositePanel(NULL)
+	, m_CompositeRects()
   , v()
   , h1()
   , h2()
@@ -161,6 +175,7 @@ M4Frame::M4Frame()
   
 	m_VideoPanels[0] = new VideoPanel(this, "Me");
   m_VideoPanels[0]->m_MediaPanel->Bind(wxEVT_LEFT_UP, &M4Frame::OnClick, this);
+	m_VideoPanels[0]->m_MediaPanel->Bind(wxEVT_SIZE, &M4Frame::OnSelfViewSize, this);
   //std::cout  << "m_VideoPanels Id " << 0 << " " << m_VideoPanels[0]->m_MediaPanel->GetId() << std::endl;
 	
 	const std::string* myName = GetNameForAddress(m_MyAddress);
@@ -170,13 +185,31 @@ M4Frame::M4Frame()
 		{
 			m_VideoPanels[i] = new VideoPanel(this, m_ParticipantList[j]);
       m_VideoPanels[i]->m_MediaPanel->Bind(wxEVT_LEFT_UP, &M4Frame::OnClick, this);
+      m_VideoPanels[i]->m_MediaPanel->Bind(wxEVT_SIZE, &M4Frame::OnRemoteViewSize, this);
       //std::cout  << "m_VideoPanels Id " << i << " " << m_VideoPanels[i]->m_MediaPanel->GetId() << std::endl;
 			++i;
 		}
 	}
 	
+	// In composite mode, the remote panels only keep the layout state; their video is drawn on
+	// the composite panel, and clicks on it go to the participant under the mouse.
+	if (COMPOSITE_VIDEO)
+	{
+		m_pCompositePanel = new VideoPanel(this, "Participants");
+		m_pCompositePanel->m_MediaPanel->Bind(wxEVT_LEFT_UP, &M4Frame::OnCompositeClick, this);
+		m_pCompositePanel->m_MediaPanel->Bind(wxEVT_SIZE, &M4Frame::OnCompositeSize, this);
+		for (size_t i = 1; i < (sizeof(m_VideoPanels) / sizeof(m_VideoPanels[0])); ++i)
+		{
+			if (m_VideoPanels[i] != NULL)
+			{
+				m_VideoPanels[i]->Hide();
+			}
+		}
+	}
+	
   SetView(0);
 	SetSizer(v);
+	Bind(wxEVT_ICONIZE, &M4Frame::OnIconize, this);
 	
 	// We can't start GStreamer stuff until the main loop is running; so we hook up an
 	// idle handler here and do the GStreamer creation the first time that handler is
@@ -198,6 +231,89 @@ void M4Frame::OnClick(wxMouseEvent& event)
   SetView(event.GetId());
 }
 
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// M4Frame::OnSelfViewSize
+///
+/// Called when the "Me" panel changes size, e.g. when another panel is maximized.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void M4Frame::OnSelfViewSize(wxSizeEvent& event)
+{
+	UpdateSelfView();
+	event.Skip();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// M4Frame::OnRemoteViewSize
+///
+/// Called when a remote participant's panel changes size, e.g. when it is maximized or iconized.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void M4Frame::OnRemoteViewSize(wxSizeEvent& event)
+{
+	UpdateVisibility();
+	event.Skip();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// M4Frame::OnIconize
+///
+/// Called when the frame is iconized (minimized) or restored; while it is, nobody's video is seen.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void M4Frame::OnIconize(wxIconizeEvent& event)
+{
+	UpdateVisibility();
+	event.Skip();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// M4Frame::OnCompositeClick
+///
+/// Called on a click in the composite video panel: toggle the panel of the participant clicked
+/// on, as a click on its own panel would.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void M4Frame::OnCompositeClick(wxMouseEvent& event)
+{
+	double scale = m_pCompositePanel->m_MediaPanel->GetContentScaleFactor();
+	wxPoint position(static_cast<int>(event.GetX() * scale), static_cast<int>(event.GetY() * scale));
+	for (size_t i = 1; i < std::min(m_ParticipantList.GetCount(), 6UL); ++i)
+	{
+		if (m_CompositeRects[i].Contains(position))
+		{
+			SetView(m_VideoPanels[i]->m_MediaPanel->GetId());
+			break;
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// M4Frame::OnCompositeSize
+///
+/// Called when the composite video panel changes size.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void M4Frame::OnCompositeSize(wxSizeEvent& event)
+{
+	UpdateCompositeLayout();
+	event.Skip();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// M4Frame::UpdateSelfView
+///
+/// Have the sender scale the self-view to the "Me" panel's size in (backing) pixels and show it
+/// at SELF_VIEW_FRAME_RATE, rather than converting every full-size frame for a thumbnail.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void M4Frame::UpdateSelfView()
+{
+	if (m_pSenderPipeline == NULL)
+	{
+		return;
+	}
+	
+	wxPanel* pPanel = m_VideoPanels[0]->m_MediaPanel;
+	wxSize size = pPanel->GetClientSize();
+	double scale = pPanel->GetContentScaleFactor();
+	m_pSenderPipeline->SetPreviewSize(static_cast<int>(size.GetWidth() * scale), static_cast<int>(size.GetHeight() * scale), SELF_VIEW_FRAME_RATE);
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 /// M4Frame::SetView
 ///
@@ -215,6 +331,9 @@ void M4Frame::SetView(int mediaPanelId)
   h1->Clear(false);
   h2->Clear(false);
   v1->Clear(false);
+  if (m_pCompositePanel != NULL) {
+    v->Detach(m_pCompositePanel);
+  }
   v->Detach(h1);
   v->Detach(h2);
   v->Detach(v1);
@@ -250,6 +369,22 @@ void M4Frame::SetView(int mediaPanelId)
     }
   }
   
+  // In composite mode, only "Me" and the composite panel are laid out here; the other panels'
+  // states lay out the composite video (see UpdateCompositeLayout()).
+  if (m_pCompositePanel != NULL) {
+    v->SetOrientation(wxHORIZONTAL);
+    h1->SetOrientation(wxVERTICAL);
+    h1->Add(m_VideoPanels[0], 0, wxALL | wxEXPAND, 5);
+    v->Add(h1, 1, wxLEFT | wxTOP | wxALIGN_LEFT | wxEXPAND);
+    v->Add(m_pCompositePanel, 4, wxALL | wxEXPAND, 5);
+    
+    lastSelectedMediaPanelId = mediaPanelId;
+    Layout(); // Redraw
+    UpdateCompositeLayout();
+    RequestVideoLayers();
+    return;
+  }
+  
   switch (_maximizedPanels) {
     case 0:
       // Set view to two rows, equal spaced
@@ -316,6 +451,221 @@ void M4Frame::SetView(int mediaPanelId)
   }
 
   Layout(); // Redraw
+  
+  // The panel sizes changed, so ask for the video layers, and decode as much, to match.
+  RequestVideoLayers();
+  UpdateVisibility();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// M4Frame::UpdateCompositeLayout
+///
+/// Lay the remote participants' video out on the composite video panel the way SetView() lays out
+/// their panels: in an equally-spaced grid when none is maximized; otherwise the maximized ones
+/// in a grid, and the others iconized in a column on the left. The layout is in (backing) pixels
+/// of the panel, which is also the size the video is composited at.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void M4Frame::UpdateCompositeLayout()
+{
+	if (m_pCompositePanel == NULL)
+	{
+		return;
+	}
+	
+	wxPanel* pPanel = m_pCompositePanel->m_MediaPanel;
+	wxSize size = pPanel->GetClientSize();
+	double scale = pPanel->GetContentScaleFactor();
+	wxRect area(0, 0, static_cast<int>(size.GetWidth() * scale), static_cast<int>(size.GetHeight() * scale));
+	size_t panelCount = std::min(m_ParticipantList.GetCount(), 6UL);
+	
+	// Panel 0 is "me", which isn't composited.
+	size_t maximized = 0;
+	for (size_t i = 1; i < panelCount; ++i)
+	{
+		if (m_SelectedVideoPanelIndices[i] == TRUE)
+		{
+			++maximized;
+		}
+	}
+	
+	size_t iconized = (panelCount > 1) ? (panelCount - 1 - maximized) : 0;
+	wxRect iconArea(area.GetX(), area.GetY(), area.GetWidth() / 5, area.GetHeight());
+	wxRect maximizedArea(area.GetX() + iconArea.GetWidth(), area.GetY(), area.GetWidth() - iconArea.GetWidth(), area.GetHeight());
+	for (size_t i = 1, iconIndex = 0, maximizedIndex = 0; i < panelCount; ++i)
+	{
+		if (maximized == 0)
+		{
+			m_CompositeRects[i] = GridCell(area, i - 1, panelCount - 1);
+		}
+		else if (m_SelectedVideoPanelIndices[i] == TRUE)
+		{
+			m_CompositeRects[i] = GridCell(maximizedArea, maximizedIndex++, maximized);
+		}
+		else
+		{
+			// Icons are stacked from the top, as wide as the column allows
+			int iconHeight = std::min(iconArea.GetHeight() / static_cast<int>(iconized), (iconArea.GetWidth() * 9) / 16);
+			int iconWidth = (iconHeight * 16) / 9;
+			m_CompositeRects[i] = wxRect(iconArea.GetX() + ((iconArea.GetWidth() - iconWidth) / 2), iconArea.GetY() + (iconHeight * static_cast<int>(iconIndex++)), iconWidth, iconHeight);
+		}
+	}
+	
+	if (m_pReceiverPipeline == NULL)
+	{
+		return;
+	}
+	m_pReceiverPipeline->SetCompositeSize(area.GetWidth(), area.GetHeight());
+	for (size_t i = 1; i < panelCount; ++i)
+	{
+		const char* address = GetAddressForPanel(i);
+		if (address != NULL)
+		{
+			const wxRect& rect = m_CompositeRects[i];
+			m_pReceiverPipeline->SetCompositeLayout(address, rect.GetX(), rect.GetY(), rect.GetWidth(), rect.GetHeight());
+		}
+	}
+	UpdateVisibility();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// M4Frame::UpdateVisibility
+///
+/// Tell the receiver how much of each remote participant's video is seen, so that it decodes no
+/// more than that: all of it for maximized panels and the equally-spaced grid, less for iconized
+/// panels (which RequestVideoLayers() asks the smallest simulcast layer for), and none while the
+/// frame is iconized. The size is that of the participant's panel (or
+/// rectangle of the composite video) in (backing) pixels.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void M4Frame::UpdateVisibility()
+{
+	if (m_pReceiverPipeline == NULL)
+	{
+		return;
+	}
+	
+	size_t panelCount = std::min(m_ParticipantList.GetCount(), 6UL);
+	bool anyMaximized = false;
+	for (size_t i = 0; i < panelCount; ++i)
+	{
+		if (m_SelectedVideoPanelIndices[i] == TRUE)
+		{
+			anyMaximized = true;
+		}
+	}
+	
+	// Panel 0 is "me"; start with the first remote participant.
+	for (size_t i = 1; i < panelCount; ++i)
+	{
+		const char* address = GetAddressForPanel(i);
+		if (address == NULL)
+		{
+			continue;
+		}
+		
+		ReceiverPipeline::Visibility visibility;
+		if (IsIconized())
+		{
+			visibility = ReceiverPipeline::VISIBILITY_HIDDEN;
+		}
+		else if (!anyMaximized || (m_SelectedVideoPanelIndices[i] == TRUE))
+		{
+			visibility = ReceiverPipeline::VISIBILITY_FULL;
+		}
+		else
+		{
+			visibility = ReceiverPipeline::VISIBILITY_REDUCED;
+		}
+		
+		wxSize size;
+		if (m_pCompositePanel != NULL)
+		{
+			size = m_CompositeRects[i].GetSize();
+		}
+		else
+		{
+			wxPanel* pPanel = m_VideoPanels[i]->m_MediaPanel;
+			double scale = pPanel->GetContentScaleFactor();
+			size = pPanel->GetClientSize();
+			size.Set(static_cast<int>(size.GetWidth() * scale), static_cast<int>(size.GetHeight() * scale));
+		}
+		m_pReceiverPipeline->SetVisibility(address, visibility, size.GetWidth(), size.GetHeight());
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// M4Frame::GridCell
+///
+/// Get one cell of a grid laid out as SetView() lays out equally-spaced panels: alternately in the
+/// top and the bottom row (one row for a single cell). The cell is the largest 16:9 rectangle
+/// centered in its part of the area.
+///
+/// @param area  The area the grid fills.
+///
+/// @param index  The cell's index.
+///
+/// @param count  The number of cells.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+wxRect M4Frame::GridCell(const wxRect& area, size_t index, size_t count)
+{
+	int rows = (count > 1) ? 2 : 1;
+	int columns = static_cast<int>((count + rows - 1) / rows);
+	int cellWidth = area.GetWidth() / columns;
+	int cellHeight = area.GetHeight() / rows;
+	int width = std::min(cellWidth, (cellHeight * 16) / 9);
+	int height = (width * 9) / 16;
+	int x = area.GetX() + (cellWidth * static_cast<int>(index / rows)) + ((cellWidth - width) / 2);
+	int y = area.GetY() + (cellHeight * static_cast<int>(index % rows)) + ((cellHeight - height) / 2);
+	return wxRect(x, y, width, height);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// M4Frame::RequestVideoLayers
+///
+/// Ask each participant for the simulcast layer that suits its panel: full resolution for
+/// maximized panels, the smallest layer for iconized panels, and a middle layer when the panels
+/// are all shown in an equally-spaced grid.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void M4Frame::RequestVideoLayers()
+{
+	size_t panelCount = std::min(m_ParticipantList.GetCount(), 6UL);
+	
+	bool anyMaximized = false;
+	for (size_t i = 0; i < panelCount; ++i)
+	{
+		if (m_SelectedVideoPanelIndices[i] == TRUE)
+		{
+			anyMaximized = true;
+		}
+	}
+	
+	// Panel 0 is "me"; start with the first remote participant.
+	for (size_t i = 1; i < panelCount; ++i)
+	{
+		const char* address = GetAddressForPanel(i);
+		if (address == NULL)
+		{
+			continue;
+		}
+		
+		unsigned int layer;
+		if (!anyMaximized)
+		{
+			layer = GRID_VIDEO_LAYER;
+		}
+		else if (m_SelectedVideoPanelIndices[i] == TRUE)
+		{
+			layer = 0;
+		}
+		else
+		{
+			layer = SIMULCAST_LAYERS - 1;
+		}
+		m_Annunciator.SendLayerRequest(address, layer);
+	}
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -330,15 +680,16 @@ M4Frame::~M4Frame()
 		delete m_pSenderPipeline;
 	}
 	
-	for (std::unordered_map<unsigned int, ReceiverPipeline*>::iterator it = m_ReceiverPipelinesByVideoSsrc.begin(); it != m_ReceiverPipelinesByVideoSsrc.end(); ++it)
+	if (m_pReceiverPipeline != NULL)
 	{
-		delete it->second;
+		delete m_pReceiverPipeline;
 	}
 	
 	for (size_t i = 0; i < (sizeof(m_VideoPanels) / sizeof(m_VideoPanels[0])); ++i)
 	{
 		delete m_VideoPanels[i];
 	}
+	delete m_pCompositePanel;
 }
 
 
@@ -356,11 +707,13 @@ void M4Frame::OnIdle(wxIdleEvent& evt)
 	assert(m_pSenderPipeline == NULL);
 
 	// Create a new sender pipeline with the chosen video and audio inputs and make it play.
-	m_pSenderPipeline = new SenderPipeline(videoInputName.c_str(), audioInputName.c_str(), this);
+	m_pSenderPipeline = new SenderPipeline(videoInputName.c_str(), audioInputName.c_str(), this, SIMULCAST_LAYERS, AUDIO_SETTINGS);
 	m_pSenderPipeline->SetBitrate(VIDEO_BITRATE);
 	m_pSenderPipeline->SetWindowSink(m_VideoPanels[0]->GetMediaPanelHandle());
+	UpdateSelfView();
 	
-	// Find "my" index in the participant list; this is the index we use for the port offset for sending.
+	// Find "my" index in the participant list; this is the index we use for the port offset we
+	// get RTCP reports on.
 	const std::string* myName = GetNameForAddress(m_MyAddress);
 	size_t myIndex = 0;
 	for (size_t i = 0; i < m_ParticipantList.GetCount(); ++i)
@@ -372,20 +725,49 @@ void M4Frame::OnIdle(wxIdleEvent& evt)
 		}
 	}
 	
-	// Now add destinations for each of the participants.
+	// Now add destinations for each of the participants. Everyone receives on the same ports, and
+	// sends its RTCP reports back to the sender's own ports.
+	m_pSenderPipeline->SetRtcpPortBase(10000 + 4 * myIndex);
 	for (size_t i = 0; i < m_ParticipantList.GetCount(); ++i)
 	{
 		if (myName->compare(m_ParticipantList[i]) != 0)
 		{
 			const char* address = GetAddressForParticipant(m_ParticipantList[i]);
 			assert(address != NULL);
-			m_pSenderPipeline->AddDestination(address, 10000 + 4 * myIndex);
+			m_pSenderPipeline->AddDestination(address, RECEIVE_PORT_BASE);
 		}
 	}
 	m_pSenderPipeline->Play();
 	
-	// Connect ourselves as the parameter listener
+	// Start receiving from everyone right away, rather than waiting for their parameter packets:
+	// senders repeat their picture parameters in-band with each key frame, and send the audio we
+	// do. One pipeline receives all of them; a parameter packet only adds audio parameters it
+	// doesn't know yet (see OnParameterPacket()).
+	gchar* audioParameters = SenderPipeline::NewAudioParameters(AUDIO_SETTINGS);
+	void* pCompositeWindowHandle = (m_pCompositePanel != NULL) ? m_pCompositePanel->GetMediaPanelHandle() : NULL;
+	m_pReceiverPipeline = new ReceiverPipeline(audioInputName.c_str(), RECEIVE_PORT_BASE, audioParameters, pCompositeWindowHandle);
+	m_pReceiverPipeline->SetExpectedBitrate(VIDEO_BITRATE);
+	g_free(audioParameters);
+	for (size_t i = 0; i < m_ParticipantList.GetCount(); ++i)
+	{
+		if (myName->compare(m_ParticipantList[i]) != 0)
+		{
+			const char* address = GetAddressForParticipant(m_ParticipantList[i]);
+			size_t index;
+			VideoPanel* pPanel = GetPanelForAddress(address, index);
+			if (pPanel != NULL)
+			{
+				m_pReceiverPipeline->AddParticipant(address, 10000 + 4 * index, pPanel->GetMediaPanelHandle());
+			}
+		}
+	}
+	UpdateCompositeLayout();
+	UpdateVisibility();
+	m_pReceiverPipeline->Play();
+	
+	// Connect ourselves as the parameter and layer request listener
 	m_Annunciator.SetParameterPacketListener(this);
+	m_Annunciator.SetLayerRequestListener(this);
 	
 	// Disconnect the idle handler, as we're done now.
 	Disconnect(wxEVT_IDLE, wxIdleEventHandler(M4Frame::OnIdle));
@@ -402,13 +784,15 @@ void M4Frame::OnIdle(wxIdleEvent& evt)
 ///
 /// @param pPictureParameters  Picture parameters string.
 ///
+/// @param pAudioParameters  Audio parameters string.
+///
 /// @param videoSsrc  The video SSRC.
 ///
 /// @param audioSsrc  The audio SSRC.
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-void M4Frame::OnNewParameters(const SenderPipeline& rPipeline, const char* pPictureParameters, unsigned int videoSsrc, unsigned int audioSsrc)
+void M4Frame::OnNewParameters(const SenderPipeline& rPipeline, const char* pPictureParameters, const char* pAudioParameters, unsigned int videoSsrc, unsigned int audioSsrc)
 {
-	m_Annunciator.SendParameters(pPictureParameters, videoSsrc, audioSsrc);
+	m_Annunciator.SendParameters(pPictureParameters, pAudioParameters, videoSsrc, audioSsrc);
 }
 
 
@@ -421,11 +805,13 @@ void M4Frame::OnNewParameters(const SenderPipeline& rPipeline, const char* pPict
 ///
 /// @param pictureParameters  The picture parameters string.
 ///
+/// @param audioParameters  The audio parameters string (empty if the sender didn't send any).
+///
 /// @param videoSsrc  The video SSRC.
 ///
 /// @param audioSsrc  The audio SSRC.
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-void M4Frame::OnParameterPacket(const char* address, const char* pictureParameters, unsigned int videoSsrc, unsigned int audioSsrc)
+void M4Frame::OnParameterPacket(const char* address, const char* pictureParameters, const char* audioParameters, unsigned int videoSsrc, unsigned int audioSsrc)
 {
 	// Ignore if I got this from myself.
 	if (std::strcmp(address, m_MyAddress.c_str()) == 0)
@@ -433,37 +819,39 @@ void M4Frame::OnParameterPacket(const char* address, const char* pictureParamete
 		return;
 	}
 	
-	// Ignore if we already have a receiver pipeline
-	if (m_ReceiverPipelinesByVideoSsrc.find(videoSsrc) != m_ReceiverPipelinesByVideoSsrc.end())
-	{
-		return;
-	}
-	
 	// See if this is in our dictionary; ignore if not.
 	size_t index;
-	VideoPanel* pPanel = GetPanelForAddress(address, index);
-	if (pPanel == NULL)
+	if (GetPanelForAddress(address, index) == NULL)
 	{
 		return;
 	}
 	
-	// We might have had a receiver pipeline from a previous SSRC from the same sender. Look
-	// through the pipelines to see if any match the video sink, and if so, delete them.
-	for (std::unordered_map<unsigned int, ReceiverPipeline*>::iterator it = m_ReceiverPipelinesByVideoSsrc.begin(); it != m_ReceiverPipelinesByVideoSsrc.end(); ++it)
+	// The receiver pipeline already receives from this sender, from the in-band picture
+	// parameters; it only needs to know its audio parameters, in case they differ from ours, and
+	// its SSRCs, which tell its streams apart from others coming from the same address.
+	if (m_pReceiverPipeline != NULL)
 	{
-		if (it->second->GetWindowSink() == pPanel->GetMediaPanelHandle())
-		{
-			delete it->second;
-			m_ReceiverPipelinesByVideoSsrc.erase(it);
-			break;
-		}
+		m_pReceiverPipeline->AddAudioParameters(audioParameters);
+		m_pReceiverPipeline->SetParticipantSsrcs(address, videoSsrc, audioSsrc);
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// M4Frame::OnLayerRequest
+///
+/// Called by the annunciator when a participant asks for a particular simulcast video layer.
+///
+/// @param address  The address of the participant making the request.
+///
+/// @param layer  The requested layer; 0 is full resolution.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void M4Frame::OnLayerRequest(const char* address, unsigned int layer)
+{
+	if (m_pSenderPipeline != NULL)
+	{
+		m_pSenderPipeline->SetDestinationLayer(address, layer);
 	}
-	
-	// If we get here, then there is an entry for this sender in the directory, but no receiver
-	// pipeline yet. Create it now.
-	ReceiverPipeline* pPipeline = new ReceiverPipeline(10000 + 4 * index, audioInputName.c_str(), pictureParameters, pPanel->GetMediaPanelHandle());
-	m_ReceiverPipelinesByVideoSsrc[videoSsrc] = pPipeline;
-	pPipeline->Play();
 }
 
 
@@ -577,4 +965,31 @@ VideoPanel* M4Frame::GetPanelForAddress(const std::string& address, size_t& rInd
 		}
 	}
 	return NULL;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// M4Frame::GetAddressForPanel
+///
+/// Get the address of the participant shown in a video panel.
+///
+/// @param panelIndex  The index of the video panel (0 is "me").
+///
+/// @return  A NULL-terminated address, or NULL if no participant is shown in the panel.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+const char* M4Frame::GetAddressForPanel(size_t panelIndex)
+{
+	const std::string* myName = GetNameForAddress(m_MyAddress);
+	for (size_t i = 0, j = 1; i < m_ParticipantList.GetCount(); ++i)
+	{
+		if (myName->compare(m_ParticipantList[i]) != 0)
+		{
+			if (j == panelIndex)
+			{
+				return GetAddressForParticipant(m_ParticipantList[i].c_str());
+			}
+			j++;
+		}
+	}
+	return NULL;
 }
\ No newline at end of file
@@ -20,7 +20,6 @@
 #ifndef __M4FRAME_HPP__
 #define __M4FRAME_HPP__
 
-#include <unordered_map>
 #include <vector>
 #include <wx/wx.h>
 
@@ -41,6 +40,7 @@ class M4Frame
 	: public wxFrame
 	, protected SenderPipeline::ISenderParameterNotifySink
 	, protected ConferenceAnnunciator::IParameterPacketListener
+	, protected ConferenceAnnunciator::ILayerRequestListener
 {
 public:
 	/// Constructor.
@@ -57,13 +57,37 @@ public:
   // Handle mouse clicks
   void OnClick(wxMouseEvent& event);
 	
+	
+	/// Called when the self-view ("Me") panel changes size.
+	void OnSelfViewSize(wxSizeEvent& event);
+	
+	
+	/// Called on a click in the composite video panel.
+	void OnCompositeClick(wxMouseEvent& event);
+	
+	
+	/// Called when the composite video panel changes size.
+	void OnCompositeSize(wxSizeEvent& event);
+	
+	
+	/// Called when a remote participant's panel changes size.
+	void OnRemoteViewSize(wxSizeEvent& event);
+	
+	
+	/// Called when the frame is iconized or restored.
+	void OnIconize(wxIconizeEvent& event);
+	
 protected:
 	/// Called by the sender pipeline when the sender-side parameters are available.
-	virtual void OnNewParameters(const SenderPipeline& rPipeline, const char* pPictureParameters, unsigned int videoSsrc, unsigned int audioSsrc);
+	virtual void OnNewParameters(const SenderPipeline& rPipeline, const char* pPictureParameters, const char* pAudioParameters, unsigned int videoSsrc, unsigned int audioSsrc);
 	
 	
 	/// Called by the conference annunciator when a parameter packet arrives.
-	virtual void OnParameterPacket(const char* address, const char* pictureParameters, unsigned int videoSsrc, unsigned int audioSsrc);
+	virtual void OnParameterPacket(const char* address, const char* pictureParameters, const char* audioParameters, unsigned int videoSsrc, unsigned int audioSsrc);
+	
+	
+	/// Called by the conference annunciator when a participant asks for a video layer.
+	virtual void OnLayerRequest(const char* address, unsigned int layer);
 	
 	
 private:
@@ -75,6 +99,31 @@ private:
 	static const size_t VIDEO_BITRATE;
 	
 	
+	/// Number of simulcast video layers we send
+	static const size_t SIMULCAST_LAYERS;
+	
+	
+	/// The simulcast layer we ask for when no panel is maximized
+	static const unsigned int GRID_VIDEO_LAYER;
+	
+	
+	/// The audio encoding we send; receivers learn it through the annunciator
+	static const SenderPipeline::AudioSettings AUDIO_SETTINGS;
+	
+	
+	/// The frame rate of the self-view
+	static const int SELF_VIEW_FRAME_RATE;
+	
+	
+	/// The port base every participant receives all the others' streams on
+	static const uint16_t RECEIVE_PORT_BASE;
+	
+	
+	/// Whether the remote participants' video is composited onto one panel, rather than shown in
+	/// a panel each
+	static const bool COMPOSITE_VIDEO;
+	
+	
 	/// Load the directory of available participants.
 	void LoadDirectory();
 	
@@ -91,6 +140,30 @@ private:
 	VideoPanel* GetPanelForAddress(const std::string& address, size_t& rIndexOut);
 	
 	
+	/// Get the participant address for a video panel index.
+	const char* GetAddressForPanel(size_t panelIndex);
+	
+	
+	/// Ask each participant for the video layer that suits its panel.
+	void RequestVideoLayers();
+	
+	
+	/// Scale the self-view to its panel.
+	void UpdateSelfView();
+	
+	
+	/// Lay the remote participants' video out on the composite video panel.
+	void UpdateCompositeLayout();
+	
+	
+	/// Tell the receiver how much of each remote participant's video is seen, and how large.
+	void UpdateVisibility();
+	
+	
+	/// Get one cell of a grid of count 16:9 cells in two rows (one for a single cell) in an area.
+	static wxRect GridCell(const wxRect& area, size_t index, size_t count);
+	
+	
 	/// A name and address entry in the directory.
 	struct DirectoryEntry
 	{
@@ -116,8 +189,8 @@ private:
 	std::string m_MyAddress;
 	
 	
-	/// A hash of receiver pipelines by video SSRC
-	std::unordered_map<unsigned int, ReceiverPipeline*> m_ReceiverPipelinesByVideoSsrc;
+	/// The receiver pipeline, receiving from all participants
+	ReceiverPipeline* m_pReceiverPipeline;
 	
 	
 	/// The name of the chosen video input
@@ -142,6 +215,15 @@ private:
 	
 	/// The sender pipeline. Not created until the GUI's main thread is started up.
 	SenderPipeline* m_pSenderPipeline;
+	
+	
+	/// The panel the remote video is composited onto, in place of their own panels; NULL unless
+	/// COMPOSITE_VIDEO
+	VideoPanel* m_pCompositePanel;
+	
+	
+	/// The rectangle of each video panel's participant on the composite video, in pixels
+	wxRect m_CompositeRects[6];
   
   /// The View, which consists of
   // 3 sizers for M4Frame,
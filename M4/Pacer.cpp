@@ -0,0 +1,342 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// @file Pacer.cpp
+///
+/// Copyright (c) 2015, BoxCast, Inc. All rights reserved.
+///
+/// This library is free software; you can redistribute it and/or modify it under the terms of the
+/// GNU Lesser General Public License as published by the Free Software Foundation; either version
+/// 3.0 of the License, or (at your option) any later version.
+///
+/// This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+/// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See
+/// the GNULesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License along with this
+/// library; if not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+/// Boston, MA 02110-1301 USA
+///
+/// @brief This file defines the functions of the Pacer class.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+
+#include "Pacer.hpp"
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Constructor.
+///
+/// Start the pacer's thread, which sleeps until there is something to pace.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+Pacer::Pacer()
+	: m_Mutex()
+	, m_Cond()
+	, m_SentCond()
+	, m_Flows()
+	, m_Taken()
+	, m_TakenBatches()
+	, m_Batch()
+	, m_Stop(false)
+	, m_Thread()
+{
+	assert(pthread_mutex_init(&m_Mutex, NULL) == 0);
+	assert(pthread_cond_init(&m_Cond, NULL) == 0);
+	assert(pthread_cond_init(&m_SentCond, NULL) == 0);
+	assert(pthread_create(&m_Thread, NULL, StaticThreadFn, this) == 0);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Destructor.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+Pacer::~Pacer()
+{
+	pthread_mutex_lock(&m_Mutex);
+	assert(m_Flows.empty());
+	m_Stop = true;
+	pthread_cond_signal(&m_Cond);
+	pthread_mutex_unlock(&m_Mutex);
+	pthread_join(m_Thread, NULL);
+
+	pthread_cond_destroy(&m_SentCond);
+	pthread_cond_destroy(&m_Cond);
+	pthread_mutex_destroy(&m_Mutex);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Pacer::AddFlow()
+///
+/// Add a flow. It starts out without priority and unpaced.
+///
+/// @param pFanout  The UdpFanout the flow's packets are sent through.
+///
+/// @return The flow, to be removed with RemoveFlow().
+///////////////////////////////////////////////////////////////////////////////////////////////////
+Pacer::Flow* Pacer::AddFlow(UdpFanout* pFanout)
+{
+	Flow* pFlow = new Flow();
+	pFlow->pFanout = pFanout;
+	pFlow->priority = false;
+	pFlow->bitsPerSecond = 0;
+	pFlow->budgetBytes = 0.0;
+	pFlow->lastUs = NowUs();
+	pFlow->queuedBytes = 0;
+	pFlow->maxQueuedPackets = 0;
+	pFlow->sentPackets = 0;
+	pFlow->sending = false;
+
+	pthread_mutex_lock(&m_Mutex);
+	m_Flows.push_back(pFlow);
+	pthread_mutex_unlock(&m_Mutex);
+	return pFlow;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Pacer::RemoveFlow()
+///
+/// Remove a flow. If the pacer's thread is sending packets it took from the flow, wait for it to
+/// finish, so that once this returns the flow's UdpFanout is no longer used.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void Pacer::RemoveFlow(Flow* pFlow)
+{
+	pthread_mutex_lock(&m_Mutex);
+	m_Flows.erase(std::remove(m_Flows.begin(), m_Flows.end(), pFlow), m_Flows.end());
+	while (pFlow->sending)
+	{
+		pthread_cond_wait(&m_SentCond, &m_Mutex);
+	}
+	pthread_mutex_unlock(&m_Mutex);
+	delete pFlow;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Pacer::SetPriority()
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void Pacer::SetPriority(Flow* pFlow, bool priority)
+{
+	pthread_mutex_lock(&m_Mutex);
+	pFlow->priority = priority;
+	pthread_mutex_unlock(&m_Mutex);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Pacer::SetRate()
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void Pacer::SetRate(Flow* pFlow, uint64_t bitsPerSecond)
+{
+	pthread_mutex_lock(&m_Mutex);
+	pFlow->bitsPerSecond = bitsPerSecond;
+	pthread_mutex_unlock(&m_Mutex);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Pacer::Send()
+///
+/// Send a batch of packets on a flow. Packets of a priority or unpaced flow go out right away
+/// (unless older packets of the flow are still queued, or being sent by the pacer's thread, which
+/// keeps them in order); those of a paced flow are copied into its queue for the pacer's thread.
+///
+/// @param pFlow  The flow.
+///
+/// @param pPackets  The packets, in order.
+///
+/// @param numPackets  The number of packets.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void Pacer::Send(Flow* pFlow, const UdpFanout::Packet* pPackets, size_t numPackets)
+{
+	pthread_mutex_lock(&m_Mutex);
+	if ((pFlow->priority || (pFlow->bitsPerSecond == 0)) && pFlow->queue.empty() && !pFlow->sending)
+	{
+		pFlow->sentPackets += numPackets;
+		pthread_mutex_unlock(&m_Mutex);
+		pFlow->pFanout->Send(pPackets, numPackets);
+		return;
+	}
+
+	int64_t now = NowUs();
+	for (size_t i = 0; i < numPackets; ++i)
+	{
+		const char* pData = reinterpret_cast<const char*>(pPackets[i].pData);
+		pFlow->queue.push_back(QueuedPacket());
+		pFlow->queue.back().data.assign(pData, pData + pPackets[i].length);
+		pFlow->queue.back().enqueuedUs = now;
+		pFlow->queuedBytes += pPackets[i].length;
+	}
+	pFlow->maxQueuedPackets = std::max(pFlow->maxQueuedPackets, pFlow->queue.size());
+	pthread_cond_signal(&m_Cond);
+	pthread_mutex_unlock(&m_Mutex);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Pacer::GetStats()
+///
+/// Get a flow's queue statistics. The queue delay is how long the oldest queued packet has
+/// waited so far.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+Pacer::Stats Pacer::GetStats(const Flow* pFlow) const
+{
+	Stats stats;
+	pthread_mutex_lock(&m_Mutex);
+	stats.queuedPackets = pFlow->queue.size();
+	stats.queuedBytes = pFlow->queuedBytes;
+	stats.maxQueuedPackets = pFlow->maxQueuedPackets;
+	stats.queueDelayUs = pFlow->queue.empty() ? 0 : static_cast<uint64_t>(NowUs() - pFlow->queue.front().enqueuedUs);
+	stats.sentPackets = pFlow->sentPackets;
+	pthread_mutex_unlock(&m_Mutex);
+	return stats;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Pacer::NowUs()
+///////////////////////////////////////////////////////////////////////////////////////////////////
+int64_t Pacer::NowUs()
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (static_cast<int64_t>(ts.tv_sec) * 1000000) + (ts.tv_nsec / 1000);
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (static_cast<int64_t>(tv.tv_sec) * 1000000) + tv.tv_usec;
+#endif
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Pacer::ThreadFn()
+///
+/// Every PACING_INTERVAL_US while anything is queued, send what is due; otherwise sleep until
+/// something is. The due packets are taken out of the queues under m_Mutex and sent without it,
+/// so that Send() on a priority flow never waits for a paced flow's batch to go out.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void Pacer::ThreadFn()
+{
+	pthread_mutex_lock(&m_Mutex);
+	while (!m_Stop)
+	{
+		int64_t now = NowUs();
+		bool pending = false;
+		m_Taken.clear();
+		m_TakenBatches.clear();
+		for (std::vector<Flow*>::iterator it = m_Flows.begin(); it != m_Flows.end(); ++it)
+		{
+			pending = TakeDue(*it, now) || pending;
+		}
+
+		if (!m_TakenBatches.empty())
+		{
+			pthread_mutex_unlock(&m_Mutex);
+			SendTaken();
+			pthread_mutex_lock(&m_Mutex);
+			for (std::vector<TakenBatch>::iterator it = m_TakenBatches.begin(); it != m_TakenBatches.end(); ++it)
+			{
+				it->pFlow->sending = false;
+			}
+			pthread_cond_broadcast(&m_SentCond);
+			
+			// Packets may have been queued meanwhile, without waking us; look again
+			if (!pending)
+			{
+				continue;
+			}
+		}
+
+		if (pending)
+		{
+			pthread_mutex_unlock(&m_Mutex);
+			usleep(PACING_INTERVAL_US);
+			pthread_mutex_lock(&m_Mutex);
+		}
+		else
+		{
+			pthread_cond_wait(&m_Cond, &m_Mutex);
+		}
+	}
+	pthread_mutex_unlock(&m_Mutex);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Pacer::TakeDue()
+///
+/// Take the queued packets of a flow that are due out of its queue, as one batch for
+/// SendTaken(); the flow is marked as sending until they are sent. The flow earns its rate's worth
+/// of bytes as time passes, up to one interval's worth, and may overspend by one packet; packets
+/// that have waited MAX_QUEUE_DELAY_US are due anyway, as is everything once the flow is no longer
+/// paced. Called with m_Mutex held.
+///
+/// @param pFlow  The flow.
+///
+/// @param nowUs  The current time.
+///
+/// @return true if packets are still queued.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool Pacer::TakeDue(Flow* pFlow, int64_t nowUs)
+{
+	double bytesPerUs = pFlow->bitsPerSecond / 8e6;
+	pFlow->budgetBytes = std::min(pFlow->budgetBytes + (bytesPerUs * (nowUs - pFlow->lastUs)), bytesPerUs * PACING_INTERVAL_US);
+	pFlow->lastUs = nowUs;
+	if (pFlow->queue.empty())
+	{
+		return false;
+	}
+
+	bool paced = !pFlow->priority && (pFlow->bitsPerSecond > 0);
+	TakenBatch batch = { pFlow, m_Taken.size(), 0 };
+	while (!pFlow->queue.empty())
+	{
+		QueuedPacket& rPacket = pFlow->queue.front();
+		if (paced && (pFlow->budgetBytes <= 0.0) && ((nowUs - rPacket.enqueuedUs) < MAX_QUEUE_DELAY_US))
+		{
+			break;
+		}
+		pFlow->budgetBytes -= rPacket.data.size();
+		pFlow->queuedBytes -= rPacket.data.size();
+		m_Taken.push_back(QueuedPacket());
+		m_Taken.back().data.swap(rPacket.data);
+		pFlow->queue.pop_front();
+		++batch.count;
+	}
+
+	if (batch.count > 0)
+	{
+		pFlow->sentPackets += batch.count;
+		pFlow->sending = true;
+		m_TakenBatches.push_back(batch);
+	}
+	return !pFlow->queue.empty();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Pacer::SendTaken()
+///
+/// Send the batches TakeDue() took, each through its flow's UdpFanout. The flows can't be removed
+/// meanwhile, as they are marked as sending.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void Pacer::SendTaken()
+{
+	for (std::vector<TakenBatch>::const_iterator it = m_TakenBatches.begin(); it != m_TakenBatches.end(); ++it)
+	{
+		m_Batch.clear();
+		for (size_t i = it->first; i < (it->first + it->count); ++i)
+		{
+			UdpFanout::Packet packet = { &m_Taken[i].data[0], m_Taken[i].data.size() };
+			m_Batch.push_back(packet);
+		}
+		it->pFlow->pFanout->Send(&m_Batch[0], m_Batch.size());
+	}
+}
@@ -0,0 +1,196 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// @file Pacer.hpp
+///
+/// Copyright (c) 2015, BoxCast, Inc. All rights reserved.
+///
+/// This library is free software; you can redistribute it and/or modify it under the terms of the
+/// GNU Lesser General Public License as published by the Free Software Foundation; either version
+/// 3.0 of the License, or (at your option) any later version.
+///
+/// This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+/// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See
+/// the GNULesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License along with this
+/// library; if not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+/// Boston, MA 02110-1301 USA
+///
+/// @brief This file declares the Pacer class, which spreads bursts of outgoing UDP packets out
+/// over time.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#ifndef __PACER_HPP__
+#define __PACER_HPP__
+
+#include <pthread.h>     // for pthread_t, pthread_mutex_t, pthread_cond_t
+#include <stdint.h>      // for uint64_t, int64_t
+#include <cstddef>       // for size_t
+#include <deque>         // for std::deque
+#include <vector>        // for std::vector
+#include "UdpFanout.hpp" // for UdpFanout
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// This class paces the packets of a number of flows, each sent through its own UdpFanout.
+///
+/// A paced flow's packets are copied into its queue and sent by the pacer's thread at (at most)
+/// the flow's rate, a few at a time every PACING_INTERVAL_US, so that a key frame goes out over a
+/// few frame intervals instead of in one burst. Packets that have waited MAX_QUEUE_DELAY_US go out
+/// regardless of the rate, so a rate set too low can't build up an ever-growing queue. The thread
+/// takes the due packets out of the queues under the lock, and sends them after releasing it.
+///
+/// Priority flows (audio) are never queued: their packets are sent right away, on the caller's
+/// thread, whatever is waiting in the paced flows. A flow with no rate set is not paced either.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class Pacer
+{
+public:
+	/// A flow of packets; opaque outside the pacer.
+	struct Flow;
+
+
+	/// Queue statistics of a flow.
+	struct Stats
+	{
+		size_t queuedPackets;
+		size_t queuedBytes;
+		size_t maxQueuedPackets;
+		uint64_t queueDelayUs;
+		uint64_t sentPackets;
+	};
+
+
+	/// Constructor; starts the pacer's thread.
+	Pacer();
+
+
+	/// Destructor; stops the pacer's thread. All flows must have been removed.
+	~Pacer();
+
+
+	/// Add a flow sending through a UdpFanout, which must outlive the flow.
+	Flow* AddFlow(UdpFanout* pFanout);
+
+
+	/// Remove a flow, dropping anything still queued.
+	void RemoveFlow(Flow* pFlow);
+
+
+	/// Set whether a flow has priority (is never queued).
+	void SetPriority(Flow* pFlow, bool priority);
+
+
+	/// Set a flow's pacing rate in bits/sec; 0 doesn't pace it.
+	void SetRate(Flow* pFlow, uint64_t bitsPerSecond);
+
+
+	/// Send a batch of packets on a flow, now or paced.
+	void Send(Flow* pFlow, const UdpFanout::Packet* pPackets, size_t numPackets);
+
+
+	/// Get a flow's queue statistics.
+	Stats GetStats(const Flow* pFlow) const;
+
+
+private:
+	/// How often the pacer's thread sends the packets that are due, in microseconds.
+	static const int64_t PACING_INTERVAL_US = 5000;
+
+
+	/// The longest a packet waits in a queue, in microseconds.
+	static const int64_t MAX_QUEUE_DELAY_US = 100000;
+
+
+	/// One queued packet
+	struct QueuedPacket
+	{
+		std::vector<char> data;
+		int64_t enqueuedUs;
+	};
+
+
+	/// The due packets taken from one flow's queue: a range of m_Taken
+	struct TakenBatch
+	{
+		Flow* pFlow;
+		size_t first;
+		size_t count;
+	};
+
+
+	/// Monotonic time, in microseconds.
+	static int64_t NowUs();
+
+
+	/// (Static) pacer thread function
+	static void* StaticThreadFn(void* pArg)
+	{
+		reinterpret_cast<Pacer*>(pArg)->ThreadFn();
+		return NULL;
+	}
+
+
+	/// (Instance) pacer thread function
+	void ThreadFn();
+
+
+	/// Take the packets of a flow that are due out of its queue. Called with m_Mutex held.
+	bool TakeDue(Flow* pFlow, int64_t nowUs);
+
+
+	/// Send the packets taken by TakeDue(). Called without m_Mutex held.
+	void SendTaken();
+
+
+	/// Protects the flows and their queues
+	mutable pthread_mutex_t m_Mutex;
+
+
+	/// Signalled when packets are queued, or the thread is to stop
+	pthread_cond_t m_Cond;
+
+
+	/// Signalled when the pacer's thread has sent the packets it took
+	pthread_cond_t m_SentCond;
+
+
+	/// The flows
+	std::vector<Flow*> m_Flows;
+
+
+	/// The due packets the pacer's thread took out of the queues, and their flows' batches; only
+	/// used by that thread, and kept to avoid allocating per round
+	std::vector<QueuedPacket> m_Taken;
+	std::vector<TakenBatch> m_TakenBatches;
+
+
+	/// Scratch space for a flow's due packets, kept to avoid allocating per batch
+	std::vector<UdpFanout::Packet> m_Batch;
+
+
+	/// Tells the thread to stop
+	bool m_Stop;
+
+
+	/// The pacer's thread
+	pthread_t m_Thread;
+}; // END class Pacer
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// A flow's state.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+struct Pacer::Flow
+{
+	UdpFanout* pFanout;
+	bool priority;
+	uint64_t bitsPerSecond;
+	double budgetBytes;
+	int64_t lastUs;
+	std::deque<QueuedPacket> queue;
+	size_t queuedBytes;
+	size_t maxQueuedPackets;
+	uint64_t sentPackets;
+	bool sending;
+};
+
+#endif // __PACER_HPP__
@@ -58,12 +58,14 @@ void PipelineBase::SendEOS()
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 /// PipelineBase::AddBusWatch()
 ///
-/// Adds a bus message watch handler.
+/// Adds a bus message watch handler. Returns the watch's event source ID, which can be passed to
+/// g_source_remove() to remove the watch again (e.g. before data is freed).
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-void PipelineBase::AddBusWatch(BusMessageFunction fnBusMessage, void* data)
+guint PipelineBase::AddBusWatch(BusMessageFunction fnBusMessage, void* data)
 {
 	GstBus* pBus = gst_pipeline_get_bus(GST_PIPELINE(m_pPipeline));
 	assert(pBus != NULL);
-	gst_bus_add_watch(pBus, fnBusMessage, data);
+	guint id = gst_bus_add_watch(pBus, fnBusMessage, data);
 	gst_object_unref(pBus);
+	return id;
 }
\ No newline at end of file
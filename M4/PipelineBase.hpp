@@ -65,7 +65,7 @@ public:
 
 	
 	/// Make the pipeline play
-	void Play();
+	virtual void Play();
 	
 	
 	/// Send an end-of-stream event to the pipeline.
@@ -77,7 +77,7 @@ public:
 	
 	
 	/// Add a bus message handler
-	void AddBusWatch(BusMessageFunction fnBusMessage, void* data = NULL);
+	guint AddBusWatch(BusMessageFunction fnBusMessage, void* data = NULL);
 
 
 protected:
@@ -0,0 +1,377 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// @file PlayoutBuffer.cpp
+///
+/// Copyright (c) 2015, BoxCast, Inc. All rights reserved.
+///
+/// This library is free software; you can redistribute it and/or modify it under the terms of the
+/// GNU Lesser General Public License as published by the Free Software Foundation; either version
+/// 3.0 of the License, or (at your option) any later version.
+///
+/// This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+/// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See
+/// the GNULesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License along with this
+/// library; if not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+/// Boston, MA 02110-1301 USA
+///
+///
+/// @brief This file defines the functions of the PlayoutBuffer class.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>         // for std::min, std::max, std::copy
+#include <cmath>             // for std::sqrt
+#include "PlayoutBuffer.hpp" // for class declaration
+
+
+const double PlayoutBuffer::MIN_CORRELATION = 0.6;
+
+const double PlayoutBuffer::SILENCE_ENERGY = 100.0 * 100.0;
+
+const double PlayoutBuffer::TARGET_PERCENTILE = 0.95;
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// PlayoutBuffer::PlayoutBuffer()
+///
+/// Constructor.
+///
+/// @param rate  The sample rate.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+PlayoutBuffer::PlayoutBuffer(unsigned int rate)
+	: m_Rate(rate)
+	, m_MinPeriod((static_cast<uint64_t>(rate) * MIN_PERIOD_US) / 1000000)
+	, m_MaxPeriod((static_cast<uint64_t>(rate) * MAX_PERIOD_US) / 1000000)
+	, m_Fifo()
+	, m_History()
+	, m_Scratch()
+	, m_Estimator(rate)
+	, m_TargetMs(INITIAL_TARGET_MS)
+	, m_LastRetargetUs(0)
+	, m_WindowMinLevel(0)
+	, m_WindowSamples(0)
+	, m_Concealing(false)
+	, m_ConcealPeriod(0)
+	, m_ConcealPosition(0)
+	, m_ConcealGain(0.0)
+	, m_AcceleratedSamples(0)
+	, m_ExpandedSamples(0)
+	, m_ConcealedSamples(0)
+	, m_Underruns(0)
+{
+	m_History.reserve(2 * m_MaxPeriod);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// PlayoutBuffer::Push()
+///
+/// Add arriving audio, and let its arrival time move the target. Should the buffer grow past
+/// MAX_LEVEL_MS (the device stopped pulling for a while), the oldest audio is dropped to catch up.
+///
+/// @param pSamples  The samples.
+///
+/// @param count  The number of samples.
+///
+/// @param timestamp  The media time of the first sample, in samples.
+///
+/// @param nowUs  The (monotonic) arrival time, in microseconds.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void PlayoutBuffer::Push(const int16_t* pSamples, size_t count, uint32_t timestamp, int64_t nowUs)
+{
+	if (count == 0)
+	{
+		return;
+	}
+	
+	m_Estimator.OnPacket(nowUs, timestamp);
+	if ((nowUs - m_LastRetargetUs) >= RETARGET_INTERVAL_US)
+	{
+		m_LastRetargetUs = nowUs;
+		m_TargetMs = m_Estimator.Retarget(m_TargetMs, TARGET_PERCENTILE);
+	}
+	
+	m_Fifo.insert(m_Fifo.end(), pSamples, pSamples + count);
+	size_t maxLevel = (static_cast<size_t>(MAX_LEVEL_MS) * m_Rate) / 1000;
+	if (m_Fifo.size() > maxLevel)
+	{
+		size_t target = (static_cast<size_t>(m_TargetMs) * m_Rate) / 1000;
+		m_Fifo.erase(m_Fifo.begin(), m_Fifo.begin() + (m_Fifo.size() - target));
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// PlayoutBuffer::Pull()
+///
+/// Take audio to play out. At the end of each LEVEL_WINDOW_MS, if the buffer's lowest level in it
+/// was above the target plus HYSTERESIS_MS, a pitch period is cut; if below the target, one is
+/// repeated (or at the next pull, if the audio isn't periodic now). Whatever the buffer can't
+/// supply is concealed.
+///
+/// @param pOut  Receives the samples.
+///
+/// @param count  The number of samples.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void PlayoutBuffer::Pull(int16_t* pOut, size_t count)
+{
+	size_t target = (static_cast<size_t>(m_TargetMs) * m_Rate) / 1000;
+	size_t hysteresis = (static_cast<size_t>(HYSTERESIS_MS) * m_Rate) / 1000;
+	m_WindowMinLevel = (m_WindowSamples == 0) ? m_Fifo.size() : std::min(m_WindowMinLevel, m_Fifo.size());
+	m_WindowSamples += count;
+	if ((m_WindowSamples >= ((static_cast<size_t>(LEVEL_WINDOW_MS) * m_Rate) / 1000)) && !m_Concealing && (m_History.size() == (2 * m_MaxPeriod)))
+	{
+		bool done = true;
+		if (m_WindowMinLevel > (target + hysteresis))
+		{
+			done = Accelerate();
+		}
+		else if (m_WindowMinLevel < target)
+		{
+			done = Expand();
+		}
+		if (done)
+		{
+			m_WindowSamples = 0;
+		}
+	}
+	
+	size_t n = std::min(count, m_Fifo.size());
+	std::copy(m_Fifo.begin(), m_Fifo.begin() + n, pOut);
+	m_Fifo.erase(m_Fifo.begin(), m_Fifo.begin() + n);
+	
+	// Fade in from where the concealment would have gone
+	if ((n > 0) && m_Concealing)
+	{
+		size_t fade = std::min(n, static_cast<size_t>((static_cast<uint64_t>(m_Rate) * FADE_IN_US) / 1000000));
+		m_Scratch.resize(fade);
+		Conceal(&m_Scratch[0], fade);
+		for (size_t i = 0; i < fade; ++i)
+		{
+			double w = static_cast<double>(i) / fade;
+			pOut[i] = static_cast<int16_t>((m_Scratch[i] * (1.0 - w)) + (pOut[i] * w));
+		}
+		m_Concealing = false;
+	}
+	AddHistory(pOut, n);
+	
+	if (n < count)
+	{
+		if (!m_Concealing)
+		{
+			bool periodic = false;
+			m_Concealing = true;
+			m_ConcealPeriod = (m_History.size() == (2 * m_MaxPeriod)) ? FindPeriod(&m_History[m_MaxPeriod], m_MaxPeriod, periodic) : 0;
+			m_ConcealPosition = 0;
+			m_ConcealGain = 1.0;
+			++m_Underruns;
+		}
+		Conceal(pOut + n, count - n);
+		m_ConcealedSamples += count - n;
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// PlayoutBuffer::GetStats()
+///////////////////////////////////////////////////////////////////////////////////////////////////
+PlayoutBuffer::Stats PlayoutBuffer::GetStats() const
+{
+	Stats stats;
+	stats.levelMs = static_cast<unsigned int>((static_cast<uint64_t>(m_Fifo.size()) * 1000) / m_Rate);
+	stats.targetMs = m_TargetMs;
+	stats.jitterMs = m_Estimator.GetJitterUs() / 1000.0;
+	stats.acceleratedMs = (m_AcceleratedSamples * 1000) / m_Rate;
+	stats.expandedMs = (m_ExpandedSamples * 1000) / m_Rate;
+	stats.concealedMs = (m_ConcealedSamples * 1000) / m_Rate;
+	stats.underruns = m_Underruns;
+	return stats;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// PlayoutBuffer::Correlation()
+///
+/// @return The normalized correlation of two runs of samples (1.0 if either is all zero).
+///////////////////////////////////////////////////////////////////////////////////////////////////
+double PlayoutBuffer::Correlation(const int16_t* pA, const int16_t* pB, size_t length, size_t step)
+{
+	double ab = 0.0;
+	double aa = 0.0;
+	double bb = 0.0;
+	for (size_t i = 0; i < length; i += step)
+	{
+		ab += static_cast<double>(pA[i]) * pB[i];
+		aa += static_cast<double>(pA[i]) * pA[i];
+		bb += static_cast<double>(pB[i]) * pB[i];
+	}
+	return ((aa == 0.0) || (bb == 0.0)) ? 1.0 : (ab / std::sqrt(aa * bb));
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// PlayoutBuffer::FindPeriod()
+///
+/// Find the pitch period P for which the P samples before a point best match the P samples from
+/// it: first at about SEARCH_RATE, then at full resolution around the best match.
+///
+/// @param pBoundary  The point; maxPeriod samples before and after it are looked at.
+///
+/// @param maxPeriod  The longest period to look for.
+///
+/// @param periodic  Set true if the match is close enough to cut or repeat the period, or the
+/// audio is silence.
+///
+/// @return The period, in samples; 0 if maxPeriod is below the shortest period looked for.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+size_t PlayoutBuffer::FindPeriod(const int16_t* pBoundary, size_t maxPeriod, bool& periodic) const
+{
+	periodic = false;
+	if (maxPeriod < m_MinPeriod)
+	{
+		return 0;
+	}
+	
+	size_t step = std::max(1u, m_Rate / SEARCH_RATE);
+	size_t best = m_MinPeriod;
+	double bestCorrelation = -2.0;
+	for (size_t period = m_MinPeriod; period <= maxPeriod; period += step)
+	{
+		double correlation = Correlation(pBoundary - period, pBoundary, period, step);
+		if (correlation > bestCorrelation)
+		{
+			bestCorrelation = correlation;
+			best = period;
+		}
+	}
+	
+	size_t first = std::max(m_MinPeriod, best - std::min(best, step - 1));
+	size_t last = std::min(maxPeriod, best + step - 1);
+	for (size_t period = first; period <= last; ++period)
+	{
+		double correlation = Correlation(pBoundary - period, pBoundary, period, 1);
+		if ((period == first) || (correlation > bestCorrelation))
+		{
+			bestCorrelation = correlation;
+			best = period;
+		}
+	}
+	
+	double energy = 0.0;
+	for (const int16_t* p = pBoundary - best; p < (pBoundary + best); ++p)
+	{
+		energy += static_cast<double>(*p) * *p;
+	}
+	energy /= 2 * best;
+	periodic = (bestCorrelation >= MIN_CORRELATION) || (energy < SILENCE_ENERGY);
+	return best;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// PlayoutBuffer::Accelerate()
+///
+/// Cut out the first pitch period of the buffered audio, if it repeats the last one played: the
+/// audio after it then follows on from what was played. The cut is smoothed with a crossfade into
+/// the following period.
+///
+/// @return true if a period was cut.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool PlayoutBuffer::Accelerate()
+{
+	size_t maxPeriod = std::min(m_MaxPeriod, m_Fifo.size());
+	m_Scratch.assign(m_History.end() - m_MaxPeriod, m_History.end());
+	m_Scratch.insert(m_Scratch.end(), m_Fifo.begin(), m_Fifo.begin() + maxPeriod);
+	
+	bool periodic = false;
+	size_t period = FindPeriod(&m_Scratch[m_MaxPeriod], maxPeriod, periodic);
+	if ((period == 0) || !periodic)
+	{
+		return false;
+	}
+	
+	size_t fade = std::min(period, m_Fifo.size() - period);
+	for (size_t i = 0; i < fade; ++i)
+	{
+		double w = static_cast<double>(i) / fade;
+		m_Fifo[period + i] = static_cast<int16_t>((m_Fifo[i] * (1.0 - w)) + (m_Fifo[period + i] * w));
+	}
+	m_Fifo.erase(m_Fifo.begin(), m_Fifo.begin() + period);
+	m_AcceleratedSamples += period;
+	return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// PlayoutBuffer::Expand()
+///
+/// Repeat the last pitch period played, if the audio played is periodic: the repetition ends
+/// where the buffered audio follows on. It starts with a crossfade from the buffered audio.
+///
+/// @return true if a period was repeated.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool PlayoutBuffer::Expand()
+{
+	bool periodic = false;
+	size_t period = FindPeriod(&m_History[m_MaxPeriod], m_MaxPeriod, periodic);
+	if ((period == 0) || !periodic)
+	{
+		return false;
+	}
+	
+	m_Scratch.assign(m_History.end() - period, m_History.end());
+	size_t fade = std::min(period, m_Fifo.size());
+	for (size_t i = 0; i < fade; ++i)
+	{
+		double w = static_cast<double>(i) / fade;
+		m_Scratch[i] = static_cast<int16_t>((m_Fifo[i] * (1.0 - w)) + (m_Scratch[i] * w));
+	}
+	m_Fifo.insert(m_Fifo.begin(), m_Scratch.begin(), m_Scratch.end());
+	m_ExpandedSamples += period;
+	return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// PlayoutBuffer::Conceal()
+///
+/// Fill samples by repeating the last pitch period played, fading out over CONCEAL_FADE_MS; then
+/// silence. Without enough audio played yet to find a period, silence.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void PlayoutBuffer::Conceal(int16_t* pOut, size_t count)
+{
+	if (m_ConcealPeriod == 0)
+	{
+		std::fill(pOut, pOut + count, 0);
+		return;
+	}
+	
+	const int16_t* pPeriod = &m_History[m_History.size() - m_ConcealPeriod];
+	double step = 1000.0 / (static_cast<double>(CONCEAL_FADE_MS) * m_Rate);
+	for (size_t i = 0; i < count; ++i)
+	{
+		pOut[i] = static_cast<int16_t>(pPeriod[m_ConcealPosition] * m_ConcealGain);
+		m_ConcealPosition = (m_ConcealPosition + 1) % m_ConcealPeriod;
+		m_ConcealGain = std::max(0.0, m_ConcealGain - step);
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// PlayoutBuffer::AddHistory()
+///
+/// Keep the last 2 * m_MaxPeriod samples played.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void PlayoutBuffer::AddHistory(const int16_t* pSamples, size_t count)
+{
+	size_t size = 2 * m_MaxPeriod;
+	if (count >= size)
+	{
+		m_History.assign(pSamples + (count - size), pSamples + count);
+		return;
+	}
+	
+	size_t excess = ((m_History.size() + count) > size) ? ((m_History.size() + count) - size) : 0;
+	m_History.erase(m_History.begin(), m_History.begin() + excess);
+	m_History.insert(m_History.end(), pSamples, pSamples + count);
+}
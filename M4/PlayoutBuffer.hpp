@@ -0,0 +1,211 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// @file PlayoutBuffer.hpp
+///
+/// Copyright (c) 2015, BoxCast, Inc. All rights reserved.
+///
+/// This library is free software; you can redistribute it and/or modify it under the terms of the
+/// GNU Lesser General Public License as published by the Free Software Foundation; either version
+/// 3.0 of the License, or (at your option) any later version.
+///
+/// This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+/// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See
+/// the GNULesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License along with this
+/// library; if not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+/// Boston, MA 02110-1301 USA
+///
+///
+/// @brief This file declares the PlayoutBuffer class, which plays decoded audio out with as little
+/// buffering as the network allows, stretching it to follow the jitter.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#ifndef __PLAYOUT_BUFFER_HPP__
+#define __PLAYOUT_BUFFER_HPP__
+
+#include <stdint.h>            // for int16_t, int64_t, uint32_t, uint64_t
+#include <cstddef>             // for size_t
+#include <deque>               // for std::deque
+#include <vector>              // for std::vector
+#include "JitterEstimator.hpp" // for JitterEstimator
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// This class buffers one stream's decoded (mono, 16 bit) audio between the decoder, which pushes
+/// it as it arrives, and the audio device, which pulls it at its own pace.
+///
+/// The buffer aims to hold only as much audio as the measured jitter calls for (see
+/// JitterEstimator): its lowest level over LEVEL_WINDOW_MS, just before audio arrives, should be
+/// that target. Above it, playout is accelerated by cutting out one pitch period; below it,
+/// decelerated by repeating one. Speech is close to periodic over a pitch period, so
+/// this changes its pace without changing its pitch; silence is stretched freely. Only one period
+/// is cut or repeated per window, so the pace changes by a few percent at most.
+///
+/// When the buffer runs dry, the last pitch period is repeated, fading out over CONCEAL_FADE_MS,
+/// rather than playing a gap; once audio arrives again, it fades in from the concealment.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class PlayoutBuffer
+{
+public:
+	/// Playout statistics
+	struct Stats
+	{
+		unsigned int levelMs;
+		unsigned int targetMs;
+		double jitterMs;
+		uint64_t acceleratedMs;
+		uint64_t expandedMs;
+		uint64_t concealedMs;
+		unsigned int underruns;
+	};
+
+
+	/// Constructor.
+	explicit PlayoutBuffer(unsigned int rate);
+
+
+	/// The sample rate.
+	inline unsigned int Rate() const { return m_Rate; }
+
+
+	/// Add arriving audio; the timestamp is in samples.
+	void Push(const int16_t* pSamples, size_t count, uint32_t timestamp, int64_t nowUs);
+
+
+	/// Take audio to play out; always fills count samples.
+	void Pull(int16_t* pOut, size_t count);
+
+
+	/// Get the playout statistics.
+	Stats GetStats() const;
+
+
+private:
+	/// The shortest pitch period looked for, in microseconds (400 Hz).
+	static const unsigned int MIN_PERIOD_US = 2500;
+
+
+	/// The longest pitch period looked for, in microseconds (83 Hz).
+	static const unsigned int MAX_PERIOD_US = 12000;
+
+
+	/// The rate the pitch period is first looked for at, before refining, in Hz.
+	static const unsigned int SEARCH_RATE = 8000;
+
+
+	/// How often the target is retargeted, in microseconds.
+	static const int64_t RETARGET_INTERVAL_US = 500000;
+
+
+	/// How far above the target the buffer may go before playout is accelerated, in milliseconds.
+	static const unsigned int HYSTERESIS_MS = 10;
+
+
+	/// The window the buffer's lowest level is taken over, in milliseconds.
+	static const unsigned int LEVEL_WINDOW_MS = 200;
+
+
+	/// Beyond this much audio, the oldest is dropped down to the target, in milliseconds.
+	static const unsigned int MAX_LEVEL_MS = 500;
+
+
+	/// How long a concealment takes to fade out, in milliseconds.
+	static const unsigned int CONCEAL_FADE_MS = 60;
+
+
+	/// How long audio takes to fade in after a concealment, in microseconds.
+	static const unsigned int FADE_IN_US = 2500;
+
+
+	/// How periodic the audio must be for a period to be cut or repeated (normalized correlation).
+	static const double MIN_CORRELATION;
+
+
+	/// Below this mean square, audio counts as silence and is stretched regardless.
+	static const double SILENCE_ENERGY;
+
+
+	/// The fraction of audio that should arrive before its turn to play.
+	static const double TARGET_PERCENTILE;
+
+
+	/// The target before any jitter has been measured, in milliseconds.
+	static const unsigned int INITIAL_TARGET_MS = 20;
+
+
+	/// The normalized correlation of two runs of samples, looking at every step-th one.
+	static double Correlation(const int16_t* pA, const int16_t* pB, size_t length, size_t step);
+
+
+	/// Find the pitch period of the audio around a point.
+	size_t FindPeriod(const int16_t* pBoundary, size_t maxPeriod, bool& periodic) const;
+
+
+	/// Cut one pitch period out of the buffered audio; returns false if it isn't periodic.
+	bool Accelerate();
+
+
+	/// Repeat the last pitch period played; returns false if it isn't periodic.
+	bool Expand();
+
+
+	/// Fill samples by repeating the last pitch period played, fading out.
+	void Conceal(int16_t* pOut, size_t count);
+
+
+	/// Keep the last samples played, for finding the period to repeat.
+	void AddHistory(const int16_t* pSamples, size_t count);
+
+
+	/// The sample rate
+	const unsigned int m_Rate;
+
+
+	/// The pitch period search range, in samples
+	const size_t m_MinPeriod;
+	const size_t m_MaxPeriod;
+
+
+	/// The buffered audio
+	std::deque<int16_t> m_Fifo;
+
+
+	/// The last 2 * m_MaxPeriod samples played (real audio, not concealment)
+	std::vector<int16_t> m_History;
+
+
+	/// Scratch space for the samples around the playout point
+	std::vector<int16_t> m_Scratch;
+
+
+	/// Measures the arrival jitter and picks the target
+	JitterEstimator m_Estimator;
+
+
+	/// The buffer level aimed for, in milliseconds
+	unsigned int m_TargetMs;
+
+
+	/// When the target was last retargeted
+	int64_t m_LastRetargetUs;
+
+
+	/// The lowest buffer level in the current window, and the samples pulled in it
+	size_t m_WindowMinLevel;
+	size_t m_WindowSamples;
+
+
+	/// Whether the last pull ran dry, and the period and position and gain of the concealment
+	bool m_Concealing;
+	size_t m_ConcealPeriod;
+	size_t m_ConcealPosition;
+	double m_ConcealGain;
+
+
+	/// Statistics, in samples
+	uint64_t m_AcceleratedSamples;
+	uint64_t m_ExpandedSamples;
+	uint64_t m_ConcealedSamples;
+	unsigned int m_Underruns;
+}; // END class PlayoutBuffer
+
+#endif // __PLAYOUT_BUFFER_HPP__
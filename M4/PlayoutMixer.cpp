@@ -0,0 +1,388 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// @file PlayoutMixer.cpp
+///
+/// Copyright (c) 2015, BoxCast, Inc. All rights reserved.
+///
+/// This library is free software; you can redistribute it and/or modify it under the terms of the
+/// GNU Lesser General Public License as published by the Free Software Foundation; either version
+/// 3.0 of the License, or (at your option) any later version.
+///
+/// This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+/// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See
+/// the GNULesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License along with this
+/// library; if not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+/// Boston, MA 02110-1301 USA
+///
+/// @brief This file defines the functions of the PlayoutMixer class.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>        // for std::min, std::max
+#include <cstring>          // for std::memset
+#include "PlayoutMixer.hpp" // for class declaration
+
+
+/// The caps of the inputs and of the mix (RATE Hz mono)
+#define PLAYOUT_MIXER_CAPS "audio/x-raw, format=(string)S16LE, layout=(string)interleaved, channels=(int)1, rate=(int)48000"
+
+
+const char PlayoutMixer::ELEMENT_NAME[] = "m4playoutmixer";
+
+gpointer PlayoutMixer::s_pParentClass = NULL;
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// PlayoutMixer::Register()
+///
+/// Register the element with GStreamer so that gst_element_factory_make(ELEMENT_NAME, ...) works.
+///
+/// @return true if the element was registered.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool PlayoutMixer::Register()
+{
+	return gst_element_register(NULL, ELEMENT_NAME, GST_RANK_NONE, GetType()) == TRUE;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// PlayoutMixer::GetType()
+///
+/// Get the element's GType, registering it the first time.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+GType PlayoutMixer::GetType()
+{
+	static gsize type = 0;
+	if (g_once_init_enter(&type))
+	{
+		GType t = g_type_register_static_simple(GST_TYPE_ELEMENT,
+			"M4PlayoutMixer",
+			sizeof(Class),
+			ClassInit,
+			sizeof(Instance),
+			InstanceInit,
+			static_cast<GTypeFlags>(0));
+		g_once_init_leave(&type, t);
+	}
+	return type;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// PlayoutMixer::ClassInit()
+///
+/// Install the virtual functions, properties, pad templates, and metadata.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void PlayoutMixer::ClassInit(gpointer klass, gpointer classData)
+{
+	static GstStaticPadTemplate sinkTemplate = GST_STATIC_PAD_TEMPLATE("sink_%u", GST_PAD_SINK, GST_PAD_REQUEST,
+		GST_STATIC_CAPS(PLAYOUT_MIXER_CAPS));
+	static GstStaticPadTemplate srcTemplate = GST_STATIC_PAD_TEMPLATE("src", GST_PAD_SRC, GST_PAD_ALWAYS,
+		GST_STATIC_CAPS(PLAYOUT_MIXER_CAPS));
+
+	s_pParentClass = g_type_class_peek_parent(klass);
+
+	GObjectClass* pObjectClass = G_OBJECT_CLASS(klass);
+	pObjectClass->get_property = GetProperty;
+	pObjectClass->finalize = Finalize;
+
+	g_object_class_install_property(pObjectClass, PROP_STATS,
+		g_param_spec_boxed("stats", "Statistics", "Playout buffer level, target, jitter, and stretching statistics of each input",
+			GST_TYPE_STRUCTURE, static_cast<GParamFlags>(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+	GstElementClass* pElementClass = GST_ELEMENT_CLASS(klass);
+	pElementClass->request_new_pad = RequestNewPad;
+	pElementClass->release_pad = ReleasePad;
+	gst_element_class_add_pad_template(pElementClass, gst_static_pad_template_get(&sinkTemplate));
+	gst_element_class_add_pad_template(pElementClass, gst_static_pad_template_get(&srcTemplate));
+	gst_element_class_set_static_metadata(pElementClass,
+		"Audio playout mixer",
+		"Generic/Audio",
+		"Buffers each input's decoded audio for playout, time-stretching it to follow the network jitter, and mixes the inputs",
+		"BoxCast");
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// PlayoutMixer::InstanceInit()
+///
+/// Create and add the output pad; the inputs come with their pads.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void PlayoutMixer::InstanceInit(GTypeInstance* pInstance, gpointer klass)
+{
+	Instance* pSelf = reinterpret_cast<Instance*>(pInstance);
+	GstElementClass* pElementClass = GST_ELEMENT_CLASS(klass);
+
+	pSelf->pSrcPad = gst_pad_new_from_template(gst_element_class_get_pad_template(pElementClass, "src"), "src");
+	gst_pad_set_activatemode_function(pSelf->pSrcPad, SrcActivateMode);
+	gst_pad_set_query_function(pSelf->pSrcPad, SrcQuery);
+	gst_element_add_pad(GST_ELEMENT(pSelf), pSelf->pSrcPad);
+
+	g_mutex_init(&pSelf->mutex);
+	pSelf->pInputs = new std::vector<Input>();
+	pSelf->nextPadId = 0;
+	pSelf->started = FALSE;
+	pSelf->samplesOut = 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// PlayoutMixer::Finalize()
+///
+/// Release what the instance created, then chain up. Inputs whose pads were never released go
+/// with the element.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void PlayoutMixer::Finalize(GObject* pObject)
+{
+	Instance* pSelf = reinterpret_cast<Instance*>(pObject);
+	for (std::vector<Input>::iterator it = pSelf->pInputs->begin(); it != pSelf->pInputs->end(); ++it)
+	{
+		delete it->pBuffer;
+	}
+	delete pSelf->pInputs;
+	g_mutex_clear(&pSelf->mutex);
+
+	G_OBJECT_CLASS(s_pParentClass)->finalize(pObject);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// PlayoutMixer::GetProperty()
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void PlayoutMixer::GetProperty(GObject* pObject, guint propId, GValue* pValue, GParamSpec* pSpec)
+{
+	Instance* pSelf = reinterpret_cast<Instance*>(pObject);
+	switch (propId)
+	{
+	case PROP_STATS:
+	{
+		GstStructure* pStats = gst_structure_new_empty("m4playoutmixer-stats");
+		g_mutex_lock(&pSelf->mutex);
+		for (std::vector<Input>::const_iterator it = pSelf->pInputs->begin(); it != pSelf->pInputs->end(); ++it)
+		{
+			PlayoutBuffer::Stats stats = it->pBuffer->GetStats();
+			GstStructure* pInputStats = gst_structure_new("m4playoutmixer-input-stats",
+				"level-ms",       G_TYPE_UINT,   stats.levelMs,
+				"target-ms",      G_TYPE_UINT,   stats.targetMs,
+				"jitter-ms",      G_TYPE_DOUBLE, stats.jitterMs,
+				"accelerated-ms", G_TYPE_UINT64, static_cast<guint64>(stats.acceleratedMs),
+				"expanded-ms",    G_TYPE_UINT64, static_cast<guint64>(stats.expandedMs),
+				"concealed-ms",   G_TYPE_UINT64, static_cast<guint64>(stats.concealedMs),
+				"underruns",      G_TYPE_UINT,   stats.underruns,
+				NULL);
+			gst_structure_set(pStats, GST_PAD_NAME(it->pPad), GST_TYPE_STRUCTURE, pInputStats, NULL);
+			gst_structure_free(pInputStats);
+		}
+		g_mutex_unlock(&pSelf->mutex);
+		g_value_take_boxed(pValue, pStats);
+		break;
+	}
+
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID(pObject, propId, pSpec);
+		break;
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// PlayoutMixer::RequestNewPad()
+///
+/// Add an input, with its pad and its PlayoutBuffer.
+///
+/// @return The input's pad.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+GstPad* PlayoutMixer::RequestNewPad(GstElement* pElement, GstPadTemplate* pTemplate, const gchar* pName, const GstCaps* pCaps)
+{
+	Instance* pSelf = reinterpret_cast<Instance*>(pElement);
+
+	g_mutex_lock(&pSelf->mutex);
+	gchar* pPadName = g_strdup_printf("sink_%u", pSelf->nextPadId++);
+	Input input;
+	input.pPad = gst_pad_new_from_template(pTemplate, pPadName);
+	input.pBuffer = new PlayoutBuffer(RATE);
+	g_free(pPadName);
+	gst_pad_set_chain_function(input.pPad, SinkChain);
+	gst_pad_set_event_function(input.pPad, SinkEvent);
+	pSelf->pInputs->push_back(input);
+	g_mutex_unlock(&pSelf->mutex);
+
+	gst_pad_set_active(input.pPad, TRUE);
+	gst_element_add_pad(pElement, input.pPad);
+	return input.pPad;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// PlayoutMixer::ReleasePad()
+///
+/// Remove an input, dropping whatever audio of it is still buffered.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void PlayoutMixer::ReleasePad(GstElement* pElement, GstPad* pPad)
+{
+	Instance* pSelf = reinterpret_cast<Instance*>(pElement);
+
+	g_mutex_lock(&pSelf->mutex);
+	for (std::vector<Input>::iterator it = pSelf->pInputs->begin(); it != pSelf->pInputs->end(); ++it)
+	{
+		if (it->pPad == pPad)
+		{
+			delete it->pBuffer;
+			pSelf->pInputs->erase(it);
+			break;
+		}
+	}
+	g_mutex_unlock(&pSelf->mutex);
+
+	gst_pad_set_active(pPad, FALSE);
+	gst_element_remove_pad(pElement, pPad);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// PlayoutMixer::SinkChain()
+///
+/// Put an input's decoded audio into its PlayoutBuffer, with its arrival time and media time (in
+/// samples).
+///////////////////////////////////////////////////////////////////////////////////////////////////
+GstFlowReturn PlayoutMixer::SinkChain(GstPad* pPad, GstObject* pParent, GstBuffer* pBuffer)
+{
+	Instance* pSelf = reinterpret_cast<Instance*>(pParent);
+	gint64 now = g_get_monotonic_time();
+
+	GstMapInfo map;
+	if (!gst_buffer_map(pBuffer, &map, GST_MAP_READ))
+	{
+		gst_buffer_unref(pBuffer);
+		return GST_FLOW_ERROR;
+	}
+
+	guint64 timestamp = GST_BUFFER_PTS_IS_VALID(pBuffer) ? gst_util_uint64_scale(GST_BUFFER_PTS(pBuffer), RATE, GST_SECOND) : 0;
+	g_mutex_lock(&pSelf->mutex);
+	for (std::vector<Input>::iterator it = pSelf->pInputs->begin(); it != pSelf->pInputs->end(); ++it)
+	{
+		if (it->pPad == pPad)
+		{
+			it->pBuffer->Push(reinterpret_cast<const int16_t*>(map.data), map.size / sizeof(int16_t), static_cast<uint32_t>(timestamp), now);
+			break;
+		}
+	}
+	g_mutex_unlock(&pSelf->mutex);
+
+	gst_buffer_unmap(pBuffer, &map);
+	gst_buffer_unref(pBuffer);
+	return GST_FLOW_OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// PlayoutMixer::SinkEvent()
+///
+/// The events of the input streams stay here; the thread starts a stream of its own, and the
+/// input caps are fixed (by the pad template).
+///////////////////////////////////////////////////////////////////////////////////////////////////
+gboolean PlayoutMixer::SinkEvent(GstPad* pPad, GstObject* pParent, GstEvent* pEvent)
+{
+	gst_event_unref(pEvent);
+	return TRUE;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// PlayoutMixer::SrcActivateMode()
+///
+/// Start the thread when the output pad is activated, and stop it when it is deactivated. The
+/// pad's sticky events are cleared when it is deactivated, so the thread starts the stream over
+/// (from time 0) the next time.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+gboolean PlayoutMixer::SrcActivateMode(GstPad* pPad, GstObject* pParent, GstPadMode mode, gboolean active)
+{
+	if (mode != GST_PAD_MODE_PUSH)
+	{
+		return FALSE;
+	}
+	if (active)
+	{
+		return gst_pad_start_task(pPad, Loop, pParent, NULL);
+	}
+	
+	gboolean stopped = gst_pad_stop_task(pPad);
+	Instance* pSelf = reinterpret_cast<Instance*>(pParent);
+	g_mutex_lock(&pSelf->mutex);
+	pSelf->started = FALSE;
+	pSelf->samplesOut = 0;
+	g_mutex_unlock(&pSelf->mutex);
+	return stopped;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// PlayoutMixer::SrcQuery()
+///
+/// Answer the latency query for the audio from here on: one chunk, whatever the latency upstream.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+gboolean PlayoutMixer::SrcQuery(GstPad* pPad, GstObject* pParent, GstQuery* pQuery)
+{
+	if (GST_QUERY_TYPE(pQuery) == GST_QUERY_LATENCY)
+	{
+		GstClockTime latency = CHUNK_MS * GST_MSECOND;
+		gst_query_set_latency(pQuery, TRUE, latency, latency);
+		return TRUE;
+	}
+	return gst_pad_query_default(pPad, pParent, pQuery);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// PlayoutMixer::Loop()
+///
+/// Pull CHUNK_MS of audio out of every input's PlayoutBuffer, mix it (saturating), and push the
+/// mix on; pushing blocks while the audio device's buffer is full. Without inputs, the mix is
+/// silence, so the device's delay stays the same as participants come and go.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void PlayoutMixer::Loop(gpointer pData)
+{
+	Instance* pSelf = reinterpret_cast<Instance*>(pData);
+
+	if (!pSelf->started)
+	{
+		GstSegment segment;
+		gst_segment_init(&segment, GST_FORMAT_TIME);
+		gst_pad_push_event(pSelf->pSrcPad, gst_event_new_stream_start(ELEMENT_NAME));
+		GstCaps* caps = gst_caps_from_string(PLAYOUT_MIXER_CAPS);
+		gst_pad_push_event(pSelf->pSrcPad, gst_event_new_caps(caps));
+		gst_caps_unref(caps);
+		gst_pad_push_event(pSelf->pSrcPad, gst_event_new_segment(&segment));
+		pSelf->started = TRUE;
+	}
+
+	GstBuffer* pBuffer = gst_buffer_new_allocate(NULL, CHUNK_SAMPLES * sizeof(int16_t), NULL);
+	GstMapInfo map;
+	gst_buffer_map(pBuffer, &map, GST_MAP_WRITE);
+	int16_t* pOut = reinterpret_cast<int16_t*>(map.data);
+
+	g_mutex_lock(&pSelf->mutex);
+	std::memset(pSelf->mix, 0, sizeof(pSelf->mix));
+	for (std::vector<Input>::iterator it = pSelf->pInputs->begin(); it != pSelf->pInputs->end(); ++it)
+	{
+		it->pBuffer->Pull(pSelf->chunk, CHUNK_SAMPLES);
+		for (size_t i = 0; i < CHUNK_SAMPLES; ++i)
+		{
+			pSelf->mix[i] += pSelf->chunk[i];
+		}
+	}
+	for (size_t i = 0; i < CHUNK_SAMPLES; ++i)
+	{
+		pOut[i] = static_cast<int16_t>(std::min(std::max(pSelf->mix[i], static_cast<int32_t>(INT16_MIN)), static_cast<int32_t>(INT16_MAX)));
+	}
+	GST_BUFFER_PTS(pBuffer) = gst_util_uint64_scale(pSelf->samplesOut, GST_SECOND, RATE);
+	GST_BUFFER_DURATION(pBuffer) = gst_util_uint64_scale(CHUNK_SAMPLES, GST_SECOND, RATE);
+	pSelf->samplesOut += CHUNK_SAMPLES;
+	g_mutex_unlock(&pSelf->mutex);
+
+	gst_buffer_unmap(pBuffer, &map);
+	if (gst_pad_push(pSelf->pSrcPad, pBuffer) != GST_FLOW_OK)
+	{
+		gst_pad_pause_task(pSelf->pSrcPad);
+	}
+}
@@ -0,0 +1,147 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// @file PlayoutMixer.hpp
+///
+/// Copyright (c) 2015, BoxCast, Inc. All rights reserved.
+///
+/// This library is free software; you can redistribute it and/or modify it under the terms of the
+/// GNU Lesser General Public License as published by the Free Software Foundation; either version
+/// 3.0 of the License, or (at your option) any later version.
+///
+/// This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+/// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See
+/// the GNULesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License along with this
+/// library; if not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+/// Boston, MA 02110-1301 USA
+///
+/// @brief This file declares the PlayoutMixer class, which implements the "m4playoutmixer"
+/// GStreamer element: the time-stretching playout buffers of all participants' audio, mixed into
+/// one output.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#ifndef __PLAYOUT_MIXER_HPP__
+#define __PLAYOUT_MIXER_HPP__
+
+#include <gst/gst.h>         // for GStreamer stuff
+#include <vector>            // for std::vector
+#include "PlayoutBuffer.hpp" // for PlayoutBuffer
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// This class registers and implements the "m4playoutmixer" element, which takes the decoded
+/// audio of any number of participants, each on a request pad ("sink_%u"), and plays it out as
+/// one stream to a single audio sink. All inputs must be RATE Hz mono.
+///
+/// Each input's audio goes into a PlayoutBuffer of its own as it arrives. The element's thread
+/// pulls CHUNK_MS at a time out of every one of them, mixes the chunks, and pushes the mix on,
+/// with timestamps of its own. The audio sink is meant to run with sync=false and a small device
+/// buffer, so that its blocking paces the thread at the device's rate.
+///
+/// So the delay of each participant's audio is its PlayoutBuffer's level, which follows that
+/// participant's jitter, plus the one device buffer; the pipeline latency (which the video's
+/// jitter buffers set) doesn't apply to the audio. The price is lip sync, which conferencing can
+/// spare better than delay.
+///
+/// The read-only "stats" property holds the statistics of each input's PlayoutBuffer, as a
+/// structure under the input pad's name.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class PlayoutMixer
+{
+public:
+	/// The element's factory name
+	static const char ELEMENT_NAME[];
+
+
+	/// The sample rate of the inputs and of the mix.
+	static const unsigned int RATE = 48000;
+
+
+	/// Register the element with GStreamer; call once after gst_init().
+	static bool Register();
+
+
+private:
+	/// The duration of the audio mixed and pushed at a time, in milliseconds.
+	static const unsigned int CHUNK_MS = 10;
+
+
+	/// The number of samples mixed and pushed at a time.
+	static const size_t CHUNK_SAMPLES = (RATE * CHUNK_MS) / 1000;
+
+
+	/// One input: a request pad, and the buffer its audio is played out of
+	struct Input
+	{
+		GstPad* pPad;
+		PlayoutBuffer* pBuffer;
+	};
+
+
+	/// The element's instance structure
+	struct Instance
+	{
+		GstElement parent;
+		GstPad* pSrcPad;
+		GMutex mutex;
+		std::vector<Input>* pInputs;
+		guint nextPadId;
+		gboolean started;
+		guint64 samplesOut;
+		int32_t mix[CHUNK_SAMPLES];
+		int16_t chunk[CHUNK_SAMPLES];
+	};
+
+
+	/// The element's class structure
+	struct Class
+	{
+		GstElementClass parentClass;
+	};
+
+
+	/// Property IDs
+	enum
+	{
+		PROP_0,
+		PROP_STATS
+	};
+
+
+	/// Get (registering, the first time) the element's GType.
+	static GType GetType();
+
+
+	/// GObject class and instance initialization, and finalization
+	static void ClassInit(gpointer klass, gpointer classData);
+	static void InstanceInit(GTypeInstance* pInstance, gpointer klass);
+	static void Finalize(GObject* pObject);
+
+
+	/// GObject property accessor
+	static void GetProperty(GObject* pObject, guint propId, GValue* pValue, GParamSpec* pSpec);
+
+
+	/// GstElement input pad requests and releases
+	static GstPad* RequestNewPad(GstElement* pElement, GstPadTemplate* pTemplate, const gchar* pName, const GstCaps* pCaps);
+	static void ReleasePad(GstElement* pElement, GstPad* pPad);
+
+
+	/// Input pad functions: decoded audio and events in
+	static GstFlowReturn SinkChain(GstPad* pPad, GstObject* pParent, GstBuffer* pBuffer);
+	static gboolean SinkEvent(GstPad* pPad, GstObject* pParent, GstEvent* pEvent);
+
+
+	/// Output pad functions: starting and stopping the thread, and the latency
+	static gboolean SrcActivateMode(GstPad* pPad, GstObject* pParent, GstPadMode mode, gboolean active);
+	static gboolean SrcQuery(GstPad* pPad, GstObject* pParent, GstQuery* pQuery);
+
+
+	/// The thread's loop: mix a chunk and push it on
+	static void Loop(gpointer pData);
+
+
+	/// The parent (GstElement) class
+	static gpointer s_pParentClass;
+}; // END class PlayoutMixer
+
+#endif // __PLAYOUT_MIXER_HPP__
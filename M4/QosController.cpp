@@ -0,0 +1,122 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// @file QosController.cpp
+///
+/// Copyright (c) 2015, BoxCast, Inc. All rights reserved.
+///
+/// This library is free software; you can redistribute it and/or modify it under the terms of the
+/// GNU Lesser General Public License as published by the Free Software Foundation; either version
+/// 3.0 of the License, or (at your option) any later version.
+///
+/// This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+/// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See
+/// the GNULesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License along with this
+/// library; if not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+/// Boston, MA 02110-1301 USA
+///
+///
+/// @brief This file defines the functions of the QosController class.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "QosController.hpp" // for class declaration
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// The ladder. The resolution goes first, since a conference is better off with smooth motion;
+/// the frame rate only halves once the picture is down to half size.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+const QosController::Level QosController::LEVELS[NUM_LEVELS] =
+{
+	{100, 1},
+	{ 75, 1},
+	{ 50, 1},
+	{ 50, 2},
+	{ 50, 3},
+};
+
+const double QosController::MAX_DROP_RATIO = 0.05;
+
+const double QosController::MAX_ENCODE_LOAD = 0.8;
+
+const double QosController::STEP_UP_ENCODE_LOAD = 0.6;
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// QosController::QosController()
+///
+/// Constructor. Start at full resolution and frame rate.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+QosController::QosController()
+	: m_Level(0)
+	, m_StepUpWindows(0)
+	, m_LastChangeUs(0)
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// QosController::OnWindow()
+///
+/// Judge a measurement window, and step the level down or up if called for.
+///
+/// @param nowUs  The (monotonic) time at the end of the window, in microseconds.
+///
+/// @param dropRatio  The fraction of frames dropped in front of the encoders (0.0 - 1.0).
+///
+/// @param encodeLoad  The mean encoding time per frame, over the interval between the frames
+/// given to the encoder.
+///
+/// @return true if the level changed.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool QosController::OnWindow(int64_t nowUs, double dropRatio, double encodeLoad)
+{
+	if ((m_LastChangeUs != 0) && ((nowUs - m_LastChangeUs) < SETTLE_US))
+	{
+		return false;
+	}
+
+	if ((dropRatio > MAX_DROP_RATIO) || (encodeLoad > MAX_ENCODE_LOAD))
+	{
+		m_StepUpWindows = 0;
+		if ((m_Level + 1) < NUM_LEVELS)
+		{
+			++m_Level;
+			m_LastChangeUs = nowUs;
+			return true;
+		}
+		return false;
+	}
+
+	if ((m_Level > 0) && (dropRatio == 0.0) && ((encodeLoad * StepUpCost(m_Level)) < STEP_UP_ENCODE_LOAD))
+	{
+		if (++m_StepUpWindows >= STEP_UP_WINDOWS)
+		{
+			m_StepUpWindows = 0;
+			--m_Level;
+			m_LastChangeUs = nowUs;
+			return true;
+		}
+	}
+	else
+	{
+		m_StepUpWindows = 0;
+	}
+	return false;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// QosController::StepUpCost()
+///
+/// How many times as much the level above a level costs to encode, in pixels per second.
+///
+/// @param level  The level; must not be 0.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+double QosController::StepUpCost(size_t level)
+{
+	const Level& from = LEVELS[level];
+	const Level& to = LEVELS[level - 1];
+	double pixels = (static_cast<double>(to.scalePercent) * to.scalePercent) / (static_cast<double>(from.scalePercent) * from.scalePercent);
+	return pixels * from.frameRateDivisor / to.frameRateDivisor;
+}
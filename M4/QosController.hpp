@@ -0,0 +1,114 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// @file QosController.hpp
+///
+/// Copyright (c) 2015, BoxCast, Inc. All rights reserved.
+///
+/// This library is free software; you can redistribute it and/or modify it under the terms of the
+/// GNU Lesser General Public License as published by the Free Software Foundation; either version
+/// 3.0 of the License, or (at your option) any later version.
+///
+/// This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+/// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See
+/// the GNULesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License along with this
+/// library; if not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+/// Boston, MA 02110-1301 USA
+///
+///
+/// @brief This file declares the QosController class, which decides how far the sender's video
+/// encoding has to be scaled down for the encoders to keep up with the camera.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#ifndef __QOS_CONTROLLER_HPP__
+#define __QOS_CONTROLLER_HPP__
+
+#include <cstddef>  // for size_t
+#include <stdint.h> // for int64_t
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// This class steps through a ladder of encoding levels (resolution first, then frame rate) from
+/// two load signals measured over a window of frames:
+///  - The fraction of frames dropped in front of the encoders because they were still busy, and
+///  - The encode load: the mean time an encoder takes per frame, relative to the time it has
+///	(the interval between the frames it is given).
+///
+/// A window with too many drops, or a load near the budget, steps one level down. Stepping back
+/// up takes STEP_UP_WINDOWS windows in a row in which the load, scaled by how much more the next
+/// level up costs, would still be comfortably below the budget, and no drops. After every change
+/// the controller waits SETTLE_US (the encoders restart on a resolution change) before judging
+/// again. Together these keep the level from oscillating.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class QosController
+{
+public:
+	/// One step of the ladder
+	struct Level
+	{
+		unsigned int scalePercent;
+		unsigned int frameRateDivisor;
+	};
+
+
+	/// The number of levels
+	static const size_t NUM_LEVELS = 5;
+
+
+	/// The levels, from full resolution and frame rate down
+	static const Level LEVELS[NUM_LEVELS];
+
+
+	/// Constructor.
+	QosController();
+
+
+	/// Feed a measurement window in; returns true if the level changed.
+	bool OnWindow(int64_t nowUs, double dropRatio, double encodeLoad);
+
+
+	/// The index of the current level (0 is full resolution and frame rate).
+	inline size_t LevelIndex() const { return m_Level; }
+
+
+	/// The current level.
+	inline const Level& CurrentLevel() const { return LEVELS[m_Level]; }
+
+
+private:
+	/// Steps down when more than this fraction of frames is dropped.
+	static const double MAX_DROP_RATIO;
+
+
+	/// Steps down when the encode load goes above this.
+	static const double MAX_ENCODE_LOAD;
+
+
+	/// Steps up when the encode load, scaled to the next level up, stays below this.
+	static const double STEP_UP_ENCODE_LOAD;
+
+
+	/// The number of windows in a row that must allow stepping up before it happens.
+	static const unsigned int STEP_UP_WINDOWS = 5;
+
+
+	/// How long to wait after a change before judging the load again, in microseconds.
+	static const int64_t SETTLE_US = 3000000;
+
+
+	/// How much more the level above a level costs to encode (pixels times frames).
+	static double StepUpCost(size_t level);
+
+
+	/// The current level
+	size_t m_Level;
+
+
+	/// The number of windows in a row that allowed stepping up
+	unsigned int m_StepUpWindows;
+
+
+	/// When the level last changed (0 if never)
+	int64_t m_LastChangeUs;
+}; // END class QosController
+
+#endif // __QOS_CONTROLLER_HPP__
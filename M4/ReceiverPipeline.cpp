@@ -18,138 +18,2177 @@
 /// @brief This file defines the functions of the ReceiverPipeline class.
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
+#include <algorithm>            // for std::min, std::max
 #include <cassert>              // for assert
 #include <cstdio>
+#include <cstring>
+#include <gst/video/video.h>  // for gst_video_event_new_upstream_force_key_unit
 #include <gst/video/videooverlay.h>
-#include "gst_utility.hpp"      // for gst_element_find_sink_pad_by_name
+#include "gst_utility.hpp"      // for gst_rtp_aux_bin_new
+#include "PlayoutMixer.hpp"     // for PlayoutMixer::RATE
 #include "ReceiverPipeline.hpp" // for class declaration
 #include "SenderPipeline.hpp"   // for static helper functions
+#include "SocketBufferSizer.hpp" // for SocketBufferSizer::Size
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// The jitter buffer latencies are picked to play out this fraction of packets in time; the
+/// rest are too late, and lost.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+const double ReceiverPipeline::DEFAULT_LATENCY_PERCENTILE = 0.95;
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// The application message SwapBranch() posts for BusMessage() to free a sender's old stream.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+const char ReceiverPipeline::CLEAR_SSRC_MESSAGE[] = "m4-clear-ssrc";
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// The element messages PostStreamStats() posts from rtpbin, one per stream.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+const char ReceiverPipeline::STREAM_STATS_MESSAGE[] = "m4-rtp-stream-stats";
+
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 /// These are the mostly "static" parts of the pipeline, represented as a string in
-/// gst_parse_launch format.
+/// gst_parse_launch format. Every sender sends here; rtpbin demultiplexes the streams by SSRC, and
+/// the decoding branches are added as they appear. Packets are received in batches (see
+/// UdpBatchSrc), so whatever has arrived by the time one is received goes to rtpbin as one buffer
+/// list, and the RTP sources' receive buffers are sized as participants come and go (see
+/// ResizeSocketBuffers()). Our RTCP reports go to every participant. The jitter buffers start out
+/// at rtpbin's latency, and then follow the jitter (see JitterBufferSinkProbe()).
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 const char ReceiverPipeline::PIPELINE_STRING[] =
-	"   rtpbin name=rtpbin latency=10"
-	"   udpsrc name=vsrc buffer-size=800000"
-	" ! application/x-rtp,media=video,clock-rate=90000,encoding-name=H264,payload=96"
-	" ! rtpbin.recv_rtp_sink_0"
-	"   udpsrc name=vcsrc"
+	"   rtpbin name=rtpbin latency=10 do-lost=true rtp-profile=avpf"
+	"   m4udpbatchsrc name=vsrc"
+	" ! capsfilter name=vsrccaps caps=\"application/x-rtp,media=video,clock-rate=90000,encoding-name=H264,payload=96\""
+	"   m4udpbatchsrc name=vcsrc"
 	" ! application/x-rtcp"
 	" ! rtpbin.recv_rtcp_sink_0"
-	"   udpsrc name=asrc"
-  " ! queue"
-	" ! application/x-rtp,media=audio,clock-rate=32000,encoding-name=SPEEX,encoding-params=1,channels=1,payload=96"
+	"   m4udpbatchsrc name=asrc caps=\"application/x-rtp,media=audio\""
 	" ! rtpbin.recv_rtp_sink_1"
-	"   udpsrc name=acsrc"
-  " ! queue"
+	"   m4udpbatchsrc name=acsrc"
 	" ! application/x-rtcp"
 	" ! rtpbin.recv_rtcp_sink_1"
-	"   rtpbin."
-	" ! capsfilter name=vfilter caps=\"application/x-rtp,media=video\""
-	" ! rtph264depay"
-	" ! video/x-h264,stream-format=avc,alignment=au"
-	" ! avdec_h264"
+	"   rtpbin.send_rtcp_src_0"
+	" ! multiudpsink name=vcsink sync=false async=false"
+	"   rtpbin.send_rtcp_src_1"
+	" ! multiudpsink name=acsink sync=false async=false"
+;
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// The compositor all video branches feed in composite mode, in gst_parse_launch format. It
+/// scales each input into its rectangle; the caps filter sets the output size (see
+/// SetCompositeSize()) and the frame rate, which is the one rate all video is presented at.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+const char ReceiverPipeline::COMPOSITOR_STRING[] =
+	"   compositor name=vcomp background=black"
+	" ! capsfilter name=vcompcaps"
 	" ! videoconvert"
-	" ! osxvideosink name=vsink enable-last-sample=false async=true sync=true"
-	"   rtpbin."
-	" ! rtpspeexdepay"
-	" ! speexdec"
-	" %s "
-	" ! osxaudiosink name=asink enable-last-sample=false async=true sync=true %s"
+	" ! osxvideosink name=vcompsink enable-last-sample=false async=false sync=true"
+;
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// The mixer all audio branches feed, in gst_parse_launch format; the audio output (see
+/// AudioOutputString()) is appended. The PlayoutMixer stretches each participant's audio to keep
+/// its delay just above that participant's jitter.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+const char ReceiverPipeline::MIXER_STRING[] =
+	"   m4playoutmixer name=amix"
 ;
 
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 /// Constructor.
 ///
-/// Parse the launch string to construct the pipeline; obtain some references; and install a
-/// callback function for when pads are added to rtpbin.
+/// Parse the launch string to construct the pipeline; obtain some references; and install the
+/// callback functions for when stream pads are added to and removed from rtpbin.
+///
+/// Every participant's streams arrive on the ports from basePort. Participants are added with
+/// AddParticipant(); until then their streams are discarded.
+///
+/// The audio parameters are our own audio RTP caps, which the other participants normally use
+/// too; AddAudioParameters() adds those of senders that use others.
+///
+/// With a composite window, all video is composited onto it; otherwise (NULL), each participant's
+/// video is shown in its own window.
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-ReceiverPipeline::ReceiverPipeline(uint16_t basePort, const char* audioDeviceName, const char* pictureParameters, void* pWindowHandle)
-	: PipelineBase(CreatePipeline(audioDeviceName))
+ReceiverPipeline::ReceiverPipeline(const char* audioDeviceName, uint16_t basePort, const char* audioParameters, void* pCompositeWindowHandle)
+	: PipelineBase(CreatePipeline(audioDeviceName, pCompositeWindowHandle != NULL))
 	, m_pRtpBin(gst_bin_get_by_name(GST_BIN(Pipeline()), "rtpbin"))
-	, m_DisplayWindowHandle(pWindowHandle)
+	, m_pMixer(gst_bin_get_by_name(GST_BIN(Pipeline()), "amix"))
+	, m_pCompositor(gst_bin_get_by_name(GST_BIN(Pipeline()), "vcomp"))
+	, m_pCompositeCaps(gst_bin_get_by_name(GST_BIN(Pipeline()), "vcompcaps"))
+	, m_pVideoRtcpSink(gst_bin_get_by_name(GST_BIN(Pipeline()), "vcsink"))
+	, m_pAudioRtcpSink(gst_bin_get_by_name(GST_BIN(Pipeline()), "acsink"))
+	, m_pVideoRtpSrc(gst_bin_get_by_name(GST_BIN(Pipeline()), "vsrc"))
+	, m_pAudioRtpSrc(gst_bin_get_by_name(GST_BIN(Pipeline()), "asrc"))
+	, m_pRtxReceiver(NULL)
+	, m_vJitterBuffers()
+	, m_Retransmission(true)
+	, m_LatencyPercentile(DEFAULT_LATENCY_PERCENTILE)
+	, m_JitterBuffersMutex()
+	, m_vParticipants()
+	, m_vBranches()
+	, m_AudioPtCaps()
+	, m_BranchesMutex()
+	, m_ExpectedBitrate(0)
+	, m_VideoBufferSize(0)
+	, m_AudioBufferSize(0)
+	, m_vSpareBins()
+	, m_StockedTemplates()
+	, m_RefillSourceId(0)
+	, m_BranchStats()
+	, m_SpareBinsMutex()
+	, m_StreamStatsSourceId(0)
+	, m_BusWatchId(0)
+	, m_KeyUnitMutex()
 {
 	assert(m_pRtpBin != NULL);
+	assert(m_pMixer != NULL);
+	assert(m_pVideoRtcpSink != NULL);
+	assert(m_pAudioRtcpSink != NULL);
+	assert(m_pVideoRtpSrc != NULL);
+	assert(m_pAudioRtpSrc != NULL);
+	
+	g_mutex_init(&m_KeyUnitMutex);
+	g_mutex_init(&m_BranchesMutex);
+	g_mutex_init(&m_JitterBuffersMutex);
+	g_mutex_init(&m_SpareBinsMutex);
+	
+	if (m_pCompositor != NULL)
+	{
+		GstElement* e = gst_bin_get_by_name(GST_BIN(Pipeline()), "vcompsink");
+		assert(e != NULL);
+		gst_video_overlay_set_window_handle(GST_VIDEO_OVERLAY(e), reinterpret_cast<guintptr>(pCompositeWindowHandle));
+		gst_object_unref(e);
+	}
+	
+	// Keep a video branch and one for our own audio built ahead, so a new stream's branch is
+	// ready as soon as its first packet is (see TakeBranchBin())
+	StockBranchTemplate(TEMPLATE_VIDEO);
+	AddAudioParameters(audioParameters);
 	
-	// Set all the udpsrc port properties
-	GstElement* e = gst_bin_get_by_name(GST_BIN(Pipeline()), "vsrc");
+	// Video packets the jitter buffer misses are NACKed, and the retransmissions (RFC 4588 RTX)
+	// turned back into the original packets ahead of it. rtpbin asks for the retransmission
+	// receiver when the session's RTP sink pad is requested, so vsrc is linked only now.
+	g_signal_connect(m_pRtpBin, "request-aux-receiver", G_CALLBACK(StaticRequestAuxReceiver), NULL);
+	g_signal_connect(m_pRtpBin, "new-jitterbuffer", G_CALLBACK(StaticNewJitterBuffer), this);
+	GstElement* e = gst_bin_get_by_name(GST_BIN(Pipeline()), "vsrccaps");
 	assert(e != NULL);
-	g_object_set(e, "port", basePort, NULL);
+	assert(gst_element_link_pads(e, "src", m_pRtpBin, "recv_rtp_sink_0"));
 	gst_object_unref(e);
+	m_pRtxReceiver = gst_bin_get_by_name(GST_BIN(m_pRtpBin), "rtxreceive");
+	assert(m_pRtxReceiver != NULL);
+	
+	// The senders add FEC packets to the video when we report loss. Recover lost packets from
+	// them (and the packets rtpbin stores for that) after the jitter buffer, before the
+	// depayloader. The audio caps of each payload type come from the audio parameters.
+	g_signal_connect(m_pRtpBin, "request-fec-decoder", G_CALLBACK(StaticRequestFecDecoder), NULL);
+	g_signal_connect(m_pRtpBin, "request-pt-map", G_CALLBACK(StaticRequestPtMap), this);
+	GObject* storage = NULL;
+	g_signal_emit_by_name(m_pRtpBin, "get-internal-storage", 0, &storage);
+	assert(storage != NULL);
+	g_object_set(storage, "size-time", FEC_STORAGE_NS, NULL);
+	g_object_unref(storage);
+	
+	// Set all the UDP source port properties, and the RTP sources' initial receive buffer sizes
+	g_object_set(m_pVideoRtpSrc, "port", basePort, NULL);
 	
 	e = gst_bin_get_by_name(GST_BIN(Pipeline()), "vcsrc");
 	assert(e != NULL);
 	g_object_set(e, "port", basePort + 1, NULL);
 	gst_object_unref(e);
 	
-	e = gst_bin_get_by_name(GST_BIN(Pipeline()), "asrc");
-	assert(e != NULL);
-	g_object_set(e, "port", basePort + 2, NULL);
-	gst_object_unref(e);
+	g_object_set(m_pAudioRtpSrc, "port", basePort + 2, NULL);
 	
 	e = gst_bin_get_by_name(GST_BIN(Pipeline()), "acsrc");
 	assert(e != NULL);
 	g_object_set(e, "port", basePort + 3, NULL);
 	gst_object_unref(e);
+	ResizeSocketBuffers();
 	
-	// Set vfilter caps sprop-parameter-sets = pictureParameters
-	e = gst_bin_get_by_name(GST_BIN(Pipeline()), "vfilter");
-	assert(e != NULL);
-	gchar* capsString = new gchar[std::strlen("application/x-rtp,media=video,sprop-parameter-sets=\"\"") + std::strlen(pictureParameters) + 1];
-	std::sprintf(capsString, "application/x-rtp,media=video,sprop-parameter-sets=\"%s\"", pictureParameters);
-	gst_util_set_object_arg(G_OBJECT(e), "caps", capsString);
-	delete[] capsString;
-	gst_object_unref(e);
+	// Report more often than the RTCP default, so the senders' congestion control reacts quickly
+	for (guint session = 0; session < 2; ++session)
+	{
+		GObject* rtpSession = NULL;
+		g_signal_emit_by_name(m_pRtpBin, "get-internal-session", session, &rtpSession);
+		if (rtpSession != NULL)
+		{
+			g_object_set(rtpSession, "rtcp-min-interval", (guint64)RTCP_MIN_INTERVAL_NS, NULL);
+			g_object_unref(rtpSession);
+		}
+	}
 	
-	// Set vsink to display on pWindowHandle
-	e = gst_bin_get_by_name(GST_BIN(Pipeline()), "vsink");
-	assert(e != NULL);
-	gst_video_overlay_set_window_handle(GST_VIDEO_OVERLAY(e), reinterpret_cast<guintptr>(pWindowHandle));
-	gst_object_unref(e);
+	// Each new stream gets its decoding branch, and loses it with its pad (on BYE or timeout)
+	g_signal_connect(m_pRtpBin, "pad-added", G_CALLBACK(StaticPadAdded), this);
+	g_signal_connect(m_pRtpBin, "pad-removed", G_CALLBACK(StaticPadRemoved), this);
+	
+	m_BusWatchId = AddBusWatch(StaticBusMessage, this);
 }
 
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 /// Destructor.
 ///
-/// Release references obtained in constructor.
+/// Release references obtained in constructor, and free the branches; their elements go with the
+/// pipeline.
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 ReceiverPipeline::~ReceiverPipeline()
 {
+	g_source_remove(m_BusWatchId);
+	
+	// Stop the streaming threads first; until then TakeBranchBin() can add a refill source.
 	Nullify();
+	g_mutex_lock(&m_SpareBinsMutex);
+	guint refillSourceId = m_RefillSourceId;
+	m_RefillSourceId = 0;
+	g_mutex_unlock(&m_SpareBinsMutex);
+	if (refillSourceId != 0)
+	{
+		g_source_remove(refillSourceId);
+	}
+	if (m_StreamStatsSourceId != 0)
+	{
+		g_source_remove(m_StreamStatsSourceId);
+	}
+	for (std::vector<Branch*>::iterator it = m_vBranches.begin(); it != m_vBranches.end(); ++it)
+	{
+		if ((*it)->pDepayloader != NULL)
+		{
+			gst_object_unref((*it)->pDepayloader);
+		}
+		if ((*it)->pDecoder != NULL)
+		{
+			gst_object_unref((*it)->pDecoder);
+		}
+		if ((*it)->pVolume != NULL)
+		{
+			gst_object_unref((*it)->pVolume);
+		}
+		if ((*it)->pRequestPad != NULL)
+		{
+			gst_object_unref((*it)->pRequestPad);
+		}
+		gst_object_unref((*it)->pSrcPad);
+		delete *it;
+	}
+	for (std::vector<JitterBuffer*>::iterator it = m_vJitterBuffers.begin(); it != m_vJitterBuffers.end(); ++it)
+	{
+		GstPad* pad = gst_element_get_static_pad((*it)->pElement, "sink");
+		gst_pad_remove_probe(pad, (*it)->probeId);
+		gst_object_unref(pad);
+	}
+	for (size_t kind = 0; kind < NUM_BRANCH_TEMPLATES; ++kind)
+	{
+		for (std::vector<GstElement*>::iterator it = m_vSpareBins[kind].begin(); it != m_vSpareBins[kind].end(); ++it)
+		{
+			gst_element_set_state(*it, GST_STATE_NULL);
+			gst_object_unref(*it);
+		}
+	}
+	gst_object_unref(m_pRtxReceiver);
+	gst_object_unref(m_pAudioRtpSrc);
+	gst_object_unref(m_pVideoRtpSrc);
+	gst_object_unref(m_pAudioRtcpSink);
+	gst_object_unref(m_pVideoRtcpSink);
+	if (m_pCompositeCaps != NULL)
+	{
+		gst_object_unref(m_pCompositeCaps);
+	}
+	if (m_pCompositor != NULL)
+	{
+		gst_object_unref(m_pCompositor);
+	}
+	gst_object_unref(m_pMixer);
 	gst_object_unref(m_pRtpBin);
+	g_mutex_clear(&m_JitterBuffersMutex);
+	g_mutex_clear(&m_BranchesMutex);
+	g_mutex_clear(&m_SpareBinsMutex);
+	g_mutex_clear(&m_KeyUnitMutex);
 }
 
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-/// ReceiverPipeline::CreatePipeline
+/// ReceiverPipeline::AddParticipant()
 ///
-/// Creates a receiver pipeline using the given audio device name for audio playback. For use in
-/// constructor member initialization list.
+/// Start receiving from a participant: send it our RTCP reports, on the RTCP ports it listens on
+/// from senderPortBase, and decode its streams, showing the video on pWindowHandle. Streams that
+/// arrived from it before are rebuilt with decoding branches.
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-GstElement* ReceiverPipeline::CreatePipeline(const char* audioDeviceName)
+void ReceiverPipeline::AddParticipant(const char* senderAddress, uint16_t senderPortBase, void* pWindowHandle)
 {
-	char* pipelineString;
-	if (std::strncmp(audioDeviceName, "Built-in Mic", sizeof("Built-in Mic") - 1) != 0)
+	Participant participant;
+	participant.address = senderAddress;
+	participant.portBase = senderPortBase;
+	participant.pWindowHandle = pWindowHandle;
+	participant.gain = 1.0;
+	participant.compositeX = 0;
+	participant.compositeY = 0;
+	participant.compositeWidth = 0;
+	participant.compositeHeight = 0;
+	participant.visibility = VISIBILITY_FULL;
+	participant.width = 0;
+	participant.height = 0;
+	participant.haveSsrcs = false;
+	participant.videoSsrc = 0;
+	participant.audioSsrc = 0;
+	
+	g_mutex_lock(&m_BranchesMutex);
+	m_vParticipants.push_back(participant);
+	g_mutex_unlock(&m_BranchesMutex);
+	
+	g_signal_emit_by_name(m_pVideoRtcpSink, "add", senderAddress, senderPortBase + 1, NULL);
+	g_signal_emit_by_name(m_pAudioRtcpSink, "add", senderAddress, senderPortBase + 3, NULL);
+	RebuildBranches(participant.address);
+	ResizeSocketBuffers();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::SetParticipantSsrcs()
+///
+/// Set the SSRCs a participant announced in its parameters. From then on its streams are
+/// recognized by SSRC rather than by the address their packets come from, so that participants
+/// behind one address (a NAT) aren't taken for one sender. Streams with these SSRCs that were
+/// taken for another sender, or discarded, are rebuilt for the participant.
+///
+/// @param senderAddress  The participant's address, as given to AddParticipant().
+///
+/// @param videoSsrc  The SSRC of its video (its full-resolution layer's; see
+///                   SenderPipeline::LayerSsrc()).
+///
+/// @param audioSsrc  The SSRC of its audio.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ReceiverPipeline::SetParticipantSsrcs(const char* senderAddress, guint videoSsrc, guint audioSsrc)
+{
+	std::vector<Branch*> vBranches;
+	
+	g_mutex_lock(&m_BranchesMutex);
+	for (std::vector<Participant>::iterator it = m_vParticipants.begin(); it != m_vParticipants.end(); ++it)
 	{
-		// not built-in
-		int idx = SenderPipeline::GetAudioDeviceIndex(audioDeviceName);
-		assert(idx >= 0);
-		char deviceString[sizeof("device=-2147483648")];
-		std::sprintf(deviceString, "device=%d", idx);
-		pipelineString = new char[sizeof(PIPELINE_STRING)];
-		std::sprintf(pipelineString, PIPELINE_STRING, "", deviceString);
+		if (it->address == senderAddress)
+		{
+			it->haveSsrcs = true;
+			it->videoSsrc = videoSsrc;
+			it->audioSsrc = audioSsrc;
+		}
 	}
-	else
+	for (std::vector<Branch*>::iterator it = m_vBranches.begin(); it != m_vBranches.end(); )
 	{
-		// built-in
-		pipelineString = new char[sizeof(PIPELINE_STRING) + sizeof("audioconvert ! audioresample")];
-		std::sprintf(pipelineString, PIPELINE_STRING, " ! audioconvert ! audioresample", "");
+		if (IsAnnouncedSsrc((*it)->session, (*it)->ssrc, videoSsrc, audioSsrc) && ((*it)->address != senderAddress))
+		{
+			vBranches.push_back(*it);
+			it = m_vBranches.erase(it);
+		}
+		else
+		{
+			++it;
+		}
 	}
-	GstElement* ret = gst_parse_launch(pipelineString, NULL);
-	assert(ret != NULL);
-	delete[] pipelineString;
-	return ret;
-}
\ No newline at end of file
+	g_mutex_unlock(&m_BranchesMutex);
+	
+	for (std::vector<Branch*>::iterator it = vBranches.begin(); it != vBranches.end(); ++it)
+	{
+		gst_pad_add_probe((*it)->pSrcPad, GST_PAD_PROBE_TYPE_IDLE, StaticRebuildProbe, *it, NULL);
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::RemoveParticipant()
+///
+/// Stop receiving from a participant. Its decoding branches are replaced by discarding ones, which
+/// go away with their pads when its streams end or time out.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ReceiverPipeline::RemoveParticipant(const char* senderAddress)
+{
+	uint16_t portBase = 0;
+	bool found = false;
+	
+	g_mutex_lock(&m_BranchesMutex);
+	for (std::vector<Participant>::iterator it = m_vParticipants.begin(); it != m_vParticipants.end(); ++it)
+	{
+		if (it->address == senderAddress)
+		{
+			portBase = it->portBase;
+			found = true;
+			m_vParticipants.erase(it);
+			break;
+		}
+	}
+	g_mutex_unlock(&m_BranchesMutex);
+	
+	if (found)
+	{
+		g_signal_emit_by_name(m_pVideoRtcpSink, "remove", senderAddress, portBase + 1, NULL);
+		g_signal_emit_by_name(m_pAudioRtcpSink, "remove", senderAddress, portBase + 3, NULL);
+		RebuildBranches(senderAddress);
+		ResizeSocketBuffers();
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::SetParticipantGain()
+///
+/// Set the gain a participant's audio is mixed at, now and for its streams to come.
+///
+/// @param senderAddress  The participant's address.
+///
+/// @param gain  The gain, as for the volume element: 1.0 leaves the audio as it is, 0.0 mutes it.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ReceiverPipeline::SetParticipantGain(const char* senderAddress, double gain)
+{
+	g_mutex_lock(&m_BranchesMutex);
+	for (std::vector<Participant>::iterator it = m_vParticipants.begin(); it != m_vParticipants.end(); ++it)
+	{
+		if (it->address == senderAddress)
+		{
+			it->gain = gain;
+		}
+	}
+	for (std::vector<Branch*>::iterator it = m_vBranches.begin(); it != m_vBranches.end(); ++it)
+	{
+		if (((*it)->address == senderAddress) && ((*it)->pVolume != NULL))
+		{
+			g_object_set((*it)->pVolume, "volume", gain, NULL);
+		}
+	}
+	g_mutex_unlock(&m_BranchesMutex);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::SetVisibility()
+///
+/// Set how much of a participant's video is seen, and the size it is shown at, now and for its
+/// streams to come. The less is seen, the less is decoded; and the video is scaled down (never up)
+/// to the size shown, before anything else is done with it.
+///
+/// @param senderAddress  The participant's address.
+///
+/// @param visibility  How much of the video is seen.
+///
+/// @param width  The width the video is shown at, in pixels; 0 for any.
+///
+/// @param height  The height the video is shown at, in pixels; 0 for any.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ReceiverPipeline::SetVisibility(const char* senderAddress, Visibility visibility, int width, int height)
+{
+	g_mutex_lock(&m_BranchesMutex);
+	for (std::vector<Participant>::iterator it = m_vParticipants.begin(); it != m_vParticipants.end(); ++it)
+	{
+		if ((it->address != senderAddress) || ((it->visibility == visibility) && (it->width == width) && (it->height == height)))
+		{
+			continue;
+		}
+		Visibility previous = it->visibility;
+		it->visibility = visibility;
+		it->width = width;
+		it->height = height;
+		for (std::vector<Branch*>::iterator branch = m_vBranches.begin(); branch != m_vBranches.end(); ++branch)
+		{
+			if (((*branch)->address == senderAddress) && ((*branch)->pDecoder != NULL))
+			{
+				ApplyVisibility(*branch, *it, previous);
+			}
+		}
+	}
+	g_mutex_unlock(&m_BranchesMutex);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::SetCompositeSize()
+///
+/// Set the size of the composite video, normally that of the composite window in pixels, so that
+/// it is scaled only once. The participants' rectangles are in this size's coordinates.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ReceiverPipeline::SetCompositeSize(int width, int height)
+{
+	if ((m_pCompositeCaps == NULL) || (width <= 0) || (height <= 0))
+	{
+		return;
+	}
+	
+	GstCaps* caps = gst_caps_new_simple("video/x-raw",
+		"width", G_TYPE_INT, width,
+		"height", G_TYPE_INT, height,
+		"framerate", GST_TYPE_FRACTION, COMPOSITE_FRAME_RATE, 1,
+		NULL);
+	g_object_set(m_pCompositeCaps, "caps", caps, NULL);
+	gst_caps_unref(caps);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::SetCompositeLayout()
+///
+/// Set the rectangle of the composite video a participant's video is scaled into, now and for its
+/// streams to come. An empty rectangle hides the video.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ReceiverPipeline::SetCompositeLayout(const char* senderAddress, int x, int y, int width, int height)
+{
+	if (m_pCompositor == NULL)
+	{
+		return;
+	}
+	
+	g_mutex_lock(&m_BranchesMutex);
+	for (std::vector<Participant>::iterator it = m_vParticipants.begin(); it != m_vParticipants.end(); ++it)
+	{
+		if (it->address != senderAddress)
+		{
+			continue;
+		}
+		it->compositeX = x;
+		it->compositeY = y;
+		it->compositeWidth = width;
+		it->compositeHeight = height;
+		for (std::vector<Branch*>::iterator branch = m_vBranches.begin(); branch != m_vBranches.end(); ++branch)
+		{
+			if (((*branch)->address == senderAddress) && ((*branch)->session == 0) && ((*branch)->pRequestPad != NULL))
+			{
+				SetCompositorPadLayout((*branch)->pRequestPad, *it);
+			}
+		}
+	}
+	g_mutex_unlock(&m_BranchesMutex);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::AddAudioParameters()
+///
+/// Make audio with a sender's audio parameters decodable, under their payload type. The first
+/// parameters given for a payload type keep it; senders of a call use the same settings, so they
+/// agree anyway. Branches decoding them are kept built ahead from now on, as their streams are on
+/// the way. The parameters come from the network; ones that don't parse are ignored.
+///
+/// No parameters are assumed for a sender that announces none: any payload type assumed would
+/// collide with (and, registered first, win over) the dynamic payload type others announce.
+///
+/// @param audioParameters  The sender's audio parameters; empty if it announced none.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ReceiverPipeline::AddAudioParameters(const char* audioParameters)
+{
+	if ((audioParameters == NULL) || (audioParameters[0] == '\0'))
+	{
+		return;
+	}
+	
+	GstStructure* s = gst_structure_from_string(audioParameters, NULL);
+	if (s == NULL)
+	{
+		g_warning("Ignoring malformed audio parameters \"%s\"", audioParameters);
+		return;
+	}
+	gint pt = 0;
+	if (gst_structure_get_int(s, "payload", &pt))
+	{
+		g_mutex_lock(&m_BranchesMutex);
+		if (m_AudioPtCaps.find(pt) == m_AudioPtCaps.end())
+		{
+			m_AudioPtCaps[pt] = audioParameters;
+		}
+		g_mutex_unlock(&m_BranchesMutex);
+		StockBranchTemplate(AudioTemplate(audioParameters));
+	}
+	gst_structure_free(s);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::SetRetransmission()
+///
+/// Turn retransmission requests for lost video packets on or off, for the current and future
+/// jitter buffers. Off, a lost packet goes straight to the decoder as lost.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ReceiverPipeline::SetRetransmission(bool enable)
+{
+	g_mutex_lock(&m_JitterBuffersMutex);
+	m_Retransmission = enable;
+	for (std::vector<JitterBuffer*>::iterator it = m_vJitterBuffers.begin(); it != m_vJitterBuffers.end(); ++it)
+	{
+		if ((*it)->session == 0)
+		{
+			g_object_set((*it)->pElement, "do-retransmission", enable ? TRUE : FALSE, NULL);
+		}
+	}
+	g_mutex_unlock(&m_JitterBuffersMutex);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::GetRetransmissionStats()
+///
+/// Get the retransmission receiver's counts, over all video streams.
+///
+/// @param requests  Receives the number of retransmissions requested.
+///
+/// @param packets  Receives the number of retransmitted packets received.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ReceiverPipeline::GetRetransmissionStats(guint& requests, guint& packets) const
+{
+	g_object_get(m_pRtxReceiver,
+		"num-rtx-requests", &requests,
+		"num-rtx-packets",  &packets,
+		NULL);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::SetLatencyPercentile()
+///
+/// Set the fraction of packets (0.0 - 1.0) the jitter buffer latencies are picked to play out in
+/// time. Higher loses fewer late packets, at the cost of a longer delay.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ReceiverPipeline::SetLatencyPercentile(double percentile)
+{
+	g_mutex_lock(&m_JitterBuffersMutex);
+	m_LatencyPercentile = std::max(0.0, std::min(1.0, percentile));
+	g_mutex_unlock(&m_JitterBuffersMutex);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::GetLatencyStats()
+///
+/// Get the state of each stream's jitter buffer: the latency it currently holds packets for, the
+/// interarrival jitter measured on the stream, and the number of stalls seen.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+std::vector<ReceiverPipeline::LatencyStats> ReceiverPipeline::GetLatencyStats() const
+{
+	std::vector<LatencyStats> vStats;
+	g_mutex_lock(&m_JitterBuffersMutex);
+	for (std::vector<JitterBuffer*>::const_iterator it = m_vJitterBuffers.begin(); it != m_vJitterBuffers.end(); ++it)
+	{
+		LatencyStats stats;
+		stats.session = (*it)->session;
+		stats.ssrc = (*it)->ssrc;
+		stats.latencyMs = (*it)->latencyMs;
+		stats.jitterMs = ((*it)->pEstimator != NULL) ? ((*it)->pEstimator->GetJitterUs() / 1000.0) : 0.0;
+		stats.stalls = (*it)->stalls;
+		vStats.push_back(stats);
+	}
+	g_mutex_unlock(&m_JitterBuffersMutex);
+	return vStats;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::GetStreamStats()
+///
+/// Get what arrived of each stream so far, counted on the way into its jitter buffer (see
+/// RtpStreamStats), and its RFC 3550 interarrival jitter. Loss in the counts happened on the
+/// network; a stream that arrives whole while its video freezes has a decoder falling behind.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+std::vector<ReceiverPipeline::StreamStats> ReceiverPipeline::GetStreamStats() const
+{
+	std::vector<StreamStats> vStats;
+	gint64 now = g_get_monotonic_time();
+	g_mutex_lock(&m_JitterBuffersMutex);
+	for (std::vector<JitterBuffer*>::const_iterator it = m_vJitterBuffers.begin(); it != m_vJitterBuffers.end(); ++it)
+	{
+		StreamStats stats;
+		stats.session = (*it)->session;
+		stats.ssrc = (*it)->ssrc;
+		stats.counts = (*it)->pStreamStats->GetStats(now);
+		stats.jitterMs = ((*it)->pEstimator != NULL) ? ((*it)->pEstimator->GetJitterUs() / 1000.0) : 0.0;
+		vStats.push_back(stats);
+	}
+	g_mutex_unlock(&m_JitterBuffersMutex);
+	return vStats;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::SetStreamStatsInterval()
+///
+/// Post each stream's statistics on the bus, as a STREAM_STATS_MESSAGE element message from
+/// rtpbin, every intervalMs milliseconds; 0 (the default) stops posting them. The timeout runs on
+/// the main thread.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ReceiverPipeline::SetStreamStatsInterval(guint intervalMs)
+{
+	if (m_StreamStatsSourceId != 0)
+	{
+		g_source_remove(m_StreamStatsSourceId);
+		m_StreamStatsSourceId = 0;
+	}
+	if (intervalMs > 0)
+	{
+		m_StreamStatsSourceId = g_timeout_add(intervalMs, StaticPostStreamStats, this);
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::PostStreamStats()
+///
+/// Timeout callback: post a STREAM_STATS_MESSAGE for each stream, with the fields of its
+/// StreamStats (bitrates in bits/sec).
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ReceiverPipeline::PostStreamStats()
+{
+	std::vector<StreamStats> vStats = GetStreamStats();
+	for (std::vector<StreamStats>::const_iterator it = vStats.begin(); it != vStats.end(); ++it)
+	{
+		GstStructure* s = gst_structure_new(STREAM_STATS_MESSAGE,
+			"session",           G_TYPE_UINT,   it->session,
+			"ssrc",              G_TYPE_UINT,   it->ssrc,
+			"expected",          G_TYPE_UINT64, static_cast<guint64>(it->counts.expected),
+			"received",          G_TYPE_UINT64, static_cast<guint64>(it->counts.received),
+			"lost",              G_TYPE_UINT64, static_cast<guint64>(it->counts.lost),
+			"duplicates",        G_TYPE_UINT64, static_cast<guint64>(it->counts.duplicates),
+			"late",              G_TYPE_UINT64, static_cast<guint64>(it->counts.late),
+			"reordered",         G_TYPE_UINT64, static_cast<guint64>(it->counts.reordered),
+			"max-reorder-depth", G_TYPE_UINT,   it->counts.maxReorderDepth,
+			"loss-bursts",       G_TYPE_UINT64, static_cast<guint64>(it->counts.lossBursts),
+			"max-loss-burst",    G_TYPE_UINT,   it->counts.maxLossBurst,
+			"jitter-ms",         G_TYPE_DOUBLE, it->jitterMs,
+			"short-bitrate",     G_TYPE_UINT64, static_cast<guint64>(it->counts.shortBitrate),
+			"long-bitrate",      G_TYPE_UINT64, static_cast<guint64>(it->counts.longBitrate),
+			NULL);
+		gst_element_post_message(m_pRtpBin, gst_message_new_element(GST_OBJECT(m_pRtpBin), s));
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::SetExpectedBitrate()
+///
+/// Set the video bitrate each participant sends at, at most (the senders' maximum bitrate),
+/// which the video receive buffer is sized for.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ReceiverPipeline::SetExpectedBitrate(size_t bitrate)
+{
+	g_mutex_lock(&m_BranchesMutex);
+	m_ExpectedBitrate = bitrate;
+	g_mutex_unlock(&m_BranchesMutex);
+	ResizeSocketBuffers();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::GetSocketStats()
+///
+/// Get the state of each UDP source's socket: its receive buffer size (as the kernel reports it),
+/// the datagrams received on it, and the datagrams the kernel dropped for want of room in the
+/// buffer (where the kernel reports them).
+///////////////////////////////////////////////////////////////////////////////////////////////////
+std::vector<ReceiverPipeline::SocketStats> ReceiverPipeline::GetSocketStats() const
+{
+	static const char* NAMES[] = { "vsrc", "vcsrc", "asrc", "acsrc" };
+	
+	std::vector<SocketStats> vStats;
+	for (size_t i = 0; i < (sizeof(NAMES) / sizeof(NAMES[0])); ++i)
+	{
+		GstElement* e = gst_bin_get_by_name(GST_BIN(Pipeline()), NAMES[i]);
+		assert(e != NULL);
+		GstStructure* pStructure = NULL;
+		g_object_get(e, "stats", &pStructure, NULL);
+		gst_object_unref(e);
+		
+		SocketStats stats = { NAMES[i], 0, 0, 0 };
+		if (pStructure != NULL)
+		{
+			gst_structure_get_int(pStructure, "buffer-size", &stats.bufferSize);
+			gst_structure_get_uint64(pStructure, "datagrams", &stats.datagrams);
+			gst_structure_get_uint64(pStructure, "dropped", &stats.dropped);
+			gst_structure_free(pStructure);
+		}
+		vStats.push_back(stats);
+	}
+	return vStats;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::GetBranchStats()
+///
+/// Get how many decoding branches were set up for new streams (rebuilt ones included), how many
+/// of those were built ahead, and how long the last and the slowest setup took: from the
+/// stream's pad appearing to its branch being linked and playing. NewBranch() also logs each
+/// setup (g_message).
+///////////////////////////////////////////////////////////////////////////////////////////////////
+ReceiverPipeline::BranchStats ReceiverPipeline::GetBranchStats() const
+{
+	g_mutex_lock(&m_SpareBinsMutex);
+	BranchStats stats = m_BranchStats;
+	g_mutex_unlock(&m_SpareBinsMutex);
+	return stats;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::ResizeSocketBuffers()
+///
+/// Size each RTP source's receive buffer for what all participants send on it (video at the
+/// expected bitrate, audio at AUDIO_BITRATE) over the longest jitter buffer latency of its
+/// session plus RECEIVE_BUFFER_MARGIN_MS. Packets held up in the socket for up to the latency
+/// still play out in time, so that is how much is worth keeping; later ones would be dropped as
+/// late anyway. The RTCP sources keep the default size: their traffic is a few reports a second.
+///
+/// Called as participants come and go, when the expected bitrate changes, and when a jitter
+/// buffer's latency is retargeted; a size is only set when it changes.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ReceiverPipeline::ResizeSocketBuffers()
+{
+	guint latencyMs[2] = { 0, 0 };
+	g_mutex_lock(&m_JitterBuffersMutex);
+	for (std::vector<JitterBuffer*>::const_iterator it = m_vJitterBuffers.begin(); it != m_vJitterBuffers.end(); ++it)
+	{
+		if ((*it)->session < 2)
+		{
+			latencyMs[(*it)->session] = std::max(latencyMs[(*it)->session], (*it)->latencyMs);
+		}
+	}
+	
+	g_mutex_lock(&m_BranchesMutex);
+	uint64_t participants = m_vParticipants.size();
+	gint videoSize = SocketBufferSizer::Size(participants * m_ExpectedBitrate, latencyMs[0] + RECEIVE_BUFFER_MARGIN_MS);
+	gint audioSize = SocketBufferSizer::Size(participants * AUDIO_BITRATE, latencyMs[1] + RECEIVE_BUFFER_MARGIN_MS);
+	if (videoSize != m_VideoBufferSize)
+	{
+		m_VideoBufferSize = videoSize;
+		g_object_set(m_pVideoRtpSrc, "buffer-size", videoSize, NULL);
+	}
+	if (audioSize != m_AudioBufferSize)
+	{
+		m_AudioBufferSize = audioSize;
+		g_object_set(m_pAudioRtpSrc, "buffer-size", audioSize, NULL);
+	}
+	g_mutex_unlock(&m_BranchesMutex);
+	g_mutex_unlock(&m_JitterBuffersMutex);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::PadAdded()
+///
+/// Called when rtpbin adds the pad of a new stream (recv_rtp_src_<session>_<ssrc>_<pt>). Give it a
+/// branch: decoding if it comes from a participant, discarding if not.
+///
+/// A participant that restarts comes back with a new SSRC (and in-band picture parameters) while
+/// its old stream's branch is still there, waiting for the stream to time out. Rather than build
+/// a second branch from scratch, the new stream takes the old one over: its pad is held back until
+/// the old stream's pad is idle, and then SwapBranch() moves the branch over.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ReceiverPipeline::PadAdded(GstPad* pad)
+{
+	guint session = 0;
+	guint ssrc = 0;
+	guint pt = 0;
+	if (std::sscanf(GST_PAD_NAME(pad), "recv_rtp_src_%u_%u_%u", &session, &ssrc, &pt) != 3)
+	{
+		return;
+	}
+	
+	std::string sourceAddress = GetSourceAddress(session, ssrc);
+	
+	g_mutex_lock(&m_BranchesMutex);
+	std::string address = SenderAddress(session, ssrc, sourceAddress);
+	Branch* pBranch = TakeSwappableBranch(pad, session, ssrc, address);
+	if (pBranch == NULL)
+	{
+		m_vBranches.push_back(NewBranch(pad, session, ssrc, address));
+	}
+	g_mutex_unlock(&m_BranchesMutex);
+	
+	if (pBranch != NULL)
+	{
+		Swap* pSwap = new Swap();
+		pSwap->pBranch = pBranch;
+		pSwap->pPad = GST_PAD(gst_object_ref(pad));
+		pSwap->ssrc = ssrc;
+		pSwap->blockProbeId = gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BLOCK_DOWNSTREAM, StaticBlockProbe, NULL, NULL);
+		gst_pad_add_probe(pBranch->pSrcPad, GST_PAD_PROBE_TYPE_IDLE, StaticSwapProbe, pSwap, NULL);
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::PadRemoved()
+///
+/// Called when rtpbin removes the pad of a stream that ended (BYE), timed out, or was cleared
+/// after a new stream took its branch over. Its branch (if it still has one) and jitter buffer go
+/// with it.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ReceiverPipeline::PadRemoved(GstPad* pad)
+{
+	guint session = 0;
+	guint ssrc = 0;
+	if (std::sscanf(GST_PAD_NAME(pad), "recv_rtp_src_%u_%u_%*u", &session, &ssrc) != 2)
+	{
+		return;
+	}
+	
+	Branch* pBranch = NULL;
+	
+	g_mutex_lock(&m_BranchesMutex);
+	for (std::vector<Branch*>::iterator it = m_vBranches.begin(); it != m_vBranches.end(); ++it)
+	{
+		if ((*it)->pSrcPad == pad)
+		{
+			pBranch = *it;
+			m_vBranches.erase(it);
+			break;
+		}
+	}
+	g_mutex_unlock(&m_BranchesMutex);
+	
+	JitterBuffer* pJitterBuffer = NULL;
+	g_mutex_lock(&m_JitterBuffersMutex);
+	for (std::vector<JitterBuffer*>::iterator it = m_vJitterBuffers.begin(); it != m_vJitterBuffers.end(); ++it)
+	{
+		if (((*it)->session == session) && ((*it)->ssrc == ssrc))
+		{
+			pJitterBuffer = *it;
+			m_vJitterBuffers.erase(it);
+			break;
+		}
+	}
+	g_mutex_unlock(&m_JitterBuffersMutex);
+	
+	// Removing the probe frees the jitter buffer's state, once the probe is no longer running
+	if (pJitterBuffer != NULL)
+	{
+		GstPad* sinkPad = gst_element_get_static_pad(pJitterBuffer->pElement, "sink");
+		gst_pad_remove_probe(sinkPad, pJitterBuffer->probeId);
+		gst_object_unref(sinkPad);
+	}
+	if (pBranch != NULL)
+	{
+		RemoveBranch(pBranch);
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::GetSourceAddress()
+///
+/// Get the address a stream's RTP packets come from, from its rtpbin source's statistics.
+///
+/// @return The address without the port, or an empty string if unknown.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+std::string ReceiverPipeline::GetSourceAddress(guint session, guint ssrc) const
+{
+	std::string address;
+	GObject* rtpSession = NULL;
+	g_signal_emit_by_name(m_pRtpBin, "get-internal-session", session, &rtpSession);
+	if (rtpSession == NULL)
+	{
+		return address;
+	}
+	
+	GObject* source = NULL;
+	g_signal_emit_by_name(rtpSession, "get-source-by-ssrc", ssrc, &source);
+	if (source != NULL)
+	{
+		GstStructure* stats = NULL;
+		g_object_get(source, "stats", &stats, NULL);
+		const gchar* from = (stats != NULL) ? gst_structure_get_string(stats, "rtp-from") : NULL;
+		if (from != NULL)
+		{
+			address = from;
+			std::string::size_type colon = address.rfind(':');
+			if (colon != std::string::npos)
+			{
+				address.erase(colon);
+			}
+		}
+		if (stats != NULL)
+		{
+			gst_structure_free(stats);
+		}
+		g_object_unref(source);
+	}
+	g_object_unref(rtpSession);
+	return address;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::SenderAddress()
+///
+/// Get the address of the participant a stream is from: the participant that announced its SSRC
+/// (see SetParticipantSsrcs()), or else the address its packets come from, which is all there is
+/// to go by until its sender's parameters arrive (or for a restarted sender's new SSRC, until they
+/// are announced again). Called with m_BranchesMutex held.
+///
+/// @param session  The stream's rtpbin session.
+///
+/// @param ssrc  The stream's SSRC.
+///
+/// @param sourceAddress  The address (without port) the stream's packets come from.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+std::string ReceiverPipeline::SenderAddress(guint session, guint ssrc, const std::string& sourceAddress) const
+{
+	for (std::vector<Participant>::const_iterator it = m_vParticipants.begin(); it != m_vParticipants.end(); ++it)
+	{
+		if (it->haveSsrcs && IsAnnouncedSsrc(session, ssrc, it->videoSsrc, it->audioSsrc))
+		{
+			return it->address;
+		}
+	}
+	return sourceAddress;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::IsAnnouncedSsrc()
+///
+/// @return Whether a stream is one a sender announced: in session 0, any of its simulcast video
+/// layers (each has an SSRC of its own); in session 1, its audio.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool ReceiverPipeline::IsAnnouncedSsrc(guint session, guint ssrc, guint videoSsrc, guint audioSsrc)
+{
+	return (session == 0) ? (SenderPipeline::SsrcLayer(videoSsrc, ssrc) < SenderPipeline::MAX_SIMULCAST_LAYERS) : (ssrc == audioSsrc);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::FindParticipant()
+///
+/// @return The participant at an address, or NULL if none.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+const ReceiverPipeline::Participant* ReceiverPipeline::FindParticipant(const std::string& address) const
+{
+	for (std::vector<Participant>::const_iterator it = m_vParticipants.begin(); it != m_vParticipants.end(); ++it)
+	{
+		if (it->address == address)
+		{
+			return &*it;
+		}
+	}
+	return NULL;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::NewBranch()
+///
+/// Create the branch of a stream in a bin of its own, add it to the pipeline, and link the
+/// stream's pad to it. Video from a participant is decoded and shown in its window; audio from a
+/// participant is decoded (by the decoder its payload type's caps call for) and mixed in, at the
+/// participant's gain; anything else is discarded. In composite mode, the video is composited
+/// instead, in the participant's rectangle. Called with m_BranchesMutex held.
+///
+/// This runs on rtpbin's streaming thread, holding up every stream of the session, so the bin is
+/// normally one built ahead (see TakeBranchBin()): only the window, the visibility, the gain, and
+/// the links are left to set up here.
+///
+/// @param pad  The stream's pad on rtpbin.
+///
+/// @param session  The stream's rtpbin session.
+///
+/// @param ssrc  The stream's SSRC.
+///
+/// @param address  The address the stream comes from.
+///
+/// @return The branch.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+ReceiverPipeline::Branch* ReceiverPipeline::NewBranch(GstPad* pad, guint session, guint ssrc, const std::string& address)
+{
+	Branch* pBranch = new Branch();
+	pBranch->pOwner = this;
+	pBranch->session = session;
+	pBranch->ssrc = ssrc;
+	pBranch->address = address;
+	pBranch->pSrcPad = GST_PAD(gst_object_ref(pad));
+	pBranch->pBin = NULL;
+	pBranch->pDepayloader = NULL;
+	pBranch->pDecoder = NULL;
+	pBranch->pVolume = NULL;
+	pBranch->pRequestPad = NULL;
+	pBranch->haveKeyFrame = FALSE;
+	pBranch->keyFramesOnly = FALSE;
+	pBranch->lastKeyFrameUs = 0;
+	pBranch->lastKeyUnitRequestUs = 0;
+	
+	gint64 startUs = g_get_monotonic_time();
+	const Participant* pParticipant = FindParticipant(address);
+	bool prebuilt = false;
+	pBranch->pBin = TakeBranchBin(GetBranchTemplate(pad, session, pParticipant), prebuilt);
+	
+	pBranch->pDepayloader = gst_bin_get_by_name(GST_BIN(pBranch->pBin), "vdepay");
+	pBranch->pDecoder = gst_bin_get_by_name(GST_BIN(pBranch->pBin), "vdec");
+	if ((pBranch->pDecoder != NULL) && (m_pCompositor == NULL))
+	{
+		// Set vsink to display on the participant's window
+		GstElement* e = gst_bin_get_by_name(GST_BIN(pBranch->pBin), "vsink");
+		assert(e != NULL);
+		gst_video_overlay_set_window_handle(GST_VIDEO_OVERLAY(e), reinterpret_cast<guintptr>(pParticipant->pWindowHandle));
+		gst_object_unref(e);
+	}
+	if (pBranch->pDecoder != NULL)
+	{
+		// The sender only sends key frames on demand. Watch what goes into the decoder so that
+		// we ask for one when we join mid-stream; the bus is watched for decode errors.
+		GstPad* sinkPad = gst_element_get_static_pad(pBranch->pDecoder, "sink");
+		assert(sinkPad != NULL);
+		gst_pad_add_probe(sinkPad, GST_PAD_PROBE_TYPE_BUFFER, StaticDecoderSinkProbe, pBranch, NULL);
+		gst_object_unref(sinkPad);
+		
+		ApplyVisibility(pBranch, *pParticipant, pParticipant->visibility);
+	}
+	
+	gst_bin_add(GST_BIN(Pipeline()), pBranch->pBin);
+	gst_object_unref(pBranch->pBin);
+	pBranch->pVolume = gst_bin_get_by_name(GST_BIN(pBranch->pBin), "avolume");
+	if (pBranch->pVolume != NULL)
+	{
+		// Mix the participant's audio in, at its gain
+		g_object_set(pBranch->pVolume, "volume", pParticipant->gain, NULL);
+		pBranch->pRequestPad = gst_element_get_request_pad(m_pMixer, "sink_%u");
+		assert(pBranch->pRequestPad != NULL);
+	}
+	else if ((pBranch->pDecoder != NULL) && (m_pCompositor != NULL))
+	{
+		// Composite the participant's video, in its rectangle
+		pBranch->pRequestPad = gst_element_get_request_pad(m_pCompositor, "sink_%u");
+		assert(pBranch->pRequestPad != NULL);
+		SetCompositorPadLayout(pBranch->pRequestPad, *pParticipant);
+	}
+	if (pBranch->pRequestPad != NULL)
+	{
+		GstPad* srcPad = gst_element_get_static_pad(pBranch->pBin, "src");
+		assert(srcPad != NULL);
+		assert(gst_pad_link(srcPad, pBranch->pRequestPad) == GST_PAD_LINK_OK);
+		gst_object_unref(srcPad);
+	}
+	gst_element_sync_state_with_parent(pBranch->pBin);
+	GstPad* sinkPad = gst_element_get_static_pad(pBranch->pBin, "sink");
+	assert(sinkPad != NULL);
+	assert(gst_pad_link(pad, sinkPad) == GST_PAD_LINK_OK);
+	gst_object_unref(sinkPad);
+	
+	gint64 setupUs = g_get_monotonic_time() - startUs;
+	g_mutex_lock(&m_SpareBinsMutex);
+	m_BranchStats.branches++;
+	m_BranchStats.lastSetupUs = setupUs;
+	m_BranchStats.maxSetupUs = std::max(m_BranchStats.maxSetupUs, setupUs);
+	gint64 maxSetupUs = m_BranchStats.maxSetupUs;
+	g_mutex_unlock(&m_SpareBinsMutex);
+	
+	g_message("Set up the branch of stream %u/%08x from %s in %lld us, %s (slowest so far %lld us)",
+		session, ssrc, address.c_str(), static_cast<long long>(setupUs),
+		prebuilt ? "built ahead" : "built on demand", static_cast<long long>(maxSetupUs));
+	return pBranch;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::GetBranchTemplate()
+///
+/// Get the kind of branch a stream needs: video from a participant is decoded; so is audio from
+/// a participant, with the decoder its payload type's caps call for; anything else is discarded.
+/// Called with m_BranchesMutex held.
+///
+/// @param pad  The stream's pad on rtpbin.
+///
+/// @param session  The stream's rtpbin session.
+///
+/// @param pParticipant  The participant the stream comes from; NULL if none.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+ReceiverPipeline::BranchTemplate ReceiverPipeline::GetBranchTemplate(GstPad* pad, guint session, const Participant* pParticipant) const
+{
+	if (pParticipant == NULL)
+	{
+		return TEMPLATE_DISCARD;
+	}
+	if (session == 0)
+	{
+		return TEMPLATE_VIDEO;
+	}
+	
+	guint pt = 0;
+	std::sscanf(GST_PAD_NAME(pad), "recv_rtp_src_%*u_%*u_%u", &pt);
+	std::map<guint, std::string>::const_iterator it = m_AudioPtCaps.find(pt);
+	return (it != m_AudioPtCaps.end()) ? AudioTemplate(it->second.c_str()) : TEMPLATE_DISCARD;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::MakeElement()
+///
+/// Create an element. Each factory is looked up in the registry the first time only, and kept;
+/// the branches are built from the same few factories over and over.
+///
+/// @param factoryName  The name of the element's factory.
+///
+/// @param name  The element's name; NULL for a unique one.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+GstElement* ReceiverPipeline::MakeElement(const char* factoryName, const char* name)
+{
+	static GMutex mutex;
+	static std::map<std::string, GstElementFactory*> factories;
+	
+	g_mutex_lock(&mutex);
+	GstElementFactory*& rFactory = factories[factoryName];
+	if (rFactory == NULL)
+	{
+		rFactory = gst_element_factory_find(factoryName);
+	}
+	GstElementFactory* pFactory = rFactory;
+	g_mutex_unlock(&mutex);
+	
+	assert(pFactory != NULL);
+	GstElement* e = gst_element_factory_create(pFactory, name);
+	assert(e != NULL);
+	return e;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::NewBranchBin()
+///
+/// Build the bin of a kind of branch, element by element, with ghost pads for its unlinked pads.
+/// It isn't in the pipeline yet; the caller owns it.
+///
+/// A video branch depayloads, decodes, scales, and converts the video, and shows it in its own
+/// sink; in composite mode, its source pad is linked to a compositor input instead. The sink
+/// doesn't preroll (async=false), as the pipeline is already playing when the branch is added.
+/// The valve, the key-frames-only dropping, and the scaling caps follow the participant's
+/// visibility (see ApplyVisibility()); the video is scaled before its colorspace is converted.
+///
+/// An audio branch depayloads and decodes the audio, and converts it to the mixer's format
+/// (PlayoutMixer::RATE Hz mono); its source pad is linked to a mixer input, and the volume is the
+/// participant's gain. The jitter buffer reports lost packets (do-lost=true), which opusdec
+/// conceals, or rebuilds from the in-band FEC in the following packet when the sender uses it.
+///
+/// A discarding branch is only a sink: the stream's pad has to be linked to something, or the
+/// jitter buffer stops on "not linked".
+///////////////////////////////////////////////////////////////////////////////////////////////////
+GstElement* ReceiverPipeline::NewBranchBin(BranchTemplate kind) const
+{
+	GstElement* bin = gst_bin_new(NULL);
+	GstElement* first = NULL;
+	GstElement* last = NULL;
+	GstCaps* caps = NULL;
+	
+	if (kind == TEMPLATE_VIDEO)
+	{
+		GstElement* vdepay = MakeElement("rtph264depay", "vdepay");
+		
+		GstElement* depaycaps = MakeElement("capsfilter", NULL);
+		caps = gst_caps_new_simple("video/x-h264",
+			"stream-format", G_TYPE_STRING, "byte-stream",
+			"alignment",     G_TYPE_STRING, "au",
+			NULL);
+		g_object_set(depaycaps, "caps", caps, NULL);
+		gst_caps_unref(caps);
+		
+		GstElement* vvalve = MakeElement("valve", "vvalve");
+		g_object_set(vvalve, "drop", FALSE, NULL);
+		
+		GstElement* vdec = MakeElement("avdec_h264", "vdec");
+		GstElement* videoscale = MakeElement("videoscale", NULL);
+		GstElement* vscalecaps = MakeElement("capsfilter", "vscalecaps");
+		GstElement* videoconvert = MakeElement("videoconvert", NULL);
+		
+		gst_bin_add_many(GST_BIN(bin), vdepay, depaycaps, vvalve, vdec, videoscale, vscalecaps, videoconvert, NULL);
+		assert(gst_element_link_many(vdepay, depaycaps, vvalve, vdec, videoscale, vscalecaps, videoconvert, NULL));
+		first = vdepay;
+		last = videoconvert;
+		
+		if (m_pCompositor == NULL)
+		{
+			GstElement* vsink = MakeElement("osxvideosink", "vsink");
+			g_object_set(vsink,
+				"enable-last-sample", FALSE,
+				"async",              FALSE,
+				"sync",               TRUE,
+				NULL);
+			gst_bin_add(GST_BIN(bin), vsink);
+			assert(gst_element_link(videoconvert, vsink));
+			last = NULL;
+		}
+	}
+	else if (kind != TEMPLATE_DISCARD)
+	{
+		GstElement* adepay = MakeElement((kind == TEMPLATE_SPEEX) ? "rtpspeexdepay" : "rtpopusdepay", NULL);
+		GstElement* adec = MakeElement((kind == TEMPLATE_SPEEX) ? "speexdec" : "opusdec", NULL);
+		if (kind != TEMPLATE_SPEEX)
+		{
+			g_object_set(adec,
+				"plc",            TRUE,
+				"use-inband-fec", (kind == TEMPLATE_OPUS_FEC) ? TRUE : FALSE,
+				NULL);
+		}
+		
+		GstElement* audioconvert = MakeElement("audioconvert", NULL);
+		GstElement* audioresample = MakeElement("audioresample", NULL);
+		
+		GstElement* mixcaps = MakeElement("capsfilter", NULL);
+		caps = gst_caps_new_simple("audio/x-raw",
+			"format",   G_TYPE_STRING, "S16LE",
+			"layout",   G_TYPE_STRING, "interleaved",
+			"channels", G_TYPE_INT,    1,
+			"rate",     G_TYPE_INT,    static_cast<gint>(PlayoutMixer::RATE),
+			NULL);
+		g_object_set(mixcaps, "caps", caps, NULL);
+		gst_caps_unref(caps);
+		
+		GstElement* avolume = MakeElement("volume", "avolume");
+		
+		gst_bin_add_many(GST_BIN(bin), adepay, adec, audioconvert, audioresample, mixcaps, avolume, NULL);
+		assert(gst_element_link_many(adepay, adec, audioconvert, audioresample, mixcaps, avolume, NULL));
+		first = adepay;
+		last = avolume;
+	}
+	else
+	{
+		GstElement* fakesink = MakeElement("fakesink", NULL);
+		g_object_set(fakesink,
+			"enable-last-sample", FALSE,
+			"async",              FALSE,
+			"sync",               FALSE,
+			NULL);
+		gst_bin_add(GST_BIN(bin), fakesink);
+		first = fakesink;
+	}
+	
+	GstPad* pad = gst_element_get_static_pad(first, "sink");
+	assert(pad != NULL);
+	gst_element_add_pad(bin, gst_ghost_pad_new("sink", pad));
+	gst_object_unref(pad);
+	if (last != NULL)
+	{
+		pad = gst_element_get_static_pad(last, "src");
+		assert(pad != NULL);
+		gst_element_add_pad(bin, gst_ghost_pad_new("src", pad));
+		gst_object_unref(pad);
+	}
+	return GST_ELEMENT(gst_object_ref_sink(bin));
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::TakeBranchBin()
+///
+/// Get a bin of a kind of branch for a new stream: one built ahead, if there is one, or else a new
+/// one. A bin built ahead is already in the READY state, so its elements have their resources;
+/// taking it has the main thread build another (see RefillSpareBins()). The caller owns the bin.
+///
+/// @param kind  The kind of branch.
+///
+/// @param rPrebuilt  Set to whether the bin was built ahead.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+GstElement* ReceiverPipeline::TakeBranchBin(BranchTemplate kind, bool& rPrebuilt)
+{
+	GstElement* bin = NULL;
+	
+	g_mutex_lock(&m_SpareBinsMutex);
+	if (!m_vSpareBins[kind].empty())
+	{
+		bin = m_vSpareBins[kind].back();
+		m_vSpareBins[kind].pop_back();
+		m_BranchStats.prebuilt++;
+	}
+	rPrebuilt = (bin != NULL);
+	if (m_StockedTemplates[kind] && (m_RefillSourceId == 0))
+	{
+		m_RefillSourceId = g_idle_add(StaticRefillSpareBins, this);
+	}
+	g_mutex_unlock(&m_SpareBinsMutex);
+	
+	return (bin != NULL) ? bin : NewBranchBin(kind);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::StockBranchTemplate()
+///
+/// Keep SPARE_BRANCHES bins of a kind of branch built ahead from now on; the main thread builds
+/// them when it is idle (see RefillSpareBins()).
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ReceiverPipeline::StockBranchTemplate(BranchTemplate kind)
+{
+	g_mutex_lock(&m_SpareBinsMutex);
+	m_StockedTemplates[kind] = true;
+	if (m_RefillSourceId == 0)
+	{
+		m_RefillSourceId = g_idle_add(StaticRefillSpareBins, this);
+	}
+	g_mutex_unlock(&m_SpareBinsMutex);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::RefillSpareBins()
+///
+/// Idle callback on the main thread: build the bins missing from SPARE_BRANCHES of each kind of
+/// branch kept built ahead, and bring them to the READY state, so that TakeBranchBin() doesn't
+/// have to build them on the streaming thread. They are built without holding the lock.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ReceiverPipeline::RefillSpareBins()
+{
+	size_t missing[NUM_BRANCH_TEMPLATES];
+	g_mutex_lock(&m_SpareBinsMutex);
+	m_RefillSourceId = 0;
+	for (size_t kind = 0; kind < NUM_BRANCH_TEMPLATES; ++kind)
+	{
+		size_t spares = m_vSpareBins[kind].size();
+		missing[kind] = (m_StockedTemplates[kind] && (spares < SPARE_BRANCHES)) ? (SPARE_BRANCHES - spares) : 0;
+	}
+	g_mutex_unlock(&m_SpareBinsMutex);
+	
+	for (size_t kind = 0; kind < NUM_BRANCH_TEMPLATES; ++kind)
+	{
+		for (size_t i = 0; i < missing[kind]; ++i)
+		{
+			GstElement* bin = NewBranchBin(static_cast<BranchTemplate>(kind));
+			gst_element_set_state(bin, GST_STATE_READY);
+			g_mutex_lock(&m_SpareBinsMutex);
+			m_vSpareBins[kind].push_back(bin);
+			g_mutex_unlock(&m_SpareBinsMutex);
+		}
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::RemoveBranch()
+///
+/// Unlink a branch from its stream's pad, stop it, release its mixer or compositor input, take it
+/// out of the pipeline, and free it. The pad must be idle or gone.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ReceiverPipeline::RemoveBranch(Branch* pBranch)
+{
+	GstPad* sinkPad = gst_element_get_static_pad(pBranch->pBin, "sink");
+	assert(sinkPad != NULL);
+	gst_pad_unlink(pBranch->pSrcPad, sinkPad);
+	gst_object_unref(sinkPad);
+	
+	gst_element_set_state(pBranch->pBin, GST_STATE_NULL);
+	if (pBranch->pRequestPad != NULL)
+	{
+		GstPad* srcPad = gst_element_get_static_pad(pBranch->pBin, "src");
+		assert(srcPad != NULL);
+		gst_pad_unlink(srcPad, pBranch->pRequestPad);
+		gst_object_unref(srcPad);
+		gst_element_release_request_pad((pBranch->session == 0) ? m_pCompositor : m_pMixer, pBranch->pRequestPad);
+		gst_object_unref(pBranch->pRequestPad);
+	}
+	gst_bin_remove(GST_BIN(Pipeline()), pBranch->pBin);
+	
+	if (pBranch->pVolume != NULL)
+	{
+		gst_object_unref(pBranch->pVolume);
+	}
+	if (pBranch->pDepayloader != NULL)
+	{
+		gst_object_unref(pBranch->pDepayloader);
+	}
+	if (pBranch->pDecoder != NULL)
+	{
+		gst_object_unref(pBranch->pDecoder);
+	}
+	gst_object_unref(pBranch->pSrcPad);
+	delete pBranch;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::RebuildBranches()
+///
+/// Replace the branches of the streams from an address, after its participant was added or
+/// removed. A branch is swapped from an idle probe on its pad, so no buffer is being pushed into
+/// it, and the pad is never left unlinked while the stream flows.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ReceiverPipeline::RebuildBranches(const std::string& address)
+{
+	std::vector<Branch*> vBranches;
+	
+	g_mutex_lock(&m_BranchesMutex);
+	for (std::vector<Branch*>::iterator it = m_vBranches.begin(); it != m_vBranches.end(); )
+	{
+		if ((*it)->address == address)
+		{
+			vBranches.push_back(*it);
+			it = m_vBranches.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+	g_mutex_unlock(&m_BranchesMutex);
+	
+	for (std::vector<Branch*>::iterator it = vBranches.begin(); it != vBranches.end(); ++it)
+	{
+		gst_pad_add_probe((*it)->pSrcPad, GST_PAD_PROBE_TYPE_IDLE, StaticRebuildProbe, *it, NULL);
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::RebuildBranch()
+///
+/// Called from an idle probe on a branch's pad: replace the branch by a new one for the same
+/// stream, for the participants as they are now.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ReceiverPipeline::RebuildBranch(Branch* pBranch)
+{
+	GstPad* pad = GST_PAD(gst_object_ref(pBranch->pSrcPad));
+	guint session = pBranch->session;
+	guint ssrc = pBranch->ssrc;
+	RemoveBranch(pBranch);
+	std::string sourceAddress = GetSourceAddress(session, ssrc);
+	
+	g_mutex_lock(&m_BranchesMutex);
+	m_vBranches.push_back(NewBranch(pad, session, ssrc, SenderAddress(session, ssrc, sourceAddress)));
+	g_mutex_unlock(&m_BranchesMutex);
+	gst_object_unref(pad);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::TakeSwappableBranch()
+///
+/// Find the branch a new stream takes over: the decoding branch of another stream from the same
+/// participant in the same session, with the same payload type (so its decoder fits). A sender has
+/// only one stream per session at a time, so that is the stream it sent before restarting, or
+/// before it switched us to another simulcast layer (each layer has an SSRC of its own). The
+/// branch is taken out of m_vBranches until it is moved, so nothing else touches it meanwhile.
+/// Called with m_BranchesMutex held.
+///
+/// @param pad  The new stream's pad on rtpbin.
+///
+/// @param session  The new stream's rtpbin session.
+///
+/// @param ssrc  The new stream's SSRC.
+///
+/// @param address  The address the new stream comes from.
+///
+/// @return The branch, or NULL if the new stream needs a branch of its own.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+ReceiverPipeline::Branch* ReceiverPipeline::TakeSwappableBranch(GstPad* pad, guint session, guint ssrc, const std::string& address)
+{
+	if (FindParticipant(address) == NULL)
+	{
+		return NULL;
+	}
+	
+	guint pt = 0;
+	std::sscanf(GST_PAD_NAME(pad), "recv_rtp_src_%*u_%*u_%u", &pt);
+	for (std::vector<Branch*>::iterator it = m_vBranches.begin(); it != m_vBranches.end(); ++it)
+	{
+		guint branchPt = 0;
+		std::sscanf(GST_PAD_NAME((*it)->pSrcPad), "recv_rtp_src_%*u_%*u_%u", &branchPt);
+		if (((*it)->session == session) && ((*it)->ssrc != ssrc) && ((*it)->address == address) && (branchPt == pt) &&
+			(((*it)->pDecoder != NULL) || ((*it)->pVolume != NULL)))
+		{
+			Branch* pBranch = *it;
+			m_vBranches.erase(it);
+			return pBranch;
+		}
+	}
+	return NULL;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::SwapBranch()
+///
+/// Called from an idle probe on the old stream's pad: move its branch over to the new stream.
+/// What the old stream left in the depayloader and decoder is flushed, but the flush goes no
+/// further: the video sink would lose its preroll (and the pipeline its state) over it, and the
+/// mixer and compositor inputs carry on as they are. The decoder then waits for the new stream's
+/// key frame, asking for one if it doesn't come first.
+///
+/// The new stream's jitter buffer starts out at the old one's latency, since the path is the same.
+/// The old stream is freed from the main thread (see BusMessage()) rather than left to time out.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ReceiverPipeline::SwapBranch(Swap* pSwap)
+{
+	Branch* pBranch = pSwap->pBranch;
+	guint oldSsrc = pBranch->ssrc;
+	
+	GstPad* sinkPad = gst_element_get_static_pad(pBranch->pBin, "sink");
+	assert(sinkPad != NULL);
+	gst_pad_unlink(pBranch->pSrcPad, sinkPad);
+	
+	GstPad* flushEndPad = (pBranch->pDecoder != NULL) ? gst_element_get_static_pad(pBranch->pDecoder, "src") : gst_element_get_static_pad(pBranch->pBin, "src");
+	assert(flushEndPad != NULL);
+	gulong dropProbeId = gst_pad_add_probe(flushEndPad, GST_PAD_PROBE_TYPE_EVENT_FLUSH, StaticDropFlushProbe, NULL, NULL);
+	gst_pad_send_event(sinkPad, gst_event_new_flush_start());
+	gst_pad_send_event(sinkPad, gst_event_new_flush_stop(TRUE));
+	gst_pad_remove_probe(flushEndPad, dropProbeId);
+	gst_object_unref(flushEndPad);
+	
+	assert(gst_pad_link(pSwap->pPad, sinkPad) == GST_PAD_LINK_OK);
+	gst_object_unref(sinkPad);
+	
+	g_mutex_lock(&m_JitterBuffersMutex);
+	JitterBuffer* pOld = NULL;
+	JitterBuffer* pNew = NULL;
+	for (std::vector<JitterBuffer*>::iterator it = m_vJitterBuffers.begin(); it != m_vJitterBuffers.end(); ++it)
+	{
+		if ((*it)->session == pBranch->session)
+		{
+			pOld = ((*it)->ssrc == oldSsrc) ? *it : pOld;
+			pNew = ((*it)->ssrc == pSwap->ssrc) ? *it : pNew;
+		}
+	}
+	if ((pOld != NULL) && (pNew != NULL) && (pOld->latencyMs != pNew->latencyMs))
+	{
+		pNew->latencyMs = pOld->latencyMs;
+		g_object_set(pNew->pElement, "latency", pNew->latencyMs, NULL);
+		if (pNew->session == 0)
+		{
+			g_object_set(pNew->pElement, "rtx-retry-period", static_cast<gint>(pNew->latencyMs), NULL);
+		}
+	}
+	
+	g_mutex_lock(&m_BranchesMutex);
+	gst_object_unref(pBranch->pSrcPad);
+	pBranch->pSrcPad = pSwap->pPad;
+	pBranch->ssrc = pSwap->ssrc;
+	g_atomic_int_set(&pBranch->haveKeyFrame, FALSE);
+	m_vBranches.push_back(pBranch);
+	g_mutex_unlock(&m_BranchesMutex);
+	g_mutex_unlock(&m_JitterBuffersMutex);
+	
+	g_mutex_lock(&m_KeyUnitMutex);
+	pBranch->lastKeyUnitRequestUs = 0;
+	g_mutex_unlock(&m_KeyUnitMutex);
+	
+	gst_pad_remove_probe(pSwap->pPad, pSwap->blockProbeId);
+	gst_element_post_message(Pipeline(), gst_message_new_application(GST_OBJECT(Pipeline()),
+		gst_structure_new(CLEAR_SSRC_MESSAGE,
+			"session", G_TYPE_UINT, pBranch->session,
+			"ssrc",    G_TYPE_UINT, oldSsrc,
+			NULL)));
+	delete pSwap;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::StaticRequestFecDecoder()
+///
+/// Handler for rtpbin's "request-fec-decoder" signal. Give the video session an rtpulpfecdec,
+/// which drops the FEC packets and rebuilds lost packets the jitter buffer reports from them.
+/// Without FEC packets it passes everything through.
+///
+/// @return The FEC decoder, or NULL for none.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+GstElement* ReceiverPipeline::StaticRequestFecDecoder(GstElement* rtpbin, guint session, gpointer user_data)
+{
+	if (session != 0)
+	{
+		return NULL;
+	}
+	
+	GObject* storage = NULL;
+	g_signal_emit_by_name(rtpbin, "get-internal-storage", session, &storage);
+	GstElement* fecdec = gst_element_factory_make("rtpulpfecdec", NULL);
+	g_object_set(G_OBJECT(fecdec),
+		"pt",      SenderPipeline::FEC_PAYLOAD_TYPE,
+		"storage", storage,
+		NULL);
+	g_object_unref(storage);
+	return fecdec;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::RequestPtMap()
+///
+/// Handler for rtpbin's "request-pt-map" signal. The video caps only describe the H.264 payload
+/// type; the jitter buffer also needs the clock rate of the FEC packets. The audio caps come from
+/// the audio parameters.
+///
+/// @return The caps for the payload type, or NULL if unknown.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+GstCaps* ReceiverPipeline::RequestPtMap(guint session, guint pt)
+{
+	if (session == 0)
+	{
+		if (pt != SenderPipeline::FEC_PAYLOAD_TYPE)
+		{
+			return NULL;
+		}
+		return gst_caps_new_simple("application/x-rtp",
+			"media",         G_TYPE_STRING, "video",
+			"clock-rate",    G_TYPE_INT,    90000,
+			"encoding-name", G_TYPE_STRING, "ULPFEC",
+			"payload",       G_TYPE_INT,    static_cast<gint>(pt),
+			NULL);
+	}
+	
+	GstCaps* caps = NULL;
+	g_mutex_lock(&m_BranchesMutex);
+	std::map<guint, std::string>::const_iterator it = m_AudioPtCaps.find(pt);
+	if (it != m_AudioPtCaps.end())
+	{
+		caps = gst_caps_from_string(it->second.c_str());
+	}
+	g_mutex_unlock(&m_BranchesMutex);
+	return caps;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::StaticRequestAuxReceiver()
+///
+/// Handler for rtpbin's "request-aux-receiver" signal. Give the video session an rtprtxreceive,
+/// which turns retransmitted packets back into the originals for the jitter buffer.
+///
+/// @return The auxiliary receiver bin, or NULL for none.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+GstElement* ReceiverPipeline::StaticRequestAuxReceiver(GstElement* rtpbin, guint session, gpointer user_data)
+{
+	if (session != 0)
+	{
+		return NULL;
+	}
+	
+	GstElement* rtxreceive = gst_element_factory_make("rtprtxreceive", "rtxreceive");
+	GstStructure* map = SenderPipeline::NewRtxPayloadTypeMap(true);
+	g_object_set(G_OBJECT(rtxreceive), "payload-type-map", map, NULL);
+	gst_structure_free(map);
+	
+	return gst_rtp_aux_bin_new(rtxreceive, session);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::NewJitterBuffer()
+///
+/// Called when rtpbin creates a jitter buffer for a new SSRC. A probe on its input measures the
+/// stream's jitter and retargets its latency. Backlog beyond the latency (after a stall) is
+/// dropped rather than played out late.
+///
+/// Video jitter buffers also NACK missing packets. They space their retries by the measured round
+/// trip time, and give up once the retry period is over; that period is pinned to the jitter
+/// buffer's latency, so no retransmission is asked for that would arrive after the packet's
+/// playout time. Only a round trip well under the latency leaves room for a retransmission to
+/// arrive in time.
+///
+/// @param jitterbuffer  The new rtpjitterbuffer.
+///
+/// @param session  Its rtpbin session.
+///
+/// @param ssrc  The SSRC of its stream.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ReceiverPipeline::NewJitterBuffer(GstElement* jitterbuffer, guint session, guint ssrc)
+{
+	guint latencyMs = 0;
+	g_object_get(jitterbuffer, "latency", &latencyMs, NULL);
+	
+	JitterBuffer* pJitterBuffer = new JitterBuffer();
+	pJitterBuffer->pOwner = this;
+	pJitterBuffer->session = session;
+	pJitterBuffer->ssrc = ssrc;
+	pJitterBuffer->pElement = GST_ELEMENT(gst_object_ref(jitterbuffer));
+	pJitterBuffer->probeId = 0;
+	pJitterBuffer->pEstimator = NULL;
+	pJitterBuffer->pStreamStats = new RtpStreamStats();
+	pJitterBuffer->lastRetargetUs = g_get_monotonic_time();
+	pJitterBuffer->latencyMs = latencyMs;
+	pJitterBuffer->stalls = 0;
+	
+	g_mutex_lock(&m_JitterBuffersMutex);
+	g_object_set(jitterbuffer, "drop-on-latency", TRUE, NULL);
+	if (session == 0)
+	{
+		g_object_set(jitterbuffer,
+			"do-retransmission", m_Retransmission ? TRUE : FALSE,
+			"rtx-retry-period",  static_cast<gint>(latencyMs),
+			"rtx-retry-timeout", -1, // (-1) from the round trip time
+			"rtx-max-retries",   -1, // (-1) until the retry period is over
+			NULL);
+	}
+	
+	GstPad* sinkPad = gst_element_get_static_pad(jitterbuffer, "sink");
+	assert(sinkPad != NULL);
+	pJitterBuffer->probeId = gst_pad_add_probe(sinkPad, GST_PAD_PROBE_TYPE_BUFFER, StaticJitterBufferSinkProbe, pJitterBuffer, StaticFreeJitterBuffer);
+	gst_object_unref(sinkPad);
+	m_vJitterBuffers.push_back(pJitterBuffer);
+	g_mutex_unlock(&m_JitterBuffersMutex);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::JitterBufferSinkProbe()
+///
+/// Called for each RTP packet going into a jitter buffer. Count it in the stream's statistics,
+/// feed its arrival time and RTP timestamp to the stream's estimator, and move the jitter buffer's
+/// latency toward the estimator's target every RETARGET_INTERVAL_US. The jitter buffer posts a
+/// latency message on a change, and BusMessage() redistributes the pipeline's latency; the receive
+/// buffers follow it too.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ReceiverPipeline::JitterBufferSinkProbe(JitterBuffer* pJitterBuffer, GstBuffer* pBuffer)
+{
+	GstMapInfo map;
+	if (!gst_buffer_map(pBuffer, &map, GST_MAP_READ))
+	{
+		return;
+	}
+	if (map.size < 12)
+	{
+		gst_buffer_unmap(pBuffer, &map);
+		return;
+	}
+	guint pt = map.data[1] & 0x7f;
+	guint16 seq = GST_READ_UINT16_BE(map.data + 2);
+	guint32 timestamp = GST_READ_UINT32_BE(map.data + 4);
+	gsize size = map.size;
+	gst_buffer_unmap(pBuffer, &map);
+	
+	gint64 now = g_get_monotonic_time();
+	g_mutex_lock(&m_JitterBuffersMutex);
+	pJitterBuffer->pStreamStats->OnPacket(now, seq, size);
+	if (pJitterBuffer->pEstimator == NULL)
+	{
+		guint clockRate = ClockRate(pJitterBuffer->session, pt);
+		if (clockRate == 0)
+		{
+			g_mutex_unlock(&m_JitterBuffersMutex);
+			return;
+		}
+		pJitterBuffer->pEstimator = new JitterEstimator(clockRate);
+	}
+	
+	if (pJitterBuffer->pEstimator->OnPacket(now, timestamp))
+	{
+		++pJitterBuffer->stalls;
+	}
+	
+	bool retargeted = false;
+	if ((now - pJitterBuffer->lastRetargetUs) >= RETARGET_INTERVAL_US)
+	{
+		pJitterBuffer->lastRetargetUs = now;
+		guint latencyMs = pJitterBuffer->pEstimator->Retarget(pJitterBuffer->latencyMs, m_LatencyPercentile);
+		if (latencyMs != pJitterBuffer->latencyMs)
+		{
+			retargeted = true;
+			pJitterBuffer->latencyMs = latencyMs;
+			g_object_set(pJitterBuffer->pElement, "latency", latencyMs, NULL);
+			if (pJitterBuffer->session == 0)
+			{
+				g_object_set(pJitterBuffer->pElement, "rtx-retry-period", static_cast<gint>(latencyMs), NULL);
+			}
+		}
+	}
+	g_mutex_unlock(&m_JitterBuffersMutex);
+	
+	if (retargeted)
+	{
+		ResizeSocketBuffers();
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::StaticFreeJitterBuffer()
+///
+/// Destroy notification of a jitter buffer's probe: free the state the probe used.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ReceiverPipeline::StaticFreeJitterBuffer(gpointer data)
+{
+	JitterBuffer* pJitterBuffer = reinterpret_cast<JitterBuffer*>(data);
+	delete pJitterBuffer->pEstimator;
+	delete pJitterBuffer->pStreamStats;
+	gst_object_unref(pJitterBuffer->pElement);
+	delete pJitterBuffer;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::ClockRate()
+///
+/// Get the RTP clock rate of a payload type: 90 kHz for the video, and the audio parameters' for
+/// the audio.
+///
+/// @return The clock rate, or 0 if the payload type is unknown.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+guint ReceiverPipeline::ClockRate(guint session, guint pt)
+{
+	if (session == 0)
+	{
+		return 90000;
+	}
+	
+	gint clockRate = 0;
+	g_mutex_lock(&m_BranchesMutex);
+	std::map<guint, std::string>::const_iterator it = m_AudioPtCaps.find(pt);
+	if (it != m_AudioPtCaps.end())
+	{
+		GstStructure* s = gst_structure_from_string(it->second.c_str(), NULL);
+		if (s != NULL)
+		{
+			gst_structure_get_int(s, "clock-rate", &clockRate);
+			gst_structure_free(s);
+		}
+	}
+	g_mutex_unlock(&m_BranchesMutex);
+	return static_cast<guint>(std::max(clockRate, 0));
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::DecoderSinkProbe()
+///
+/// Called for each H.264 access unit going into a video branch's decoder. Until a key frame has
+/// arrived (after joining mid-stream, or after a decode error) the decoder can't show anything,
+/// so keep asking the sender for one. Video down to key frames drops the delta units here, so the
+/// decoder never sees them, and asks for a fresh key frame once the last one is
+/// KEY_FRAMES_ONLY_INTERVAL_US old.
+///
+/// @return GST_PAD_PROBE_DROP for a delta unit of video down to key frames, else GST_PAD_PROBE_OK.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+GstPadProbeReturn ReceiverPipeline::DecoderSinkProbe(Branch* pBranch, GstBuffer* pBuffer)
+{
+	if (!GST_BUFFER_FLAG_IS_SET(pBuffer, GST_BUFFER_FLAG_DELTA_UNIT))
+	{
+		g_atomic_int_set(&pBranch->haveKeyFrame, TRUE);
+		pBranch->lastKeyFrameUs = g_get_monotonic_time();
+		return GST_PAD_PROBE_OK;
+	}
+	
+	if (g_atomic_int_get(&pBranch->keyFramesOnly))
+	{
+		if ((g_get_monotonic_time() - pBranch->lastKeyFrameUs) >= KEY_FRAMES_ONLY_INTERVAL_US)
+		{
+			RequestKeyUnit(pBranch);
+		}
+		return GST_PAD_PROBE_DROP;
+	}
+	
+	if (!g_atomic_int_get(&pBranch->haveKeyFrame))
+	{
+		RequestKeyUnit(pBranch);
+	}
+	return GST_PAD_PROBE_OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::BusMessage()
+///
+/// Bus message handler. A latency message (a jitter buffer's latency changed) redistributes the
+/// pipeline's latency. A warning or error from a video decoder means it has lost the picture, so
+/// ask its sender for a key frame (and keep asking until one arrives). A CLEAR_SSRC_MESSAGE has
+/// rtpbin free a stream whose branch a new stream took over; its pad goes away with it.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ReceiverPipeline::BusMessage(GstMessage* pMessage)
+{
+	if (GST_MESSAGE_TYPE(pMessage) == GST_MESSAGE_LATENCY)
+	{
+		gst_bin_recalculate_latency(GST_BIN(Pipeline()));
+		return;
+	}
+	
+	if ((GST_MESSAGE_TYPE(pMessage) == GST_MESSAGE_APPLICATION) &&
+		gst_structure_has_name(gst_message_get_structure(pMessage), CLEAR_SSRC_MESSAGE))
+	{
+		guint session = 0;
+		guint ssrc = 0;
+		gst_structure_get_uint(gst_message_get_structure(pMessage), "session", &session);
+		gst_structure_get_uint(gst_message_get_structure(pMessage), "ssrc", &ssrc);
+		g_signal_emit_by_name(m_pRtpBin, "clear-ssrc", session, ssrc, NULL);
+		return;
+	}
+	
+	if ((GST_MESSAGE_TYPE(pMessage) != GST_MESSAGE_WARNING) && (GST_MESSAGE_TYPE(pMessage) != GST_MESSAGE_ERROR))
+	{
+		return;
+	}
+	
+	g_mutex_lock(&m_BranchesMutex);
+	for (std::vector<Branch*>::iterator it = m_vBranches.begin(); it != m_vBranches.end(); ++it)
+	{
+		if (((*it)->pDecoder != NULL) && (GST_MESSAGE_SRC(pMessage) == GST_OBJECT((*it)->pDecoder)))
+		{
+			g_atomic_int_set(&(*it)->haveKeyFrame, FALSE);
+			RequestKeyUnit(*it);
+			break;
+		}
+	}
+	g_mutex_unlock(&m_BranchesMutex);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::RequestKeyUnit()
+///
+/// Ask the sender of a video stream for a key frame, at most once per
+/// KEY_UNIT_REQUEST_INTERVAL_US. The upstream key unit event travels from the branch's
+/// depayloader into rtpbin, which sends a PLI for the stream's SSRC.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ReceiverPipeline::RequestKeyUnit(Branch* pBranch)
+{
+	gint64 now = g_get_monotonic_time();
+	bool request = false;
+	
+	g_mutex_lock(&m_KeyUnitMutex);
+	if ((now - pBranch->lastKeyUnitRequestUs) >= KEY_UNIT_REQUEST_INTERVAL_US)
+	{
+		pBranch->lastKeyUnitRequestUs = now;
+		request = true;
+	}
+	g_mutex_unlock(&m_KeyUnitMutex);
+	
+	if (request)
+	{
+		gst_element_send_event(pBranch->pDepayloader, gst_video_event_new_upstream_force_key_unit(GST_CLOCK_TIME_NONE, TRUE, 0));
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::ApplyVisibility()
+///
+/// Set a video branch up for its participant's visibility and size. Hidden video is dropped by the
+/// valve ahead of the decoder, so only depayloading is left. Video down to key frames has its
+/// delta units dropped by the decoder probe; every P-frame is a reference frame (the sender uses
+/// no B-frames), so nothing short of that saves decoding. Reduced video is decoded in full, as
+/// the sender sends it a smaller simulcast layer. The scaling caps cap the decoded size at the
+/// size shown.
+///
+/// Video seen again after being hidden or down to key frames needs a key frame, since the frames
+/// it would refer to were dropped; the decoder probe asks for one at the first delta frame. Video
+/// down to key frames asks for one right away, to show something current.
+/// Called with m_BranchesMutex held.
+///
+/// @param pBranch  The video branch.
+///
+/// @param rParticipant  Its participant, with the visibility and size to apply.
+///
+/// @param previous  The visibility the branch was set up for before.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ReceiverPipeline::ApplyVisibility(Branch* pBranch, const Participant& rParticipant, Visibility previous)
+{
+	g_atomic_int_set(&pBranch->keyFramesOnly, (rParticipant.visibility == VISIBILITY_KEY_FRAMES) ? TRUE : FALSE);
+	
+	GstElement* e = gst_bin_get_by_name(GST_BIN(pBranch->pBin), "vvalve");
+	assert(e != NULL);
+	g_object_set(e, "drop", (rParticipant.visibility == VISIBILITY_HIDDEN) ? TRUE : FALSE, NULL);
+	gst_object_unref(e);
+	
+	gchar* capsString = ((rParticipant.width > 0) && (rParticipant.height > 0))
+		? g_strdup_printf("video/x-raw,width=(int)[1,%d],height=(int)[1,%d]", rParticipant.width, rParticipant.height)
+		: g_strdup("video/x-raw");
+	GstCaps* caps = gst_caps_from_string(capsString);
+	g_free(capsString);
+	e = gst_bin_get_by_name(GST_BIN(pBranch->pBin), "vscalecaps");
+	assert(e != NULL);
+	g_object_set(e, "caps", caps, NULL);
+	gst_object_unref(e);
+	gst_caps_unref(caps);
+	
+	if (((previous == VISIBILITY_HIDDEN) || (previous == VISIBILITY_KEY_FRAMES)) &&
+		(rParticipant.visibility != VISIBILITY_HIDDEN) && (rParticipant.visibility != VISIBILITY_KEY_FRAMES))
+	{
+		g_atomic_int_set(&pBranch->haveKeyFrame, FALSE);
+	}
+	else if ((previous != VISIBILITY_KEY_FRAMES) && (rParticipant.visibility == VISIBILITY_KEY_FRAMES))
+	{
+		RequestKeyUnit(pBranch);
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::SetCompositorPadLayout()
+///
+/// Place a compositor input at a participant's rectangle; one without a rectangle (yet) is shown
+/// transparent, so it takes no room.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void ReceiverPipeline::SetCompositorPadLayout(GstPad* pad, const Participant& rParticipant)
+{
+	bool visible = (rParticipant.compositeWidth > 0) && (rParticipant.compositeHeight > 0);
+	g_object_set(pad,
+		"xpos", rParticipant.compositeX,
+		"ypos", rParticipant.compositeY,
+		"width", visible ? rParticipant.compositeWidth : 1,
+		"height", visible ? rParticipant.compositeHeight : 1,
+		"alpha", visible ? 1.0 : 0.0,
+		NULL);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::AudioTemplate
+///
+/// Get the kind of branch that decodes a sender's audio parameters, picked by encoding name, and
+/// for Opus by whether the sender adds in-band FEC. Older GStreamers name Opus
+/// "X-GST-OPUS-DRAFT-SPITTKA-00". Parameters that don't parse get a discarding branch.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+ReceiverPipeline::BranchTemplate ReceiverPipeline::AudioTemplate(const char* audioParameters)
+{
+	BranchTemplate kind = TEMPLATE_SPEEX;
+	GstStructure* s = gst_structure_from_string(audioParameters, NULL);
+	if (s == NULL)
+	{
+		return TEMPLATE_DISCARD;
+	}
+	const gchar* encodingName = gst_structure_get_string(s, "encoding-name");
+	if ((encodingName != NULL) && ((g_ascii_strcasecmp(encodingName, "OPUS") == 0) || (g_str_has_prefix(encodingName, "X-GST-OPUS") == TRUE)))
+	{
+		bool fec = (g_strcmp0(gst_structure_get_string(s, "useinbandfec"), "1") == 0);
+		kind = fec ? TEMPLATE_OPUS_FEC : TEMPLATE_OPUS;
+	}
+	gst_structure_free(s);
+	return kind;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::AudioOutputString
+///
+/// Get the audio output that follows the mixer, for an audio output device: the audio sink, with
+/// the device to play on, or conversion for the built-in output. It is the pipeline's only audio
+/// sink.
+///
+/// The sink plays whatever the PlayoutMixer hands it as soon as it can (sync=false), through a
+/// small device buffer, so that it paces the PlayoutMixer. Audio and video are no longer in sync;
+/// the audio is as early as the jitter allows instead.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+std::string ReceiverPipeline::AudioOutputString(const char* audioDeviceName)
+{
+	const char SINK_STRING[] = " ! osxaudiosink enable-last-sample=false async=false sync=false buffer-time=20000 latency-time=10000";
+	std::string outputString;
+	if (std::strncmp(audioDeviceName, "Built-in Mic", sizeof("Built-in Mic") - 1) != 0)
+	{
+		// not built-in
+		int idx = SenderPipeline::GetAudioDeviceIndex(audioDeviceName);
+		assert(idx >= 0);
+		char deviceString[sizeof(" device=-2147483648")];
+		std::sprintf(deviceString, " device=%d", idx);
+		outputString = std::string(SINK_STRING) + deviceString;
+	}
+	else
+	{
+		// built-in
+		outputString = std::string(" ! audioconvert ! audioresample") + SINK_STRING;
+	}
+	return outputString;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// ReceiverPipeline::CreatePipeline
+///
+/// Creates a receiver pipeline, without any decoding branches yet, but with the audio mixer and
+/// output, and in composite mode the compositor and its sink. For use in constructor member
+/// initialization list.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+GstElement* ReceiverPipeline::CreatePipeline(const char* audioDeviceName, bool composite)
+{
+	std::string description = std::string(PIPELINE_STRING) + MIXER_STRING + AudioOutputString(audioDeviceName);
+	if (composite)
+	{
+		description += COMPOSITOR_STRING;
+	}
+	GstElement* ret = gst_parse_launch(description.c_str(), NULL);
+	assert(ret != NULL);
+	return ret;
+}
@@ -16,54 +16,674 @@
 /// Boston, MA 02110-1301 USA
 ///
 /// @brief This file declares the ReceiverPipeline class, which represents a pipeline receiving
-/// video and audio data from a remote endpoint.
+/// video and audio data from the remote endpoints.
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 #ifndef __RECEIVER_PIPELINE_HPP__
 #define __RECEIVER_PIPELINE_HPP__
 
 
 #include <gst/gst.h>          // for GStreamer stuff
+#include <map>                // for std::map
+#include <string>             // for std::string
+#include <vector>             // for std::vector
+#include "JitterEstimator.hpp" // for JitterEstimator
 #include "PipelineBase.hpp"   // for PipelineBase
 #include "PipelineTracer.hpp" // for PipelineTracer
+#include "RtpStreamStats.hpp" // for RtpStreamStats
 
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 /// This class represents the "receiver" side of the conference; that is, the received, decoded,
-/// and displayed video and audio data.
+/// and displayed video and audio data of all participants.
+///
+/// All senders send to the same ports, into one rtpbin: one session for the video and one for the
+/// audio. rtpbin demultiplexes the streams by SSRC, and a decoding branch is added for each new
+/// stream as its pad appears, and removed with it; the sender is recognized by the SSRCs it
+/// announced (see SetParticipantSsrcs()), or until then by the address its packets come from. So
+/// a participant costs a jitter buffer and a decoding branch, not a pipeline with its own sockets
+/// and threads.
+///
+/// Each stream's jitter buffer latency follows the jitter measured on it (see JitterEstimator).
+/// What arrives of each stream is counted on the way into its jitter buffer (see RtpStreamStats),
+/// so network loss can be told apart from the decoders falling behind.
+///
+/// All audio branches feed one PlayoutMixer, which plays the mix through the pipeline's only audio
+/// sink; each participant's audio goes through a volume element set to its gain on the way.
+///
+/// The video of each participant is shown by a sink of its own, in the participant's window;
+/// or, given a composite window, all of it is composited onto that one window, each participant
+/// in its own rectangle (see SetCompositeLayout()), and presented by one sink at one frame rate.
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 class ReceiverPipeline : public PipelineBase
 {
-public:	
+public:
 	/// Constructor
-	ReceiverPipeline(uint16_t basePort, const char* audioDeviceName, const char* pictureParameters, void* pWindowHandle);
+	ReceiverPipeline(const char* audioDeviceName, uint16_t basePort, const char* audioParameters, void* pCompositeWindowHandle);
 	
 	
 	/// Destructor
 	virtual ~ReceiverPipeline();
 	
 	
-	/// Get the display window sink using a native window handle.
-	const void* GetWindowSink() const { return m_DisplayWindowHandle; }
-		
-
+	/// Add a participant to receive from, showing its video in a window
+	void AddParticipant(const char* senderAddress, uint16_t senderPortBase, void* pWindowHandle);
+	
+	
+	/// Set the SSRCs a participant announced, which tell its streams apart from others coming from
+	/// the same address
+	void SetParticipantSsrcs(const char* senderAddress, guint videoSsrc, guint audioSsrc);
+	
+	
+	/// Remove a participant, and the decoding branches of its streams
+	void RemoveParticipant(const char* senderAddress);
+	
+	
+	/// Make audio described by a sender's audio parameters (its RTP caps) decodable
+	void AddAudioParameters(const char* audioParameters);
+	
+	
+	/// Turn asking for retransmission (NACK) of lost video packets on or off
+	void SetRetransmission(bool enable);
+	
+	
+	/// Get whether lost video packets are NACKed
+	inline bool GetRetransmission() const { return m_Retransmission; }
+	
+	
+	/// Get the number of retransmissions requested and received
+	void GetRetransmissionStats(guint& requests, guint& packets) const;
+	
+	
+	/// The jitter buffer state of one stream
+	struct LatencyStats
+	{
+		guint session;
+		guint ssrc;
+		guint latencyMs;
+		double jitterMs;
+		guint stalls;
+	};
+	
+	
+	/// Set the fraction of packets the jitter buffer latencies are picked to wait for
+	void SetLatencyPercentile(double percentile);
+	
+	
+	/// Get the current latency and jitter of each stream's jitter buffer
+	std::vector<LatencyStats> GetLatencyStats() const;
+	
+	
+	/// The packet-level receive statistics of one stream (see RtpStreamStats)
+	struct StreamStats
+	{
+		guint session;
+		guint ssrc;
+		RtpStreamStats::Stats counts;
+		double jitterMs;
+	};
+	
+	
+	/// The name of the element messages posting StreamStats (see SetStreamStatsInterval()).
+	static const char STREAM_STATS_MESSAGE[];
+	
+	
+	/// Get the packet-level receive statistics of each stream
+	std::vector<StreamStats> GetStreamStats() const;
+	
+	
+	/// Post each stream's statistics on the bus every intervalMs milliseconds; 0 stops
+	void SetStreamStatsInterval(guint intervalMs);
+	
+	
+	/// Set the video bitrate each participant sends at, at most, in bits/sec
+	void SetExpectedBitrate(size_t bitrate);
+	
+	
+	/// The receiving state of one UDP source
+	struct SocketStats
+	{
+		const char* name;
+		gint bufferSize;
+		guint64 datagrams;
+		guint64 dropped;
+	};
+	
+	
+	/// Get the receive buffer size of each UDP source, and the datagrams it received and the
+	/// kernel dropped for a full buffer
+	std::vector<SocketStats> GetSocketStats() const;
+	
+	
+	/// How long setting up the decoding branches of new streams took, and how many of them were
+	/// set up with a branch built ahead (see TakeBranchBin())
+	struct BranchStats
+	{
+		guint64 branches;
+		guint64 prebuilt;
+		gint64 lastSetupUs;
+		gint64 maxSetupUs;
+	};
+	
+	
+	/// Get how long setting up the branches of new streams took
+	BranchStats GetBranchStats() const;
+	
+	
+	/// Set the gain (1.0 for unchanged) a participant's audio is mixed at
+	void SetParticipantGain(const char* senderAddress, double gain);
+	
+	
+	/// How much of a participant's video is seen, which sets how much of it is decoded
+	enum Visibility
+	{
+		VISIBILITY_FULL,       ///< decode every frame
+		VISIBILITY_REDUCED,    ///< decode every frame of a smaller simulcast layer, which the
+		                       ///< caller asks the sender for
+		VISIBILITY_KEY_FRAMES, ///< decode key frames only, asking for one every
+		                       ///< KEY_FRAMES_ONLY_INTERVAL_US
+		VISIBILITY_HIDDEN      ///< drop the video ahead of the decoder
+	};
+	
+	
+	/// Set how much of a participant's video is seen, and its size in pixels (0 for any)
+	void SetVisibility(const char* senderAddress, Visibility visibility, int width, int height);
+	
+	
+	/// Set the size of the composite window's video, in pixels (composite mode only)
+	void SetCompositeSize(int width, int height);
+	
+	
+	/// Set the rectangle of the composite video a participant's video is shown in (composite
+	/// mode only); an empty one hides it
+	void SetCompositeLayout(const char* senderAddress, int x, int y, int width, int height);
+	
+	
 protected:
-
-
+	
+	
 private:
+	/// A participant we receive from
+	struct Participant
+	{
+		std::string address;
+		uint16_t portBase;
+		void* pWindowHandle;
+		double gain;
+		int compositeX;
+		int compositeY;
+		int compositeWidth;
+		int compositeHeight;
+		Visibility visibility;
+		int width;
+		int height;
+		bool haveSsrcs;
+		guint videoSsrc;
+		guint audioSsrc;
+	};
+	
+	
+	/// The decoding branch of one incoming stream (one SSRC of one session)
+	struct Branch
+	{
+		ReceiverPipeline* pOwner;
+		guint session;
+		guint ssrc;
+		std::string address;
+		GstPad* pSrcPad;
+		GstElement* pBin;
+		GstElement* pDepayloader;
+		GstElement* pDecoder;
+		GstElement* pVolume;
+		GstPad* pRequestPad;
+		volatile gint haveKeyFrame;
+		volatile gint keyFramesOnly;
+		gint64 lastKeyFrameUs;
+		gint64 lastKeyUnitRequestUs;
+	};
+	
+	
+	/// The kinds of branch; each kind is built the same way every time (see NewBranchBin())
+	enum BranchTemplate
+	{
+		TEMPLATE_DISCARD,  ///< discard the stream
+		TEMPLATE_VIDEO,    ///< decode H.264, and show or composite it
+		TEMPLATE_SPEEX,    ///< decode Speex, and mix it
+		TEMPLATE_OPUS,     ///< decode Opus, and mix it
+		TEMPLATE_OPUS_FEC, ///< decode Opus, recovering from its in-band FEC, and mix it
+		NUM_BRANCH_TEMPLATES
+	};
+	
+	
+	/// A stream taking over the decoding branch of its sender's previous stream (see PadAdded())
+	struct Swap
+	{
+		Branch* pBranch;
+		GstPad* pPad;
+		guint ssrc;
+		gulong blockProbeId;
+	};
+	
+	
+	/// A stream's jitter buffer, and the estimator of its latency
+	struct JitterBuffer
+	{
+		ReceiverPipeline* pOwner;
+		guint session;
+		guint ssrc;
+		GstElement* pElement;
+		gulong probeId;
+		JitterEstimator* pEstimator;
+		RtpStreamStats* pStreamStats;
+		gint64 lastRetargetUs;
+		guint latencyMs;
+		guint stalls;
+	};
+	
+	
+	/// The minimum interval between our RTCP reports, in nanoseconds.
+	static const guint64 RTCP_MIN_INTERVAL_NS = 500000000;
+	
+	
+	/// The minimum interval between our key unit requests (PLIs) per stream, in microseconds.
+	static const gint64 KEY_UNIT_REQUEST_INTERVAL_US = 500000;
+	
+	
+	/// How old the last key frame of video down to key frames gets before we ask for another, in
+	/// microseconds.
+	static const gint64 KEY_FRAMES_ONLY_INTERVAL_US = 2000000;
+	
+	
+	/// How long rtpbin keeps received video packets for FEC recovery, in nanoseconds. FEC packets
+	/// protect the packets of one frame, so this need only cover a few frames.
+	static const guint64 FEC_STORAGE_NS = 250000000;
+	
+	
+	/// How often a stream's jitter buffer latency is retargeted, in microseconds.
+	static const gint64 RETARGET_INTERVAL_US = 500000;
+	
+	
+	/// A participant's audio bitrate, RTP overhead included, in bits/sec; generous, since the
+	/// audio buffer comes out at SocketBufferSizer::MIN_SIZE all the same.
+	static const size_t AUDIO_BITRATE = 64000;
+	
+	
+	/// How much traffic the receive buffers hold beyond the jitter buffer latency, in
+	/// milliseconds, for a receiving thread stalled while the latency is still low.
+	static const guint RECEIVE_BUFFER_MARGIN_MS = 50;
+	
+	
+	/// How many branches of each kind in use are kept built ahead, for the streams to come.
+	static const size_t SPARE_BRANCHES = 2;
+	
+	
+	/// The fraction of packets the jitter buffer latencies wait for, unless set otherwise.
+	static const double DEFAULT_LATENCY_PERCENTILE;
+	
+	
+	/// The name of the application message asking the main thread to free an old stream.
+	static const char CLEAR_SSRC_MESSAGE[];
+	
+	
 	/// The "static" parts of the pipeline, as a string.
 	static const char PIPELINE_STRING[];
-
-
+	
+	
+	/// The compositor the video branches feed in composite mode, and its sink, as a string.
+	static const char COMPOSITOR_STRING[];
+	
+	
+	/// The frame rate of the composite video.
+	static const int COMPOSITE_FRAME_RATE = 30;
+	
+	
+	/// The mixer the audio branches feed, as a string; the audio output follows it.
+	static const char MIXER_STRING[];
+	
+	
+	/// Get the kind of branch that decodes audio with some audio parameters.
+	static BranchTemplate AudioTemplate(const char* audioParameters);
+	
+	
+	/// Get the conversion and audio sink options for an audio output device.
+	static std::string AudioOutputString(const char* audioDeviceName);
+	
+	
 	/// Create a pipeline (used in MIL)
-	static GstElement* CreatePipeline(const char* audioDeviceName);
-
-
+	static GstElement* CreatePipeline(const char* audioDeviceName, bool composite);
+	
+	
+	/// (Static) callback for a new stream's pad on rtpbin
+	static void StaticPadAdded(GstElement* element, GstPad* pad, gpointer user_data)
+	{
+		reinterpret_cast<ReceiverPipeline*>(user_data)->PadAdded(pad);
+	}
+	
+	
+	/// (Instance) callback for a new stream's pad on rtpbin
+	void PadAdded(GstPad* pad);
+	
+	
+	/// (Static) callback for a stream's pad going away
+	static void StaticPadRemoved(GstElement* element, GstPad* pad, gpointer user_data)
+	{
+		reinterpret_cast<ReceiverPipeline*>(user_data)->PadRemoved(pad);
+	}
+	
+	
+	/// (Instance) callback for a stream's pad going away
+	void PadRemoved(GstPad* pad);
+	
+	
+	/// Get the address (without port) a stream's packets come from; empty if unknown.
+	std::string GetSourceAddress(guint session, guint ssrc) const;
+	
+	
+	/// Get the address of the participant a stream is from, given the address its packets come
+	/// from. Called with m_BranchesMutex held.
+	std::string SenderAddress(guint session, guint ssrc, const std::string& sourceAddress) const;
+	
+	
+	/// Get whether a stream is one of those a sender announced by its video and audio SSRCs.
+	static bool IsAnnouncedSsrc(guint session, guint ssrc, guint videoSsrc, guint audioSsrc);
+	
+	
+	/// Find the participant with an address. Called with m_BranchesMutex held.
+	const Participant* FindParticipant(const std::string& address) const;
+	
+	
+	/// Create the branch of a stream, and link it to the stream's pad. Called with
+	/// m_BranchesMutex held.
+	Branch* NewBranch(GstPad* pad, guint session, guint ssrc, const std::string& address);
+	
+	
+	/// Get the kind of branch a stream needs. Called with m_BranchesMutex held.
+	BranchTemplate GetBranchTemplate(GstPad* pad, guint session, const Participant* pParticipant) const;
+	
+	
+	/// Create an element from a factory, which is looked up only the first time.
+	static GstElement* MakeElement(const char* factoryName, const char* name);
+	
+	
+	/// Build a bin of a kind of branch, not yet in the pipeline.
+	GstElement* NewBranchBin(BranchTemplate kind) const;
+	
+	
+	/// Get a bin of a kind of branch: one built ahead if there is one, or a new one.
+	GstElement* TakeBranchBin(BranchTemplate kind, bool& rPrebuilt);
+	
+	
+	/// Keep bins of a kind of branch built ahead from now on.
+	void StockBranchTemplate(BranchTemplate kind);
+	
+	
+	/// (Static) idle callback building the bins that are to be built ahead
+	static gboolean StaticRefillSpareBins(gpointer data)
+	{
+		reinterpret_cast<ReceiverPipeline*>(data)->RefillSpareBins();
+		return FALSE;
+	}
+	
+	
+	/// (Instance) idle callback building the bins that are to be built ahead
+	void RefillSpareBins();
+	
+	
+	/// Unlink a branch, take it out of the pipeline, and free it.
+	void RemoveBranch(Branch* pBranch);
+	
+	
+	/// Replace the branches of the streams from an address, once their pads are idle.
+	void RebuildBranches(const std::string& address);
+	
+	
+	/// (Static) probe replacing a branch once its pad is idle
+	static GstPadProbeReturn StaticRebuildProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data)
+	{
+		Branch* pBranch = reinterpret_cast<Branch*>(user_data);
+		pBranch->pOwner->RebuildBranch(pBranch);
+		return GST_PAD_PROBE_REMOVE;
+	}
+	
+	
+	/// (Instance) probe replacing a branch once its pad is idle
+	void RebuildBranch(Branch* pBranch);
+	
+	
+	/// Take out the decoding branch a new stream from an address takes over, if any: that of its
+	/// sender's previous stream in the session. Called with m_BranchesMutex held.
+	Branch* TakeSwappableBranch(GstPad* pad, guint session, guint ssrc, const std::string& address);
+	
+	
+	/// (Static) probe holding a new stream back until it has taken over its branch
+	static GstPadProbeReturn StaticBlockProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data)
+	{
+		return GST_PAD_PROBE_OK;
+	}
+	
+	
+	/// (Static) probe moving a branch to a new stream once the old stream's pad is idle
+	static GstPadProbeReturn StaticSwapProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data)
+	{
+		Swap* pSwap = reinterpret_cast<Swap*>(user_data);
+		pSwap->pBranch->pOwner->SwapBranch(pSwap);
+		return GST_PAD_PROBE_REMOVE;
+	}
+	
+	
+	/// (Instance) probe moving a branch to a new stream once the old stream's pad is idle
+	void SwapBranch(Swap* pSwap);
+	
+	
+	/// (Static) probe keeping a branch's flush from going past its decoder
+	static GstPadProbeReturn StaticDropFlushProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data)
+	{
+		return GST_PAD_PROBE_DROP;
+	}
+	
+	
+	/// (Static) probe on a video branch's decoder input
+	static GstPadProbeReturn StaticDecoderSinkProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data)
+	{
+		Branch* pBranch = reinterpret_cast<Branch*>(user_data);
+		return pBranch->pOwner->DecoderSinkProbe(pBranch, GST_PAD_PROBE_INFO_BUFFER(info));
+	}
+	
+	
+	/// (Instance) probe on a video branch's decoder input
+	GstPadProbeReturn DecoderSinkProbe(Branch* pBranch, GstBuffer* pBuffer);
+	
+	
+	/// (Static) bus message handler
+	static gboolean StaticBusMessage(GstBus* bus, GstMessage* msg, gpointer data)
+	{
+		reinterpret_cast<ReceiverPipeline*>(data)->BusMessage(msg);
+		return TRUE;
+	}
+	
+	
+	/// (Instance) bus message handler
+	void BusMessage(GstMessage* pMessage);
+	
+	
+	/// (Static) callback creating the FEC decoder of an rtpbin session
+	static GstElement* StaticRequestFecDecoder(GstElement* rtpbin, guint session, gpointer user_data);
+	
+	
+	/// (Static) callback mapping payload types to caps
+	static GstCaps* StaticRequestPtMap(GstElement* rtpbin, guint session, guint pt, gpointer user_data)
+	{
+		return reinterpret_cast<ReceiverPipeline*>(user_data)->RequestPtMap(session, pt);
+	}
+	
+	
+	/// (Instance) callback mapping payload types to caps
+	GstCaps* RequestPtMap(guint session, guint pt);
+	
+	
+	/// (Static) callback creating the retransmission receiver of an rtpbin session
+	static GstElement* StaticRequestAuxReceiver(GstElement* rtpbin, guint session, gpointer user_data);
+	
+	
+	/// (Static) callback for a new jitter buffer in rtpbin
+	static void StaticNewJitterBuffer(GstElement* rtpbin, GstElement* jitterbuffer, guint session, guint ssrc, gpointer user_data)
+	{
+		reinterpret_cast<ReceiverPipeline*>(user_data)->NewJitterBuffer(jitterbuffer, session, ssrc);
+	}
+	
+	
+	/// (Instance) callback for a new jitter buffer in rtpbin
+	void NewJitterBuffer(GstElement* jitterbuffer, guint session, guint ssrc);
+	
+	
+	/// (Static) probe on a jitter buffer's input
+	static GstPadProbeReturn StaticJitterBufferSinkProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data)
+	{
+		JitterBuffer* pJitterBuffer = reinterpret_cast<JitterBuffer*>(user_data);
+		pJitterBuffer->pOwner->JitterBufferSinkProbe(pJitterBuffer, GST_PAD_PROBE_INFO_BUFFER(info));
+		return GST_PAD_PROBE_OK;
+	}
+	
+	
+	/// (Instance) probe on a jitter buffer's input
+	void JitterBufferSinkProbe(JitterBuffer* pJitterBuffer, GstBuffer* pBuffer);
+	
+	
+	/// Free a jitter buffer's state once its probe is gone
+	static void StaticFreeJitterBuffer(gpointer data);
+	
+	
+	/// (Static) timeout callback posting the streams' statistics
+	static gboolean StaticPostStreamStats(gpointer data)
+	{
+		reinterpret_cast<ReceiverPipeline*>(data)->PostStreamStats();
+		return TRUE;
+	}
+	
+	
+	/// (Instance) timeout callback posting the streams' statistics
+	void PostStreamStats();
+	
+	
+	/// Get the RTP clock rate of a payload type; 0 if unknown.
+	guint ClockRate(guint session, guint pt);
+	
+	
+	/// Ask the sender of a video stream for a key frame (rate-limited).
+	void RequestKeyUnit(Branch* pBranch);
+	
+	
+	/// Place a video branch's compositor input at its participant's rectangle.
+	static void SetCompositorPadLayout(GstPad* pad, const Participant& rParticipant);
+	
+	
+	/// Set a video branch up for its participant's visibility and size.
+	void ApplyVisibility(Branch* pBranch, const Participant& rParticipant, Visibility previous);
+	
+	
+	/// Size the RTP sources' receive buffers for the participants' bitrates and the latency.
+	void ResizeSocketBuffers();
+	
+	
 	/// Reference to rtpbin element
 	GstElement* const m_pRtpBin;
 	
 	
-	/// The display window handle
-	const void* const m_DisplayWindowHandle;
+	/// Reference to the mixer the audio branches feed
+	GstElement* const m_pMixer;
+	
+	
+	/// References to the compositor the video branches feed, and the caps filter setting its
+	/// output size; NULL unless in composite mode
+	GstElement* const m_pCompositor;
+	GstElement* const m_pCompositeCaps;
+	
+	
+	/// References to the RTCP sinks, which send our reports to every participant
+	GstElement* const m_pVideoRtcpSink;
+	GstElement* const m_pAudioRtcpSink;
+	
+	
+	/// References to the RTP sources, whose receive buffers follow the bitrate and latency
+	GstElement* const m_pVideoRtpSrc;
+	GstElement* const m_pAudioRtpSrc;
+	
+	
+	/// Reference to the retransmission receiver (rtprtxreceive) element
+	GstElement* m_pRtxReceiver;
+	
+	
+	/// The jitter buffers, each with its probe; the probe owns the state
+	std::vector<JitterBuffer*> m_vJitterBuffers;
+	
+	
+	/// Whether lost video packets are NACKed
+	bool m_Retransmission;
+	
+	
+	/// The fraction of packets the jitter buffer latencies wait for
+	double m_LatencyPercentile;
+	
+	
+	/// Protects the jitter buffers, m_Retransmission, and m_LatencyPercentile, which are touched
+	/// from the streaming and main threads. Taken before m_BranchesMutex when both are.
+	mutable GMutex m_JitterBuffersMutex;
+	
+	
+	/// The participants
+	std::vector<Participant> m_vParticipants;
+	
+	
+	/// The decoding branches
+	std::vector<Branch*> m_vBranches;
+	
+	
+	/// The caps of each audio payload type, from the audio parameters
+	std::map<guint, std::string> m_AudioPtCaps;
+	
+	
+	/// Protects the participants, branches, and audio caps, which are touched from the streaming
+	/// and main threads
+	GMutex m_BranchesMutex;
+	
+	
+	/// The video bitrate each participant sends at, at most, and the receive buffer sizes last
+	/// set on the RTP sources. Protected by m_BranchesMutex.
+	size_t m_ExpectedBitrate;
+	gint m_VideoBufferSize;
+	gint m_AudioBufferSize;
+	
+	
+	/// The bins built ahead, per kind of branch, each in the READY state
+	std::vector<GstElement*> m_vSpareBins[NUM_BRANCH_TEMPLATES];
+	
+	
+	/// The kinds of branch kept built ahead
+	bool m_StockedTemplates[NUM_BRANCH_TEMPLATES];
+	
+	
+	/// The event source ID of the pending RefillSpareBins(); 0 if none
+	guint m_RefillSourceId;
+	
+	
+	/// How long setting up the branches took
+	BranchStats m_BranchStats;
+	
+	
+	/// Protects the bins built ahead, and the branch statistics. Taken after m_BranchesMutex when
+	/// both are.
+	mutable GMutex m_SpareBinsMutex;
+	
+	
+	/// The event source ID of the timeout posting the streams' statistics; 0 if none
+	guint m_StreamStatsSourceId;
+	
+	
+	/// The bus watch's event source ID
+	guint m_BusWatchId;
+	
+	
+	/// Protects the branches' lastKeyUnitRequestUs
+	GMutex m_KeyUnitMutex;
 }; // END class ReceiverPipeline
 
-#endif // __RECEIVER_PIPELINE_HPP__
\ No newline at end of file
+#endif // __RECEIVER_PIPELINE_HPP__
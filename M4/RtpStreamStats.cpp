@@ -0,0 +1,220 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// @file RtpStreamStats.cpp
+///
+/// Copyright (c) 2015, BoxCast, Inc. All rights reserved.
+///
+/// This library is free software; you can redistribute it and/or modify it under the terms of the
+/// GNU Lesser General Public License as published by the Free Software Foundation; either version
+/// 3.0 of the License, or (at your option) any later version.
+///
+/// This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+/// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See
+/// the GNULesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License along with this
+/// library; if not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+/// Boston, MA 02110-1301 USA
+///
+///
+/// @brief This file defines the functions of the RtpStreamStats class.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>          // for std::fill, std::min, std::max
+#include "RtpStreamStats.hpp" // for class declaration
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// RtpStreamStats::RtpStreamStats()
+///
+/// Constructor.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+RtpStreamStats::RtpStreamStats()
+	: m_HavePacket(false)
+	, m_FirstArrivalUs(0)
+	, m_BaseSeq(0)
+	, m_HighestSeq(0)
+	, m_ExpectedBefore(0)
+	, m_Received(0)
+	, m_Duplicates(0)
+	, m_Reordered(0)
+	, m_MaxReorderDepth(0)
+	, m_LossBursts(0)
+	, m_MaxLossBurst(0)
+	, m_Late(0)
+	, m_BadSeq(-1)
+	, m_Seen(HISTORY, false)
+	, m_Buckets(NUM_BUCKETS)
+{
+	for (size_t i = 0; i < NUM_BUCKETS; ++i)
+	{
+		m_Buckets[i].index = -1;
+		m_Buckets[i].bytes = 0;
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// RtpStreamStats::OnPacket()
+///
+/// Account for an arriving packet. Its sequence number is extended from the highest one so far;
+/// the extended numbers start at 0x10000, so that an early packet reordered before the first one
+/// doesn't go below 0. A packet ahead of the highest skips the sequence numbers in between, which
+/// makes a loss burst (for now: a later packet may still fill them in); one behind it is
+/// reordered, unless it arrived before.
+///
+/// A packet too far from the highest to be loss or reordering is on probation (RFC 3550 A.1): only
+/// if the next packet follows it did the sender restart its sequence, and the count starts over
+/// from there. Otherwise it was a stray, such as a retransmission arriving very late; it counts
+/// as a duplicate if it arrived before, as reordered if it fills in a remembered gap, and else as
+/// late, outside the sequence.
+///
+/// @param arrivalUs  The (monotonic) arrival time, in microseconds.
+///
+/// @param seq  The packet's RTP sequence number.
+///
+/// @param bytes  The packet's size, in bytes.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void RtpStreamStats::OnPacket(int64_t arrivalUs, uint16_t seq, size_t bytes)
+{
+	int64_t index = arrivalUs / BUCKET_US;
+	Bucket& rBucket = m_Buckets[index % NUM_BUCKETS];
+	if (rBucket.index != index)
+	{
+		rBucket.index = index;
+		rBucket.bytes = 0;
+	}
+	rBucket.bytes += bytes;
+	++m_Received;
+	
+	if (!m_HavePacket)
+	{
+		m_HavePacket = true;
+		m_FirstArrivalUs = arrivalUs;
+		m_BaseSeq = m_HighestSeq = 0x10000 + seq;
+		m_Seen[m_HighestSeq % HISTORY] = true;
+		return;
+	}
+	
+	int64_t delta = static_cast<int16_t>(seq - static_cast<uint16_t>(m_HighestSeq));
+	int64_t extendedSeq = m_HighestSeq + delta;
+	if ((delta >= MAX_DROPOUT) || (delta < -MAX_MISORDER))
+	{
+		if (seq == m_BadSeq)
+		{
+			// Two packets in sequence: the sender restarted its sequence, with the stray before
+			// this one. Start over past the highest number so far.
+			m_ExpectedBefore += m_HighestSeq - m_BaseSeq + 1;
+			m_BaseSeq = m_HighestSeq = (m_HighestSeq & ~static_cast<int64_t>(0xffff)) + 0x10000 + seq;
+			std::fill(m_Seen.begin(), m_Seen.end(), false);
+			m_Seen[m_HighestSeq % HISTORY] = true;
+			m_BadSeq = -1;
+			return;
+		}
+		
+		m_BadSeq = (seq + 1) & 0xffff;
+		if ((delta < 0) && (static_cast<size_t>(-delta) < HISTORY) && (extendedSeq >= m_BaseSeq))
+		{
+			if (m_Seen[extendedSeq % HISTORY])
+			{
+				++m_Duplicates;
+				return;
+			}
+			m_Seen[extendedSeq % HISTORY] = true;
+			++m_Reordered;
+			m_MaxReorderDepth = std::max(m_MaxReorderDepth, static_cast<unsigned int>(-delta));
+			return;
+		}
+		++m_Late;
+		return;
+	}
+	m_BadSeq = -1;
+	
+	if (delta > 0)
+	{
+		if (static_cast<size_t>(delta - 1) >= HISTORY)
+		{
+			std::fill(m_Seen.begin(), m_Seen.end(), false);
+		}
+		for (int64_t s = m_HighestSeq + 1; (s < extendedSeq) && (static_cast<size_t>(delta - 1) < HISTORY); ++s)
+		{
+			m_Seen[s % HISTORY] = false;
+		}
+		if (delta > 1)
+		{
+			++m_LossBursts;
+			m_MaxLossBurst = std::max(m_MaxLossBurst, static_cast<unsigned int>(delta - 1));
+		}
+		m_HighestSeq = extendedSeq;
+		m_Seen[extendedSeq % HISTORY] = true;
+		return;
+	}
+	
+	if (m_Seen[extendedSeq % HISTORY] && (extendedSeq >= m_BaseSeq))
+	{
+		++m_Duplicates;
+		return;
+	}
+	m_Seen[extendedSeq % HISTORY] = true;
+	m_BaseSeq = std::min(m_BaseSeq, extendedSeq);
+	++m_Reordered;
+	m_MaxReorderDepth = std::max(m_MaxReorderDepth, static_cast<unsigned int>(-delta));
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// RtpStreamStats::GetStats()
+///
+/// Get the counts so far. The packets lost are those expected that never arrived (duplicates and
+/// late packets aside), so packets recovered by retransmission don't count as lost; the loss
+/// bursts do count them, as they were lost on the way.
+///
+/// @param nowUs  The (monotonic) time the bitrates are measured up to, in microseconds.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+RtpStreamStats::Stats RtpStreamStats::GetStats(int64_t nowUs) const
+{
+	Stats stats;
+	stats.expected = m_HavePacket ? (m_ExpectedBefore + (m_HighestSeq - m_BaseSeq + 1)) : 0;
+	stats.received = m_Received;
+	uint64_t inSequence = m_Received - m_Duplicates - m_Late;
+	stats.lost = (stats.expected > inSequence) ? (stats.expected - inSequence) : 0;
+	stats.duplicates = m_Duplicates;
+	stats.late = m_Late;
+	stats.reordered = m_Reordered;
+	stats.maxReorderDepth = m_MaxReorderDepth;
+	stats.lossBursts = m_LossBursts;
+	stats.maxLossBurst = m_MaxLossBurst;
+	stats.shortBitrate = Bitrate(nowUs, SHORT_WINDOW_US);
+	stats.longBitrate = Bitrate(nowUs, LONG_WINDOW_US);
+	return stats;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// RtpStreamStats::Bitrate()
+///
+/// Get the bitrate over a window (a whole number of buckets) ending at a time: the bytes of the
+/// buckets it covers, over the time they cover up to now. A stream younger than the window is
+/// measured over its lifetime instead.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+uint64_t RtpStreamStats::Bitrate(int64_t nowUs, int64_t windowUs) const
+{
+	if (!m_HavePacket)
+	{
+		return 0;
+	}
+	
+	int64_t nowIndex = nowUs / BUCKET_US;
+	int64_t numBuckets = windowUs / BUCKET_US;
+	uint64_t bytes = 0;
+	for (size_t i = 0; i < NUM_BUCKETS; ++i)
+	{
+		if ((m_Buckets[i].index > (nowIndex - numBuckets)) && (m_Buckets[i].index <= nowIndex))
+		{
+			bytes += m_Buckets[i].bytes;
+		}
+	}
+	
+	int64_t durationUs = ((numBuckets - 1) * BUCKET_US) + (nowUs - (nowIndex * BUCKET_US));
+	durationUs = std::min(durationUs, nowUs - m_FirstArrivalUs);
+	return (durationUs > 0) ? ((bytes * 8 * 1000000) / durationUs) : 0;
+}
@@ -0,0 +1,161 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// @file RtpStreamStats.hpp
+///
+/// Copyright (c) 2015, BoxCast, Inc. All rights reserved.
+///
+/// This library is free software; you can redistribute it and/or modify it under the terms of the
+/// GNU Lesser General Public License as published by the Free Software Foundation; either version
+/// 3.0 of the License, or (at your option) any later version.
+///
+/// This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+/// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See
+/// the GNULesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License along with this
+/// library; if not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+/// Boston, MA 02110-1301 USA
+///
+///
+/// @brief This file declares the RtpStreamStats class, which counts what arrives of one RTP
+/// stream: the packets expected and received, and how they were lost, reordered, or duplicated.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#ifndef __RTP_STREAM_STATS_HPP__
+#define __RTP_STREAM_STATS_HPP__
+
+#include <stdint.h> // for int64_t, uint64_t, int32_t, uint16_t
+#include <cstddef>  // for size_t
+#include <vector>   // for std::vector
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// This class follows the sequence numbers and sizes of one stream's packets as they arrive. It
+/// counts the packets expected (RFC 3550 A.3) and received, and from them the packets lost. It
+/// also counts:
+///  - loss bursts: runs of sequence numbers skipped when a packet arrives, before any
+///	retransmission fills them in,
+///  - reordered packets: packets older than the newest one so far, and how far back they were,
+///  - duplicates: packets arriving again, among the last HISTORY sequence numbers,
+///  - late packets: strays too far out of sequence to place, such as late retransmissions, and
+///  - the bitrate over the last SHORT_WINDOW_US and LONG_WINDOW_US.
+///
+/// A jump in the sequence numbers too large to be loss or reordering starts the sequence over
+/// once the next packet confirms it (the sender restarted its sequence), as RFC 3550 A.1 does; the
+/// counts carry on.
+///
+/// It doesn't lock; its owner serializes the calls.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class RtpStreamStats
+{
+public:
+	/// The shorter window the bitrate is measured over, in microseconds.
+	static const int64_t SHORT_WINDOW_US = 1000000;
+
+
+	/// The longer window the bitrate is measured over, in microseconds.
+	static const int64_t LONG_WINDOW_US = 10000000;
+
+
+	/// The counts so far
+	struct Stats
+	{
+		uint64_t expected;
+		uint64_t received;
+		uint64_t lost;
+		uint64_t duplicates;
+		uint64_t late;
+		uint64_t reordered;
+		unsigned int maxReorderDepth;
+		uint64_t lossBursts;
+		unsigned int maxLossBurst;
+		uint64_t shortBitrate;
+		uint64_t longBitrate;
+	};
+
+
+	/// Constructor.
+	RtpStreamStats();
+
+
+	/// Account for an arriving packet.
+	void OnPacket(int64_t arrivalUs, uint16_t seq, size_t bytes);
+
+
+	/// Get the counts so far, and the bitrates as of a time.
+	Stats GetStats(int64_t nowUs) const;
+
+
+private:
+	/// The largest forward jump in sequence numbers taken for loss (RFC 3550 A.1).
+	static const int64_t MAX_DROPOUT = 3000;
+
+
+	/// The largest backward jump in sequence numbers taken for reordering (RFC 3550 A.1).
+	static const int64_t MAX_MISORDER = 100;
+
+
+	/// How many of the latest sequence numbers are remembered, to recognize duplicates.
+	static const size_t HISTORY = 1024;
+
+
+	/// The time the bytes received are summed over, in microseconds.
+	static const int64_t BUCKET_US = 100000;
+
+
+	/// How many buckets cover the longer window.
+	static const size_t NUM_BUCKETS = LONG_WINDOW_US / BUCKET_US;
+
+
+	/// The bytes received in one BUCKET_US
+	struct Bucket
+	{
+		int64_t index;
+		uint64_t bytes;
+	};
+
+
+	/// The bitrate over the window before a time, in bits/sec.
+	uint64_t Bitrate(int64_t nowUs, int64_t windowUs) const;
+
+
+	/// Whether a packet has arrived yet
+	bool m_HavePacket;
+
+
+	/// The first packet's arrival time, in microseconds
+	int64_t m_FirstArrivalUs;
+
+
+	/// The lowest and highest sequence numbers since the sequence (re)started, extended past
+	/// wraparounds
+	int64_t m_BaseSeq;
+	int64_t m_HighestSeq;
+
+
+	/// The packets expected before the sequence last restarted
+	uint64_t m_ExpectedBefore;
+
+
+	/// The counts
+	uint64_t m_Received;
+	uint64_t m_Duplicates;
+	uint64_t m_Reordered;
+	unsigned int m_MaxReorderDepth;
+	uint64_t m_LossBursts;
+	unsigned int m_MaxLossBurst;
+	uint64_t m_Late;
+
+
+	/// The sequence number that confirms a jump, following the last packet out of sequence; -1 if
+	/// none (RFC 3550 A.1 bad_seq)
+	int32_t m_BadSeq;
+
+
+	/// Whether each of the last HISTORY sequence numbers arrived, by extended sequence number
+	std::vector<bool> m_Seen;
+
+
+	/// The bytes received, per BUCKET_US, by bucket index modulo NUM_BUCKETS
+	std::vector<Bucket> m_Buckets;
+}; // END class RtpStreamStats
+
+#endif // __RTP_STREAM_STATS_HPP__
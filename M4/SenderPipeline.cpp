@@ -18,11 +18,73 @@
 /// @brief This file defines the functions of the SenderPipeline class.
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
+#include <algorithm>          // for std::min, std::max
 #include <cassert>            // for assert
-#include <cmath>              // for round
+#include <cmath>              // for round, std::ceil
+#include <cstdlib>            // for std::abs
 #include <cstring>
+#include <gst/video/video.h>  // for gst_video_event_new_upstream_force_key_unit
 #include <gst/video/videooverlay.h>
+#include "FanoutSink.hpp"     // for FanoutSink::ELEMENT_NAME
+#include "gst_utility.hpp"    // for gst_rtp_aux_bin_new
 #include "SenderPipeline.hpp" // for class declaration
+#include "SocketBufferSizer.hpp" // for SocketBufferSizer::Size
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// The simulcast layers. Layer 0 is the full-resolution stream; each following layer halves the
+/// resolution and quarters the bitrate of the one before it.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+const SenderPipeline::LayerSpec SenderPipeline::LAYER_SPECS[MAX_SIMULCAST_LAYERS] =
+{
+	{1,  1},
+	{2,  4},
+	{4, 16},
+};
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// The field our retransmission requests carry their layer in.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+const char SenderPipeline::RTX_REQUEST_LAYER_FIELD[] = "m4-layer";
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// The encoder profiles. All use tune=zerolatency, and override it only where they differ: no
+/// B-frames or rate control lookahead (either would delay every frame), and sliced threads, which
+/// split each frame between the threads instead of adding a frame of delay per thread. Threads 0
+/// means one per core.
+///
+/// Measured with libx264 on a single-core Xeon server, encoding 150 frames of a moving, textured
+/// test scene at 30 fps, with the profile's VBV buffer. With one core every profile ran on one
+/// thread, so this compares the presets only, not the threads and sliced-threads settings:
+///
+///   profile      resolution  target     CPU/frame  PSNR-Y
+///   low-cpu       1280x720   1500 kbps    4.2 ms   30.8 dB
+///   low-latency   1280x720   1500 kbps    6.9 ms   32.3 dB
+///   balanced      1280x720   1500 kbps   10.3 ms   32.4 dB
+///   low-cpu      1920x1080   3000 kbps    9.3 ms   30.8 dB
+///   low-latency  1920x1080   3000 kbps   14.8 ms   32.3 dB
+///   balanced     1920x1080   3000 kbps   24.8 ms   32.4 dB
+///
+/// With simulcast, the scaled layers add about a third to the CPU time. Quality per bit is what
+/// low-cpu gives up, and balanced gains little PSNR over low-latency on this scene. How the
+/// profiles scale on multi-core hosts has not been measured.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+const SenderPipeline::EncoderSettings SenderPipeline::ENCODER_SETTINGS[NUM_ENCODER_PROFILES] =
+{
+	// name           preset       threads  sliced  lookahead  vbv ms  bframes
+	{"auto",          NULL,        0,       TRUE,   0,         0,      0}, // see AutoEncoderProfile()
+	{"low-latency",   "superfast", 0,       TRUE,   0,         300,    0},
+	{"balanced",      "veryfast",  0,       TRUE,   0,         600,    0},
+	{"low-cpu",       "ultrafast", 2,       TRUE,   0,         300,    0},
+};
+
+
+const double SenderPipeline::PACING_RATE_FACTOR = 2.5;
+
+
+const SenderPipeline::AudioSettings SenderPipeline::DEFAULT_AUDIO_SETTINGS = { AUDIO_CODEC_OPUS, 20, true, true };
 
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -30,27 +92,121 @@
 ///
 /// Constructor. Create the pipeline from the static string representation.
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-SenderPipeline::SenderPipeline(const char* videoInputName, const char* audioInputName, ISenderParameterNotifySink* pNotifySink)
-	: PipelineBase(BuildPipeline(videoInputName, audioInputName))
-	, m_pVideoEncoder(gst_bin_get_by_name(GST_BIN(Pipeline()), "venc"))
-	, m_pVideoRtpSink(gst_bin_get_by_name(GST_BIN(Pipeline()), "vsink"))
-	, m_pVideoRtcpSink(gst_bin_get_by_name(GST_BIN(Pipeline()), "vcsink"))
+SenderPipeline::SenderPipeline(const char* videoInputName, const char* audioInputName, ISenderParameterNotifySink* pNotifySink, size_t numLayers, const AudioSettings& audioSettings, EncoderProfile encoderProfile)
+	: PipelineBase(BuildPipeline(videoInputName, audioInputName, numLayers, audioSettings, encoderProfile))
+	, m_NumLayers(numLayers)
+	, m_pRtpBin(gst_bin_get_by_name(GST_BIN(Pipeline()), "rtpbin"))
+	, m_pVideoRtcpSource(gst_bin_get_by_name(GST_BIN(Pipeline()), "vcsrc"))
+	, m_pAudioRtcpSource(gst_bin_get_by_name(GST_BIN(Pipeline()), "acsrc"))
+	, m_RtcpPortBaseSet(false)
+	, m_pVideoSession(NULL)
+	, m_pVideoEncoders()
+	, m_pVideoRtpSinks()
+	, m_pVideoRtcpSinks()
+	, m_pFecEncoders()
+	, m_LayerFecPercentages()
+	, m_pRtxSenders()
+	, m_Retransmission(true)
+	, m_EncoderProfile((encoderProfile == ENCODER_PROFILE_AUTO) ? AutoEncoderProfile() : encoderProfile)
+	, m_LayerBitrates()
+	, m_MaxBitrate(0)
+	, m_LastKeyUnitUs()
+	, m_KeyUnitPending()
+	, m_KeyUnitMutex()
+	, m_pVideoRates()
+	, m_pVideoScaleFilters()
+	, m_CaptureWidth(0)
+	, m_CaptureHeight(0)
+	, m_VideoWidth(0)
+	, m_VideoHeight(0)
+	, m_VideoFrameRate(0)
+	, m_PreviewWidth(0)
+	, m_PreviewHeight(0)
+	, m_PreviewFrameRate(0)
+	, m_Qos()
+	, m_QosMutex()
+	, m_QosWindows(0)
+	, m_QosWindowStartUs(0)
+	, m_QosFramesIn(0)
+	, m_QosFramesOut(0)
+	, m_EncodeStarts()
+	, m_EncodeTimeUs()
+	, m_EncodedFrames()
+	, m_Pacer()
 	, m_pAudioRtpSink(gst_bin_get_by_name(GST_BIN(Pipeline()), "asink"))
 	, m_pAudioRtcpSink(gst_bin_get_by_name(GST_BIN(Pipeline()), "acsink"))
+	, m_pVideoValve(gst_bin_get_by_name(GST_BIN(Pipeline()), "vvalve"))
+	, m_pAudioValve(gst_bin_get_by_name(GST_BIN(Pipeline()), "avalve"))
+	, m_SkipStaticFrames(TRUE)
+	, m_StaticSamples()
+	, m_FrameSamples()
+	, m_LastStaticPassUs(0)
+	, m_PassNextFrame(FALSE)
 	, m_vDestinations()
+	, m_DestinationsMutex()
 	, m_pNotifySink(pNotifySink)
 	, m_pSpropParameterSets(NULL)
+	, m_AudioSettings(audioSettings)
+	, m_pAudioParameters(NULL)
 	, m_VideoSsrc(0)
 	, m_AudioSsrc(0)
 {
-	assert(m_pVideoEncoder != NULL);
-	assert(m_pVideoRtpSink != NULL);
-	assert(m_pVideoRtcpSink != NULL);
+	assert((m_NumLayers >= 1) && (m_NumLayers <= MAX_SIMULCAST_LAYERS));
+	assert(m_pRtpBin != NULL);
+	assert(m_pVideoRtcpSource != NULL);
+	assert(m_pAudioRtcpSource != NULL);
+	for (size_t layer = 0; layer < m_NumLayers; ++layer)
+	{
+		m_pVideoEncoders[layer] = GetLayerElement("venc", layer);
+		m_pVideoRtpSinks[layer] = GetLayerElement("vsink", layer);
+		m_pVideoRtcpSinks[layer] = GetLayerElement("vcsink", layer);
+		m_pFecEncoders[layer] = GetLayerElement("fecenc", layer);
+		m_pRtxSenders[layer] = GetLayerElement("rtxsend", layer);
+		m_pVideoRates[layer] = GetLayerElement("vrate", layer);
+		m_pVideoScaleFilters[layer] = GetLayerElement("vscale", layer);
+		assert(m_pVideoEncoders[layer] != NULL);
+		assert(m_pVideoRtpSinks[layer] != NULL);
+		assert(m_pVideoRtcpSinks[layer] != NULL);
+		assert(m_pFecEncoders[layer] != NULL);
+		assert(m_pRtxSenders[layer] != NULL);
+		assert(m_pVideoRates[layer] != NULL);
+		assert(m_pVideoScaleFilters[layer] != NULL);
+	}
 	assert(m_pAudioRtpSink != NULL);
 	assert(m_pAudioRtcpSink != NULL);
+	assert(m_pVideoValve != NULL);
+	assert(m_pAudioValve != NULL);
+	
+	g_mutex_init(&m_DestinationsMutex);
+	g_mutex_init(&m_KeyUnitMutex);
+	g_mutex_init(&m_QosMutex);
 	
-	// Receive a callback when the caps property of the vsink:sink and asink:sink pads change
-	GstPad* pad = gst_element_get_static_pad(m_pVideoRtpSink, "sink");
+	// The full-resolution layer starts out at the capture size, the initial video format.
+	GstCaps* caps = NULL;
+	g_object_get(m_pVideoScaleFilters[0], "caps", &caps, NULL);
+	assert(caps != NULL);
+	GstStructure* s = gst_caps_get_structure(caps, 0);
+	assert(gst_structure_get_int(s, "width", &m_CaptureWidth));
+	assert(gst_structure_get_int(s, "height", &m_CaptureHeight));
+	gst_caps_unref(caps);
+	m_VideoWidth = m_CaptureWidth;
+	m_VideoHeight = m_CaptureHeight;
+	
+	// All UDP sinks send through the pacer: the video at a pace RetargetBitrates() sets, and
+	// the audio as a priority flow that is never queued behind it.
+	for (size_t layer = 0; layer < m_NumLayers; ++layer)
+	{
+		g_object_set(m_pVideoRtpSinks[layer], "pacer", &m_Pacer, NULL);
+	}
+	g_object_set(m_pAudioRtpSink,
+		"priority", TRUE,
+		"pacer",    &m_Pacer,
+		NULL);
+	
+	// Receive a callback when the caps property of the vsink:sink and asink:sink pads change. The
+	// full-resolution layer's parameters are the ones announced; receivers derive the other
+	// layers' SSRCs from its SSRC (see LayerSsrc()).
+	GstPad* pad = gst_element_get_static_pad(m_pVideoRtpSinks[0], "sink");
 	assert(pad != NULL);
 	g_signal_connect(pad, "notify::caps", G_CALLBACK(StaticPadNotifyCaps), this);
 	gst_object_unref(pad);
@@ -59,6 +215,71 @@ SenderPipeline::SenderPipeline(const char* videoInputName, const char* audioInpu
 	assert(pad != NULL);
 	g_signal_connect(pad, "notify::caps", G_CALLBACK(StaticPadNotifyCaps), this);
 	gst_object_unref(pad);
+	
+	// Receive a callback whenever RTCP (i.e. a receiver report) arrives from a destination
+	g_signal_connect(m_pRtpBin, "on-ssrc-active", G_CALLBACK(StaticSsrcActive), this);
+	
+	// Key frames are sent on demand. rtpbin turns a PLI/FIR into a key unit request to the
+	// payloader of the session it arrived in, and every video session sees all the video RTCP.
+	// So drop those, and handle the feedback ourselves, once, in session 0: its SSRC tells which
+	// layer it is about, and we can rate-limit and coalesce the requests.
+	g_signal_emit_by_name(m_pRtpBin, "get-internal-session", 0, &m_pVideoSession);
+	assert(m_pVideoSession != NULL);
+	g_signal_connect(m_pVideoSession, "on-feedback-rtcp", G_CALLBACK(StaticFeedbackRtcp), this);
+	for (size_t layer = 0; layer < m_NumLayers; ++layer)
+	{
+		pad = gst_element_get_static_pad(m_pVideoEncoders[layer], "sink");
+		assert(pad != NULL);
+		gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, StaticEncoderSinkProbe, this, NULL);
+		gst_object_unref(pad);
+		
+		GstPad* srcPad = gst_element_get_static_pad(m_pVideoEncoders[layer], "src");
+		assert(srcPad != NULL);
+		gst_pad_add_probe(srcPad, GST_PAD_PROBE_TYPE_BUFFER, StaticEncoderSrcProbe, this, NULL);
+		pad = gst_pad_get_peer(srcPad);
+		assert(pad != NULL);
+		gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_EVENT_UPSTREAM, StaticPayloaderSinkProbe, this, NULL);
+		gst_object_unref(pad);
+		gst_object_unref(srcPad);
+	}
+	
+	// The QoS controller watches how long the encoders take per frame (probes above), and how
+	// many frames the leaky queue in front of each one drops because it was still busy: the
+	// frames going into the queues minus those coming out.
+	for (size_t layer = 0; layer < m_NumLayers; ++layer)
+	{
+		GstElement* vqueue = GetLayerElement("vqueue", layer);
+		assert(vqueue != NULL);
+		pad = gst_element_get_static_pad(vqueue, "sink");
+		assert(pad != NULL);
+		gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, StaticQueueProbe, this, NULL);
+		gst_object_unref(pad);
+		pad = gst_element_get_static_pad(vqueue, "src");
+		assert(pad != NULL);
+		gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, StaticQueueProbe, this, NULL);
+		gst_object_unref(pad);
+		gst_object_unref(vqueue);
+	}
+	
+	// Frames of a static scene are skipped before they reach the encoders (and the self-view).
+	GstElement* t = gst_bin_get_by_name(GST_BIN(Pipeline()), "t");
+	assert(t != NULL);
+	pad = gst_element_get_static_pad(t, "sink");
+	assert(pad != NULL);
+	gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, StaticTeeSinkProbe, this, NULL);
+	gst_object_unref(pad);
+	gst_object_unref(t);
+	
+	// Likewise, rtpbin turns NACKs into retransmission requests to the sender of the session they
+	// arrive in. So drop those too; FeedbackRtcp() sends the requests to the retransmission sender
+	// of the layer the NACK names by its SSRC, which has the packets with those sequence numbers.
+	for (size_t layer = 0; layer < m_NumLayers; ++layer)
+	{
+		pad = gst_element_get_static_pad(m_pRtxSenders[layer], "src");
+		assert(pad != NULL);
+		gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_EVENT_UPSTREAM, StaticRtxSenderSrcProbe, this, NULL);
+		gst_object_unref(pad);
+	}
 }
 
 
@@ -71,12 +292,41 @@ SenderPipeline::~SenderPipeline()
 {
 	Nullify();
 	
+	// The sinks outlive the pacer
+	g_object_set(m_pAudioRtpSink, "pacer", NULL, NULL);
+	for (size_t layer = 0; layer < m_NumLayers; ++layer)
+	{
+		g_object_set(m_pVideoRtpSinks[layer], "pacer", NULL, NULL);
+	}
+	
 	// Unref everything we ref'ed before
+	gst_object_unref(m_pAudioValve);
+	gst_object_unref(m_pVideoValve);
 	gst_object_unref(m_pAudioRtcpSink);
 	gst_object_unref(m_pAudioRtpSink);
-	gst_object_unref(m_pVideoRtcpSink);
-	gst_object_unref(m_pVideoRtpSink);
-	gst_object_unref(m_pVideoEncoder);
+	gst_object_unref(m_pAudioRtcpSource);
+	gst_object_unref(m_pVideoRtcpSource);
+	g_object_unref(m_pVideoSession);
+	gst_object_unref(m_pRtpBin);
+	for (size_t layer = 0; layer < m_NumLayers; ++layer)
+	{
+		gst_object_unref(m_pVideoScaleFilters[layer]);
+		gst_object_unref(m_pVideoRates[layer]);
+		gst_object_unref(m_pRtxSenders[layer]);
+		gst_object_unref(m_pFecEncoders[layer]);
+		gst_object_unref(m_pVideoRtcpSinks[layer]);
+		gst_object_unref(m_pVideoRtpSinks[layer]);
+		gst_object_unref(m_pVideoEncoders[layer]);
+	}
+	
+	for (std::vector<Destination*>::iterator it = m_vDestinations.begin(); it != m_vDestinations.end(); ++it)
+	{
+		delete *it;
+	}
+	g_free(m_pAudioParameters);
+	g_mutex_clear(&m_QosMutex);
+	g_mutex_clear(&m_KeyUnitMutex);
+	g_mutex_clear(&m_DestinationsMutex);
 }
 
 
@@ -84,25 +334,172 @@ SenderPipeline::~SenderPipeline()
 /// SenderPipeline::AddDestination()
 ///
 /// Add a destination address or hostname to the sender's pipeline.
+///
+/// Unless SetRtcpPortBase() was called, destinations send their RTCP receiver reports back to
+/// the same port base on this host, so the first destination also decides which ports we listen
+/// on for them. This must be called before the pipeline starts playing.
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 void SenderPipeline::AddDestination(const char* destination, uint16_t portBase)
 {
-	m_vDestinations.push_back(new Destination(destination, portBase));
+	if (m_vDestinations.empty() && !m_RtcpPortBaseSet)
+	{
+		g_object_set(m_pVideoRtcpSource, "port", portBase + 1, NULL);
+		g_object_set(m_pAudioRtcpSource, "port", portBase + 3, NULL);
+	}
+	
+	g_mutex_lock(&m_DestinationsMutex);
+	m_vDestinations.push_back(new Destination(destination, portBase, m_MaxBitrate));
 	SetDestinations();
+	RetargetBitrates();
+	g_mutex_unlock(&m_DestinationsMutex);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SenderPipeline::SetDestinationLayer()
+///
+/// Select which simulcast layer is sent to a destination. Layers beyond those this pipeline
+/// encodes are clamped to the smallest layer available.
+///
+/// @param destination  The destination address or hostname, as given to AddDestination().
+///
+/// @param layer  The layer index; 0 is full resolution.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void SenderPipeline::SetDestinationLayer(const char* destination, size_t layer)
+{
+	layer = std::min(layer, m_NumLayers - 1);
+	
+	g_mutex_lock(&m_DestinationsMutex);
+	bool changed = false;
+	for (std::vector<Destination*>::iterator it = m_vDestinations.begin(); it != m_vDestinations.end(); ++it)
+	{
+		if (((*it)->HostOrIp().compare(destination) == 0) && ((*it)->Layer() != layer))
+		{
+			(*it)->Layer(layer);
+			changed = true;
+		}
+	}
+	if (changed)
+	{
+		SetDestinations();
+		RetargetBitrates();
+	}
+	g_mutex_unlock(&m_DestinationsMutex);
+	
+	// The destination has never seen this layer's parameter sets, so it needs a key frame to
+	// start decoding.
+	if (changed)
+	{
+		RequestKeyUnit(layer);
+	}
 }
 
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 /// SenderPipeline::SetBitrate()
 ///
-/// Set the sender pipeline's video bitrate.
+/// Set the sender pipeline's maximum video bitrate. This is the bitrate of the full-resolution
+/// layer; the other simulcast layers get their fraction of it according to LAYER_SPECS. The
+/// congestion control keeps each encoder at or below its maximum, depending on what the
+/// destinations receiving its layer report back.
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 void SenderPipeline::SetBitrate(size_t bitrate)
 {
-	// The x264enc's bitrate property is in kbit/sec, so here we divide by 1024 and round to the
-	// nearest integer.
-	bitrate = (size_t)round(((double)bitrate) / ((double)1024.0));
-	g_object_set(m_pVideoEncoder, "bitrate", bitrate, NULL);
+	g_mutex_lock(&m_DestinationsMutex);
+	m_MaxBitrate = bitrate;
+	for (std::vector<Destination*>::iterator it = m_vDestinations.begin(); it != m_vDestinations.end(); ++it)
+	{
+		(*it)->Estimator().SetMaxBitrate(bitrate);
+	}
+	RetargetBitrates();
+	g_mutex_unlock(&m_DestinationsMutex);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SenderPipeline::GetPacingStats()
+///
+/// Get the pacing queue statistics of the video sent to a destination. Destinations receiving
+/// the same layer get the same packets at the same pace, so they share the layer's queue.
+///
+/// @param destination  The destination address or hostname, as given to AddDestination().
+///
+/// @param stats  Receives the statistics.
+///
+/// @return false if there is no such destination.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool SenderPipeline::GetPacingStats(const char* destination, PacingStats& stats)
+{
+	GstElement* sink = NULL;
+	g_mutex_lock(&m_DestinationsMutex);
+	for (std::vector<Destination*>::const_iterator it = m_vDestinations.begin(); it != m_vDestinations.end(); ++it)
+	{
+		if ((*it)->HostOrIp().compare(destination) == 0)
+		{
+			sink = m_pVideoRtpSinks[(*it)->Layer()];
+			break;
+		}
+	}
+	g_mutex_unlock(&m_DestinationsMutex);
+	if (sink == NULL)
+	{
+		return false;
+	}
+	
+	GstStructure* s = NULL;
+	g_object_get(sink, "stats", &s, NULL);
+	assert(s != NULL);
+	gst_structure_get_uint(s, "queued-packets", &stats.queuedPackets);
+	gst_structure_get_uint(s, "queued-bytes", &stats.queuedBytes);
+	gst_structure_get_uint(s, "max-queued-packets", &stats.maxQueuedPackets);
+	gst_structure_get_uint64(s, "queue-delay", &stats.queueDelayUs);
+	gst_structure_free(s);
+	return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SenderPipeline::SetRetransmission()
+///
+/// Turn retransmission of lost video packets on or off. Off, the retransmission senders neither
+/// keep a history nor answer NACKs, and receivers fall back on asking for key frames.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void SenderPipeline::SetRetransmission(bool enable)
+{
+	GstStructure* map = NewRtxPayloadTypeMap(enable);
+	for (size_t layer = 0; layer < m_NumLayers; ++layer)
+	{
+		g_object_set(m_pRtxSenders[layer], "payload-type-map", map, NULL);
+	}
+	gst_structure_free(map);
+	m_Retransmission = enable;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SenderPipeline::GetRetransmissionStats()
+///
+/// Get the retransmission counts of all layers' retransmission senders together.
+///
+/// @param requests  Receives the number of packets receivers asked to have retransmitted.
+///
+/// @param packets  Receives the number of packets retransmitted.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void SenderPipeline::GetRetransmissionStats(guint& requests, guint& packets) const
+{
+	requests = 0;
+	packets = 0;
+	for (size_t layer = 0; layer < m_NumLayers; ++layer)
+	{
+		guint layerRequests = 0;
+		guint layerPackets = 0;
+		g_object_get(m_pRtxSenders[layer],
+			"num-rtx-requests", &layerRequests,
+			"num-rtx-packets",  &layerPackets,
+			NULL);
+		requests += layerRequests;
+		packets += layerPackets;
+	}
 }
 
 
@@ -121,6 +518,286 @@ void SenderPipeline::SetWindowSink(void* handle)
 }
 
 
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SenderPipeline::SetPreviewSize()
+///
+/// Scale and rate-limit the self-view to what its window can show. The picture is scaled to fit
+/// the size with the video's aspect ratio, but never up.
+///
+/// @param width  The width of the preview window, in pixels; 0 shows the video's size.
+///
+/// @param height  The height of the preview window, in pixels; 0 shows the video's size.
+///
+/// @param frameRate  The most frames per second to show; 0 shows every frame.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void SenderPipeline::SetPreviewSize(int width, int height, int frameRate)
+{
+	m_PreviewWidth = width;
+	m_PreviewHeight = height;
+	m_PreviewFrameRate = frameRate;
+	
+	g_mutex_lock(&m_QosMutex);
+	gint videoWidth = m_VideoWidth;
+	gint videoHeight = m_VideoHeight;
+	g_mutex_unlock(&m_QosMutex);
+	
+	GstCaps* caps = gst_caps_new_empty_simple("video/x-raw");
+	if ((width > 0) && (height > 0) && ((width < videoWidth) || (height < videoHeight)))
+	{
+		double scale = std::min(static_cast<double>(width) / videoWidth, static_cast<double>(height) / videoHeight);
+		gst_caps_set_simple(caps,
+			"width",  G_TYPE_INT, std::max(static_cast<gint>(videoWidth * scale), static_cast<gint>(MIN_QOS_DIMENSION)) & ~1,
+			"height", G_TYPE_INT, std::max(static_cast<gint>(videoHeight * scale), static_cast<gint>(MIN_QOS_DIMENSION)) & ~1,
+			NULL);
+	}
+	
+	GstElement* previewcaps = gst_bin_get_by_name(GST_BIN(Pipeline()), "previewcaps");
+	assert(previewcaps != NULL);
+	GstCaps* oldCaps = NULL;
+	g_object_get(previewcaps, "caps", &oldCaps, NULL);
+	if ((oldCaps == NULL) || !gst_caps_is_equal(caps, oldCaps))
+	{
+		// Each change renegotiates the preview branch, so only change it when it changes.
+		g_object_set(previewcaps,
+			"caps", caps,
+			NULL);
+	}
+	if (oldCaps != NULL)
+	{
+		gst_caps_unref(oldCaps);
+	}
+	gst_caps_unref(caps);
+	gst_object_unref(previewcaps);
+	
+	GstElement* previewrate = gst_bin_get_by_name(GST_BIN(Pipeline()), "previewrate");
+	assert(previewrate != NULL);
+	g_object_set(previewrate,
+		"max-rate", (frameRate > 0) ? frameRate : G_MAXINT,
+		NULL);
+	gst_object_unref(previewrate);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SenderPipeline::SetVideoFormat()
+///
+/// Change the resolution and frame rate the video is sent in, while the pipeline plays. The
+/// format capsfilter after the capture's conversion takes the new caps, the simulcast layers and
+/// the self-view are rescaled from them, and the encoders restart with new parameter sets, which
+/// the payloaders send in-band (and the annunciator announces). The SSRC and RTP timestamps
+/// carry on, so receivers keep their pipelines; they just decode the new parameter sets.
+///
+/// @param width  The width; 0 for the capture's. At most the capture's; video isn't scaled up.
+///
+/// @param height  The height; 0 for the capture's. At most the capture's.
+///
+/// @param frameRate  The most frames per second; 0 for the capture's frame rate.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void SenderPipeline::SetVideoFormat(int width, int height, int frameRate)
+{
+	width = ((width > 0) ? std::min(width, m_CaptureWidth) : m_CaptureWidth) & ~1;
+	height = ((height > 0) ? std::min(height, m_CaptureHeight) : m_CaptureHeight) & ~1;
+	width = std::max(width, static_cast<int>(MIN_QOS_DIMENSION));
+	height = std::max(height, static_cast<int>(MIN_QOS_DIMENSION));
+	
+	g_mutex_lock(&m_QosMutex);
+	m_VideoWidth = width;
+	m_VideoHeight = height;
+	m_VideoFrameRate = std::max(frameRate, 0);
+	g_mutex_unlock(&m_QosMutex);
+	
+	GstElement* formatrate = gst_bin_get_by_name(GST_BIN(Pipeline()), "vformatrate");
+	assert(formatrate != NULL);
+	g_object_set(formatrate,
+		"max-rate", (frameRate > 0) ? frameRate : G_MAXINT,
+		NULL);
+	gst_object_unref(formatrate);
+	
+	GstCaps* caps = gst_caps_new_simple("video/x-raw",
+		"width",  G_TYPE_INT, width,
+		"height", G_TYPE_INT, height,
+		NULL);
+	GstElement* format = gst_bin_get_by_name(GST_BIN(Pipeline()), "vformat");
+	assert(format != NULL);
+	g_object_set(format,
+		"caps", caps,
+		NULL);
+	gst_object_unref(format);
+	gst_caps_unref(caps);
+	
+	// The layers are sized from the video format, at the current QoS level.
+	ApplyQosLevel();
+	SetPreviewSize(m_PreviewWidth, m_PreviewHeight, m_PreviewFrameRate);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SenderPipeline::SetVideoMuted()
+///
+/// Mute or unmute the video. While muted, captured frames are dropped before anything else
+/// handles them, so neither the conversion nor the encoders run and no video RTP is sent; RTCP
+/// keeps flowing, and receivers keep showing the last frame, as no packets are missing. The
+/// self-view freezes as well.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void SenderPipeline::SetVideoMuted(bool muted)
+{
+	g_object_set(m_pVideoValve, "drop", muted ? TRUE : FALSE, NULL);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SenderPipeline::GetVideoMuted()
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool SenderPipeline::GetVideoMuted() const
+{
+	gboolean drop = FALSE;
+	g_object_get(m_pVideoValve, "drop", &drop, NULL);
+	return drop != FALSE;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SenderPipeline::SetAudioMuted()
+///
+/// Mute or unmute the audio. While muted, captured audio is dropped before the resampler and
+/// encoder, and no audio RTP is sent; RTCP keeps flowing.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void SenderPipeline::SetAudioMuted(bool muted)
+{
+	g_object_set(m_pAudioValve, "drop", muted ? TRUE : FALSE, NULL);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SenderPipeline::GetAudioMuted()
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool SenderPipeline::GetAudioMuted() const
+{
+	gboolean drop = FALSE;
+	g_object_get(m_pAudioValve, "drop", &drop, NULL);
+	return drop != FALSE;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SenderPipeline::SetEncoderProfile()
+///
+/// Select the video encoder profile. x264enc ignores changes to these settings once it is past
+/// READY, and taking a running encoder back to READY would flush its pads and stop the layer, so
+/// the profile is only stored here; Play() applies it the next time the pipeline starts.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void SenderPipeline::SetEncoderProfile(EncoderProfile profile)
+{
+	m_EncoderProfile = (profile == ENCODER_PROFILE_AUTO) ? AutoEncoderProfile() : profile;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SenderPipeline::Play()
+///
+/// Make the pipeline play. If it is starting (rather than resuming from PAUSED), the encoders are
+/// still at READY at most, and take the profile SetEncoderProfile() selected last.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void SenderPipeline::Play()
+{
+	GstState state = GST_STATE_NULL;
+	gst_element_get_state(Pipeline(), &state, NULL, 0);
+	if (state <= GST_STATE_READY)
+	{
+		for (size_t layer = 0; layer < m_NumLayers; ++layer)
+		{
+			ApplyEncoderProfile(m_pVideoEncoders[layer], m_EncoderProfile);
+		}
+	}
+	PipelineBase::Play();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SenderPipeline::AutoEncoderProfile()
+///
+/// Pick an encoder profile by the number of CPU cores: low-cpu with two or fewer, low-latency
+/// with up to eight, and balanced with more.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+SenderPipeline::EncoderProfile SenderPipeline::AutoEncoderProfile()
+{
+	guint cores = g_get_num_processors();
+	if (cores <= 2)
+	{
+		return ENCODER_PROFILE_LOW_CPU;
+	}
+	return (cores <= 8) ? ENCODER_PROFILE_LOW_LATENCY : ENCODER_PROFILE_BALANCED;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SenderPipeline::NewAudioParameters()
+///
+/// Get the audio parameters a sender with some audio settings announces, as far as a receiver
+/// needs them to pick its decoder; a receiver can start with these before the announcement
+/// arrives. They describe the payloaders' default payload types. Free with g_free().
+///////////////////////////////////////////////////////////////////////////////////////////////////
+gchar* SenderPipeline::NewAudioParameters(const AudioSettings& audioSettings)
+{
+	GstStructure* params;
+	if (audioSettings.codec == AUDIO_CODEC_OPUS)
+	{
+		params = gst_structure_new("application/x-rtp",
+			"media",           G_TYPE_STRING, "audio",
+			"clock-rate",      G_TYPE_INT,    48000,
+			"encoding-name",   G_TYPE_STRING, "OPUS",
+			"encoding-params", G_TYPE_STRING, "2",
+			"payload",         G_TYPE_INT,    96,
+			"useinbandfec",    G_TYPE_STRING, audioSettings.fec ? "1" : "0",
+			"usedtx",          G_TYPE_STRING, audioSettings.dtx ? "1" : "0",
+			NULL);
+	}
+	else
+	{
+		params = gst_structure_new("application/x-rtp",
+			"media",           G_TYPE_STRING, "audio",
+			"clock-rate",      G_TYPE_INT,    32000,
+			"encoding-name",   G_TYPE_STRING, "SPEEX",
+			"encoding-params", G_TYPE_STRING, "1",
+			"payload",         G_TYPE_INT,    110,
+			NULL);
+	}
+	gchar* ret = gst_structure_to_string(params);
+	gst_structure_free(params);
+	return ret;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SenderPipeline::EncoderProfileName()
+///////////////////////////////////////////////////////////////////////////////////////////////////
+const char* SenderPipeline::EncoderProfileName(EncoderProfile profile)
+{
+	assert(profile < NUM_ENCODER_PROFILES);
+	return ENCODER_SETTINGS[profile].name;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SenderPipeline::ApplyEncoderProfile()
+///
+/// Set an x264enc's properties from an encoder profile.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void SenderPipeline::ApplyEncoderProfile(GstElement* encoder, EncoderProfile profile)
+{
+	assert((profile > ENCODER_PROFILE_AUTO) && (profile < NUM_ENCODER_PROFILES));
+	const EncoderSettings& settings = ENCODER_SETTINGS[profile];
+	gst_util_set_object_arg(G_OBJECT(encoder), "speed-preset", settings.speedPreset);
+	g_object_set(G_OBJECT(encoder),
+		"threads",          settings.threads,
+		"sliced-threads",   settings.slicedThreads,
+		"rc-lookahead",     settings.rcLookahead,
+		"vbv-buf-capacity", settings.vbvBufferMs,
+		"bframes",          settings.bframes,
+		NULL);
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 /// SenderPipeline::BuildPipeline()
 ///
@@ -132,7 +809,7 @@ void SenderPipeline::SetWindowSink(void* handle)
 ///
 /// @return  The pipeline.
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-GstElement* SenderPipeline::BuildPipeline(const char* videoInputName, const char* audioInputName)
+GstElement* SenderPipeline::BuildPipeline(const char* videoInputName, const char* audioInputName, size_t numLayers, const AudioSettings& audioSettings, EncoderProfile encoderProfile)
 {
 	// Create a new pipeline
 	GstElement* pipeline = gst_pipeline_new(NULL);
@@ -150,6 +827,13 @@ GstElement* SenderPipeline::BuildPipeline(const char* videoInputName, const char
                "use-pipeline-clock",    FALSE,  // (FALSE)
 		NULL);
 	
+	// AVPF lets receivers send feedback (NACK, PLI) right away rather than with their next
+	// regular report. Each video session gets a FEC encoder and a retransmission sender as its
+	// sessions are created.
+	gst_util_set_object_arg(G_OBJECT(rtpbin), "rtp-profile", "avpf");
+	g_signal_connect(rtpbin, "request-fec-encoder", G_CALLBACK(StaticRequestFecEncoder), NULL);
+	g_signal_connect(rtpbin, "request-aux-sender", G_CALLBACK(StaticRequestAuxSender), NULL);
+	
 	// Get device index and caps for the selected video input
 	int avfDeviceIndex = GetVideoDeviceIndex(videoInputName);
 	assert((avfDeviceIndex >= 0) && (avfDeviceIndex < 2147483647));
@@ -169,10 +853,30 @@ GstElement* SenderPipeline::BuildPipeline(const char* videoInputName, const char
     g_object_set(srccapsfilter,
     	"caps", caps,
     	NULL);
+    
+	// Remember the capture size; the simulcast layers are scaled down from it.
+	int width = 0, height = 0;
+	GstStructure* s = gst_caps_get_structure(caps, 0);
+	assert(gst_structure_get_int(s, "width", &width));
+	assert(gst_structure_get_int(s, "height", &height));
     gst_caps_unref(caps);
     
+	// Muting the video stops it right after capture; see SetVideoMuted().
+	GstElement* vvalve = gst_element_factory_make("valve", "vvalve");
+	
 	GstElement* videoconvert1 = gst_element_factory_make("videoconvert", NULL);
 	
+	// The format the video is sent in; passes the capture through until SetVideoFormat() changes
+	// it. The encoders' branches renegotiate behind the tee, with no change to the pipeline.
+	GstElement* formatrate = gst_element_factory_make("videorate", "vformatrate");
+	g_object_set(G_OBJECT(formatrate),
+		"drop-only", TRUE,
+		NULL);
+	
+	GstElement* formatscale = gst_element_factory_make("videoscale", NULL);
+	
+	GstElement* formatcapsfilter = gst_element_factory_make("capsfilter", "vformat");
+	
 	GstElement* t = gst_element_factory_make("tee", "t");
 	
 	GstElement* queue = gst_element_factory_make("queue", NULL);
@@ -184,41 +888,140 @@ GstElement* SenderPipeline::BuildPipeline(const char* videoInputName, const char
     "leaky",            2, // GST_QUEUE_LEAK_DOWNSTREAM
 		NULL);
 
-	GstElement* videoconvert2 = gst_element_factory_make("videoconvert", NULL);
-	
-	GstElement* videosink = gst_element_factory_make("osxvideosink", "videosink");
-	g_object_set(G_OBJECT(videosink),
-		"enable-last-sample", FALSE,
-		"sync",               TRUE,
+	// The self-view is scaled and rate-limited (see SetPreviewSize()) before its colorspace
+	// conversion, which then only converts what is shown; the full-size conversion before the tee
+	// is the one the encoders need anyway.
+	GstElement* previewrate = gst_element_factory_make("videorate", "previewrate");
+	g_object_set(G_OBJECT(previewrate),
+		"drop-only", TRUE,
 		NULL);
 	
-	GstElement* venc = gst_element_factory_make("x264enc", "venc");
-	gst_util_set_object_arg(G_OBJECT(venc), "speed-preset", "ultrafast");
-	gst_util_set_object_arg(G_OBJECT(venc), "tune", "zerolatency");
-	g_object_set(G_OBJECT(venc), "key-int-max", 10, NULL);
+	GstElement* previewscale = gst_element_factory_make("videoscale", NULL);
+	
+	GstElement* previewcapsfilter = gst_element_factory_make("capsfilter", "previewcaps");
 	
-	GstElement* rtph264pay = gst_element_factory_make("rtph264pay", NULL);
+	GstElement* videoconvert2 = gst_element_factory_make("videoconvert", NULL);
 	
-	GstElement* vsink = gst_element_factory_make("multiudpsink", "vsink");
-	g_object_set(G_OBJECT(vsink),
+	GstElement* videosink = gst_element_factory_make("osxvideosink", "videosink");
+	g_object_set(G_OBJECT(videosink),
 		"enable-last-sample", FALSE,
 		"sync",               TRUE,
-		"async",              TRUE,
 		NULL);
 	
-	GstElement* vcsink = gst_element_factory_make("multiudpsink", "vcsink");
-	g_object_set(G_OBJECT(vcsink),
-		"enable-last-sample", FALSE,
-		"sync",               FALSE,
-		"async",              FALSE,
-		NULL);
+	gst_bin_add_many(GST_BIN(pipeline), rtpbin, videosrc, srccapsfilter, vvalve, videoconvert1, formatrate, formatscale, formatcapsfilter, t, queue, previewrate, previewscale, previewcapsfilter, videoconvert2, videosink, NULL);
+	assert(gst_element_link_many(videosrc, srccapsfilter, vvalve, videoconvert1, formatrate, formatscale, formatcapsfilter, t, queue, previewrate, previewscale, previewcapsfilter, videoconvert2, videosink, NULL));
 	
-	gst_bin_add_many(GST_BIN(pipeline), rtpbin, videosrc, srccapsfilter, videoconvert1, t, queue, videoconvert2, videosink, venc, rtph264pay, vsink, vcsink, NULL);
-	assert(gst_element_link_many(videosrc, srccapsfilter, videoconvert1, t, queue, videoconvert2, videosink, NULL));
-	assert(gst_element_link_many(t, venc, rtph264pay, NULL));
-	assert(gst_element_link_pads(rtph264pay, "src", rtpbin, "send_rtp_sink_0"));
-	assert(gst_element_link_pads(rtpbin, "send_rtp_src_0", vsink, "sink"));
-	assert(gst_element_link_pads(rtpbin, "send_rtcp_src_0", vcsink, "sink"));
+	// Each simulcast layer is a stream of its own, with its own SSRC (see LayerSsrc()), sequence
+	// numbers and sender reports; a receiver that is switched to another layer sees a new stream
+	// replace the old one, rather than a jump in one stream's sequence numbers that looks like
+	// loss. The layers share an RTP timestamp base, as they share their frames' timestamps.
+	guint videoSsrc = g_random_int();
+	guint videoTimestampOffset = g_random_int();
+	
+	// Build one encoding branch per simulcast layer off of the tee. Each branch gets its own
+	// thread (via its queue) and its own rtpbin session and UDP sinks.
+	for (size_t layer = 0; layer < numLayers; ++layer)
+	{
+		char name[sizeof("vcsink-2147483648")];
+		char pad[sizeof("send_rtcp_src_-2147483648")];
+		unsigned int session = LayerSession(layer);
+		
+		std::sprintf(name, "vqueue%u", static_cast<unsigned int>(layer));
+		GstElement* vqueue = gst_element_factory_make("queue", name);
+		g_object_set(G_OBJECT(vqueue),
+			"max-size-buffers", 1,
+			"max-size-bytes",   0,
+			"max-size-time",    0,
+			"silent",           TRUE,
+			"leaky",            2, // GST_QUEUE_LEAK_DOWNSTREAM
+			NULL);
+		
+		// Passes every frame until the QoS controller lowers the frame rate; see ApplyQosLevel().
+		std::sprintf(name, "vrate%u", static_cast<unsigned int>(layer));
+		GstElement* videorate = gst_element_factory_make("videorate", name);
+		g_object_set(G_OBJECT(videorate),
+			"drop-only", TRUE,
+			NULL);
+		
+		GstElement* videoscale = gst_element_factory_make("videoscale", NULL);
+		
+		std::sprintf(name, "vscale%u", static_cast<unsigned int>(layer));
+		GstElement* scalefilter = gst_element_factory_make("capsfilter", name);
+		caps = gst_caps_new_simple("video/x-raw",
+			"width",  G_TYPE_INT, (width / LAYER_SPECS[layer].scaleDivisor) & ~1,
+			"height", G_TYPE_INT, (height / LAYER_SPECS[layer].scaleDivisor) & ~1,
+			NULL);
+		g_object_set(scalefilter,
+			"caps", caps,
+			NULL);
+		gst_caps_unref(caps);
+		
+		std::sprintf(name, "venc%u", static_cast<unsigned int>(layer));
+		GstElement* venc = gst_element_factory_make("x264enc", name);
+		gst_util_set_object_arg(G_OBJECT(venc), "tune", "zerolatency");
+		g_object_set(G_OBJECT(venc), "key-int-max", KEY_INT_MAX_FRAMES, NULL);
+		ApplyEncoderProfile(venc, (encoderProfile == ENCODER_PROFILE_AUTO) ? AutoEncoderProfile() : encoderProfile);
+		
+		GstElement* rtph264pay = gst_element_factory_make("rtph264pay", NULL);
+		g_object_set(G_OBJECT(rtph264pay),
+			"ssrc",             LayerSsrc(videoSsrc, layer),
+			"timestamp-offset", videoTimestampOffset,
+			"config-interval",  -1, // SPS/PPS with every IDR: receivers start and follow changes in-band
+			NULL);
+		
+		std::sprintf(name, "vsink%u", static_cast<unsigned int>(layer));
+		GstElement* vsink = gst_element_factory_make(FanoutSink::ELEMENT_NAME, name);
+		g_object_set(G_OBJECT(vsink),
+			"enable-last-sample", FALSE,
+			"sync",               TRUE,
+			"async",              TRUE,
+			NULL);
+		
+		std::sprintf(name, "vcsink%u", static_cast<unsigned int>(layer));
+		GstElement* vcsink = gst_element_factory_make("multiudpsink", name);
+		g_object_set(G_OBJECT(vcsink),
+			"enable-last-sample", FALSE,
+			"sync",               FALSE,
+			"async",              FALSE,
+			NULL);
+		
+		gst_bin_add_many(GST_BIN(pipeline), vqueue, videorate, videoscale, scalefilter, venc, rtph264pay, vsink, vcsink, NULL);
+		assert(gst_element_link_many(t, vqueue, videorate, videoscale, scalefilter, venc, rtph264pay, NULL));
+		std::sprintf(pad, "send_rtp_sink_%u", session);
+		assert(gst_element_link_pads(rtph264pay, "src", rtpbin, pad));
+		std::sprintf(pad, "send_rtp_src_%u", session);
+		assert(gst_element_link_pads(rtpbin, pad, vsink, "sink"));
+		std::sprintf(pad, "send_rtcp_src_%u", session);
+		assert(gst_element_link_pads(rtpbin, pad, vcsink, "sink"));
+	}
+	
+	// Destinations send RTCP receiver reports back to us; feed them into the video sessions, where
+	// they drive the congestion control, and the audio session. All video RTCP arrives on one
+	// port, so it goes to every video session; each one takes the report blocks about its own
+	// layer's SSRC. The ports are set along with the first destination.
+	GstElement* vcsrc = gst_element_factory_make("udpsrc", "vcsrc");
+	caps = gst_caps_from_string("application/x-rtcp");
+	g_object_set(G_OBJECT(vcsrc),
+		"caps", caps,
+		NULL);
+	
+	GstElement* acsrc = gst_element_factory_make("udpsrc", "acsrc");
+	g_object_set(G_OBJECT(acsrc),
+		"caps", caps,
+		NULL);
+	gst_caps_unref(caps);
+	
+	GstElement* vcsrctee = gst_element_factory_make("tee", NULL);
+	
+	gst_bin_add_many(GST_BIN(pipeline), vcsrc, vcsrctee, acsrc, NULL);
+	assert(gst_element_link(vcsrc, vcsrctee));
+	for (size_t layer = 0; layer < numLayers; ++layer)
+	{
+		char pad[sizeof("recv_rtcp_sink_-2147483648")];
+		std::sprintf(pad, "recv_rtcp_sink_%u", LayerSession(layer));
+		assert(gst_element_link_pads(vcsrctee, "src_%u", rtpbin, pad));
+	}
+	assert(gst_element_link_pads(acsrc, "src", rtpbin, "recv_rtcp_sink_1"));
 	
 	// Get device index and caps for the selected video input
 	int audioDeviceIndex = GetAudioDeviceIndex(audioInputName);
@@ -241,10 +1044,16 @@ GstElement* SenderPipeline::BuildPipeline(const char* videoInputName, const char
     	NULL);
     gst_caps_unref(caps);
 
+	// Muting the audio stops it right after capture; see SetAudioMuted().
+	GstElement* avalve = gst_element_factory_make("valve", "avalve");
+	
 	GstElement* audioresample = gst_element_factory_make("audioresample", NULL);
 
+	// Speex runs at 32kHz; Opus wants 48kHz.
 	GstElement* capsfilter2 = gst_element_factory_make("capsfilter", NULL);
-	caps = gst_caps_from_string("audio/x-raw, format=(string)S32LE, layout=(string)interleaved, rate=(int)32000, channels=(int)1");
+	caps = gst_caps_from_string((audioSettings.codec == AUDIO_CODEC_OPUS)
+		? "audio/x-raw, format=(string)S32LE, layout=(string)interleaved, rate=(int)48000, channels=(int)1"
+		: "audio/x-raw, format=(string)S32LE, layout=(string)interleaved, rate=(int)32000, channels=(int)1");
 	g_object_set(capsfilter2,
 		"caps", caps,
 		NULL);
@@ -252,14 +1061,34 @@ GstElement* SenderPipeline::BuildPipeline(const char* videoInputName, const char
 	
 	GstElement* audioconvert = gst_element_factory_make("audioconvert", NULL);
 
-	GstElement* speexenc = gst_element_factory_make("speexenc", NULL);
-	g_object_set(G_OBJECT(speexenc),
-		"vad", TRUE,
-		NULL);
-
-	GstElement* rtpspeexpay = gst_element_factory_make("rtpspeexpay", NULL);
+	GstElement* aenc;
+	GstElement* apay;
+	if (audioSettings.codec == AUDIO_CODEC_OPUS)
+	{
+		// Opus has much less algorithmic delay than Speex, in-band FEC so that a lost packet can
+		// be rebuilt from the next one, and DTX to (almost) stop sending during silence.
+		aenc = gst_element_factory_make("opusenc", NULL);
+		char frameSize[sizeof("-2147483648")];
+		std::sprintf(frameSize, "%u", audioSettings.frameMs);
+		gst_util_set_object_arg(G_OBJECT(aenc), "frame-size", frameSize);
+		g_object_set(G_OBJECT(aenc),
+			"bitrate",                OPUS_BITRATE,
+			"inband-fec",             audioSettings.fec ? TRUE : FALSE,
+			"packet-loss-percentage", audioSettings.fec ? OPUS_FEC_LOSS_PERCENTAGE : 0,
+			"dtx",                    audioSettings.dtx ? TRUE : FALSE,
+			NULL);
+		apay = gst_element_factory_make("rtpopuspay", NULL);
+	}
+	else
+	{
+		aenc = gst_element_factory_make("speexenc", NULL);
+		g_object_set(G_OBJECT(aenc),
+			"vad", TRUE,
+			NULL);
+		apay = gst_element_factory_make("rtpspeexpay", NULL);
+	}
     
-	GstElement* asink = gst_element_factory_make("multiudpsink", "asink");
+	GstElement* asink = gst_element_factory_make(FanoutSink::ELEMENT_NAME, "asink");
 	g_object_set(G_OBJECT(asink),
 		"enable-last-sample", FALSE,
   	"sync",               TRUE,
@@ -273,9 +1102,9 @@ GstElement* SenderPipeline::BuildPipeline(const char* videoInputName, const char
 		"async",              FALSE,
 		NULL);
     	
-	gst_bin_add_many(GST_BIN(pipeline), osxaudiosrc, srccapsfilter, audioresample, capsfilter2, audioconvert, speexenc, rtpspeexpay, asink, acsink, NULL);
-	assert(gst_element_link_many(osxaudiosrc, srccapsfilter, audioresample, capsfilter2, audioconvert, speexenc, rtpspeexpay, NULL));
-	assert(gst_element_link_pads(rtpspeexpay, "src", rtpbin, "send_rtp_sink_1"));
+	gst_bin_add_many(GST_BIN(pipeline), osxaudiosrc, srccapsfilter, avalve, audioresample, capsfilter2, audioconvert, aenc, apay, asink, acsink, NULL);
+	assert(gst_element_link_many(osxaudiosrc, srccapsfilter, avalve, audioresample, capsfilter2, audioconvert, aenc, apay, NULL));
+	assert(gst_element_link_pads(apay, "src", rtpbin, "send_rtp_sink_1"));
 	assert(gst_element_link_pads(rtpbin, "send_rtp_src_1", asink, "sink"));
 	assert(gst_element_link_pads(rtpbin, "send_rtcp_src_1", acsink, "sink"));
 
@@ -323,6 +1152,21 @@ void SenderPipeline::PadNotifyCaps(GObject* gobject, GParamSpec* pspec)
 				{
 					m_AudioSsrc = ssrc;
 				}
+				
+				// The audio parameters are these caps without the per-stream fields, so receivers
+				// know the encoding, plus the Opus SDP fmtp parameters.
+				GstStructure* params = gst_structure_copy(s);
+				gst_structure_remove_fields(params, "ssrc", "timestamp-offset", "seqnum-offset", NULL);
+				if (m_AudioSettings.codec == AUDIO_CODEC_OPUS)
+				{
+					gst_structure_set(params,
+						"useinbandfec", G_TYPE_STRING, m_AudioSettings.fec ? "1" : "0",
+						"usedtx",       G_TYPE_STRING, m_AudioSettings.dtx ? "1" : "0",
+						NULL);
+				}
+				g_free(m_pAudioParameters);
+				m_pAudioParameters = gst_structure_to_string(params);
+				gst_structure_free(params);
 			}
 		}
 		
@@ -332,13 +1176,147 @@ void SenderPipeline::PadNotifyCaps(GObject* gobject, GParamSpec* pspec)
 	{
 		m_pSpropParameterSets = NULL;
 	}
-	if ((m_pNotifySink != NULL) && (m_pSpropParameterSets != NULL) && (m_VideoSsrc != 0) && (m_AudioSsrc))
+	if ((m_pNotifySink != NULL) && (m_pSpropParameterSets != NULL) && (m_pAudioParameters != NULL) && (m_VideoSsrc != 0) && (m_AudioSsrc))
 	{
-		m_pNotifySink->OnNewParameters(*this, m_pSpropParameterSets, m_VideoSsrc, m_AudioSsrc);
+		m_pNotifySink->OnNewParameters(*this, m_pSpropParameterSets, m_pAudioParameters, m_VideoSsrc, m_AudioSsrc);
 	}
 }
 
 
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SenderPipeline::SsrcActive()
+///
+/// Callback when RTCP arrives from an SSRC. If it came from one of our destinations and carries a
+/// report block about the video layer that destination gets, feed the report into its bandwidth
+/// estimator and retarget the encoders. Every video session sees all the video RTCP, but only
+/// keeps the report blocks about its own layer.
+///
+/// @param session  The rtpbin session the RTCP arrived on.
+///
+/// @param ssrc  The SSRC that sent the RTCP.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void SenderPipeline::SsrcActive(guint session, guint ssrc)
+{
+	size_t layer = SessionLayer(session);
+	if (layer >= m_NumLayers)
+	{
+		return;
+	}
+	
+	GObject* rtpSession = NULL;
+	g_signal_emit_by_name(m_pRtpBin, "get-internal-session", session, &rtpSession);
+	if (rtpSession == NULL)
+	{
+		return;
+	}
+	GObject* source = NULL;
+	g_signal_emit_by_name(rtpSession, "get-source-by-ssrc", ssrc, &source);
+	g_object_unref(rtpSession);
+	if (source == NULL)
+	{
+		return;
+	}
+	GstStructure* stats = NULL;
+	g_object_get(source, "stats", &stats, NULL);
+	g_object_unref(source);
+	if (stats == NULL)
+	{
+		return;
+	}
+	
+	gboolean haveRb = FALSE;
+	guint fractionLost = 0, roundTrip = 0, jitter = 0;
+	const gchar* rtcpFrom = gst_structure_get_string(stats, "rtcp-from");
+	if (gst_structure_get_boolean(stats, "have-rb", &haveRb) && haveRb && (rtcpFrom != NULL)
+		&& gst_structure_get_uint(stats, "rb-fractionlost", &fractionLost)
+		&& gst_structure_get_uint(stats, "rb-round-trip", &roundTrip)
+		&& gst_structure_get_uint(stats, "rb-jitter", &jitter))
+	{
+		// "rtcp-from" is "address:port"; the destination is identified by the address alone.
+		std::string from(rtcpFrom);
+		from = from.substr(0, from.rfind(':'));
+		
+		g_mutex_lock(&m_DestinationsMutex);
+		for (std::vector<Destination*>::iterator it = m_vDestinations.begin(); it != m_vDestinations.end(); ++it)
+		{
+			if (((*it)->HostOrIp().compare(from) == 0) && ((*it)->Layer() == layer))
+			{
+				// The fraction lost is in 1/256ths, the round trip in 1/65536ths of a second, and
+				// the jitter in 90kHz RTP clock units.
+				(*it)->Estimator().OnReceiverReport(g_get_monotonic_time(), fractionLost / 256.0, roundTrip / 65536.0, jitter / 90000.0);
+			}
+		}
+		RetargetBitrates();
+		g_mutex_unlock(&m_DestinationsMutex);
+	}
+	gst_structure_free(stats);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SenderPipeline::RetargetBitrates()
+///
+/// Set each layer's encoder bitrate to the lowest bandwidth estimate among the destinations that
+/// receive that layer, limited to the layer's maximum. A layer nobody receives runs at its
+/// maximum. Must be called with m_DestinationsMutex held.
+///
+/// Each layer's FEC overhead follows the highest loss among those destinations, and the encoder
+/// gets what is left of the bitrate after the FEC. The layer is paced at PACING_RATE_FACTOR
+/// times the bitrate, FEC included.
+///
+/// Each sink's send buffer is sized for SEND_BUFFER_WINDOW_MS of what it sends: the layer's (or
+/// the audio's) rate times the number of destinations it goes to.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void SenderPipeline::RetargetBitrates()
+{
+	for (size_t layer = 0; layer < m_NumLayers; ++layer)
+	{
+		size_t bitrate = m_MaxBitrate / LAYER_SPECS[layer].bitrateDivisor;
+		double fractionLost = 0.0;
+		size_t receivers = 0;
+		for (std::vector<Destination*>::const_iterator it = m_vDestinations.begin(); it != m_vDestinations.end(); ++it)
+		{
+			if ((*it)->Layer() == layer)
+			{
+				bitrate = std::min(bitrate, (*it)->Estimator().Bitrate());
+				fractionLost = std::max(fractionLost, (*it)->Estimator().FractionLost());
+				++receivers;
+			}
+		}
+		
+		guint fecPercentage = FecPercentage(fractionLost);
+		if (fecPercentage != m_LayerFecPercentages[layer])
+		{
+			m_LayerFecPercentages[layer] = fecPercentage;
+			g_object_set(m_pFecEncoders[layer],
+				"percentage",           fecPercentage,
+				"percentage-important", fecPercentage,
+				NULL);
+		}
+		guint64 pacingRate = static_cast<guint64>(bitrate * PACING_RATE_FACTOR);
+		g_object_set(m_pVideoRtpSinks[layer],
+			"pacing-rate", pacingRate,
+			"buffer-size", SocketBufferSizer::Size(pacingRate * receivers, SEND_BUFFER_WINDOW_MS),
+			NULL);
+		bitrate = (bitrate * 100) / (100 + fecPercentage);
+		
+		// Don't make the encoder reconfigure itself for tiny changes.
+		size_t delta = (bitrate > m_LayerBitrates[layer]) ? (bitrate - m_LayerBitrates[layer]) : (m_LayerBitrates[layer] - bitrate);
+		if ((m_LayerBitrates[layer] == 0) || (delta > (m_LayerBitrates[layer] / BITRATE_CHANGE_DIVISOR)))
+		{
+			m_LayerBitrates[layer] = bitrate;
+			
+			// The x264enc's bitrate property is in kbit/sec, so here we divide by 1024 and round
+			// to the nearest integer.
+			guint kbps = (guint)round(((double)bitrate) / ((double)1024.0));
+			g_object_set(m_pVideoEncoders[layer], "bitrate", kbps, NULL);
+		}
+	}
+	
+	g_object_set(m_pAudioRtpSink, "buffer-size", SocketBufferSizer::Size(static_cast<uint64_t>(OPUS_BITRATE) * m_vDestinations.size(), SEND_BUFFER_WINDOW_MS), NULL);
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 /// SenderPipeline::SetDestinations()
 ///
@@ -346,24 +1324,41 @@ void SenderPipeline::PadNotifyCaps(GObject* gobject, GParamSpec* pspec)
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 void SenderPipeline::SetDestinations()
 {
-	static const struct
+	static const size_t ALL_LAYERS = static_cast<size_t>(-1);
+	
+	struct
 	{
 		GstElement* pElement;
 		uint16_t portOffset;
+		size_t layer;
 	}
-	pairs[] = 
+	pairs[2 * MAX_SIMULCAST_LAYERS + 2] = 
 	{
-		{m_pVideoRtpSink,  0},
-		{m_pVideoRtcpSink, 1},
-		{m_pAudioRtpSink,  2},
-		{m_pAudioRtcpSink, 3},
+		{m_pAudioRtpSink,  2, ALL_LAYERS},
+		{m_pAudioRtcpSink, 3, ALL_LAYERS},
 	};
+	size_t numPairs = 2;
+	
+	// Each destination receives only the video layer selected for it, always on the same ports.
+	for (size_t layer = 0; layer < m_NumLayers; ++layer)
+	{
+		pairs[numPairs].pElement = m_pVideoRtpSinks[layer];
+		pairs[numPairs].portOffset = 0;
+		pairs[numPairs++].layer = layer;
+		pairs[numPairs].pElement = m_pVideoRtcpSinks[layer];
+		pairs[numPairs].portOffset = 1;
+		pairs[numPairs++].layer = layer;
+	}
 	
-	for (size_t i = 0; i < sizeof(pairs) / sizeof(pairs[0]); i++)
+	for (size_t i = 0; i < numPairs; i++)
 	{
 		std::string clients;
-		for (std::vector<const Destination*>::const_iterator it = m_vDestinations.begin(); it != m_vDestinations.end(); ++it)
+		for (std::vector<Destination*>::const_iterator it = m_vDestinations.begin(); it != m_vDestinations.end(); ++it)
 		{
+			if ((pairs[i].layer != ALL_LAYERS) && (pairs[i].layer != (*it)->Layer()))
+			{
+				continue;
+			}
 			if (!clients.empty())
 			{
 				clients += ",";
@@ -375,4 +1370,634 @@ void SenderPipeline::SetDestinations()
 		}
 		g_object_set(pairs[i].pElement, "clients", clients.c_str(), NULL);
 	}
-}
\ No newline at end of file
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SenderPipeline::SetRtcpPortBase()
+///
+/// Set the port base we listen on for the destinations' RTCP receiver reports (video on
+/// portBase + 1, audio on portBase + 3), when they don't send them back to the port base we send
+/// to. This must be called before the pipeline starts playing.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void SenderPipeline::SetRtcpPortBase(uint16_t portBase)
+{
+	g_object_set(m_pVideoRtcpSource, "port", portBase + 1, NULL);
+	g_object_set(m_pAudioRtcpSource, "port", portBase + 3, NULL);
+	m_RtcpPortBaseSet = true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SenderPipeline::FeedbackRtcp()
+///
+/// Callback when RTCP feedback arrives in session 0, which sees all the video RTCP. A PLI gets a
+/// key frame for the layer whose SSRC it names, and a NACK gets the packets it lists
+/// retransmitted from that layer's history; a FIR names its layers in its FCI. A receiver sends
+/// its feedback about every sender it receives to all of them, so feedback about other SSRCs is
+/// ignored.
+///
+/// Called on the RTCP thread. The layer is worked out from each NACK's SSRC and goes with its
+/// requests, so NACKs from receivers on different layers can't get each other's packets.
+///
+/// @param type  The RTCP packet type.
+///
+/// @param fbtype  The feedback message type.
+///
+/// @param senderSsrc  The SSRC of the receiver that sent the feedback.
+///
+/// @param mediaSsrc  The SSRC of the stream the feedback is about.
+///
+/// @param fci  The feedback control information (for a NACK, the lost packets), or NULL.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void SenderPipeline::FeedbackRtcp(guint type, guint fbtype, guint senderSsrc, guint mediaSsrc, GstBuffer* fci)
+{
+	if (m_VideoSsrc == 0)
+	{
+		return;
+	}
+	size_t layer = SsrcLayer(m_VideoSsrc, mediaSsrc);
+	
+	if ((type == RTCP_TYPE_RTPFB) && (fbtype == RTCP_RTPFB_TYPE_NACK))
+	{
+		if ((layer < m_NumLayers) && (fci != NULL))
+		{
+			RequestRetransmissions(layer, mediaSsrc, fci);
+		}
+		return;
+	}
+	
+	if ((type == RTCP_TYPE_PSFB) && (fbtype == RTCP_PSFB_TYPE_PLI))
+	{
+		if (layer < m_NumLayers)
+		{
+			RequestKeyUnit(layer);
+		}
+		return;
+	}
+	
+	// Each FIR FCI entry is the SSRC to key, a sequence number, and three reserved bytes.
+	GstMapInfo map;
+	if ((type != RTCP_TYPE_PSFB) || (fbtype != RTCP_PSFB_TYPE_FIR) || (fci == NULL) || !gst_buffer_map(fci, &map, GST_MAP_READ))
+	{
+		return;
+	}
+	for (gsize i = 0; (i + 8) <= map.size; i += 8)
+	{
+		layer = SsrcLayer(m_VideoSsrc, GST_READ_UINT32_BE(map.data + i));
+		if (layer < m_NumLayers)
+		{
+			RequestKeyUnit(layer);
+		}
+	}
+	gst_buffer_unmap(fci, &map);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SenderPipeline::RequestRetransmissions()
+///
+/// Ask a layer's retransmission sender for the packets a NACK lists, with requests like those
+/// rtpbin makes, plus the layer (RTX_REQUEST_LAYER_FIELD). Each FCI entry is the sequence number
+/// of a lost packet and a bitmask of which of the 16 packets after it are lost too (RFC 4585).
+///
+/// @param layer  The layer index.
+///
+/// @param ssrc  The SSRC of the stream the NACK is about.
+///
+/// @param fci  The NACK's feedback control information.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void SenderPipeline::RequestRetransmissions(size_t layer, guint ssrc, GstBuffer* fci)
+{
+	GstMapInfo map;
+	if (!gst_buffer_map(fci, &map, GST_MAP_READ))
+	{
+		return;
+	}
+	
+	GstPad* pad = gst_element_get_static_pad(m_pRtxSenders[layer], "src");
+	assert(pad != NULL);
+	for (gsize i = 0; (i + 4) <= map.size; i += 4)
+	{
+		guint16 pid = GST_READ_UINT16_BE(map.data + i);
+		guint16 blp = GST_READ_UINT16_BE(map.data + i + 2);
+		for (guint bit = 0; bit <= 16; ++bit)
+		{
+			if ((bit > 0) && ((blp & (1 << (bit - 1))) == 0))
+			{
+				continue;
+			}
+			GstStructure* s = gst_structure_new("GstRTPRetransmissionRequest",
+				"seqnum",                G_TYPE_UINT, static_cast<guint>(static_cast<guint16>(pid + bit)),
+				"ssrc",                  G_TYPE_UINT, ssrc,
+				RTX_REQUEST_LAYER_FIELD, G_TYPE_UINT, static_cast<guint>(layer),
+				NULL);
+			gst_pad_send_event(pad, gst_event_new_custom(GST_EVENT_CUSTOM_UPSTREAM, s));
+		}
+	}
+	gst_object_unref(pad);
+	gst_buffer_unmap(fci, &map);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SenderPipeline::StaticRtxSenderSrcProbe()
+///
+/// Probe on the retransmission senders' source pads that drops the retransmission requests rtpbin
+/// generates from NACKs, which all go to session 0's sender; RequestRetransmissions() sends them
+/// to the right layer's instead, marked with RTX_REQUEST_LAYER_FIELD.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+GstPadProbeReturn SenderPipeline::StaticRtxSenderSrcProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data)
+{
+	GstEvent* pEvent = GST_PAD_PROBE_INFO_EVENT(info);
+	if ((GST_EVENT_TYPE(pEvent) == GST_EVENT_CUSTOM_UPSTREAM)
+		&& gst_structure_has_name(gst_event_get_structure(pEvent), "GstRTPRetransmissionRequest")
+		&& !gst_structure_has_field(gst_event_get_structure(pEvent), RTX_REQUEST_LAYER_FIELD))
+	{
+		return GST_PAD_PROBE_DROP;
+	}
+	return GST_PAD_PROBE_OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SenderPipeline::StaticPayloaderSinkProbe()
+///
+/// Probe on the payloaders' sink pads that drops the upstream key unit requests rtpbin generates
+/// from PLI/FIR; FeedbackRtcp() handles those instead.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+GstPadProbeReturn SenderPipeline::StaticPayloaderSinkProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data)
+{
+	if (gst_video_event_is_force_key_unit(GST_PAD_PROBE_INFO_EVENT(info)))
+	{
+		return GST_PAD_PROBE_DROP;
+	}
+	return GST_PAD_PROBE_OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SenderPipeline::EncoderSinkProbe()
+///
+/// Called for each raw frame going into an encoder. Note when the frame went in, for
+/// EncoderSrcProbe(). If the layer has a coalesced key unit request waiting and the minimum
+/// interval has passed, force the key unit now.
+///
+/// @param pad  The encoder's sink pad.
+///
+/// @param buffer  The frame.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void SenderPipeline::EncoderSinkProbe(GstPad* pad, GstBuffer* buffer)
+{
+	size_t layer = EncoderLayer(pad);
+	if (layer >= m_NumLayers)
+	{
+		return;
+	}
+	
+	g_mutex_lock(&m_QosMutex);
+	std::deque<EncodeStart>& starts = m_EncodeStarts[layer];
+	if (starts.size() >= MAX_ENCODE_STARTS)
+	{
+		starts.pop_front();
+	}
+	starts.push_back(EncodeStart(GST_BUFFER_PTS(buffer), g_get_monotonic_time()));
+	g_mutex_unlock(&m_QosMutex);
+	
+	// The flag is set from the RTCP thread; RequestKeyUnit() decides whether it is time yet.
+	g_mutex_lock(&m_KeyUnitMutex);
+	bool pending = m_KeyUnitPending[layer];
+	g_mutex_unlock(&m_KeyUnitMutex);
+	if (pending)
+	{
+		RequestKeyUnit(layer);
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SenderPipeline::EncoderSrcProbe()
+///
+/// Called for each encoded frame coming out of an encoder. Add the time it took, since the raw
+/// frame with the same timestamp went in, to the layer's encoding time for the QoS window. Raw
+/// frames the encoder dropped (or that were flushed by a restart) are forgotten.
+///
+/// @param pad  The encoder's src pad.
+///
+/// @param buffer  The encoded frame.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void SenderPipeline::EncoderSrcProbe(GstPad* pad, GstBuffer* buffer)
+{
+	size_t layer = EncoderLayer(pad);
+	GstClockTime pts = GST_BUFFER_PTS(buffer);
+	if ((layer >= m_NumLayers) || !GST_CLOCK_TIME_IS_VALID(pts))
+	{
+		return;
+	}
+	
+	gint64 now = g_get_monotonic_time();
+	g_mutex_lock(&m_QosMutex);
+	std::deque<EncodeStart>& starts = m_EncodeStarts[layer];
+	while (!starts.empty() && (starts.front().first < pts))
+	{
+		starts.pop_front();
+	}
+	if (!starts.empty() && (starts.front().first == pts))
+	{
+		m_EncodeTimeUs[layer] += now - starts.front().second;
+		++m_EncodedFrames[layer];
+		starts.pop_front();
+	}
+	g_mutex_unlock(&m_QosMutex);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SenderPipeline::EncoderLayer()
+///
+/// Get the layer of an encoder pad, or m_NumLayers if the pad is not an encoder's.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+size_t SenderPipeline::EncoderLayer(GstPad* pad) const
+{
+	for (size_t layer = 0; layer < m_NumLayers; ++layer)
+	{
+		if (GST_PAD_PARENT(pad) == m_pVideoEncoders[layer])
+		{
+			return layer;
+		}
+	}
+	return m_NumLayers;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SenderPipeline::QueueProbe()
+///
+/// Called for each raw frame going into or coming out of a layer's queue. Count the frames, and
+/// at the end of each QOS_WINDOW_US window hand the frames dropped and the encode load to the QoS
+/// controller, applying the level it picks. The first window is skipped: the encoders start up in
+/// it.
+///
+/// @param pad  The queue's sink or src pad.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void SenderPipeline::QueueProbe(GstPad* pad)
+{
+	if (GST_PAD_DIRECTION(pad) != GST_PAD_SINK)
+	{
+		g_mutex_lock(&m_QosMutex);
+		++m_QosFramesOut;
+		g_mutex_unlock(&m_QosMutex);
+		return;
+	}
+	
+	gint64 now = g_get_monotonic_time();
+	bool changed = false;
+	
+	g_mutex_lock(&m_QosMutex);
+	++m_QosFramesIn;
+	if (m_QosWindowStartUs == 0)
+	{
+		m_QosWindowStartUs = now;
+	}
+	else if ((now - m_QosWindowStartUs) >= QOS_WINDOW_US)
+	{
+		// The interval between the frames each layer gets from the camera, and each encoder's mean
+		// time per frame relative to the interval between the frames it is given after videorate.
+		double framesPerLayer = static_cast<double>(m_QosFramesIn) / m_NumLayers;
+		double frameIntervalUs = (now - m_QosWindowStartUs) / framesPerLayer;
+		double encodeLoad = 0.0;
+		for (size_t layer = 0; layer < m_NumLayers; ++layer)
+		{
+			if (m_EncodedFrames[layer] > 0)
+			{
+				double meanUs = static_cast<double>(m_EncodeTimeUs[layer]) / m_EncodedFrames[layer];
+				encodeLoad = std::max(encodeLoad, meanUs / (frameIntervalUs * m_Qos.CurrentLevel().frameRateDivisor));
+			}
+			m_EncodeTimeUs[layer] = 0;
+			m_EncodedFrames[layer] = 0;
+		}
+		double dropRatio = (m_QosFramesOut < m_QosFramesIn) ? (static_cast<double>(m_QosFramesIn - m_QosFramesOut) / m_QosFramesIn) : 0.0;
+		
+		if (m_QosWindows++ > 0)
+		{
+			changed = m_Qos.OnWindow(now, dropRatio, encodeLoad);
+		}
+		m_QosWindowStartUs = now;
+		m_QosFramesIn = 0;
+		m_QosFramesOut = 0;
+	}
+	g_mutex_unlock(&m_QosMutex);
+	
+	if (changed)
+	{
+		ApplyQosLevel();
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SenderPipeline::ApplyQosLevel()
+///
+/// Scale every layer's resolution and frame rate, from the video format, to the QoS controller's
+/// current level. The new
+/// caps renegotiate the branches behind the tee, and the encoders restart with new parameter sets
+/// (sent in-band by the payloaders) and a key frame; the capture keeps running.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void SenderPipeline::ApplyQosLevel()
+{
+	g_mutex_lock(&m_QosMutex);
+	QosController::Level level = m_Qos.CurrentLevel();
+	gint videoWidth = m_VideoWidth;
+	gint videoHeight = m_VideoHeight;
+	gint videoFrameRate = m_VideoFrameRate;
+	g_mutex_unlock(&m_QosMutex);
+	
+	// The frame rate is divided from the video format's (the frames actually arriving can be
+	// fewer, when a static scene is skipped).
+	gint maxRate = G_MAXINT;
+	if (level.frameRateDivisor > 1)
+	{
+		gint numerator = 30, denominator = 1;
+		GstElement* t = gst_bin_get_by_name(GST_BIN(Pipeline()), "t");
+		assert(t != NULL);
+		GstPad* pad = gst_element_get_static_pad(t, "sink");
+		assert(pad != NULL);
+		GstCaps* caps = gst_pad_get_current_caps(pad);
+		if (caps != NULL)
+		{
+			gst_structure_get_fraction(gst_caps_get_structure(caps, 0), "framerate", &numerator, &denominator);
+			gst_caps_unref(caps);
+		}
+		gst_object_unref(pad);
+		gst_object_unref(t);
+		
+		double frameRate = (denominator > 0) ? (static_cast<double>(numerator) / denominator) : 0.0;
+		if (videoFrameRate > 0)
+		{
+			// The caps may not have been renegotiated to a new format yet.
+			frameRate = std::min(frameRate, static_cast<double>(videoFrameRate));
+		}
+		maxRate = std::max(1, static_cast<gint>(round(frameRate / level.frameRateDivisor)));
+	}
+	
+	for (size_t layer = 0; layer < m_NumLayers; ++layer)
+	{
+		gint width = ((videoWidth / LAYER_SPECS[layer].scaleDivisor) * level.scalePercent) / 100;
+		gint height = ((videoHeight / LAYER_SPECS[layer].scaleDivisor) * level.scalePercent) / 100;
+		GstCaps* caps = gst_caps_new_simple("video/x-raw",
+			"width",  G_TYPE_INT, std::max(width, static_cast<gint>(MIN_QOS_DIMENSION)) & ~1,
+			"height", G_TYPE_INT, std::max(height, static_cast<gint>(MIN_QOS_DIMENSION)) & ~1,
+			NULL);
+		g_object_set(m_pVideoScaleFilters[layer],
+			"caps", caps,
+			NULL);
+		gst_caps_unref(caps);
+		
+		g_object_set(m_pVideoRates[layer],
+			"max-rate", maxRate,
+			NULL);
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SenderPipeline::RequestKeyUnit()
+///
+/// Ask for a key frame on a layer. At most one key unit per MIN_KEY_UNIT_INTERVAL_US is forced
+/// per layer; a request arriving sooner is remembered, and EncoderSinkProbe() forces it once the
+/// interval has passed, so any number of requests in one interval cost one key frame.
+///
+/// @param layer  The layer index.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void SenderPipeline::RequestKeyUnit(size_t layer)
+{
+	gint64 now = g_get_monotonic_time();
+	bool force = false;
+	
+	g_mutex_lock(&m_KeyUnitMutex);
+	if ((now - m_LastKeyUnitUs[layer]) >= MIN_KEY_UNIT_INTERVAL_US)
+	{
+		m_LastKeyUnitUs[layer] = now;
+		m_KeyUnitPending[layer] = false;
+		force = true;
+	}
+	else
+	{
+		m_KeyUnitPending[layer] = true;
+	}
+	g_mutex_unlock(&m_KeyUnitMutex);
+	
+	if (force)
+	{
+		ForceKeyUnit(layer);
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SenderPipeline::TeeSinkProbe()
+///
+/// Called for each converted frame before the tee. Unless static frame skipping is off, compare
+/// a sparse sample of the frame's bytes with that of the last frame passed on; if almost none
+/// changed, the scene is static and the frame is dropped, so neither the encoders nor the
+/// self-view see it. A static scene is still refreshed every STATIC_REFRESH_US, and a frame always
+/// passes when a key unit has just been forced, so the encoders can produce it. Receivers keep
+/// showing the last frame; nothing is lost, so nothing is concealed.
+///
+/// The sample covers the whole buffer at a fixed step, whatever the pixel format, so it sees
+/// changes anywhere in the picture; a sample counts as changed only if it moves by more than
+/// camera noise. Comparing with the last frame passed on, rather than the one just before, keeps
+/// a slow change from slipping through a frame at a time.
+///
+/// @param buffer  The frame.
+///
+/// @return GST_PAD_PROBE_DROP to skip the frame.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+GstPadProbeReturn SenderPipeline::TeeSinkProbe(GstBuffer* buffer)
+{
+	if (!g_atomic_int_get(&m_SkipStaticFrames))
+	{
+		m_StaticSamples.clear();
+		return GST_PAD_PROBE_OK;
+	}
+	
+	GstMapInfo map;
+	if (!gst_buffer_map(buffer, &map, GST_MAP_READ))
+	{
+		return GST_PAD_PROBE_OK;
+	}
+	size_t step = std::max(static_cast<size_t>(map.size / STATIC_SAMPLES), static_cast<size_t>(1));
+	size_t numSamples = map.size / step;
+	bool compare = (m_StaticSamples.size() == numSamples);
+	m_FrameSamples.resize(numSamples);
+	
+	size_t changed = 0;
+	for (size_t i = 0; i < numSamples; ++i)
+	{
+		guint8 sample = map.data[i * step];
+		if (compare && (std::abs(static_cast<int>(sample) - m_StaticSamples[i]) > STATIC_SAMPLE_NOISE))
+		{
+			++changed;
+		}
+		m_FrameSamples[i] = sample;
+	}
+	gst_buffer_unmap(buffer, &map);
+	
+	// Take any pass request in one step; one made after this applies to the next frame
+	gint64 now = g_get_monotonic_time();
+	bool passNext = g_atomic_int_compare_and_exchange(&m_PassNextFrame, TRUE, FALSE);
+	bool staticFrame = compare && ((changed * STATIC_CHANGED_DIVISOR) < numSamples);
+	if (staticFrame && !passNext && ((now - m_LastStaticPassUs) < STATIC_REFRESH_US))
+	{
+		return GST_PAD_PROBE_DROP;
+	}
+	m_StaticSamples.swap(m_FrameSamples);
+	m_LastStaticPassUs = now;
+	return GST_PAD_PROBE_OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SenderPipeline::ForceKeyUnit()
+///
+/// Ask a layer's encoder to produce a key frame as soon as possible.
+///
+/// @param layer  The layer index.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void SenderPipeline::ForceKeyUnit(size_t layer)
+{
+	// The encoder produces the key frame from its next frame; don't skip it as static.
+	g_atomic_int_set(&m_PassNextFrame, TRUE);
+	
+	GstPad* pad = gst_element_get_static_pad(m_pVideoEncoders[layer], "src");
+	assert(pad != NULL);
+	gst_pad_send_event(pad, gst_video_event_new_upstream_force_key_unit(GST_CLOCK_TIME_NONE, TRUE, 0));
+	gst_object_unref(pad);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SenderPipeline::NewRtxPayloadTypeMap()
+///
+/// Create the payload type map for rtprtxsend/rtprtxreceive. The map is empty when retransmission
+/// is off, so no payload type is kept or retransmitted. Free it with gst_structure_free().
+///////////////////////////////////////////////////////////////////////////////////////////////////
+GstStructure* SenderPipeline::NewRtxPayloadTypeMap(bool enable)
+{
+	GstStructure* map = gst_structure_new_empty("application/x-rtp-pt-map");
+	if (enable)
+	{
+		char pt[sizeof("4294967295")];
+		std::sprintf(pt, "%u", VIDEO_PAYLOAD_TYPE);
+		gst_structure_set(map, pt, G_TYPE_UINT, RTX_PAYLOAD_TYPE, NULL);
+	}
+	return map;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SenderPipeline::StaticRequestFecEncoder()
+///
+/// Handler for rtpbin's "request-fec-encoder" signal. Give each video session an rtpulpfecenc,
+/// named "fecenc" and the layer index, protecting the packets of each frame (RFC 5109). It
+/// starts with no overhead, which sends no FEC packets at all; RetargetBitrates() raises the
+/// overhead when receivers of the layer report loss.
+///
+/// @param rtpbin  The rtpbin.
+///
+/// @param session  The session being created.
+///
+/// @return The FEC encoder, or NULL for none.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+GstElement* SenderPipeline::StaticRequestFecEncoder(GstElement* rtpbin, guint session, gpointer user_data)
+{
+	if (session == 1)
+	{
+		return NULL;
+	}
+	
+	char name[sizeof("fecenc4294967295")];
+	std::sprintf(name, "fecenc%u", (session == 0) ? 0 : (session - 1));
+	GstElement* fecenc = gst_element_factory_make("rtpulpfecenc", name);
+	g_object_set(G_OBJECT(fecenc),
+		"pt",                   FEC_PAYLOAD_TYPE,
+		"multipacket",          TRUE,
+		"percentage",           0,
+		"percentage-important", 0,
+		NULL);
+	return fecenc;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SenderPipeline::FecPercentage()
+///
+/// Get the FEC overhead for a loss rate: none without loss, otherwise
+/// FEC_PERCENTAGE_PER_LOSS_PERCENTAGE times the loss, kept between MIN_FEC_PERCENTAGE and
+/// MAX_FEC_PERCENTAGE.
+///
+/// @param fractionLost  The fraction of packets lost, 0 to 1.
+///
+/// @return The overhead, in percent of the media packets.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+guint SenderPipeline::FecPercentage(double fractionLost)
+{
+	if (fractionLost <= 0.0)
+	{
+		return 0;
+	}
+	double percentage = std::ceil(fractionLost * 100.0 * FEC_PERCENTAGE_PER_LOSS_PERCENTAGE);
+	return static_cast<guint>(std::min(std::max(percentage, static_cast<double>(MIN_FEC_PERCENTAGE)), static_cast<double>(MAX_FEC_PERCENTAGE)));
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SenderPipeline::StaticRequestAuxSender()
+///
+/// Handler for rtpbin's "request-aux-sender" signal. Give each video session an rtprtxsend,
+/// named "rtxsend" and the layer index, that keeps a bounded history of the layer's packets and
+/// retransmits those receivers NACK, as RTX_PAYLOAD_TYPE on their own SSRC (RFC 4588). Audio
+/// relies on Opus FEC instead.
+///
+/// @param rtpbin  The rtpbin.
+///
+/// @param session  The session being created.
+///
+/// @return The auxiliary sender bin, or NULL for none.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+GstElement* SenderPipeline::StaticRequestAuxSender(GstElement* rtpbin, guint session, gpointer user_data)
+{
+	if (session == 1)
+	{
+		return NULL;
+	}
+	
+	char name[sizeof("rtxsend4294967295")];
+	std::sprintf(name, "rtxsend%u", (session == 0) ? 0 : (session - 1));
+	GstElement* rtxsend = gst_element_factory_make("rtprtxsend", name);
+	GstStructure* map = NewRtxPayloadTypeMap(true);
+	g_object_set(G_OBJECT(rtxsend),
+		"payload-type-map", map,
+		"max-size-packets", RTX_HISTORY_PACKETS,
+		"max-size-time",    RTX_HISTORY_MS,
+		NULL);
+	gst_structure_free(map);
+	
+	return gst_rtp_aux_bin_new(rtxsend, session);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SenderPipeline::GetLayerElement()
+///
+/// Get a layer element by its base name (e.g. "venc") and layer index. The returned element has
+/// its ref count incremented.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+GstElement* SenderPipeline::GetLayerElement(const char* baseName, size_t layer) const
+{
+	char* name = new char[std::strlen(baseName) + sizeof("-2147483648")];
+	std::sprintf(name, "%s%u", baseName, static_cast<unsigned int>(layer));
+	GstElement* e = gst_bin_get_by_name(GST_BIN(Pipeline()), name);
+	delete[] name;
+	return e;
+}
@@ -23,11 +23,16 @@
 
 
 #include <gst/gst.h>          // for GStreamer stuff
+#include <deque>              // for deque
 #include <string>             // for vector
+#include <utility>            // for pair
 #include <vector>             // for vector
 
+#include "BandwidthEstimator.hpp" // for BandwidthEstimator
+#include "Pacer.hpp"          // for Pacer
 #include "PipelineBase.hpp"   // for PipelineBase
 #include "PipelineTracer.hpp" // for PipelineTracer
+#include "QosController.hpp"  // for QosController
 
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -37,32 +42,129 @@
 class SenderPipeline : public PipelineBase
 {
 public:
-	/// An interface for notifying about new picture parameters
+	/// An interface for notifying about new picture and audio parameters
 	class ISenderParameterNotifySink
 	{
 	public:
 		virtual ~ISenderParameterNotifySink() {}
-		virtual void OnNewParameters(const SenderPipeline& rPipeline, const char* pPictureParameters, unsigned int videoSsrc, unsigned int audioSsrc) = 0;
+		virtual void OnNewParameters(const SenderPipeline& rPipeline, const char* pPictureParameters, const char* pAudioParameters, unsigned int videoSsrc, unsigned int audioSsrc) = 0;
 	};
 	
 	
+	/// The audio codecs the sender can use
+	enum AudioCodec
+	{
+		AUDIO_CODEC_SPEEX,
+		AUDIO_CODEC_OPUS
+	};
+	
+	
+	/// The audio encoding for a call. The frame duration, FEC, and DTX settings only apply to Opus.
+	struct AudioSettings
+	{
+		AudioCodec codec;
+		unsigned int frameMs;
+		bool fec;
+		bool dtx;
+	};
+	
+	
+	/// The pacing queue statistics of a destination's video
+	struct PacingStats
+	{
+		guint queuedPackets;
+		guint queuedBytes;
+		guint maxQueuedPackets;
+		guint64 queueDelayUs;
+	};
+	
+	
+	/// The audio settings used when none are given: Opus, 20 ms frames, FEC and DTX on.
+	static const AudioSettings DEFAULT_AUDIO_SETTINGS;
+	
+	
+	/// The video encoder profiles, trading CPU for quality at a given bitrate. See the table with
+	/// ENCODER_SETTINGS in SenderPipeline.cpp.
+	enum EncoderProfile
+	{
+		ENCODER_PROFILE_AUTO,        ///< pick one by the number of CPU cores
+		ENCODER_PROFILE_LOW_LATENCY, ///< superfast preset, all cores on slices
+		ENCODER_PROFILE_BALANCED,    ///< veryfast preset, all cores on slices, a larger VBV buffer
+		ENCODER_PROFILE_LOW_CPU,     ///< ultrafast preset on two threads
+		NUM_ENCODER_PROFILES
+	};
+	
+	
+	/// Get the profile ENCODER_PROFILE_AUTO stands for on this machine.
+	static EncoderProfile AutoEncoderProfile();
+	
+	
+	/// Get an encoder profile's name (e.g. "low-latency").
+	static const char* EncoderProfileName(EncoderProfile profile);
+	
+	
 	/// Get the index of an audio device by name.
 	static int GetAudioDeviceIndex(const char* inputName);
 	
 	
+	/// Get the audio parameters a sender with these settings announces, for receivers starting
+	/// before the announcement (free with g_free()).
+	static gchar* NewAudioParameters(const AudioSettings& audioSettings);
+	
+	
+	/// The RTP payload type of the video's forward error correction (ULPFEC, RFC 5109) packets.
+	static const guint FEC_PAYLOAD_TYPE = 122;
+	
+	
+	/// Create the video retransmission payload type map (for rtprtxsend/rtprtxreceive), or an
+	/// empty one if retransmission is off.
+	static GstStructure* NewRtxPayloadTypeMap(bool enable);
+	
+	
+	/// The maximum number of simulcast video layers.
+	static const size_t MAX_SIMULCAST_LAYERS = 3;
+	
+	
+	/// Get the SSRC of a simulcast layer of the sender that announced a video SSRC. Each layer is
+	/// a stream of its own, with its own sequence numbers, so its SSRC is the announced one (the
+	/// full-resolution layer's) plus its index.
+	static inline guint LayerSsrc(guint videoSsrc, size_t layer) { return videoSsrc + static_cast<guint>(layer); }
+	
+	
+	/// Get the simulcast layer of an SSRC from the sender that announced a video SSRC;
+	/// MAX_SIMULCAST_LAYERS or more if it is none of them.
+	static inline size_t SsrcLayer(guint videoSsrc, guint ssrc) { return static_cast<size_t>(ssrc - videoSsrc); }
+	
+	
 	/// Constructor
-	SenderPipeline(const char* videoInputName, const char* audioInputName, ISenderParameterNotifySink* pNotifySink = NULL);
+	SenderPipeline(const char* videoInputName, const char* audioInputName, ISenderParameterNotifySink* pNotifySink = NULL, size_t numLayers = 1, const AudioSettings& audioSettings = DEFAULT_AUDIO_SETTINGS, EncoderProfile encoderProfile = ENCODER_PROFILE_AUTO);
 	
 	
 	/// Destructor
 	virtual ~SenderPipeline();
 	
 	
+	/// Make the pipeline play, with the encoder profile selected last
+	virtual void Play();
+	
+	
 	/// Add the destination IP address or hostname
 	void AddDestination(const char* destination, uint16_t portBase);
 	
 	
-	/// Set the video bitrate
+	/// Set the port base we listen on for the destinations' RTCP reports
+	void SetRtcpPortBase(uint16_t portBase);
+	
+	
+	/// Select the simulcast layer sent to a destination
+	void SetDestinationLayer(const char* destination, size_t layer);
+	
+	
+	/// Get the number of simulcast video layers
+	inline size_t NumLayers() const { return m_NumLayers; }
+	
+	
+	/// Set the maximum video bitrate (of the full-resolution layer)
 	void SetBitrate(size_t bitrate);
 	
 	
@@ -70,9 +172,75 @@ public:
 	void SetWindowSink(void* handle);
 	
 	
+	/// Scale the self-view to fit a window size and limit its frame rate (0 for no limit).
+	void SetPreviewSize(int width, int height, int frameRate);
+	
+	
+	/// Change the video resolution and frame rate (0 for the capture's) while sending, keeping
+	/// the SSRC; the new parameter sets are sent in-band.
+	void SetVideoFormat(int width, int height, int frameRate);
+	
+	
+	/// Mute the video: stop capturing it into the encoders and sending it (RTCP continues).
+	void SetVideoMuted(bool muted);
+	
+	
+	/// Get whether the video is muted
+	bool GetVideoMuted() const;
+	
+	
+	/// Mute the audio: stop capturing it into the encoder and sending it (RTCP continues).
+	void SetAudioMuted(bool muted);
+	
+	
+	/// Get whether the audio is muted
+	bool GetAudioMuted() const;
+	
+	
+	/// Turn skipping the frames of a static scene on (the default) or off
+	inline void SetSkipStaticFrames(bool skip) { g_atomic_int_set(&m_SkipStaticFrames, skip ? TRUE : FALSE); }
+	
+	
+	/// Get whether the frames of a static scene are skipped
+	inline bool GetSkipStaticFrames() const { return g_atomic_int_get(&m_SkipStaticFrames) != FALSE; }
+	
+	
+	/// Select the video encoder profile, for the next time the pipeline starts playing
+	void SetEncoderProfile(EncoderProfile profile);
+	
+	
+	/// Get the video encoder profile (never ENCODER_PROFILE_AUTO)
+	inline EncoderProfile GetEncoderProfile() const { return m_EncoderProfile; }
+	
+	
 	/// Get picture parameters
 	inline const char* GetPictureParameters() const { return m_pSpropParameterSets; }
 	
+	
+	/// Get audio parameters (the audio RTP caps receivers should expect)
+	inline const char* GetAudioParameters() const { return m_pAudioParameters; }
+	
+	
+	/// Get the pacing queue statistics of the video sent to a destination
+	bool GetPacingStats(const char* destination, PacingStats& stats);
+	
+	
+	/// Turn retransmission (RTX) of video packets receivers report lost on or off
+	void SetRetransmission(bool enable);
+	
+	
+	/// Get whether video packets receivers report lost are retransmitted
+	inline bool GetRetransmission() const { return m_Retransmission; }
+	
+	
+	/// Get the number of retransmissions requested (NACKed packets) and sent, over all layers
+	void GetRetransmissionStats(guint& requests, guint& packets) const;
+	
+	
+	/// Get the QoS level the video is encoded at (0 is full resolution and frame rate; see
+	/// QosController::LEVELS)
+	inline size_t GetQosLevel() const { return m_Qos.LevelIndex(); }
+	
 
 protected:
 
@@ -81,25 +249,195 @@ private:
 	class Destination
 	{
 	public:
-		inline Destination(const char* hostOrIp, uint16_t portBase)
+		inline Destination(const char* hostOrIp, uint16_t portBase, size_t maxBitrate)
 			: m_HostOrIp(hostOrIp)
 			, m_PortBase(portBase)
+			, m_Layer(0)
+			, m_Estimator(MIN_VIDEO_BITRATE, START_VIDEO_BITRATE, maxBitrate)
 		{}
 		
 		inline const std::string& HostOrIp() const { return m_HostOrIp; }
 		inline uint16_t PortBase() const { return m_PortBase; }
+		inline size_t Layer() const { return m_Layer; }
+		inline void Layer(size_t layer) { m_Layer = layer; }
+		inline BandwidthEstimator& Estimator() { return m_Estimator; }
+		inline const BandwidthEstimator& Estimator() const { return m_Estimator; }
 		
 	private:
 		std::string m_HostOrIp;
 		uint16_t m_PortBase;
+		size_t m_Layer;
+		BandwidthEstimator m_Estimator;
 	};
 	
+	
+	/// The scaling and bitrate of one simulcast layer, relative to the full-resolution layer.
+	struct LayerSpec
+	{
+		unsigned int scaleDivisor;
+		unsigned int bitrateDivisor;
+	};
+	
+	
+	/// The simulcast layer specifications, from full resolution down to thumbnail.
+	static const LayerSpec LAYER_SPECS[MAX_SIMULCAST_LAYERS];
+	
+	
+	/// The x264enc settings of an encoder profile.
+	struct EncoderSettings
+	{
+		const char* name;
+		const char* speedPreset;
+		guint threads;
+		gboolean slicedThreads;
+		gint rcLookahead;
+		guint vbvBufferMs;
+		guint bframes;
+	};
+	
+	
+	/// The encoder profiles' settings, indexed by EncoderProfile.
+	static const EncoderSettings ENCODER_SETTINGS[NUM_ENCODER_PROFILES];
+	
+	
+	/// Apply an encoder profile (not ENCODER_PROFILE_AUTO) to an x264enc.
+	static void ApplyEncoderProfile(GstElement* encoder, EncoderProfile profile);
+	
+	
 	/// The latency of the sender RTP bin, in milliseconds.
 	static const unsigned int RTP_BIN_LATENCY_MS = 10;
 	
 	
+	/// The lowest video bitrate the congestion control will go to, in bits/sec.
+	static const size_t MIN_VIDEO_BITRATE = 150000;
+	
+	
+	/// The video bitrate from which the congestion control starts probing, in bits/sec.
+	static const size_t START_VIDEO_BITRATE = 1000000;
+	
+	
+	/// The Opus encoder bitrate, in bits/sec.
+	static const int OPUS_BITRATE = 32000;
+	
+	
+	/// The packet loss Opus in-band FEC is tuned for, in percent. Opus adds no FEC at 0.
+	static const int OPUS_FEC_LOSS_PERCENTAGE = 10;
+	
+	
+	/// The FEC overhead, in percent of the media packets, per percent of packet loss reported by
+	/// the worst receiver of a layer, and the range it is kept in while there is loss. Without
+	/// loss there is no FEC at all.
+	static const guint FEC_PERCENTAGE_PER_LOSS_PERCENTAGE = 2;
+	static const guint MIN_FEC_PERCENTAGE = 5;
+	static const guint MAX_FEC_PERCENTAGE = 50;
+	
+	
+	/// The video is paced at this multiple of the layer's bitrate, so that a key frame takes a few
+	/// frame intervals to go out rather than leaving in one burst.
+	static const double PACING_RATE_FACTOR;
+	
+	
+	/// How much of a sink's traffic its socket's send buffer holds, in milliseconds: as long as the
+	/// pacer holds packets at most, since that much may leave in one burst once it gives up.
+	static const unsigned int SEND_BUFFER_WINDOW_MS = 100;
+	
+	
+	/// Encoder bitrates are only changed when they move by more than 1/this of their value.
+	static const size_t BITRATE_CHANGE_DIVISOR = 20;
+	
+	
+	/// The longest interval between key frames, in frames. Key frames are otherwise only sent when
+	/// a receiver asks for one (PLI/FIR) or a destination switches layers.
+	static const unsigned int KEY_INT_MAX_FRAMES = 300;
+	
+	
+	/// The shortest interval between two forced key frames of a layer, in microseconds. Requests
+	/// arriving sooner are coalesced into one key frame at the end of the interval.
+	static const gint64 MIN_KEY_UNIT_INTERVAL_US = 500000;
+	
+	
+	/// The length of a QoS measurement window, in microseconds.
+	static const gint64 QOS_WINDOW_US = 1000000;
+	
+	
+	/// The smallest width or height the QoS controller or the self-view scales video down to.
+	static const gint MIN_QOS_DIMENSION = 16;
+	
+	
+	/// The most frames remembered per encoder for measuring encoding times.
+	static const size_t MAX_ENCODE_STARTS = 32;
+	
+	
+	/// Static scene detection: the number of bytes of each frame sampled, by how much (out of 255)
+	/// a sample must move to count as changed, and the fraction (1/this) of samples that must
+	/// change for the scene to count as moving.
+	static const size_t STATIC_SAMPLES = 4096;
+	static const int STATIC_SAMPLE_NOISE = 12;
+	static const size_t STATIC_CHANGED_DIVISOR = 200;
+	
+	
+	/// How often a frame of a static scene is passed on anyway, in microseconds.
+	static const gint64 STATIC_REFRESH_US = 1000000;
+	
+	
+	/// When a raw frame (by timestamp) went into an encoder (monotonic microseconds)
+	typedef std::pair<GstClockTime, gint64> EncodeStart;
+	
+	
+	/// RTCP payload-specific feedback packet type, and its PLI and FIR message types (RFC 4585/5104)
+	static const guint RTCP_TYPE_PSFB = 206;
+	static const guint RTCP_PSFB_TYPE_PLI = 1;
+	static const guint RTCP_PSFB_TYPE_FIR = 4;
+	
+	
+	/// RTCP transport layer feedback packet type, and its generic NACK message type (RFC 4585)
+	static const guint RTCP_TYPE_RTPFB = 205;
+	static const guint RTCP_RTPFB_TYPE_NACK = 1;
+	
+	
+	/// The field our retransmission requests carry their layer in, which tells them apart from
+	/// rtpbin's own
+	static const char RTX_REQUEST_LAYER_FIELD[];
+	
+	
+	/// The RTP payload type of the video (rtph264pay's default), and of its retransmissions
+	static const guint VIDEO_PAYLOAD_TYPE = 96;
+	static const guint RTX_PAYLOAD_TYPE = 97;
+	
+	
+	/// The bounds of each layer's retransmission history: the most packets, and the longest time
+	/// (in milliseconds) a packet is kept. A receiver only asks while its jitter buffer could still
+	/// use the packet, so a few hundred milliseconds covers any useful round trip.
+	static const guint RTX_HISTORY_PACKETS = 256;
+	static const guint RTX_HISTORY_MS = 500;
+	
+	
+	/// Get the rtpbin session carrying a video layer. Session 1 is always audio.
+	static inline unsigned int LayerSession(size_t layer) { return (layer == 0) ? 0 : static_cast<unsigned int>(layer + 1); }
+	
+	
+	/// Get the video layer an rtpbin session carries (MAX_SIMULCAST_LAYERS for audio).
+	static inline size_t SessionLayer(guint session) { return (session == 0) ? 0 : ((session == 1) ? MAX_SIMULCAST_LAYERS : (session - 1)); }
+	
+	
 	/// Function to build the sender pipeline. Needed for the constructor.
-	static GstElement* BuildPipeline(const char* videoInputName, const char* audioInputName);
+	static GstElement* BuildPipeline(const char* videoInputName, const char* audioInputName, size_t numLayers, const AudioSettings& audioSettings, EncoderProfile encoderProfile);
+	
+	
+	/// (Static) callback creating the FEC encoder of an rtpbin session
+	static GstElement* StaticRequestFecEncoder(GstElement* rtpbin, guint session, gpointer user_data);
+	
+	
+	/// Get the FEC overhead (in percent) that protects against a fraction of packets lost.
+	static guint FecPercentage(double fractionLost);
+	
+	
+	/// (Static) callback creating the retransmission sender of an rtpbin session
+	static GstElement* StaticRequestAuxSender(GstElement* rtpbin, guint session, gpointer user_data);
+	
+	
+	/// Get a layer element from the pipeline by its base name and layer index.
+	GstElement* GetLayerElement(const char* baseName, size_t layer) const;
 	
 	
 	/// Get the capabilities for an audio input device.
@@ -125,20 +463,246 @@ private:
 	void PadNotifyCaps(GObject* gobject, GParamSpec* pspec);
 	
 	
+	/// (Static) callback for RTCP arriving from an SSRC
+	static void StaticSsrcActive(GstElement* rtpbin, guint session, guint ssrc, gpointer user_data)
+	{
+		reinterpret_cast<SenderPipeline*>(user_data)->SsrcActive(session, ssrc);
+	}
+	
+	
+	/// (Instance) callback for RTCP arriving from an SSRC
+	void SsrcActive(guint session, guint ssrc);
+	
+	
+	/// (Static) callback for RTCP feedback (e.g. PLI) arriving in the video session
+	static void StaticFeedbackRtcp(GObject* session, guint type, guint fbtype, guint senderSsrc, guint mediaSsrc, GstBuffer* fci, gpointer user_data)
+	{
+		reinterpret_cast<SenderPipeline*>(user_data)->FeedbackRtcp(type, fbtype, senderSsrc, mediaSsrc, fci);
+	}
+	
+	
+	/// (Instance) callback for RTCP feedback arriving in the video session
+	void FeedbackRtcp(guint type, guint fbtype, guint senderSsrc, guint mediaSsrc, GstBuffer* fci);
+	
+	
+	/// Ask a layer's retransmission sender for the packets a NACK's FCI lists.
+	void RequestRetransmissions(size_t layer, guint ssrc, GstBuffer* fci);
+	
+	
+	/// (Static) probe dropping rtpbin's own retransmission requests; see FeedbackRtcp()
+	static GstPadProbeReturn StaticRtxSenderSrcProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data);
+	
+	
+	/// (Static) probe dropping rtpbin's own key unit requests; see FeedbackRtcp()
+	static GstPadProbeReturn StaticPayloaderSinkProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data);
+	
+	
+	/// (Static) probe on each encoder's input, timing frames and forcing coalesced key units when
+	/// they are due
+	static GstPadProbeReturn StaticEncoderSinkProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data)
+	{
+		reinterpret_cast<SenderPipeline*>(user_data)->EncoderSinkProbe(pad, GST_PAD_PROBE_INFO_BUFFER(info));
+		return GST_PAD_PROBE_OK;
+	}
+	
+	
+	/// (Instance) probe on each encoder's input
+	void EncoderSinkProbe(GstPad* pad, GstBuffer* buffer);
+	
+	
+	/// (Static) probe on each encoder's output, measuring how long frames took to encode
+	static GstPadProbeReturn StaticEncoderSrcProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data)
+	{
+		reinterpret_cast<SenderPipeline*>(user_data)->EncoderSrcProbe(pad, GST_PAD_PROBE_INFO_BUFFER(info));
+		return GST_PAD_PROBE_OK;
+	}
+	
+	
+	/// (Instance) probe on each encoder's output
+	void EncoderSrcProbe(GstPad* pad, GstBuffer* buffer);
+	
+	
+	/// Get the layer of an encoder pad (m_NumLayers if none).
+	size_t EncoderLayer(GstPad* pad) const;
+	
+	
+	/// (Static) probe on both pads of each layer's queue, counting frames in and out
+	static GstPadProbeReturn StaticQueueProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data)
+	{
+		reinterpret_cast<SenderPipeline*>(user_data)->QueueProbe(pad);
+		return GST_PAD_PROBE_OK;
+	}
+	
+	
+	/// (Instance) probe on both pads of each layer's queue; runs the QoS windows
+	void QueueProbe(GstPad* pad);
+	
+	
+	/// Scale the layers' resolution and frame rate to the current QoS level.
+	void ApplyQosLevel();
+	
+	
+	/// (Static) probe on the tee's input, skipping the frames of a static scene
+	static GstPadProbeReturn StaticTeeSinkProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data)
+	{
+		return reinterpret_cast<SenderPipeline*>(user_data)->TeeSinkProbe(GST_PAD_PROBE_INFO_BUFFER(info));
+	}
+	
+	
+	/// (Instance) probe on the tee's input
+	GstPadProbeReturn TeeSinkProbe(GstBuffer* buffer);
+	
+	
 	/// Internally set the destinations for the pipeline
 	void SetDestinations();
+	
+	
+	/// Retarget the encoder bitrates from the destinations' bandwidth estimates
+	void RetargetBitrates();
+	
+	
+	/// Ask for a key frame on a layer, subject to MIN_KEY_UNIT_INTERVAL_US.
+	void RequestKeyUnit(size_t layer);
+	
+	
+	/// Ask a layer's encoder for a key frame right away.
+	void ForceKeyUnit(size_t layer);
 
 
-	/// Pointer to video encoder element
-	GstElement* const m_pVideoEncoder;
+	/// The number of simulcast video layers
+	const size_t m_NumLayers;
+	
+	
+	/// Pointer to the rtpbin element
+	GstElement* const m_pRtpBin;
+	
+	
+	/// Pointer to video RTCP source element (receiver reports from destinations)
+	GstElement* const m_pVideoRtcpSource;
+	
+	
+	/// Pointer to audio RTCP source element (receiver reports from destinations)
+	GstElement* const m_pAudioRtcpSource;
+	
+	
+	/// Whether SetRtcpPortBase() chose the RTCP ports, rather than the first destination
+	bool m_RtcpPortBaseSet;
+	
 	
+	/// The rtpbin's internal video session (session 0), where all receivers' RTCP arrives
+	GObject* m_pVideoSession;
 	
-	/// Pointer to video RTP sink element
-	GstElement* const m_pVideoRtpSink;
 	
+	/// Pointers to video encoder elements, one per layer
+	GstElement* m_pVideoEncoders[MAX_SIMULCAST_LAYERS];
 	
-	/// Pointer to video RTCP sink element
-	GstElement* const m_pVideoRtcpSink;
+	
+	/// Pointers to video RTP sink elements, one per layer
+	GstElement* m_pVideoRtpSinks[MAX_SIMULCAST_LAYERS];
+	
+	
+	/// Pointers to video RTCP sink elements, one per layer
+	GstElement* m_pVideoRtcpSinks[MAX_SIMULCAST_LAYERS];
+	
+	
+	/// Pointers to the FEC encoder (rtpulpfecenc) elements, one per layer
+	GstElement* m_pFecEncoders[MAX_SIMULCAST_LAYERS];
+	
+	
+	/// The current FEC overhead of each layer, in percent
+	guint m_LayerFecPercentages[MAX_SIMULCAST_LAYERS];
+	
+	
+	/// Pointers to the retransmission (rtprtxsend) elements, one per layer
+	GstElement* m_pRtxSenders[MAX_SIMULCAST_LAYERS];
+	
+	
+	/// Whether lost video packets are retransmitted
+	bool m_Retransmission;
+	
+	
+	/// The video encoder profile
+	EncoderProfile m_EncoderProfile;
+	
+	
+	/// The current bitrate of each layer's encoder
+	size_t m_LayerBitrates[MAX_SIMULCAST_LAYERS];
+	
+	
+	/// The maximum bitrate of the full-resolution layer
+	size_t m_MaxBitrate;
+	
+	
+	/// When each layer last had a key unit forced (monotonic microseconds)
+	gint64 m_LastKeyUnitUs[MAX_SIMULCAST_LAYERS];
+	
+	
+	/// Whether each layer has a key unit request waiting for MIN_KEY_UNIT_INTERVAL_US to pass
+	bool m_KeyUnitPending[MAX_SIMULCAST_LAYERS];
+	
+	
+	/// Protects the key unit state, which is touched from the RTCP and streaming threads
+	GMutex m_KeyUnitMutex;
+	
+	
+	/// Pointers to the videorate elements, one per layer
+	GstElement* m_pVideoRates[MAX_SIMULCAST_LAYERS];
+	
+	
+	/// Pointers to the capsfilters setting the size each layer is scaled to
+	GstElement* m_pVideoScaleFilters[MAX_SIMULCAST_LAYERS];
+	
+	
+	/// The capture size
+	gint m_CaptureWidth;
+	gint m_CaptureHeight;
+	
+	
+	/// The video format set by SetVideoFormat(); the layers are scaled from it. A frame rate of 0
+	/// is the capture's.
+	gint m_VideoWidth;
+	gint m_VideoHeight;
+	gint m_VideoFrameRate;
+	
+	
+	/// The self-view size and frame rate last set by SetPreviewSize()
+	int m_PreviewWidth;
+	int m_PreviewHeight;
+	int m_PreviewFrameRate;
+	
+	
+	/// Picks the resolution and frame rate the encoders can keep up with
+	QosController m_Qos;
+	
+	
+	/// Protects the QoS controller and measurements, which are touched from the streaming threads
+	GMutex m_QosMutex;
+	
+	
+	/// The number of QoS windows so far
+	unsigned int m_QosWindows;
+	
+	
+	/// When the current QoS window started (monotonic microseconds; 0 before the first frame)
+	gint64 m_QosWindowStartUs;
+	
+	
+	/// The frames that went into and came out of the layers' queues in the current window
+	guint m_QosFramesIn;
+	guint m_QosFramesOut;
+	
+	
+	/// The frames each encoder is working on
+	std::deque<EncodeStart> m_EncodeStarts[MAX_SIMULCAST_LAYERS];
+	
+	
+	/// The total encoding time and number of frames encoded per layer in the current window
+	gint64 m_EncodeTimeUs[MAX_SIMULCAST_LAYERS];
+	guint m_EncodedFrames[MAX_SIMULCAST_LAYERS];
+	
+	
+	/// Paces the video, and sends the audio ahead of it
+	Pacer m_Pacer;
 	
 	
 	/// Pointer to audio RTP sink element
@@ -149,8 +713,37 @@ private:
 	GstElement* const m_pAudioRtcpSink;
 	
 	
+	/// Pointers to the valves muting the video and audio
+	GstElement* const m_pVideoValve;
+	GstElement* const m_pAudioValve;
+	
+	
+	/// Whether the frames of a static scene are skipped (set from the GUI thread)
+	volatile gint m_SkipStaticFrames;
+	
+	
+	/// The sampled bytes of the last frame passed on, for static scene detection
+	std::vector<guint8> m_StaticSamples;
+	
+	
+	/// The sampled bytes of the frame being checked
+	std::vector<guint8> m_FrameSamples;
+	
+	
+	/// When a frame was last passed on by the static scene detection (monotonic microseconds)
+	gint64 m_LastStaticPassUs;
+	
+	
+	/// Set when a key unit is forced (from any thread), so that the next frame is not skipped
+	volatile gint m_PassNextFrame;
+	
+	
 	/// Vector of destination addresses
-	std::vector<const Destination*> m_vDestinations;
+	std::vector<Destination*> m_vDestinations;
+	
+	
+	/// Protects the destinations, which are changed from the GUI and annunciator threads
+	GMutex m_DestinationsMutex;
 	
 	
 	/// Notify pointer
@@ -161,7 +754,15 @@ private:
 	const char* m_pSpropParameterSets;
 	
 	
-	/// The video SSRC
+	/// The audio encoding in use
+	const AudioSettings m_AudioSettings;
+	
+	
+	/// The audio parameters string (owned; freed with g_free)
+	gchar* m_pAudioParameters;
+	
+	
+	/// The video SSRC (the full-resolution layer's; see LayerSsrc())
 	unsigned int m_VideoSsrc;
 	
 	
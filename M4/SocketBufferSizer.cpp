@@ -0,0 +1,41 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// @file SocketBufferSizer.cpp
+///
+/// Copyright (c) 2015, BoxCast, Inc. All rights reserved.
+///
+/// This library is free software; you can redistribute it and/or modify it under the terms of the
+/// GNU Lesser General Public License as published by the Free Software Foundation; either version
+/// 3.0 of the License, or (at your option) any later version.
+///
+/// This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+/// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See
+/// the GNULesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License along with this
+/// library; if not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+/// Boston, MA 02110-1301 USA
+///
+/// @brief This file defines the functions of the SocketBufferSizer class.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+
+#include "SocketBufferSizer.hpp"
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// SocketBufferSizer::Size()
+///
+/// Get the buffer size that holds a window's worth of traffic at a rate.
+///
+/// @param bitsPerSecond  The rate of all of the traffic through the socket, in bits/sec.
+///
+/// @param windowMs  How long the traffic may pile up, in milliseconds.
+///
+/// @return The buffer size in bytes, as for SO_SNDBUF or SO_RCVBUF.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+int SocketBufferSizer::Size(uint64_t bitsPerSecond, unsigned int windowMs)
+{
+	uint64_t bytes = ((bitsPerSecond / 8) * windowMs) / 1000;
+	return static_cast<int>(std::max(static_cast<uint64_t>(MIN_SIZE), std::min(bytes, static_cast<uint64_t>(MAX_SIZE))));
+}
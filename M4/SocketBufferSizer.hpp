@@ -0,0 +1,51 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// @file SocketBufferSizer.hpp
+///
+/// Copyright (c) 2015, BoxCast, Inc. All rights reserved.
+///
+/// This library is free software; you can redistribute it and/or modify it under the terms of the
+/// GNU Lesser General Public License as published by the Free Software Foundation; either version
+/// 3.0 of the License, or (at your option) any later version.
+///
+/// This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+/// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See
+/// the GNULesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License along with this
+/// library; if not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+/// Boston, MA 02110-1301 USA
+///
+/// @brief This file declares the SocketBufferSizer class, which picks UDP socket buffer sizes from
+/// the rate of the traffic going through them.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#ifndef __SOCKET_BUFFER_SIZER_HPP__
+#define __SOCKET_BUFFER_SIZER_HPP__
+
+#include <stdint.h> // for uint64_t
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// This class sizes a socket's send or receive buffer to hold a window's worth of its traffic:
+/// the longest the traffic may pile up in the kernel, e.g. a burst the pacer lets out at once, or
+/// what arrives while the receiving thread is held up. Too small a buffer drops packets at high
+/// bitrates; too large a one ties up kernel memory for every participant at low bitrates.
+///
+/// The size is kept between MIN_SIZE and MAX_SIZE. The kernel may cap it further (at
+/// net.core.rmem_max or wmem_max on Linux, kern.ipc.maxsockbuf on OS X).
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class SocketBufferSizer
+{
+public:
+	/// The smallest buffer size picked, in bytes; enough for a burst of small packets.
+	static const int MIN_SIZE = 64 * 1024;
+
+
+	/// The largest buffer size picked, in bytes.
+	static const int MAX_SIZE = 8 * 1024 * 1024;
+
+
+	/// The buffer size for traffic at a rate, piling up for a window of time.
+	static int Size(uint64_t bitsPerSecond, unsigned int windowMs);
+}; // END class SocketBufferSizer
+
+#endif // __SOCKET_BUFFER_SIZER_HPP__
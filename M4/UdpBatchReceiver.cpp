@@ -0,0 +1,388 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// @file UdpBatchReceiver.cpp
+///
+/// Copyright (c) 2015, BoxCast, Inc. All rights reserved.
+///
+/// This library is free software; you can redistribute it and/or modify it under the terms of the
+/// GNU Lesser General Public License as published by the Free Software Foundation; either version
+/// 3.0 of the License, or (at your option) any later version.
+///
+/// This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+/// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See
+/// the GNULesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License along with this
+/// library; if not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+/// Boston, MA 02110-1301 USA
+///
+/// @brief This file defines the functions of the UdpBatchReceiver class.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "UdpBatchReceiver.hpp"
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Constructor.
+///
+/// Create the socket and the interrupt pipe, and pick the most batched mode the platform supports.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+UdpBatchReceiver::UdpBatchReceiver()
+	: m_Socket(socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP))
+	, m_InterruptPipe()
+	, m_Mode(MODE_RECVFROM)
+	, m_IoVecs()
+	, m_Control()
+	, m_SyscallCount(0)
+	, m_DatagramCount(0)
+	, m_TruncatedCount(0)
+	, m_DroppedCount(0)
+{
+	assert(m_Socket >= 0);
+	assert(pipe(m_InterruptPipe) == 0);
+	for (size_t i = 0; i < 2; ++i)
+	{
+		fcntl(m_InterruptPipe[i], F_SETFL, fcntl(m_InterruptPipe[i], F_GETFL) | O_NONBLOCK);
+	}
+	SetMode(MODE_RECVMMSG);
+#ifdef SO_RXQ_OVFL
+	int enable = 1;
+	setsockopt(m_Socket, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable));
+#endif
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Destructor.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+UdpBatchReceiver::~UdpBatchReceiver()
+{
+	close(m_Socket);
+	close(m_InterruptPipe[0]);
+	close(m_InterruptPipe[1]);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// UdpBatchReceiver::Bind()
+///
+/// Bind the socket to a port on all addresses, first setting its receive buffer size.
+///
+/// @param port  The port.
+///
+/// @param bufferSize  The receive buffer size in bytes, as for SO_RCVBUF; 0 for the default.
+///
+/// @return true if the socket was bound.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool UdpBatchReceiver::Bind(uint16_t port, int bufferSize)
+{
+	if (bufferSize > 0)
+	{
+		SetBufferSize(bufferSize);
+	}
+
+	int reuse = 1;
+	setsockopt(m_Socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	return bind(m_Socket, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// UdpBatchReceiver::SetBufferSize()
+///
+/// Set the receive buffer size. This takes effect right away, even while receiving; datagrams
+/// already queued beyond a smaller size are kept.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void UdpBatchReceiver::SetBufferSize(int bufferSize)
+{
+	setsockopt(m_Socket, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// UdpBatchReceiver::GetBufferSize()
+///
+/// Get the receive buffer size. Linux reports twice what was set, the other half being its
+/// allowance for bookkeeping; either kernel may have capped it.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+int UdpBatchReceiver::GetBufferSize() const
+{
+	int bufferSize = 0;
+	socklen_t length = sizeof(bufferSize);
+	getsockopt(m_Socket, SOL_SOCKET, SO_RCVBUF, &bufferSize, &length);
+	return bufferSize;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// UdpBatchReceiver::SetMode()
+///
+/// Request a receive mode. The batched mode falls back to MODE_RECVFROM off Linux.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void UdpBatchReceiver::SetMode(Mode mode)
+{
+#ifdef __linux__
+	m_Mode = mode;
+#else
+	(void)mode;
+	m_Mode = MODE_RECVFROM;
+#endif
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// UdpBatchReceiver::Receive()
+///
+/// Wait for a datagram, then receive as many as are waiting, up to one per buffer, in the order
+/// they arrived. A datagram that doesn't fit its buffer is dropped, leaving a length of 0.
+///
+/// @param pDatagrams  The buffers; on return, the first ones hold the datagrams received.
+///
+/// @param numDatagrams  The number of buffers.
+///
+/// @return The number of buffers used, or 0 if interrupted.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+size_t UdpBatchReceiver::Receive(Datagram* pDatagrams, size_t numDatagrams)
+{
+	size_t received = 0;
+	while ((received == 0) && (numDatagrams > 0))
+	{
+		if (!Wait())
+		{
+			return 0;
+		}
+		received = (m_Mode == MODE_RECVFROM) ? ReceiveEach(pDatagrams, numDatagrams) : ReceiveBatched(pDatagrams, numDatagrams);
+	}
+
+	for (size_t i = 0; i < received; ++i)
+	{
+		if (pDatagrams[i].length == 0)
+		{
+			++m_TruncatedCount;
+		}
+		else
+		{
+			++m_DatagramCount;
+		}
+	}
+	return received;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// UdpBatchReceiver::Interrupt()
+///
+/// Wake a Receive() blocked in another thread, and keep it from blocking until ClearInterrupt().
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void UdpBatchReceiver::Interrupt()
+{
+	char c = 0;
+	ssize_t r;
+	do
+	{
+		r = write(m_InterruptPipe[1], &c, sizeof(c));
+	} while ((r < 0) && (errno == EINTR));
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// UdpBatchReceiver::ClearInterrupt()
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void UdpBatchReceiver::ClearInterrupt()
+{
+	char buffer[64];
+	while ((read(m_InterruptPipe[0], buffer, sizeof(buffer)) > 0) || (errno == EINTR))
+	{
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// UdpBatchReceiver::Wait()
+///
+/// Wait until the socket is readable, or Interrupt() is called.
+///
+/// @return false if interrupted.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool UdpBatchReceiver::Wait()
+{
+	struct pollfd fds[2];
+	fds[0].fd = m_Socket;
+	fds[0].events = POLLIN;
+	fds[1].fd = m_InterruptPipe[0];
+	fds[1].events = POLLIN;
+	for (;;)
+	{
+		fds[0].revents = 0;
+		fds[1].revents = 0;
+		int r = poll(fds, 2, -1);
+		if ((r < 0) && (errno != EINTR))
+		{
+			return false;
+		}
+		if (fds[1].revents != 0)
+		{
+			return false;
+		}
+		if (fds[0].revents != 0)
+		{
+			return true;
+		}
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// UdpBatchReceiver::PrepareMessage()
+///
+/// Point a message header at a datagram's buffer and address, and at the index'th slot of the
+/// control data, growing that as needed.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void UdpBatchReceiver::PrepareMessage(struct msghdr& message, Datagram& datagram, size_t index)
+{
+	if (m_IoVecs.size() <= index)
+	{
+		m_IoVecs.resize(index + 1);
+	}
+	if (m_Control.size() < ((index + 1) * CONTROL_SIZE))
+	{
+		m_Control.resize((index + 1) * CONTROL_SIZE);
+	}
+	m_IoVecs[index].iov_base = datagram.pData;
+	m_IoVecs[index].iov_len = datagram.capacity;
+
+	memset(&message, 0, sizeof(message));
+	message.msg_name = &datagram.from;
+	message.msg_namelen = sizeof(datagram.from);
+	message.msg_iov = &m_IoVecs[index];
+	message.msg_iovlen = 1;
+	message.msg_control = &m_Control[index * CONTROL_SIZE];
+	message.msg_controllen = CONTROL_SIZE;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// UdpBatchReceiver::ReadDropCount()
+///
+/// The kernel attaches its running count of the datagrams the socket dropped to each datagram it
+/// delivers, once SO_RXQ_OVFL is on (and the count is not 0). It is a 32-bit counter; follow its
+/// wraparound.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void UdpBatchReceiver::ReadDropCount(const struct msghdr& message)
+{
+#ifdef SO_RXQ_OVFL
+	for (struct cmsghdr* pCmsg = CMSG_FIRSTHDR(&message); pCmsg != NULL; pCmsg = CMSG_NXTHDR(const_cast<struct msghdr*>(&message), pCmsg))
+	{
+		if ((pCmsg->cmsg_level == SOL_SOCKET) && (pCmsg->cmsg_type == SO_RXQ_OVFL))
+		{
+			uint32_t dropped;
+			memcpy(&dropped, CMSG_DATA(pCmsg), sizeof(dropped));
+			m_DroppedCount += static_cast<uint32_t>(dropped - static_cast<uint32_t>(m_DroppedCount));
+		}
+	}
+#else
+	(void)message;
+#endif
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// UdpBatchReceiver::ReceiveEach()
+///
+/// Receive the waiting datagrams with one recvmsg() call each, until none is left or the buffers
+/// run out.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+size_t UdpBatchReceiver::ReceiveEach(Datagram* pDatagrams, size_t numDatagrams)
+{
+	size_t received = 0;
+	while (received < numDatagrams)
+	{
+		Datagram& datagram = pDatagrams[received];
+		struct msghdr message;
+		PrepareMessage(message, datagram, 0);
+		ssize_t r;
+		do
+		{
+			r = recvmsg(m_Socket, &message, MSG_DONTWAIT);
+			++m_SyscallCount;
+		} while ((r < 0) && (errno == EINTR));
+
+		if (r < 0)
+		{
+			// Nothing left (EAGAIN), or an error reported for an earlier send (e.g. ECONNREFUSED)
+			break;
+		}
+		datagram.length = ((message.msg_flags & MSG_TRUNC) == 0) ? static_cast<size_t>(r) : 0;
+		ReadDropCount(message);
+		++received;
+	}
+	return received;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// UdpBatchReceiver::ReceiveBatched()
+///
+/// Receive the waiting datagrams with as few recvmmsg() calls as possible: one, unless there are
+/// more than MAX_MESSAGES_PER_CALL buffers.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+size_t UdpBatchReceiver::ReceiveBatched(Datagram* pDatagrams, size_t numDatagrams)
+{
+#ifdef __linux__
+	m_Messages.resize(numDatagrams);
+	for (size_t i = 0; i < numDatagrams; ++i)
+	{
+		PrepareMessage(m_Messages[i].msg_hdr, pDatagrams[i], i);
+		m_Messages[i].msg_len = 0;
+	}
+
+	size_t received = 0;
+	while (received < numDatagrams)
+	{
+		unsigned int count = static_cast<unsigned int>(std::min(numDatagrams - received, MAX_MESSAGES_PER_CALL));
+		int r = recvmmsg(m_Socket, &m_Messages[received], count, MSG_DONTWAIT, NULL);
+		++m_SyscallCount;
+		if (r > 0)
+		{
+			for (size_t i = received; i < received + r; ++i)
+			{
+				bool truncated = (m_Messages[i].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+				pDatagrams[i].length = truncated ? 0 : m_Messages[i].msg_len;
+				ReadDropCount(m_Messages[i].msg_hdr);
+			}
+			received += r;
+			if (static_cast<unsigned int>(r) < count)
+			{
+				break;
+			}
+		}
+		else if ((r < 0) && (errno == EINTR))
+		{
+			continue;
+		}
+		else
+		{
+			break;
+		}
+	}
+	return received;
+#else
+	return ReceiveEach(pDatagrams, numDatagrams);
+#endif
+}
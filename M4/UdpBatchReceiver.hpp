@@ -0,0 +1,179 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// @file UdpBatchReceiver.hpp
+///
+/// Copyright (c) 2015, BoxCast, Inc. All rights reserved.
+///
+/// This library is free software; you can redistribute it and/or modify it under the terms of the
+/// GNU Lesser General Public License as published by the Free Software Foundation; either version
+/// 3.0 of the License, or (at your option) any later version.
+///
+/// This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+/// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See
+/// the GNULesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License along with this
+/// library; if not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+/// Boston, MA 02110-1301 USA
+///
+/// @brief This file declares the UdpBatchReceiver class, which receives UDP datagrams in batches,
+/// with as few system calls as the platform allows.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#ifndef __UDP_BATCH_RECEIVER_HPP__
+#define __UDP_BATCH_RECEIVER_HPP__
+
+#include <netinet/in.h> // for struct sockaddr_in
+#include <stdint.h>     // for uint16_t, uint64_t
+#include <sys/socket.h> // for struct mmsghdr
+#include <sys/uio.h>    // for struct iovec
+#include <cstddef>      // for size_t
+#include <vector>       // for std::vector
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// This class receives the datagrams sent to a UDP port into buffers the caller provides, as many
+/// as are waiting (up to the number of buffers) at a time. Depending on the mode, it does so
+///  - With one system call per datagram (MODE_RECVFROM, which is what udpsrc does), or
+///  - With recvmmsg(), so that a whole batch takes one system call (MODE_RECVMMSG).
+///
+/// The batched mode is only available on Linux; elsewhere the mode is always MODE_RECVFROM.
+///
+/// Receive() blocks until a datagram arrives, or until Interrupt() is called from another thread.
+///
+/// Where the kernel reports them (SO_RXQ_OVFL, Linux), the datagrams it dropped for want of room
+/// in the receive buffer are counted; SetBufferSize() can grow the buffer at any time.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class UdpBatchReceiver
+{
+public:
+	/// The ways datagrams can be received, from least to most batched.
+	enum Mode
+	{
+		MODE_RECVFROM,
+		MODE_RECVMMSG
+	};
+
+
+	/// One buffer to receive a datagram into, and what was received.
+	struct Datagram
+	{
+		void* pData;
+		size_t capacity;
+		size_t length;
+		struct sockaddr_in from;
+	};
+
+
+	/// Constructor
+	UdpBatchReceiver();
+
+
+	/// Destructor
+	~UdpBatchReceiver();
+
+
+	/// Bind to a port (on all addresses), with a receive buffer size (0 for the default).
+	bool Bind(uint16_t port, int bufferSize);
+
+
+	/// Set the receive buffer size in bytes (SO_RCVBUF), before or after binding.
+	void SetBufferSize(int bufferSize);
+
+
+	/// The receive buffer size in bytes, as the kernel reports it.
+	int GetBufferSize() const;
+
+
+	/// Receive a batch of datagrams; returns how many (0 if interrupted).
+	size_t Receive(Datagram* pDatagrams, size_t numDatagrams);
+
+
+	/// Make a blocked (or the next) Receive() return 0, until ClearInterrupt().
+	void Interrupt();
+
+
+	/// Let Receive() block again after Interrupt().
+	void ClearInterrupt();
+
+
+	/// Request a receive mode; the mode actually used may be less batched if unsupported.
+	void SetMode(Mode mode);
+
+
+	/// The receive mode in use.
+	inline Mode GetMode() const { return m_Mode; }
+
+
+	/// The number of receive system calls made so far.
+	inline uint64_t SyscallCount() const { return m_SyscallCount; }
+
+
+	/// The number of datagrams received so far.
+	inline uint64_t DatagramCount() const { return m_DatagramCount; }
+
+
+	/// The number of datagrams dropped so far for not fitting their buffer.
+	inline uint64_t TruncatedCount() const { return m_TruncatedCount; }
+
+
+	/// The number of datagrams the kernel dropped so far for a full receive buffer, as of the last
+	/// datagram received (always 0 where the kernel doesn't report it).
+	inline uint64_t DroppedCount() const { return m_DroppedCount; }
+
+
+private:
+	/// Most messages passed to one recvmmsg() call (UIO_MAXIOV).
+	static const size_t MAX_MESSAGES_PER_CALL = 1024;
+
+
+	/// Wait until the socket is readable; false if interrupted.
+	bool Wait();
+
+
+	/// Room for each message's control data (the SO_RXQ_OVFL drop count).
+	static const size_t CONTROL_SIZE = 64;
+
+
+	/// Point a message header at a datagram's buffer, address, and control data.
+	void PrepareMessage(struct msghdr& message, Datagram& datagram, size_t index);
+
+
+	/// Take the kernel's drop count from a received message's control data, if it is there.
+	void ReadDropCount(const struct msghdr& message);
+
+
+	/// Receive with one recvmsg() per datagram.
+	size_t ReceiveEach(Datagram* pDatagrams, size_t numDatagrams);
+
+
+	/// Receive with recvmmsg().
+	size_t ReceiveBatched(Datagram* pDatagrams, size_t numDatagrams);
+
+
+	/// The UDP socket
+	const int m_Socket;
+
+
+	/// The pipe Interrupt() writes to, to wake Receive() up
+	int m_InterruptPipe[2];
+
+
+	/// The receive mode in use
+	Mode m_Mode;
+
+
+	/// Scratch space for building a batch, kept to avoid allocating per batch.
+	std::vector<struct iovec> m_IoVecs;
+	std::vector<char> m_Control;
+#ifdef __linux__
+	std::vector<struct mmsghdr> m_Messages;
+#endif
+
+
+	/// Statistics
+	uint64_t m_SyscallCount;
+	uint64_t m_DatagramCount;
+	uint64_t m_TruncatedCount;
+	uint64_t m_DroppedCount;
+}; // END class UdpBatchReceiver
+
+#endif // __UDP_BATCH_RECEIVER_HPP__
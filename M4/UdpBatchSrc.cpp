@@ -0,0 +1,579 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// @file UdpBatchSrc.cpp
+///
+/// Copyright (c) 2015, BoxCast, Inc. All rights reserved.
+///
+/// This library is free software; you can redistribute it and/or modify it under the terms of the
+/// GNU Lesser General Public License as published by the Free Software Foundation; either version
+/// 3.0 of the License, or (at your option) any later version.
+///
+/// This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+/// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See
+/// the GNULesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License along with this
+/// library; if not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+/// Boston, MA 02110-1301 USA
+///
+/// @brief This file defines the functions of the UdpBatchSrc class.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <cstring>                      // for memset()
+#include <gst/net/gstnetaddressmeta.h>  // for gst_buffer_add_net_address_meta()
+#include "UdpBatchSrc.hpp"              // for class declaration
+
+
+const char UdpBatchSrc::ELEMENT_NAME[] = "m4udpbatchsrc";
+
+gpointer UdpBatchSrc::s_pParentClass = NULL;
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// UdpBatchSrc::Register()
+///
+/// Register the element with GStreamer so that gst_element_factory_make(ELEMENT_NAME, ...) works.
+///
+/// @return true if the element was registered.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+bool UdpBatchSrc::Register()
+{
+	return gst_element_register(NULL, ELEMENT_NAME, GST_RANK_NONE, GetType()) == TRUE;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// UdpBatchSrc::GetType()
+///
+/// Get the element's GType, registering it the first time.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+GType UdpBatchSrc::GetType()
+{
+	static gsize type = 0;
+	if (g_once_init_enter(&type))
+	{
+		GType t = g_type_register_static_simple(GST_TYPE_PUSH_SRC,
+			"M4UdpBatchSrc",
+			sizeof(Class),
+			ClassInit,
+			sizeof(Instance),
+			InstanceInit,
+			static_cast<GTypeFlags>(0));
+		g_once_init_leave(&type, t);
+	}
+	return type;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// UdpBatchSrc::ClassInit()
+///
+/// Install the virtual functions, properties, pad template, and metadata.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void UdpBatchSrc::ClassInit(gpointer klass, gpointer classData)
+{
+	static GstStaticPadTemplate srcTemplate = GST_STATIC_PAD_TEMPLATE("src", GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS_ANY);
+
+	s_pParentClass = g_type_class_peek_parent(klass);
+
+	GObjectClass* pObjectClass = G_OBJECT_CLASS(klass);
+	pObjectClass->set_property = SetProperty;
+	pObjectClass->get_property = GetProperty;
+	pObjectClass->finalize = Finalize;
+
+	g_object_class_install_property(pObjectClass, PROP_PORT,
+		g_param_spec_int("port", "Port", "The port to receive packets from, 0 = allocate",
+			0, G_MAXUINT16, 5004, static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+	g_object_class_install_property(pObjectClass, PROP_BUFFER_SIZE,
+		g_param_spec_int("buffer-size", "Buffer Size", "Size of the kernel receive buffer in bytes, 0 = default (applied live)",
+			0, G_MAXINT, 0, static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+	g_object_class_install_property(pObjectClass, PROP_CAPS,
+		g_param_spec_boxed("caps", "Caps", "The caps of the source pad",
+			GST_TYPE_CAPS, static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+	g_object_class_install_property(pObjectClass, PROP_BATCH_SIZE,
+		g_param_spec_uint("batch-size", "Batch size", "The most datagrams received at a time (set only while stopped)",
+			1, MAX_BATCH_SIZE, DEFAULT_BATCH_SIZE, static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+	g_object_class_install_property(pObjectClass, PROP_MTU,
+		g_param_spec_uint("mtu", "MTU", "The largest datagram received, in bytes (set only while stopped)",
+			1, G_MAXUINT16, DEFAULT_MTU, static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+	g_object_class_install_property(pObjectClass, PROP_MODE,
+		g_param_spec_uint("mode", "Mode", "0 = recvfrom per datagram, 1 = recvmmsg (set only while stopped)",
+			UdpBatchReceiver::MODE_RECVFROM, UdpBatchReceiver::MODE_RECVMMSG, UdpBatchReceiver::MODE_RECVMMSG,
+			static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+	g_object_class_install_property(pObjectClass, PROP_STATS,
+		g_param_spec_boxed("stats", "Statistics", "Receiving statistics",
+			GST_TYPE_STRUCTURE, static_cast<GParamFlags>(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+	GstElementClass* pElementClass = GST_ELEMENT_CLASS(klass);
+	gst_element_class_add_pad_template(pElementClass, gst_static_pad_template_get(&srcTemplate));
+	gst_element_class_set_static_metadata(pElementClass,
+		"UDP batch source",
+		"Source/Network",
+		"Receives packets in batches into pooled buffers",
+		"BoxCast");
+
+	GstBaseSrcClass* pBaseSrcClass = GST_BASE_SRC_CLASS(klass);
+	pBaseSrcClass->start = Start;
+	pBaseSrcClass->stop = Stop;
+	pBaseSrcClass->unlock = Unlock;
+	pBaseSrcClass->unlock_stop = UnlockStop;
+	pBaseSrcClass->get_caps = GetCaps;
+
+	GstPushSrcClass* pPushSrcClass = GST_PUSH_SRC_CLASS(klass);
+	pPushSrcClass->create = Create;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// UdpBatchSrc::InstanceInit()
+///
+/// Make the source live, in time format, and create the instance's scratch space.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void UdpBatchSrc::InstanceInit(GTypeInstance* pInstance, gpointer klass)
+{
+	Instance* pSelf = reinterpret_cast<Instance*>(pInstance);
+	pSelf->pReceiver = NULL;
+	pSelf->pPool = NULL;
+	pSelf->pCaps = NULL;
+	pSelf->port = 5004;
+	pSelf->bufferSize = 0;
+	pSelf->batchSize = DEFAULT_BATCH_SIZE;
+	pSelf->mtu = DEFAULT_MTU;
+	pSelf->mode = UdpBatchReceiver::MODE_RECVMMSG;
+	pSelf->pLastAddress = NULL;
+	memset(&pSelf->lastFrom, 0, sizeof(pSelf->lastFrom));
+	pSelf->pSlots = new std::vector<GstBuffer*>();
+	pSelf->pMaps = new std::vector<GstMapInfo>();
+	pSelf->pDatagrams = new std::vector<UdpBatchReceiver::Datagram>();
+
+	gst_base_src_set_live(GST_BASE_SRC(pSelf), TRUE);
+	gst_base_src_set_format(GST_BASE_SRC(pSelf), GST_FORMAT_TIME);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// UdpBatchSrc::Finalize()
+///
+/// Release what InstanceInit created (Stop() has released the rest), then chain up.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void UdpBatchSrc::Finalize(GObject* pObject)
+{
+	Instance* pSelf = reinterpret_cast<Instance*>(pObject);
+	delete pSelf->pDatagrams;
+	delete pSelf->pMaps;
+	delete pSelf->pSlots;
+	if (pSelf->pCaps != NULL)
+	{
+		gst_caps_unref(pSelf->pCaps);
+	}
+
+	G_OBJECT_CLASS(s_pParentClass)->finalize(pObject);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// UdpBatchSrc::SetProperty()
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void UdpBatchSrc::SetProperty(GObject* pObject, guint propId, const GValue* pValue, GParamSpec* pSpec)
+{
+	Instance* pSelf = reinterpret_cast<Instance*>(pObject);
+	switch (propId)
+	{
+	case PROP_PORT:
+		pSelf->port = g_value_get_int(pValue);
+		break;
+
+	case PROP_BUFFER_SIZE:
+		GST_OBJECT_LOCK(pSelf);
+		pSelf->bufferSize = g_value_get_int(pValue);
+		if ((pSelf->pReceiver != NULL) && (pSelf->bufferSize > 0))
+		{
+			pSelf->pReceiver->SetBufferSize(pSelf->bufferSize);
+		}
+		GST_OBJECT_UNLOCK(pSelf);
+		break;
+
+	case PROP_CAPS:
+	{
+		const GstCaps* pCaps = gst_value_get_caps(pValue);
+		GST_OBJECT_LOCK(pSelf);
+		if (pSelf->pCaps != NULL)
+		{
+			gst_caps_unref(pSelf->pCaps);
+		}
+		pSelf->pCaps = (pCaps != NULL) ? gst_caps_copy(pCaps) : NULL;
+		GST_OBJECT_UNLOCK(pSelf);
+		gst_pad_mark_reconfigure(GST_BASE_SRC_PAD(pSelf));
+		break;
+	}
+
+	case PROP_BATCH_SIZE:
+		pSelf->batchSize = g_value_get_uint(pValue);
+		break;
+
+	case PROP_MTU:
+		pSelf->mtu = g_value_get_uint(pValue);
+		break;
+
+	case PROP_MODE:
+		pSelf->mode = static_cast<UdpBatchReceiver::Mode>(g_value_get_uint(pValue));
+		break;
+
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID(pObject, propId, pSpec);
+		break;
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// UdpBatchSrc::GetProperty()
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void UdpBatchSrc::GetProperty(GObject* pObject, guint propId, GValue* pValue, GParamSpec* pSpec)
+{
+	Instance* pSelf = reinterpret_cast<Instance*>(pObject);
+	switch (propId)
+	{
+	case PROP_PORT:
+		g_value_set_int(pValue, pSelf->port);
+		break;
+
+	case PROP_BUFFER_SIZE:
+		g_value_set_int(pValue, pSelf->bufferSize);
+		break;
+
+	case PROP_CAPS:
+		GST_OBJECT_LOCK(pSelf);
+		gst_value_set_caps(pValue, pSelf->pCaps);
+		GST_OBJECT_UNLOCK(pSelf);
+		break;
+
+	case PROP_BATCH_SIZE:
+		g_value_set_uint(pValue, pSelf->batchSize);
+		break;
+
+	case PROP_MTU:
+		g_value_set_uint(pValue, pSelf->mtu);
+		break;
+
+	case PROP_MODE:
+		g_value_set_uint(pValue, pSelf->mode);
+		break;
+
+	case PROP_STATS:
+	{
+		guint64 datagrams = 0;
+		guint64 syscalls = 0;
+		guint64 truncated = 0;
+		guint64 dropped = 0;
+		gint bufferSize = 0;
+		GST_OBJECT_LOCK(pSelf);
+		if (pSelf->pReceiver != NULL)
+		{
+			datagrams = pSelf->pReceiver->DatagramCount();
+			syscalls = pSelf->pReceiver->SyscallCount();
+			truncated = pSelf->pReceiver->TruncatedCount();
+			dropped = pSelf->pReceiver->DroppedCount();
+			bufferSize = pSelf->pReceiver->GetBufferSize();
+		}
+		GST_OBJECT_UNLOCK(pSelf);
+		g_value_take_boxed(pValue, gst_structure_new("m4udpbatchsrc-stats",
+			"datagrams",   G_TYPE_UINT64, datagrams,
+			"syscalls",    G_TYPE_UINT64, syscalls,
+			"truncated",   G_TYPE_UINT64, truncated,
+			"dropped",     G_TYPE_UINT64, dropped,
+			"buffer-size", G_TYPE_INT,    bufferSize,
+			NULL));
+		break;
+	}
+
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID(pObject, propId, pSpec);
+		break;
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// UdpBatchSrc::Start()
+///
+/// Bind a new receiver to the port, and create and activate the buffer pool, preallocating
+/// POOL_BATCHES batches' worth of buffers. The pool has no maximum, since downstream (the jitter
+/// buffer) may hold on to any number of them.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+gboolean UdpBatchSrc::Start(GstBaseSrc* pSrc)
+{
+	Instance* pSelf = reinterpret_cast<Instance*>(pSrc);
+
+	UdpBatchReceiver* pReceiver = new UdpBatchReceiver();
+	pReceiver->SetMode(pSelf->mode);
+	if (!pReceiver->Bind(static_cast<uint16_t>(pSelf->port), pSelf->bufferSize))
+	{
+		delete pReceiver;
+		GST_ELEMENT_ERROR(pSelf, RESOURCE, OPEN_READ, ("Could not bind to port %d", pSelf->port), (NULL));
+		return FALSE;
+	}
+
+	GstBufferPool* pPool = gst_buffer_pool_new();
+	GstStructure* pConfig = gst_buffer_pool_get_config(pPool);
+	gst_buffer_pool_config_set_params(pConfig, NULL, pSelf->mtu, pSelf->batchSize * POOL_BATCHES, 0);
+	if (!gst_buffer_pool_set_config(pPool, pConfig) || !gst_buffer_pool_set_active(pPool, TRUE))
+	{
+		gst_object_unref(pPool);
+		delete pReceiver;
+		GST_ELEMENT_ERROR(pSelf, RESOURCE, NO_SPACE_LEFT, ("Could not allocate the buffer pool"), (NULL));
+		return FALSE;
+	}
+
+	GST_OBJECT_LOCK(pSelf);
+	pSelf->pReceiver = pReceiver;
+	pSelf->pPool = pPool;
+	GST_OBJECT_UNLOCK(pSelf);
+	pSelf->pSlots->assign(pSelf->batchSize, NULL);
+	pSelf->pMaps->resize(pSelf->batchSize);
+	pSelf->pDatagrams->resize(pSelf->batchSize);
+	return TRUE;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// UdpBatchSrc::Stop()
+///
+/// Release the slots' buffers, the buffer pool, the cached sender address, and the receiver.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+gboolean UdpBatchSrc::Stop(GstBaseSrc* pSrc)
+{
+	Instance* pSelf = reinterpret_cast<Instance*>(pSrc);
+
+	ReleaseSlots(pSelf);
+	if (pSelf->pLastAddress != NULL)
+	{
+		g_object_unref(pSelf->pLastAddress);
+		pSelf->pLastAddress = NULL;
+	}
+
+	GST_OBJECT_LOCK(pSelf);
+	UdpBatchReceiver* pReceiver = pSelf->pReceiver;
+	GstBufferPool* pPool = pSelf->pPool;
+	pSelf->pReceiver = NULL;
+	pSelf->pPool = NULL;
+	GST_OBJECT_UNLOCK(pSelf);
+
+	if (pPool != NULL)
+	{
+		gst_buffer_pool_set_active(pPool, FALSE);
+		gst_object_unref(pPool);
+	}
+	delete pReceiver;
+	return TRUE;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// UdpBatchSrc::Unlock()
+///
+/// Make a Create() blocked waiting for datagrams return, and keep it from blocking until
+/// UnlockStop().
+///////////////////////////////////////////////////////////////////////////////////////////////////
+gboolean UdpBatchSrc::Unlock(GstBaseSrc* pSrc)
+{
+	Instance* pSelf = reinterpret_cast<Instance*>(pSrc);
+	GST_OBJECT_LOCK(pSelf);
+	if (pSelf->pReceiver != NULL)
+	{
+		pSelf->pReceiver->Interrupt();
+	}
+	GST_OBJECT_UNLOCK(pSelf);
+	return TRUE;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// UdpBatchSrc::UnlockStop()
+///////////////////////////////////////////////////////////////////////////////////////////////////
+gboolean UdpBatchSrc::UnlockStop(GstBaseSrc* pSrc)
+{
+	Instance* pSelf = reinterpret_cast<Instance*>(pSrc);
+	GST_OBJECT_LOCK(pSelf);
+	if (pSelf->pReceiver != NULL)
+	{
+		pSelf->pReceiver->ClearInterrupt();
+	}
+	GST_OBJECT_UNLOCK(pSelf);
+	return TRUE;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// UdpBatchSrc::GetCaps()
+///
+/// The "caps" property (filtered), or the parent class's caps if it isn't set.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+GstCaps* UdpBatchSrc::GetCaps(GstBaseSrc* pSrc, GstCaps* pFilter)
+{
+	Instance* pSelf = reinterpret_cast<Instance*>(pSrc);
+
+	GST_OBJECT_LOCK(pSelf);
+	GstCaps* pCaps = (pSelf->pCaps != NULL) ? gst_caps_ref(pSelf->pCaps) : NULL;
+	GST_OBJECT_UNLOCK(pSelf);
+
+	if (pCaps == NULL)
+	{
+		return GST_BASE_SRC_CLASS(s_pParentClass)->get_caps(pSrc, pFilter);
+	}
+	if (pFilter != NULL)
+	{
+		GstCaps* pIntersection = gst_caps_intersect_full(pFilter, pCaps, GST_CAPS_INTERSECT_FIRST);
+		gst_caps_unref(pCaps);
+		pCaps = pIntersection;
+	}
+	return pCaps;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// UdpBatchSrc::Create()
+///
+/// Receive a batch of datagrams into the slots' buffers, and submit those that arrived whole as
+/// one buffer list, refilling their slots from the pool next time. A truncated datagram's buffer
+/// stays in its slot to be received into again; a batch of nothing but those is not submitted.
+///
+/// @return GST_FLOW_OK with *ppBuffer NULL (the list having been submitted), or GST_FLOW_FLUSHING
+/// if Unlock() interrupted the wait.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+GstFlowReturn UdpBatchSrc::Create(GstPushSrc* pSrc, GstBuffer** ppBuffer)
+{
+	Instance* pSelf = reinterpret_cast<Instance*>(pSrc);
+	std::vector<GstBuffer*>& slots = *pSelf->pSlots;
+	std::vector<GstMapInfo>& maps = *pSelf->pMaps;
+	std::vector<UdpBatchReceiver::Datagram>& datagrams = *pSelf->pDatagrams;
+
+	*ppBuffer = NULL;
+	size_t received = 0;
+	size_t whole = 0;
+	while (whole == 0)
+	{
+		GstFlowReturn ret = FillSlots(pSelf);
+		if (ret != GST_FLOW_OK)
+		{
+			return ret;
+		}
+
+		received = pSelf->pReceiver->Receive(&datagrams[0], datagrams.size());
+		if (received == 0)
+		{
+			return GST_FLOW_FLUSHING;
+		}
+		for (size_t i = 0; i < received; ++i)
+		{
+			whole += (datagrams[i].length > 0) ? 1 : 0;
+		}
+	}
+
+	// Everything in the batch was waiting by now, so it all gets the same arrival time.
+	GstClockTime dts = GST_CLOCK_TIME_NONE;
+	GstClock* pClock = gst_element_get_clock(GST_ELEMENT(pSelf));
+	if (pClock != NULL)
+	{
+		dts = gst_clock_get_time(pClock) - gst_element_get_base_time(GST_ELEMENT(pSelf));
+		gst_object_unref(pClock);
+	}
+
+	GstBufferList* pList = gst_buffer_list_new_sized(whole);
+	for (size_t i = 0; i < received; ++i)
+	{
+		if (datagrams[i].length == 0)
+		{
+			continue;
+		}
+		GstBuffer* pBuffer = slots[i];
+		slots[i] = NULL;
+		gst_buffer_unmap(pBuffer, &maps[i]);
+		gst_buffer_resize(pBuffer, 0, datagrams[i].length);
+		GST_BUFFER_DTS(pBuffer) = dts;
+		gst_buffer_add_net_address_meta(pBuffer, SenderAddress(pSelf, datagrams[i].from));
+		gst_buffer_list_add(pList, pBuffer);
+	}
+
+	gst_base_src_submit_buffer_list(GST_BASE_SRC(pSelf), pList);
+	return GST_FLOW_OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// UdpBatchSrc::FillSlots()
+///
+/// Acquire a buffer from the pool for every slot whose buffer went downstream, and map it for the
+/// receiver to write into.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+GstFlowReturn UdpBatchSrc::FillSlots(Instance* pSelf)
+{
+	std::vector<GstBuffer*>& slots = *pSelf->pSlots;
+	std::vector<GstMapInfo>& maps = *pSelf->pMaps;
+	std::vector<UdpBatchReceiver::Datagram>& datagrams = *pSelf->pDatagrams;
+
+	for (size_t i = 0; i < slots.size(); ++i)
+	{
+		if (slots[i] == NULL)
+		{
+			GstFlowReturn ret = gst_buffer_pool_acquire_buffer(pSelf->pPool, &slots[i], NULL);
+			if (ret != GST_FLOW_OK)
+			{
+				slots[i] = NULL;
+				return ret;
+			}
+			if (!gst_buffer_map(slots[i], &maps[i], GST_MAP_WRITE))
+			{
+				gst_buffer_unref(slots[i]);
+				slots[i] = NULL;
+				return GST_FLOW_ERROR;
+			}
+		}
+		datagrams[i].pData = maps[i].data;
+		datagrams[i].capacity = maps[i].size;
+		datagrams[i].length = 0;
+	}
+	return GST_FLOW_OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// UdpBatchSrc::ReleaseSlots()
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void UdpBatchSrc::ReleaseSlots(Instance* pSelf)
+{
+	std::vector<GstBuffer*>& slots = *pSelf->pSlots;
+	for (size_t i = 0; i < slots.size(); ++i)
+	{
+		if (slots[i] != NULL)
+		{
+			gst_buffer_unmap(slots[i], &(*pSelf->pMaps)[i]);
+			gst_buffer_unref(slots[i]);
+			slots[i] = NULL;
+		}
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// UdpBatchSrc::SenderAddress()
+///
+/// Get the sender's address as a GSocketAddress. A batch (and a stream) usually comes from one
+/// sender, so the last one is kept and reused instead of creating one per datagram.
+///
+/// @return The address, owned by the instance (the meta takes its own reference).
+///////////////////////////////////////////////////////////////////////////////////////////////////
+GSocketAddress* UdpBatchSrc::SenderAddress(Instance* pSelf, const struct sockaddr_in& from)
+{
+	if ((pSelf->pLastAddress == NULL) ||
+		(from.sin_addr.s_addr != pSelf->lastFrom.sin_addr.s_addr) ||
+		(from.sin_port != pSelf->lastFrom.sin_port))
+	{
+		if (pSelf->pLastAddress != NULL)
+		{
+			g_object_unref(pSelf->pLastAddress);
+		}
+		pSelf->pLastAddress = g_socket_address_new_from_native(const_cast<struct sockaddr_in*>(&from), sizeof(from));
+		pSelf->lastFrom = from;
+	}
+	return pSelf->pLastAddress;
+}
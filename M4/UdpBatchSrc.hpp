@@ -0,0 +1,165 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// @file UdpBatchSrc.hpp
+///
+/// Copyright (c) 2015, BoxCast, Inc. All rights reserved.
+///
+/// This library is free software; you can redistribute it and/or modify it under the terms of the
+/// GNU Lesser General Public License as published by the Free Software Foundation; either version
+/// 3.0 of the License, or (at your option) any later version.
+///
+/// This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+/// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See
+/// the GNULesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License along with this
+/// library; if not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+/// Boston, MA 02110-1301 USA
+///
+/// @brief This file declares the UdpBatchSrc class, which implements the "m4udpbatchsrc" GStreamer
+/// element: a batching replacement for udpsrc.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#ifndef __UDP_BATCH_SRC_HPP__
+#define __UDP_BATCH_SRC_HPP__
+
+#include <gst/gst.h>                // for GStreamer stuff
+#include <gst/base/gstpushsrc.h>    // for GstPushSrc
+#include <gio/gio.h>                // for GSocketAddress
+#include <vector>                   // for std::vector
+#include "UdpBatchReceiver.hpp"     // for UdpBatchReceiver
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// This class registers and implements the "m4udpbatchsrc" element. It takes udpsrc's "port",
+/// "buffer-size", and "caps" properties, so it can stand in for one, but receives up to
+/// "batch-size" datagrams at a time through a UdpBatchReceiver and pushes them downstream as one
+/// buffer list.
+///
+/// Datagrams are received straight into buffers of at most "mtu" bytes from a buffer pool, which
+/// preallocates them and recycles them once downstream is done with them, so that steady-state
+/// receiving allocates nothing. Each buffer gets a GstNetAddressMeta with the sender's address
+/// (as from udpsrc, so that rtpbin's "rtp-from" statistic still works) and, as its DTS, the
+/// running time at which its batch was received.
+///
+/// The "mode" property selects the UdpBatchReceiver::Mode; it defaults to the most batched mode
+/// the platform supports. "buffer-size" can be changed while playing, and resizes the socket's
+/// receive buffer right away. The read-only "stats" property holds the receiving statistics,
+/// including the datagrams the kernel dropped for a full receive buffer and the buffer's size.
+///
+/// Pushing a buffer list from a GstPushSrc requires GStreamer 1.14.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class UdpBatchSrc
+{
+public:
+	/// The element's factory name
+	static const char ELEMENT_NAME[];
+
+
+	/// Register the element with GStreamer; call once after gst_init().
+	static bool Register();
+
+
+private:
+	/// The default and largest number of datagrams received at a time
+	static const guint DEFAULT_BATCH_SIZE = 32;
+	static const guint MAX_BATCH_SIZE = 1024;
+
+
+	/// The default largest datagram received, in bytes
+	static const guint DEFAULT_MTU = 1500;
+
+
+	/// The number of batches' worth of buffers the pool preallocates
+	static const guint POOL_BATCHES = 4;
+
+
+	/// The element's instance structure
+	struct Instance
+	{
+		GstPushSrc parent;
+		UdpBatchReceiver* pReceiver;
+		GstBufferPool* pPool;
+		GstCaps* pCaps;
+		gint port;
+		gint bufferSize;
+		guint batchSize;
+		guint mtu;
+		UdpBatchReceiver::Mode mode;
+		GSocketAddress* pLastAddress;
+		struct sockaddr_in lastFrom;
+		std::vector<GstBuffer*>* pSlots;
+		std::vector<GstMapInfo>* pMaps;
+		std::vector<UdpBatchReceiver::Datagram>* pDatagrams;
+	};
+
+
+	/// The element's class structure
+	struct Class
+	{
+		GstPushSrcClass parentClass;
+	};
+
+
+	/// Property IDs
+	enum
+	{
+		PROP_0,
+		PROP_PORT,
+		PROP_BUFFER_SIZE,
+		PROP_CAPS,
+		PROP_BATCH_SIZE,
+		PROP_MTU,
+		PROP_MODE,
+		PROP_STATS
+	};
+
+
+	/// Get (registering, the first time) the element's GType.
+	static GType GetType();
+
+
+	/// GObject class and instance initialization, and finalization
+	static void ClassInit(gpointer klass, gpointer classData);
+	static void InstanceInit(GTypeInstance* pInstance, gpointer klass);
+	static void Finalize(GObject* pObject);
+
+
+	/// GObject property accessors
+	static void SetProperty(GObject* pObject, guint propId, const GValue* pValue, GParamSpec* pSpec);
+	static void GetProperty(GObject* pObject, guint propId, GValue* pValue, GParamSpec* pSpec);
+
+
+	/// GstBaseSrc starting and stopping: bind the socket and set up the buffer pool, or release them
+	static gboolean Start(GstBaseSrc* pSrc);
+	static gboolean Stop(GstBaseSrc* pSrc);
+
+
+	/// GstBaseSrc unblocking of Create() when flushing or stopping
+	static gboolean Unlock(GstBaseSrc* pSrc);
+	static gboolean UnlockStop(GstBaseSrc* pSrc);
+
+
+	/// GstBaseSrc caps: the "caps" property, if set
+	static GstCaps* GetCaps(GstBaseSrc* pSrc, GstCaps* pFilter);
+
+
+	/// GstPushSrc creation of output: receive a batch and submit it as a buffer list
+	static GstFlowReturn Create(GstPushSrc* pSrc, GstBuffer** ppBuffer);
+
+
+	/// Fill every empty slot with a mapped buffer from the pool
+	static GstFlowReturn FillSlots(Instance* pSelf);
+
+
+	/// Release the slots' buffers back to the pool
+	static void ReleaseSlots(Instance* pSelf);
+
+
+	/// The sender's address as a GSocketAddress, reusing the last one if it is the same sender
+	static GSocketAddress* SenderAddress(Instance* pSelf, const struct sockaddr_in& from);
+
+
+	/// The parent (GstPushSrc) class
+	static gpointer s_pParentClass;
+}; // END class UdpBatchSrc
+
+#endif // __UDP_BATCH_SRC_HPP__
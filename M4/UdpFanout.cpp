@@ -0,0 +1,382 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// @file UdpFanout.cpp
+///
+/// Copyright (c) 2015, BoxCast, Inc. All rights reserved.
+///
+/// This library is free software; you can redistribute it and/or modify it under the terms of the
+/// GNU Lesser General Public License as published by the Free Software Foundation; either version
+/// 3.0 of the License, or (at your option) any later version.
+///
+/// This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+/// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See
+/// the GNULesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License along with this
+/// library; if not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+/// Boston, MA 02110-1301 USA
+///
+/// @brief This file defines the functions of the UdpFanout class.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "UdpFanout.hpp"
+
+#ifdef __linux__
+#include <netinet/udp.h>
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Constructor.
+///
+/// Create the socket and pick the most batched mode the platform supports.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+UdpFanout::UdpFanout()
+	: m_Socket(socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP))
+	, m_Mutex()
+	, m_Clients()
+	, m_Mode(MODE_SENDTO)
+	, m_Runs()
+	, m_IoVecs()
+	, m_Control()
+	, m_SyscallCount(0)
+	, m_DatagramCount(0)
+	, m_ErrorCount(0)
+{
+	assert(m_Socket >= 0);
+	assert(pthread_mutex_init(&m_Mutex, NULL) == 0);
+	SetMode(MODE_SENDMMSG_GSO);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Destructor.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+UdpFanout::~UdpFanout()
+{
+	close(m_Socket);
+	pthread_mutex_destroy(&m_Mutex);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// UdpFanout::SetClients()
+///
+/// Set the clients from a "host:port,host:port" string, the format of multiudpsink's "clients"
+/// property. Entries that don't resolve to an IPv4 address are skipped.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void UdpFanout::SetClients(const char* clients)
+{
+	std::vector<struct sockaddr_in> newClients;
+
+	std::string remaining((clients != NULL) ? clients : "");
+	while (!remaining.empty())
+	{
+		size_t comma = remaining.find(',');
+		std::string entry = remaining.substr(0, comma);
+		remaining = (comma == std::string::npos) ? "" : remaining.substr(comma + 1);
+
+		size_t colon = entry.rfind(':');
+		if ((colon == std::string::npos) || (colon == 0))
+		{
+			continue;
+		}
+		std::string host = entry.substr(0, colon);
+		unsigned long port = std::strtoul(entry.c_str() + colon + 1, NULL, 10);
+		if ((port == 0) || (port > 65535))
+		{
+			continue;
+		}
+
+		struct addrinfo hints;
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_INET;
+		hints.ai_socktype = SOCK_DGRAM;
+		struct addrinfo* pResult = NULL;
+		if ((getaddrinfo(host.c_str(), NULL, &hints, &pResult) != 0) || (pResult == NULL))
+		{
+			continue;
+		}
+		struct sockaddr_in addr;
+		memcpy(&addr, pResult->ai_addr, sizeof(addr));
+		addr.sin_port = htons(static_cast<uint16_t>(port));
+		freeaddrinfo(pResult);
+
+		newClients.push_back(addr);
+	}
+
+	pthread_mutex_lock(&m_Mutex);
+	m_Clients.swap(newClients);
+	pthread_mutex_unlock(&m_Mutex);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// UdpFanout::SetMode()
+///
+/// Request a send mode. Batched modes fall back to MODE_SENDTO off Linux, and GSO falls back to
+/// MODE_SENDMMSG on kernels that don't know the UDP_SEGMENT socket option (before 4.18).
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void UdpFanout::SetMode(Mode mode)
+{
+	pthread_mutex_lock(&m_Mutex);
+#ifdef __linux__
+	if (mode == MODE_SENDMMSG_GSO)
+	{
+		int segmentSize = 0;
+		if (setsockopt(m_Socket, SOL_UDP, UDP_SEGMENT, &segmentSize, sizeof(segmentSize)) != 0)
+		{
+			mode = MODE_SENDMMSG;
+		}
+	}
+	m_Mode = mode;
+#else
+	(void)mode;
+	m_Mode = MODE_SENDTO;
+#endif
+	pthread_mutex_unlock(&m_Mutex);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// UdpFanout::SetBufferSize()
+///
+/// Set the send buffer size. A batch for all clients goes into it at once, so it needs room for
+/// every client's copy of a burst, or the sends block (or fail, for a full batch) until it drains.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void UdpFanout::SetBufferSize(int bufferSize)
+{
+	setsockopt(m_Socket, SOL_SOCKET, SO_SNDBUF, &bufferSize, sizeof(bufferSize));
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// UdpFanout::GetBufferSize()
+///////////////////////////////////////////////////////////////////////////////////////////////////
+int UdpFanout::GetBufferSize() const
+{
+	int bufferSize = 0;
+	socklen_t length = sizeof(bufferSize);
+	getsockopt(m_Socket, SOL_SOCKET, SO_SNDBUF, &bufferSize, &length);
+	return bufferSize;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// UdpFanout::Send()
+///
+/// Send a batch of packets to every client.
+///
+/// @param pPackets  The packets, in order.
+///
+/// @param numPackets  The number of packets.
+///
+/// @return The number of datagrams sent (packets times clients, less any failures).
+///////////////////////////////////////////////////////////////////////////////////////////////////
+size_t UdpFanout::Send(const Packet* pPackets, size_t numPackets)
+{
+	pthread_mutex_lock(&m_Mutex);
+	size_t sent = 0;
+	if ((numPackets > 0) && !m_Clients.empty())
+	{
+		sent = (m_Mode == MODE_SENDTO) ? SendEach(pPackets, numPackets) : SendBatched(pPackets, numPackets);
+		m_DatagramCount += sent;
+	}
+	pthread_mutex_unlock(&m_Mutex);
+	return sent;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// UdpFanout::SendEach()
+///
+/// Send each packet to each client with its own sendto() call. Called with m_Mutex held.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+size_t UdpFanout::SendEach(const Packet* pPackets, size_t numPackets)
+{
+	size_t sent = 0;
+	for (std::vector<struct sockaddr_in>::const_iterator it = m_Clients.begin(); it != m_Clients.end(); ++it)
+	{
+		for (size_t i = 0; i < numPackets; ++i)
+		{
+			ssize_t r;
+			do
+			{
+				r = sendto(m_Socket, pPackets[i].pData, pPackets[i].length, 0, reinterpret_cast<const struct sockaddr*>(&*it), sizeof(*it));
+				++m_SyscallCount;
+			} while ((r < 0) && (errno == EINTR));
+
+			if (r < 0)
+			{
+				++m_ErrorCount;
+			}
+			else
+			{
+				++sent;
+			}
+		}
+	}
+	return sent;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// UdpFanout::SendBatched()
+///
+/// Send the batch to all clients with as few sendmmsg() calls as possible. In GSO mode, runs of
+/// packets that have the same size (the last one may be shorter) become a single message with a
+/// UDP_SEGMENT control message, so one rtph264pay frame typically costs one message per client.
+/// The I/O vectors and control messages don't depend on the client, so they are built once and
+/// shared by every client's messages. Called with m_Mutex held.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+size_t UdpFanout::SendBatched(const Packet* pPackets, size_t numPackets)
+{
+#ifdef __linux__
+	const bool gso = (m_Mode == MODE_SENDMMSG_GSO);
+
+	// Split the batch into runs
+	m_Runs.clear();
+	for (size_t i = 0; i < numPackets; )
+	{
+		Run run = { i, 1, pPackets[i].length };
+		size_t bytes = pPackets[i].length;
+		while (gso && ((i + run.count) < numPackets) && (run.count < MAX_GSO_SEGMENTS))
+		{
+			size_t length = pPackets[i + run.count].length;
+			if ((length > run.segmentSize) || ((bytes + length) > MAX_GSO_BYTES) || (length == 0))
+			{
+				break;
+			}
+			bytes += length;
+			++run.count;
+			if (length < run.segmentSize)
+			{
+				// Only the last segment may be short
+				break;
+			}
+		}
+		m_Runs.push_back(run);
+		i += run.count;
+	}
+
+	// One I/O vector per packet
+	m_IoVecs.resize(numPackets);
+	for (size_t i = 0; i < numPackets; ++i)
+	{
+		m_IoVecs[i].iov_base = const_cast<void*>(pPackets[i].pData);
+		m_IoVecs[i].iov_len = pPackets[i].length;
+	}
+
+	// One segment-size control message per run of more than one packet
+	const size_t controlSpace = CMSG_SPACE(sizeof(uint16_t));
+	m_Control.assign(m_Runs.size() * controlSpace, 0);
+	for (size_t r = 0; r < m_Runs.size(); ++r)
+	{
+		if (m_Runs[r].count > 1)
+		{
+			struct msghdr hdr;
+			memset(&hdr, 0, sizeof(hdr));
+			hdr.msg_control = &m_Control[r * controlSpace];
+			hdr.msg_controllen = controlSpace;
+			struct cmsghdr* pCmsg = CMSG_FIRSTHDR(&hdr);
+			pCmsg->cmsg_level = SOL_UDP;
+			pCmsg->cmsg_type = UDP_SEGMENT;
+			pCmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+			uint16_t segmentSize = static_cast<uint16_t>(m_Runs[r].segmentSize);
+			memcpy(CMSG_DATA(pCmsg), &segmentSize, sizeof(segmentSize));
+		}
+	}
+
+	// One message per run per client
+	m_Messages.resize(m_Clients.size() * m_Runs.size());
+	size_t m = 0;
+	for (size_t c = 0; c < m_Clients.size(); ++c)
+	{
+		for (size_t r = 0; r < m_Runs.size(); ++r, ++m)
+		{
+			struct msghdr& hdr = m_Messages[m].msg_hdr;
+			memset(&m_Messages[m], 0, sizeof(m_Messages[m]));
+			hdr.msg_name = &m_Clients[c];
+			hdr.msg_namelen = sizeof(m_Clients[c]);
+			hdr.msg_iov = &m_IoVecs[m_Runs[r].first];
+			hdr.msg_iovlen = m_Runs[r].count;
+			if (m_Runs[r].count > 1)
+			{
+				hdr.msg_control = &m_Control[r * controlSpace];
+				hdr.msg_controllen = controlSpace;
+			}
+		}
+	}
+
+	// Send them all
+	size_t sent = 0;
+	size_t next = 0;
+	while (next < m_Messages.size())
+	{
+		unsigned int count = static_cast<unsigned int>(std::min(m_Messages.size() - next, MAX_MESSAGES_PER_CALL));
+		int r = sendmmsg(m_Socket, &m_Messages[next], count, 0);
+		++m_SyscallCount;
+		if (r > 0)
+		{
+			for (size_t k = next; k < next + r; ++k)
+			{
+				sent += m_Messages[k].msg_hdr.msg_iovlen;
+			}
+			next += r;
+		}
+		else if (errno == EINTR)
+		{
+			continue;
+		}
+		else if (gso && (m_Messages[next].msg_hdr.msg_controllen != 0) && ((errno == EIO) || (errno == EINVAL)))
+		{
+			// The route can't do GSO (e.g. no checksum offload on the device). Don't try again;
+			// send what's left of this batch a packet at a time.
+			m_Mode = MODE_SENDMMSG;
+			for (; next < m_Messages.size(); ++next)
+			{
+				const struct msghdr& hdr = m_Messages[next].msg_hdr;
+				for (size_t i = 0; i < hdr.msg_iovlen; ++i)
+				{
+					++m_SyscallCount;
+					if (sendto(m_Socket, hdr.msg_iov[i].iov_base, hdr.msg_iov[i].iov_len, 0, reinterpret_cast<const struct sockaddr*>(hdr.msg_name), hdr.msg_namelen) < 0)
+					{
+						++m_ErrorCount;
+					}
+					else
+					{
+						++sent;
+					}
+				}
+			}
+		}
+		else
+		{
+			// Skip the message that failed, like multiudpsink skips a client it can't send to.
+			m_ErrorCount += m_Messages[next].msg_hdr.msg_iovlen;
+			++next;
+		}
+	}
+	return sent;
+#else
+	return SendEach(pPackets, numPackets);
+#endif
+}
@@ -0,0 +1,173 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// @file UdpFanout.hpp
+///
+/// Copyright (c) 2015, BoxCast, Inc. All rights reserved.
+///
+/// This library is free software; you can redistribute it and/or modify it under the terms of the
+/// GNU Lesser General Public License as published by the Free Software Foundation; either version
+/// 3.0 of the License, or (at your option) any later version.
+///
+/// This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+/// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See
+/// the GNULesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License along with this
+/// library; if not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+/// Boston, MA 02110-1301 USA
+///
+/// @brief This file declares the UdpFanout class, which sends batches of UDP packets to a list of
+/// clients with as few system calls as the platform allows.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#ifndef __UDP_FANOUT_HPP__
+#define __UDP_FANOUT_HPP__
+
+#include <netinet/in.h> // for struct sockaddr_in
+#include <pthread.h>    // for pthread_mutex_t
+#include <stdint.h>     // for uint64_t
+#include <sys/socket.h> // for struct mmsghdr
+#include <sys/uio.h>    // for struct iovec
+#include <cstddef>      // for size_t
+#include <vector>       // for std::vector
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// This class sends every packet of a batch to every client. Depending on the mode, it does so
+///  - With one sendto() per packet per client (MODE_SENDTO, which is what multiudpsink does),
+///  - With sendmmsg(), so that the whole batch for all clients takes (usually) one system call
+///	(MODE_SENDMMSG), or
+///  - With sendmmsg() and UDP generic segmentation offload, so that runs of equally-sized packets
+///	(e.g. the fragments of one video frame) to the same client go down the stack as one large
+///	datagram, which the kernel or NIC splits up again (MODE_SENDMMSG_GSO).
+///
+/// The batched modes are only available on Linux; elsewhere the mode is always MODE_SENDTO. If the
+/// kernel turns out not to support GSO for a destination, the instance drops to MODE_SENDMMSG.
+///
+/// Clients are set with the same "host:port,host:port" string that multiudpsink's "clients"
+/// property takes (IPv4 only).
+///////////////////////////////////////////////////////////////////////////////////////////////////
+class UdpFanout
+{
+public:
+	/// The ways packets can be sent, from least to most batched.
+	enum Mode
+	{
+		MODE_SENDTO,
+		MODE_SENDMMSG,
+		MODE_SENDMMSG_GSO
+	};
+
+
+	/// One packet in a batch.
+	struct Packet
+	{
+		const void* pData;
+		size_t length;
+	};
+
+
+	/// Constructor
+	UdpFanout();
+
+
+	/// Destructor
+	~UdpFanout();
+
+
+	/// Set the clients from a "host:port,host:port" string.
+	void SetClients(const char* clients);
+
+
+	/// Send a batch of packets to every client; returns the number of datagrams sent.
+	size_t Send(const Packet* pPackets, size_t numPackets);
+
+
+	/// Request a send mode; the mode actually used may be less batched if unsupported.
+	void SetMode(Mode mode);
+
+
+	/// The send mode in use.
+	inline Mode GetMode() const { return m_Mode; }
+
+
+	/// Set the send buffer size in bytes (SO_SNDBUF); takes effect right away.
+	void SetBufferSize(int bufferSize);
+
+
+	/// The send buffer size in bytes, as the kernel reports it.
+	int GetBufferSize() const;
+
+
+	/// The number of send system calls made so far.
+	inline uint64_t SyscallCount() const { return m_SyscallCount; }
+
+
+	/// The number of datagrams sent so far.
+	inline uint64_t DatagramCount() const { return m_DatagramCount; }
+
+
+	/// The number of datagrams that failed to send so far.
+	inline uint64_t ErrorCount() const { return m_ErrorCount; }
+
+
+private:
+	/// Most segments the kernel accepts in one GSO send (UDP_MAX_SEGMENTS).
+	static const size_t MAX_GSO_SEGMENTS = 64;
+
+
+	/// Most payload bytes in one GSO send (the largest UDP datagram, rounded down).
+	static const size_t MAX_GSO_BYTES = 65000;
+
+
+	/// Most messages passed to one sendmmsg() call (UIO_MAXIOV).
+	static const size_t MAX_MESSAGES_PER_CALL = 1024;
+
+
+	/// A run of consecutive packets that go out as one message.
+	struct Run
+	{
+		size_t first;
+		size_t count;
+		size_t segmentSize;
+	};
+
+
+	/// Send with one sendto() per packet per client.
+	size_t SendEach(const Packet* pPackets, size_t numPackets);
+
+
+	/// Send with sendmmsg() (and GSO, if that's the mode).
+	size_t SendBatched(const Packet* pPackets, size_t numPackets);
+
+
+	/// The UDP socket
+	const int m_Socket;
+
+
+	/// Protects the client list against changes while a batch is being sent.
+	pthread_mutex_t m_Mutex;
+
+
+	/// The clients
+	std::vector<struct sockaddr_in> m_Clients;
+
+
+	/// The send mode in use
+	Mode m_Mode;
+
+
+	/// Scratch space for building a batch, kept to avoid allocating per batch.
+	std::vector<Run> m_Runs;
+	std::vector<struct iovec> m_IoVecs;
+	std::vector<char> m_Control;
+#ifdef __linux__
+	std::vector<struct mmsghdr> m_Messages;
+#endif
+
+
+	/// Statistics
+	uint64_t m_SyscallCount;
+	uint64_t m_DatagramCount;
+	uint64_t m_ErrorCount;
+}; // END class UdpFanout
+
+#endif // __UDP_FANOUT_HPP__
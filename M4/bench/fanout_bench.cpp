@@ -0,0 +1,223 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// @file fanout_bench.cpp
+///
+/// Copyright (c) 2015, BoxCast, Inc. All rights reserved.
+///
+/// This library is free software; you can redistribute it and/or modify it under the terms of the
+/// GNU Lesser General Public License as published by the Free Software Foundation; either version
+/// 3.0 of the License, or (at your option) any later version.
+///
+/// This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+/// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See
+/// the GNULesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License along with this
+/// library; if not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+/// Boston, MA 02110-1301 USA
+///
+/// @brief Loopback benchmark for UdpFanout. Sends simulated video frames (a run of RTP-sized
+/// packets with a short last packet) to a number of loopback receivers in each UdpFanout mode,
+/// and reports packets per second, send system calls, and sender CPU time per mode.
+///
+/// Usage: fanout_bench [destinations [frames [packets-per-frame]]]
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../UdpFanout.hpp"
+
+
+/// Size of a full RTP packet (rtph264pay's default MTU)
+static const size_t PACKET_SIZE = 1400;
+
+/// First loopback port the receivers bind to
+static const uint16_t BASE_PORT = 23000;
+
+
+/// The receiving side: a set of bound sockets and a thread that drains them.
+struct Receivers
+{
+	std::vector<int> sockets;
+	volatile bool stop;
+	volatile unsigned long long received;
+	pthread_t thread;
+};
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Receiver thread: count datagrams arriving on any receiver socket until told to stop.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+static void* ReceiverFn(void* pArg)
+{
+	Receivers* pReceivers = reinterpret_cast<Receivers*>(pArg);
+	std::vector<struct pollfd> fds(pReceivers->sockets.size());
+	for (size_t i = 0; i < fds.size(); ++i)
+	{
+		fds[i].fd = pReceivers->sockets[i];
+		fds[i].events = POLLIN;
+	}
+
+	char buffer[65536];
+	while (!pReceivers->stop)
+	{
+		if (poll(&fds[0], fds.size(), 50) <= 0)
+		{
+			continue;
+		}
+		for (size_t i = 0; i < fds.size(); ++i)
+		{
+			while ((fds[i].revents & POLLIN) && (recv(fds[i].fd, buffer, sizeof(buffer), MSG_DONTWAIT) > 0))
+			{
+				++pReceivers->received;
+			}
+		}
+	}
+	return NULL;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// The CPU time (user + system) used by the calling thread, in seconds.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+static double ThreadCpuSeconds()
+{
+	struct rusage usage;
+#ifdef RUSAGE_THREAD
+	getrusage(RUSAGE_THREAD, &usage);
+#else
+	getrusage(RUSAGE_SELF, &usage);
+#endif
+	return usage.ru_utime.tv_sec + (usage.ru_utime.tv_usec / 1e6) + usage.ru_stime.tv_sec + (usage.ru_stime.tv_usec / 1e6);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Wall clock time, in seconds.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+static double WallSeconds()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + (tv.tv_usec / 1e6);
+}
+
+
+int main(int argc, char* argv[])
+{
+	size_t destinations = (argc > 1) ? std::strtoul(argv[1], NULL, 10) : 8;
+	size_t frames = (argc > 2) ? std::strtoul(argv[2], NULL, 10) : 5000;
+	size_t packetsPerFrame = (argc > 3) ? std::strtoul(argv[3], NULL, 10) : 20;
+	assert((destinations > 0) && (packetsPerFrame > 0));
+
+	// Bind the receivers and build the clients string
+	Receivers receivers;
+	receivers.stop = false;
+	receivers.received = 0;
+	std::string clients;
+	for (size_t i = 0; i < destinations; ++i)
+	{
+		int s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		assert(s >= 0);
+		int size = 8 * 1024 * 1024;
+		setsockopt(s, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+		struct sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		addr.sin_port = htons(BASE_PORT + i);
+		assert(bind(s, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0);
+		receivers.sockets.push_back(s);
+
+		char client[sizeof("127.0.0.1:65535,")];
+		std::sprintf(client, "%s127.0.0.1:%u", clients.empty() ? "" : ",", static_cast<unsigned int>(BASE_PORT + i));
+		clients += client;
+	}
+	assert(pthread_create(&receivers.thread, NULL, ReceiverFn, &receivers) == 0);
+
+	// One simulated frame: full packets and a short last one
+	std::vector<std::vector<char> > payloads(packetsPerFrame);
+	std::vector<UdpFanout::Packet> frame(packetsPerFrame);
+	for (size_t i = 0; i < packetsPerFrame; ++i)
+	{
+		payloads[i].assign(((i + 1) < packetsPerFrame) ? PACKET_SIZE : (PACKET_SIZE / 2), static_cast<char>(i));
+		frame[i].pData = &payloads[i][0];
+		frame[i].length = payloads[i].size();
+	}
+
+	static const char* MODE_NAMES[] = { "sendto", "sendmmsg", "sendmmsg+gso" };
+	std::printf("%zu destinations, %zu frames of %zu packets\n", destinations, frames, packetsPerFrame);
+	std::printf("%-14s %12s %12s %10s %12s %10s\n", "mode", "packets/s", "syscalls", "cpu s", "us cpu/frame", "delivered");
+
+	double baselineCpu = 0.0;
+	for (int m = UdpFanout::MODE_SENDTO; m <= UdpFanout::MODE_SENDMMSG_GSO; ++m)
+	{
+		UdpFanout fanout;
+		fanout.SetMode(static_cast<UdpFanout::Mode>(m));
+		if (fanout.GetMode() != m)
+		{
+			std::printf("%-14s (not supported here)\n", MODE_NAMES[m]);
+			continue;
+		}
+		fanout.SetClients(clients.c_str());
+
+		unsigned long long receivedBefore = receivers.received;
+		double wallStart = WallSeconds();
+		double cpuStart = ThreadCpuSeconds();
+		for (size_t f = 0; f < frames; ++f)
+		{
+			fanout.Send(&frame[0], frame.size());
+		}
+		double cpu = ThreadCpuSeconds() - cpuStart;
+		double wall = WallSeconds() - wallStart;
+
+		// Let the receiver catch up before counting
+		usleep(200000);
+		unsigned long long delivered = receivers.received - receivedBefore;
+
+		if (m == UdpFanout::MODE_SENDTO)
+		{
+			baselineCpu = cpu;
+		}
+		std::printf("%-14s %12.0f %12llu %10.3f %12.2f %9.1f%%",
+			MODE_NAMES[m],
+			fanout.DatagramCount() / wall,
+			static_cast<unsigned long long>(fanout.SyscallCount()),
+			cpu,
+			(cpu * 1e6) / frames,
+			(100.0 * delivered) / (destinations * frames * packetsPerFrame));
+		if ((m != UdpFanout::MODE_SENDTO) && (cpu > 0.0) && (baselineCpu > 0.0))
+		{
+			if (baselineCpu >= cpu)
+			{
+				std::printf("  (%.2fx less CPU than sendto)", baselineCpu / cpu);
+			}
+			else
+			{
+				std::printf("  (%.2fx more CPU than sendto)", cpu / baselineCpu);
+			}
+		}
+		std::printf("\n");
+	}
+
+	receivers.stop = true;
+	pthread_join(receivers.thread, NULL);
+	for (size_t i = 0; i < receivers.sockets.size(); ++i)
+	{
+		close(receivers.sockets[i]);
+	}
+	return 0;
+}
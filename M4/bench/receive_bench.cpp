@@ -0,0 +1,286 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// @file receive_bench.cpp
+///
+/// Copyright (c) 2015, BoxCast, Inc. All rights reserved.
+///
+/// This library is free software; you can redistribute it and/or modify it under the terms of the
+/// GNU Lesser General Public License as published by the Free Software Foundation; either version
+/// 3.0 of the License, or (at your option) any later version.
+///
+/// This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+/// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See
+/// the GNULesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License along with this
+/// library; if not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+/// Boston, MA 02110-1301 USA
+///
+/// @brief Loopback benchmark for UdpBatchReceiver. A sender thread sends simulated video frames
+/// (a run of RTP-sized packets with a short last packet) to a loopback port, which is received
+/// udpsrc-style (a poll, a recvfrom, and a freshly allocated buffer per datagram) and then in each
+/// UdpBatchReceiver mode into recycled buffers, and reports datagrams per second, receive system
+/// calls, and receiver CPU time per mode.
+///
+/// Usage: receive_bench [frames [packets-per-frame [batch-size]]]
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "../UdpBatchReceiver.hpp"
+#include "../UdpFanout.hpp"
+
+
+/// Size of a full RTP packet (rtph264pay's default MTU)
+static const size_t PACKET_SIZE = 1400;
+
+/// Size of a receive buffer (m4udpbatchsrc's default MTU)
+static const size_t BUFFER_SIZE = 1500;
+
+/// First loopback port received on; each run uses the next one
+static const uint16_t BASE_PORT = 23100;
+
+/// Frames sent between short pauses, so a receiver that keeps up loses nothing
+static const size_t FRAMES_PER_BURST = 8;
+
+
+/// The sending side: what to send, where, and a way to wake the receiver when done.
+struct Sender
+{
+	uint16_t port;
+	size_t frames;
+	std::vector<UdpFanout::Packet> frame;
+	UdpBatchReceiver* pReceiver;
+	volatile bool done;
+	pthread_t thread;
+};
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Sender thread: send the frames to the port in short bursts, then let the receiver drain and
+/// interrupt it.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+static void* SenderFn(void* pArg)
+{
+	Sender* pSender = reinterpret_cast<Sender*>(pArg);
+	char client[sizeof("127.0.0.1:65535")];
+	std::sprintf(client, "127.0.0.1:%u", static_cast<unsigned int>(pSender->port));
+	UdpFanout fanout;
+	fanout.SetClients(client);
+
+	for (size_t f = 0; f < pSender->frames; ++f)
+	{
+		fanout.Send(&pSender->frame[0], pSender->frame.size());
+		if (((f + 1) % FRAMES_PER_BURST) == 0)
+		{
+			usleep(100);
+		}
+	}
+
+	usleep(200000);
+	pSender->done = true;
+	if (pSender->pReceiver != NULL)
+	{
+		pSender->pReceiver->Interrupt();
+	}
+	return NULL;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// The CPU time (user + system) used by the calling thread, in seconds.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+static double ThreadCpuSeconds()
+{
+	struct rusage usage;
+#ifdef RUSAGE_THREAD
+	getrusage(RUSAGE_THREAD, &usage);
+#else
+	getrusage(RUSAGE_SELF, &usage);
+#endif
+	return usage.ru_utime.tv_sec + (usage.ru_utime.tv_usec / 1e6) + usage.ru_stime.tv_sec + (usage.ru_stime.tv_usec / 1e6);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Wall clock time, in seconds.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+static double WallSeconds()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + (tv.tv_usec / 1e6);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Receive the way udpsrc does: wait for the socket, then receive one datagram into a newly
+/// allocated buffer, which is freed as if downstream were done with it.
+///
+/// @return The number of datagrams received; *pSyscalls is set to the receive system calls made.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+static unsigned long long ReceiveLikeUdpsrc(uint16_t port, Sender* pSender, unsigned long long* pSyscalls)
+{
+	int s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	assert(s >= 0);
+	int size = 8 * 1024 * 1024;
+	setsockopt(s, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	assert(bind(s, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0);
+	assert(pthread_create(&pSender->thread, NULL, SenderFn, pSender) == 0);
+
+	unsigned long long received = 0;
+	*pSyscalls = 0;
+	struct pollfd fd;
+	fd.fd = s;
+	fd.events = POLLIN;
+	while (!pSender->done)
+	{
+		if (poll(&fd, 1, 50) <= 0)
+		{
+			continue;
+		}
+		char* pBuffer = static_cast<char*>(std::malloc(BUFFER_SIZE));
+		struct sockaddr_in from;
+		socklen_t fromLength = sizeof(from);
+		ssize_t r = recvfrom(s, pBuffer, BUFFER_SIZE, MSG_DONTWAIT, reinterpret_cast<struct sockaddr*>(&from), &fromLength);
+		++*pSyscalls;
+		if (r > 0)
+		{
+			++received;
+		}
+		std::free(pBuffer);
+	}
+
+	pthread_join(pSender->thread, NULL);
+	close(s);
+	return received;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Receive with a UdpBatchReceiver into a fixed set of recycled buffers.
+///
+/// @return The number of datagrams received; *pSyscalls is set to the receive system calls made.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+static unsigned long long ReceiveBatched(UdpBatchReceiver& receiver, uint16_t port, size_t batchSize, Sender* pSender, unsigned long long* pSyscalls)
+{
+	assert(receiver.Bind(port, 8 * 1024 * 1024));
+	std::vector<char> buffers(batchSize * BUFFER_SIZE);
+	std::vector<UdpBatchReceiver::Datagram> datagrams(batchSize);
+
+	pSender->pReceiver = &receiver;
+	assert(pthread_create(&pSender->thread, NULL, SenderFn, pSender) == 0);
+
+	for (;;)
+	{
+		for (size_t i = 0; i < batchSize; ++i)
+		{
+			datagrams[i].pData = &buffers[i * BUFFER_SIZE];
+			datagrams[i].capacity = BUFFER_SIZE;
+		}
+		if (receiver.Receive(&datagrams[0], datagrams.size()) == 0)
+		{
+			break;
+		}
+	}
+
+	pthread_join(pSender->thread, NULL);
+	*pSyscalls = receiver.SyscallCount();
+	return receiver.DatagramCount();
+}
+
+
+int main(int argc, char* argv[])
+{
+	size_t frames = (argc > 1) ? std::strtoul(argv[1], NULL, 10) : 20000;
+	size_t packetsPerFrame = (argc > 2) ? std::strtoul(argv[2], NULL, 10) : 20;
+	size_t batchSize = (argc > 3) ? std::strtoul(argv[3], NULL, 10) : 32;
+	assert((packetsPerFrame > 0) && (batchSize > 0));
+
+	// One simulated frame: full packets and a short last one
+	std::vector<std::vector<char> > payloads(packetsPerFrame);
+	std::vector<UdpFanout::Packet> frame(packetsPerFrame);
+	for (size_t i = 0; i < packetsPerFrame; ++i)
+	{
+		payloads[i].assign(((i + 1) < packetsPerFrame) ? PACKET_SIZE : (PACKET_SIZE / 2), static_cast<char>(i));
+		frame[i].pData = &payloads[i][0];
+		frame[i].length = payloads[i].size();
+	}
+
+	static const char* MODE_NAMES[] = { "udpsrc-like", "recvfrom", "recvmmsg" };
+	std::printf("%zu frames of %zu packets, batches of %zu\n", frames, packetsPerFrame, batchSize);
+	std::printf("%-14s %12s %12s %10s %14s %10s\n", "mode", "datagrams/s", "syscalls", "cpu s", "ns cpu/packet", "delivered");
+
+	double baselineCpu = 0.0;
+	for (int m = 0; m < 3; ++m)
+	{
+		Sender sender;
+		sender.port = static_cast<uint16_t>(BASE_PORT + m);
+		sender.frames = frames;
+		sender.frame = frame;
+		sender.pReceiver = NULL;
+		sender.done = false;
+
+		UdpBatchReceiver receiver;
+		if (m > 0)
+		{
+			receiver.SetMode(static_cast<UdpBatchReceiver::Mode>(m - 1));
+			if (receiver.GetMode() != (m - 1))
+			{
+				std::printf("%-14s (not supported here)\n", MODE_NAMES[m]);
+				continue;
+			}
+		}
+
+		unsigned long long syscalls = 0;
+		double wallStart = WallSeconds();
+		double cpuStart = ThreadCpuSeconds();
+		unsigned long long received = (m == 0) ?
+			ReceiveLikeUdpsrc(sender.port, &sender, &syscalls) :
+			ReceiveBatched(receiver, sender.port, batchSize, &sender, &syscalls);
+		double cpu = ThreadCpuSeconds() - cpuStart;
+		double wall = WallSeconds() - wallStart;
+
+		if (m == 0)
+		{
+			baselineCpu = cpu;
+		}
+		std::printf("%-14s %12.0f %12llu %10.3f %14.0f %9.1f%%",
+			MODE_NAMES[m],
+			received / wall,
+			syscalls,
+			cpu,
+			(received > 0) ? ((cpu * 1e9) / received) : 0.0,
+			(100.0 * received) / (frames * packetsPerFrame));
+		if ((m != 0) && (cpu > 0.0) && (baselineCpu > 0.0))
+		{
+			if (baselineCpu >= cpu)
+			{
+				std::printf("  (%.2fx less CPU than udpsrc-like)", baselineCpu / cpu);
+			}
+			else
+			{
+				std::printf("  (%.2fx more CPU than udpsrc-like)", cpu / baselineCpu);
+			}
+		}
+		std::printf("\n");
+	}
+	return 0;
+}
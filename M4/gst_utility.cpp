@@ -157,3 +157,29 @@ GstPad* gst_element_get_first_src_pad(GstElement* element)
 	gst_iterator_free(iter);
 	return ret;
 } // END gst_element_get_first_src_pad()
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// gst_rtp_aux_bin_new()
+///
+/// Add the element to a new bin and ghost its pads under the names rtpbin looks for.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+GstElement* gst_rtp_aux_bin_new(GstElement* element, guint session)
+{
+	GstElement* bin = gst_bin_new(NULL);
+	gst_bin_add(GST_BIN(bin), element);
+	
+	gchar* name = g_strdup_printf("sink_%u", session);
+	GstPad* pad = gst_element_get_static_pad(element, "sink");
+	gst_element_add_pad(bin, gst_ghost_pad_new(name, pad));
+	gst_object_unref(pad);
+	g_free(name);
+	
+	name = g_strdup_printf("src_%u", session);
+	pad = gst_element_get_static_pad(element, "src");
+	gst_element_add_pad(bin, gst_ghost_pad_new(name, pad));
+	gst_object_unref(pad);
+	g_free(name);
+	
+	return bin;
+} // END gst_rtp_aux_bin_new()
@@ -101,4 +101,20 @@ GstPad* gst_element_get_first_sink_pad(GstElement* element);
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 GstPad* gst_element_get_first_src_pad(GstElement* element);
 
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Wrap an element in a bin fit to return from rtpbin's "request-aux-sender" and
+/// "request-aux-receiver" signals.
+///
+/// rtpbin links an auxiliary bin by the pad names "sink_<session>" and "src_<session>", so the
+/// bin gets ghost pads of those names for the element's "sink" and "src" pads.
+///
+/// @param The element (e.g. rtprtxsend or rtprtxreceive); the bin takes ownership of it.
+///
+/// @param The rtpbin session the bin is for.
+///
+/// @return A new, floating bin.
+///////////////////////////////////////////////////////////////////////////////////////////////////
+GstElement* gst_rtp_aux_bin_new(GstElement* element, guint session);
+
 #endif // __GST_UTILITY_HPP__